@@ -0,0 +1,141 @@
+#ifndef NAIVE_FAKE_LIBVMI_EVENTS
+#define NAIVE_FAKE_LIBVMI_EVENTS
+
+#include <string.h>
+
+#include <libvmi/libvmi.h>
+
+typedef uint32_t event_response_t;
+#define VMI_EVENT_RESPONSE_NONE 0
+#define VMI_EVENT_RESPONSE_EMULATE (1u << 1)
+#define VMI_EVENT_RESPONSE_TOGGLE_SINGLESTEP (1u << 5)
+#define VMI_EVENT_RESPONSE_SLAT_ID (1u << 6)
+
+#define VMI_MEMACCESS_R 1
+#define VMI_MEMACCESS_W 2
+#define VMI_MEMACCESS_X 4
+
+#define VMI_EVENT_MEMORY 1
+#define VMI_EVENT_SINGLESTEP 4
+
+typedef struct
+{
+  uint64_t gfn;
+  uint64_t offset;
+  uint64_t gla;
+  uint8_t in_access;
+  uint8_t out_access;
+} mem_access_event_t;
+
+typedef struct
+{
+  uint32_t vcpus;
+  uint8_t enable;
+} single_step_event_t;
+
+typedef event_response_t (*event_callback_t)(vmi_instance_t vmi, vmi_event_t *event);
+typedef void (*vmi_event_free_t)(vmi_event_t *event, status_t status);
+
+struct vmi_event
+{
+  uint32_t type;
+  uint32_t vcpu_id;
+  uint16_t slat_id;
+  void *data;
+  event_callback_t callback;
+  mem_access_event_t mem_event;
+  single_step_event_t ss_event;
+};
+
+#define SETUP_MEM_EVENT(_event, _gfn, _access, _callback, _generic) \
+  do { \
+    (_event)->type = VMI_EVENT_MEMORY; \
+    (_event)->mem_event.gfn = (_gfn); \
+    (_event)->mem_event.in_access = (_access); \
+    (_event)->callback = (_callback); \
+  } while (0)
+
+#define SETUP_SINGLESTEP_EVENT(_event, _vcpu_mask, _callback, _enable) \
+  do { \
+    (_event)->type = VMI_EVENT_SINGLESTEP; \
+    (_event)->ss_event.vcpus = (_vcpu_mask); \
+    (_event)->ss_event.enable = (_enable); \
+    (_event)->callback = (_callback); \
+  } while (0)
+
+static inline status_t vmi_register_event(vmi_instance_t vmi, vmi_event_t *event)
+{
+  if (event->type == VMI_EVENT_SINGLESTEP)
+  {
+    if (vmi->step_event)
+      return VMI_FAILURE;
+    vmi->step_event = event;
+    return VMI_SUCCESS;
+  }
+  vmi->p2m_updates++;
+  return vmi->events.insert(std::make_pair(event->mem_event.gfn, event)).second ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+static inline status_t vmi_clear_event(vmi_instance_t vmi, vmi_event_t *event, vmi_event_free_t free_routine)
+{
+  (void) free_routine;
+  if (event->type == VMI_EVENT_SINGLESTEP)
+  {
+    if (vmi->step_event == event)
+      vmi->step_event = NULL;
+    return VMI_SUCCESS;
+  }
+  vmi->cleared++;
+  vmi->p2m_updates++;
+  return VMI_SUCCESS;
+}
+
+static inline status_t vmi_step_event(vmi_instance_t vmi, vmi_event_t *event, uint32_t vcpu_id, uint64_t steps,
+  event_callback_t callback)
+{
+  (void) event;
+  (void) vcpu_id;
+  (void) steps;
+  (void) callback;
+  // The step exit, then libvmi re-registers the event
+  vmi->stepped++;
+  vmi->p2m_updates++;
+  return VMI_SUCCESS;
+}
+
+// Removes a page event for good (a real vmi_clear_event on shutdown)
+static inline void fake_vmi_unregister(vmi_instance_t vmi, vmi_event_t *event)
+{
+  vmi->events.erase(event->mem_event.gfn);
+}
+
+// Delivers a guest write to gfn:offset; false if no event is registered on the page
+static inline bool fake_vmi_write(vmi_instance_t vmi, uint64_t gfn, uint64_t offset, uint32_t vcpu)
+{
+  std::unordered_map<uint64_t, vmi_event_t *>::const_iterator it = vmi->events.find(gfn);
+  if (it == vmi->events.end())
+    return false;
+
+  vmi_event_t *event = it->second;
+  event->vcpu_id = vcpu;
+  event->mem_event.offset = offset;
+  event->mem_event.gla = 0xffff880000000000ull + (gfn << 12) + offset;
+  event->mem_event.out_access = VMI_MEMACCESS_W;
+  vmi->delivered++;
+  event_response_t response = event->callback(vmi, event);
+
+  // Applied the way Xen does: the view first, then one step with the singlestep event's callback
+  if (response & VMI_EVENT_RESPONSE_SLAT_ID)
+    vmi->view_switches++;
+  if ((response & VMI_EVENT_RESPONSE_TOGGLE_SINGLESTEP) && vmi->step_event)
+  {
+    vmi_event_t *step = vmi->step_event;
+    step->vcpu_id = vcpu;
+    vmi->stepped++;
+    if (step->callback(vmi, step) & VMI_EVENT_RESPONSE_SLAT_ID)
+      vmi->view_switches++;
+  }
+  return true;
+}
+
+#endif
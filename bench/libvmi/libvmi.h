@@ -0,0 +1,97 @@
+#ifndef NAIVE_FAKE_LIBVMI
+#define NAIVE_FAKE_LIBVMI
+
+/**
+ * Fake LibVMI for naive-bench: just enough of the libvmi API for the
+ * detector's event bookkeeping (naive-event-list.h, page events) to build
+ * and run without Xen. Memory events are delivered by fake_vmi_write(),
+ * which calls the registered callback the way vmi_events_listen would and
+ * applies its response. Counts the exits and p2m changes a real
+ * hypervisor would have made, so response strategies can be compared.
+ * Only found when bench/ is on the include path (build-bench.sh).
+ **/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <unordered_map>
+
+typedef uint64_t addr_t;
+typedef int32_t vmi_pid_t;
+typedef enum status { VMI_SUCCESS, VMI_FAILURE } status_t;
+
+struct vmi_event;
+typedef struct vmi_event vmi_event_t;
+
+struct fake_vmi
+{
+  std::unordered_map<uint64_t, vmi_event_t *> events;   // gfn -> registered memory event
+  vmi_event_t *step_event;                              // Registered singlestep event, if any
+  unsigned long delivered;        // Write faults (one exit each)
+  unsigned long cleared;
+  unsigned long stepped;          // Single steps (one more exit each)
+  unsigned long p2m_updates;      // Page permission changes (clearing and re-arming watches)
+  unsigned long view_switches;    // Per-vCPU altp2m view changes requested by responses
+  bool slat_enabled;
+  uint16_t views;                 // altp2m views created so far
+};
+typedef struct fake_vmi *vmi_instance_t;
+
+static inline vmi_instance_t fake_vmi_create()
+{
+  vmi_instance_t vmi = new fake_vmi();
+  vmi->step_event = NULL;
+  vmi->delivered = vmi->cleared = vmi->stepped = 0;
+  vmi->p2m_updates = vmi->view_switches = 0;
+  vmi->slat_enabled = false;
+  vmi->views = 0;
+  return vmi;
+}
+
+static inline void fake_vmi_destroy(vmi_instance_t vmi)
+{
+  delete vmi;
+}
+
+static inline unsigned int vmi_get_num_vcpus(vmi_instance_t vmi)
+{
+  (void) vmi;
+  return 4;
+}
+
+// Exits the hypervisor took: every write fault plus every single step
+static inline unsigned long fake_vmi_exits(vmi_instance_t vmi)
+{
+  return vmi->delivered + vmi->stepped;
+}
+
+/////////////////////
+// altp2m
+/////////////////////
+
+static inline status_t vmi_slat_set_domain_state(vmi_instance_t vmi, bool state)
+{
+  vmi->slat_enabled = state;
+  return VMI_SUCCESS;
+}
+
+static inline status_t vmi_slat_create(vmi_instance_t vmi, uint16_t *slat_id)
+{
+  if (!vmi->slat_enabled)
+    return VMI_FAILURE;
+  *slat_id = ++vmi->views;
+  return VMI_SUCCESS;
+}
+
+static inline status_t vmi_slat_switch(vmi_instance_t vmi, uint16_t slat_id)
+{
+  return vmi->slat_enabled && slat_id <= vmi->views ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+static inline status_t vmi_slat_destroy(vmi_instance_t vmi, uint16_t slat_id)
+{
+  return vmi->slat_enabled && slat_id != 0 && slat_id <= vmi->views ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+#endif
@@ -0,0 +1,4 @@
+#!/bin/sh
+
+# naive-bench needs neither libvmi nor Python: bench/libvmi fakes the libvmi headers it includes
+g++ -std=c++11 -Ibench -Wall -Wextra -g -O2 -o ${1:-naive-bench.out} naive-bench.cpp -lpthread
@@ -0,0 +1,275 @@
+#ifndef NAIVE_ADAPTIVE
+#define NAIVE_ADAPTIVE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "naive-watch.h"
+
+// Defaults: window the irrelevant writes are counted over, and how many in it switch a page to polling
+#define ADAPTIVE_WINDOW_MS 1000
+#define ADAPTIVE_POLL_THRESHOLD 2000
+
+// Longest a polled page goes unchecked, i.e. the detection latency bound of polled pages
+#define ADAPTIVE_POLL_INTERVAL_MS 100
+
+// Time a page stays polled before its trap is re-armed to measure again (doubled each time it trips again)
+#define ADAPTIVE_PROBE_MS 5000
+#define ADAPTIVE_MAX_PROBE_MS 60000
+
+// Most pages polled at once, which bounds the polling cost (a page read each per interval)
+#define ADAPTIVE_MAX_POLLED 64
+
+// vcpu of the events polling finds
+#define ADAPTIVE_POLL_VCPU UINT32_MAX
+
+struct adaptive_stats
+{
+  unsigned long to_polled;        // Traps removed because of irrelevant write rate
+  unsigned long to_trapped;       // Traps re-armed after a probe period
+  unsigned long polls;            // Polled page reads
+  unsigned long changed_words;    // Relevant 8-byte words found changed by polling
+  size_t polled;                  // Pages polled right now
+};
+
+/**
+ * Moves watched pages between trapping and polling. The callback counts
+ * irrelevant writes per page; once per window the event loop hands each
+ * trapped page's count to trip(), and a page over the threshold has its
+ * trap removed and is polled instead: every poll interval the caller reads
+ * the page and poll() compares its relevant words (the watch table's
+ * relevance bitmap) with the copy taken when polling started. After the
+ * probe period the trap is re-armed; a page that trips again stays polled
+ * twice as long, up to the max probe. Used only from the event loop
+ * thread.
+ **/
+class AdaptiveController
+{
+ public:
+
+  AdaptiveController() = default;
+  AdaptiveController(const AdaptiveController&) = delete;            // disable copying
+  AdaptiveController& operator=(const AdaptiveController&) = delete; // disable assignment
+
+  // A threshold of 0 disables polling
+  void configure(uint32_t threshold, uint64_t poll_interval_ns, uint64_t window_ns = ADAPTIVE_WINDOW_MS * 1000000ull,
+    uint64_t probe_ns = ADAPTIVE_PROBE_MS * 1000000ull, size_t max_polled = ADAPTIVE_MAX_POLLED)
+  {
+    threshold_ = threshold;
+    poll_interval_ns_ = poll_interval_ns;
+    window_ns_ = window_ns;
+    probe_ns_ = probe_ns;
+    max_probe_ns_ = probe_ns > ADAPTIVE_MAX_PROBE_MS * 1000000ull ? probe_ns : ADAPTIVE_MAX_PROBE_MS * 1000000ull;
+    max_polled_ = max_polled;
+  }
+
+  bool enabled() const { return threshold_ != 0; }
+  uint32_t threshold() const { return threshold_; }
+  uint64_t poll_interval_ns() const { return poll_interval_ns_; }
+
+  // True once per window; the caller then passes every trapped page to trip()
+  bool window_due(uint64_t now)
+  {
+    if (!enabled() || now < next_window_)
+      return false;
+    if (next_window_ == 0)
+    {
+      // The first window starts now, not at registration
+      next_window_ = now + window_ns_;
+      return false;
+    }
+    next_window_ = now + window_ns_;
+    return true;
+  }
+
+  // A trapped page's irrelevant writes over the window that just ended; true if it should be polled from now
+  bool trip(uint64_t gfn, uint32_t irrelevant)
+  {
+    if (irrelevant < threshold_)
+    {
+      // Quiet for a whole window after a probe: the next trip starts from the base probe period again
+      if (irrelevant < threshold_ / 2)
+        backoff_.erase(gfn);
+      return false;
+    }
+    return true;
+  }
+
+  // Whether another page may switch to polling
+  bool can_poll() const
+  {
+    return polled_.size() < max_polled_;
+  }
+
+  // The trap of gfn was removed; contents (WATCH_PAGE_SIZE bytes, read before the trap went) are the baseline
+  void start_polling(uint64_t gfn, const uint64_t *contents, uint64_t now)
+  {
+    std::unordered_map<uint64_t, uint64_t>::iterator backoff = backoff_.find(gfn);
+    uint64_t probe = backoff == backoff_.end() ? probe_ns_ : backoff->second;
+    backoff_[gfn] = probe * 2 < max_probe_ns_ ? probe * 2 : max_probe_ns_;
+
+    polled_page &page = polled_[gfn];
+    memcpy(page.words, contents, sizeof(page.words));
+    page.next_poll = now + poll_interval_ns_;
+    page.rearm_at = now + probe;
+    stats_.to_polled++;
+  }
+
+  // The trap of gfn is armed again, or the page is no longer watched
+  void stop_polling(uint64_t gfn, bool rearmed)
+  {
+    if (polled_.erase(gfn) != 0 && rearmed)
+      stats_.to_trapped++;
+  }
+
+  bool polled(uint64_t gfn) const
+  {
+    return polled_.find(gfn) != polled_.end();
+  }
+
+  // Calls fn(gfn, rearm) for every polled page due a poll, or due its trap back (rearm) which also wants a last poll
+  template <typename F>
+  void for_each_due(uint64_t now, F fn)
+  {
+    due_.clear();
+    for (std::unordered_map<uint64_t, polled_page>::const_iterator it = polled_.begin(); it != polled_.end(); ++it)
+    {
+      if (now >= it->second.next_poll || now >= it->second.rearm_at)
+        due_.push_back(it->first);
+    }
+    for (size_t i = 0; i < due_.size(); i++)
+      fn(due_[i], now >= polled_.find(due_[i])->second.rearm_at);
+  }
+
+  // Compares contents with the baseline over the relevant words, calling changed(offset) per changed word.
+  // The baseline then becomes contents (all of it, so words that become relevant later compare from here);
+  // returns the number of changed words.
+  template <typename F>
+  size_t poll(uint64_t gfn, const uint64_t *contents, const uint64_t *relevant, uint64_t now, F changed)
+  {
+    std::unordered_map<uint64_t, polled_page>::iterator it = polled_.find(gfn);
+    if (it == polled_.end())
+      return 0;
+
+    polled_page &page = it->second;
+    size_t count = 0;
+    for (unsigned block = 0; block < WATCH_BITMAP_WORDS; block++)
+    {
+      for (uint64_t bits = relevant[block]; bits != 0; bits &= bits - 1)
+      {
+        unsigned word = block * 64 + __builtin_ctzll(bits);
+        if (contents[word] != page.words[word])
+        {
+          changed((uint32_t) word << WATCH_WORD_SHIFT);
+          count++;
+        }
+      }
+    }
+    memcpy(page.words, contents, sizeof(page.words));
+
+    page.next_poll = now + poll_interval_ns_;
+    stats_.polls++;
+    stats_.changed_words += count;
+    return count;
+  }
+
+  adaptive_stats stats() const
+  {
+    adaptive_stats copy = stats_;
+    copy.polled = polled_.size();
+    return copy;
+  }
+
+ private:
+
+  struct polled_page
+  {
+    uint64_t words[WATCH_PAGE_SIZE / sizeof(uint64_t)];
+    uint64_t next_poll;
+    uint64_t rearm_at;
+  };
+
+  uint32_t threshold_ = 0;
+  uint64_t poll_interval_ns_ = ADAPTIVE_POLL_INTERVAL_MS * 1000000ull;
+  uint64_t window_ns_ = ADAPTIVE_WINDOW_MS * 1000000ull;
+  uint64_t probe_ns_ = ADAPTIVE_PROBE_MS * 1000000ull;
+  uint64_t max_probe_ns_ = ADAPTIVE_MAX_PROBE_MS * 1000000ull;
+  size_t max_polled_ = ADAPTIVE_MAX_POLLED;
+  uint64_t next_window_ = 0;
+
+  std::unordered_map<uint64_t, polled_page> polled_;
+  std::unordered_map<uint64_t, uint64_t> backoff_;    // gfn -> probe period of its next trip
+  std::vector<uint64_t> due_;
+  adaptive_stats stats_ = adaptive_stats();
+};
+
+/////////////////////
+// Event Loop Step
+/////////////////////
+
+/**
+ * The event loop's adaptive polling between listens, on table's pages.
+ * At the end of a window every page's irrelevant count is read and reset;
+ * trapped pages over the threshold lose their trap and are polled, except
+ * pages with a range of a keep_types type, which stay trapped. Due polled
+ * pages are then polled, and those due their trap back are re-armed before
+ * their last poll. host does the guest side:
+ *
+ *   bool read(page, contents)   read the page (WATCH_PAGE_SIZE bytes)
+ *   bool untrap(page)           remove the page's trap
+ *   bool trap(page)             arm it again
+ *   void poll(page, now)        read the page and hand it to poll()
+ **/
+template <typename Event, typename Host>
+static inline void adapt_page_watches(AdaptiveController &adaptive, WatchTable<Event> &table, uint32_t keep_types,
+  uint64_t now, Host &host)
+{
+  typedef typename WatchTable<Event>::page_type page_type;
+  if (adaptive.window_due(now))
+  {
+    std::vector<page_type *> tripped;
+    table.for_each_page([&adaptive, &tripped, keep_types](page_type *page) {
+      uint32_t irrelevant = page->irrelevant;
+      page->irrelevant = 0;
+      if (adaptive.polled(page->gfn) || !adaptive.trip(page->gfn, irrelevant))
+        return;
+      for (size_t i = 0; i < page->ranges.size(); i++)
+      {
+        if (page->ranges[i].type & keep_types)
+          return;
+      }
+      tripped.push_back(page);
+    });
+
+    for (size_t i = 0; i < tripped.size() && adaptive.can_poll(); i++)
+    {
+      // Baseline first: a write landing before the trap goes still traps
+      uint64_t contents[WATCH_PAGE_SIZE / sizeof(uint64_t)];
+      if (!host.read(tripped[i], contents) || !host.untrap(tripped[i]))
+        continue;
+      adaptive.start_polling(tripped[i]->gfn, contents, now);
+    }
+  }
+
+  adaptive.for_each_due(now, [&adaptive, &table, &host, now](uint64_t gfn, bool rearm) {
+    page_type *page = table.find(gfn);
+    if (!page)
+    {
+      adaptive.stop_polling(gfn, false);
+      return;
+    }
+
+    // Trap back before the last poll, so no write falls between the two
+    if (rearm && !host.trap(page))
+      rearm = false;
+    host.poll(page, now);
+    if (rearm)
+      adaptive.stop_polling(gfn, true);
+  });
+}
+
+#endif
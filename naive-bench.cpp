@@ -0,0 +1,2983 @@
+/**
+ * VMI Event Naive Detector Benchmarks
+ * Built without libvmi by build-bench.sh; bench/libvmi provides a fake VMI layer.
+ **/
+/////////////////////
+// Includes
+/////////////////////
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+#include "naive-adaptive.h"
+#include "naive-callback.h"
+#include "naive-checks.h"
+#include "naive-coalesce.h"
+#include "naive-delta.h"
+#include "naive-deque.h"
+#include "naive-dwarf.h"
+#include "naive-event-list.h"
+#include "naive-integrity.h"
+#include "naive-latency.h"
+#include "naive-listgraph.h"
+#include "naive-memory.h"
+#include "naive-metrics.h"
+#include "naive-modes.h"
+#include "naive-pipeline.h"
+#include "naive-response.h"
+#include "naive-ring.h"
+#include "naive-shadow.h"
+#include "naive-trace.h"
+#include "naive-walk.h"
+#include "naive-watch.h"
+
+/////////////////////
+// Defines
+/////////////////////
+#define PROCESS_BENCH_EVENT 1
+#define MODULE_BENCH_EVENT 2
+#define PAGE_TABLE_BENCH_EVENT 16   // PAGE_TABLE_EVENT in naive-hawk.cpp, handled in the callback
+
+/////////////////////
+// Allocation Counting
+/////////////////////
+// Every malloc (and so every operator new) in the process is counted, to report allocations per event,
+// and per thread, to tell the stages of a pipeline apart
+static atomic<unsigned long> bench_allocations(0);
+static thread_local unsigned long bench_thread_allocations = 0;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *malloc(size_t size)
+{
+    bench_allocations.fetch_add(1, memory_order_relaxed);
+    bench_thread_allocations++;
+    return __libc_malloc(size);
+}
+#endif
+
+/////////////////////
+// Results
+/////////////////////
+// One measured value; written as a JSON line per metric with --json=FILE (- for stdout)
+struct bench_result
+{
+    string bench;
+    string name;
+    string metric;
+    double value;
+    string unit;
+};
+
+static vector<bench_result> bench_results;
+
+static void bench_metric(const char *bench, const string &name, const char *metric, double value, const char *unit)
+{
+    bench_result result;
+    result.bench = bench;
+    result.name = name;
+    result.metric = metric;
+    result.value = value;
+    result.unit = unit;
+    bench_results.push_back(result);
+}
+
+static void bench_percentiles(const char *bench, const string &name, const latency_snapshot &snapshot)
+{
+    bench_metric(bench, name, "p50", snapshot.percentile(0.50), "ns");
+    bench_metric(bench, name, "p90", snapshot.percentile(0.90), "ns");
+    bench_metric(bench, name, "p99", snapshot.percentile(0.99), "ns");
+    bench_metric(bench, name, "p99.9", snapshot.percentile(0.999), "ns");
+    bench_metric(bench, name, "max", snapshot.max, "ns");
+}
+
+static bool write_results(const char *path)
+{
+    FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!out)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+
+    long timestamp = (long) time(NULL);
+    for (size_t i = 0; i < bench_results.size(); i++)
+    {
+        const bench_result &result = bench_results[i];
+        fprintf(out, "{\"time\":%ld,\"bench\":\"%s\",\"case\":\"%s\",\"metric\":\"%s\",\"value\":%.6g,\"unit\":\"%s\"}\n",
+            timestamp, result.bench.c_str(), result.name.c_str(), result.metric.c_str(), result.value, result.unit.c_str());
+    }
+
+    if (out != stdout)
+        fclose(out);
+    return true;
+}
+
+/////////////////////
+// Helpers
+/////////////////////
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Previous line-scanning lookup, kept as the benchmark baseline
+static int legacy_retrieve_struct_size(string file_path, string struct_name){
+    int result = -1;
+    ifstream in_file(file_path);
+
+    string struct_substr("<DW_TAG_structure_type> DW_AT_name<\"" + struct_name + "\">");
+    string struct_size_substr("DW_AT_byte_size<");
+    string line;
+    while (getline(in_file, line))
+    {
+        if (line.find(struct_substr) != string::npos){
+            string temp_mem_loc(line.substr(line.find(struct_size_substr) + struct_size_substr.size()));
+            result = stoi(temp_mem_loc.substr(0, temp_mem_loc.find(">")), NULL, 16);
+            break;
+        }
+    }
+
+    return result;
+}
+
+/////////////////////
+// Benchmarks
+/////////////////////
+// Struct sizes looked up by the register_*_events functions
+static const char *dwarf_bench_structs[] = { "task_struct", "file", "module", "tcp_seq_afinfo", "udp_seq_afinfo" };
+#define DWARF_BENCH_STRUCT_COUNT (sizeof(dwarf_bench_structs) / sizeof(dwarf_bench_structs[0]))
+
+static int bench_dwarf(const char *dwarf_path, int lookup_count)
+{
+    printf("DWARF startup benchmark (%d simulated lookups)\n", lookup_count);
+
+    // Legacy: one full scan per lookup
+    double start = now_seconds();
+    int legacy_size = 0;
+    for (int i = 0; i < lookup_count; i++)
+        legacy_size += legacy_retrieve_struct_size(dwarf_path, dwarf_bench_structs[i % DWARF_BENCH_STRUCT_COUNT]);
+    double legacy_time = now_seconds() - start;
+
+    // Index from text, then cache write
+    string cache_path = string(dwarf_path) + ".bench.cache";
+    unlink(cache_path.c_str());
+
+    DwarfIndex text_index;
+    start = now_seconds();
+    if (!text_index.load_text(dwarf_path))
+        return 1;
+    int text_size = 0;
+    for (int i = 0; i < lookup_count; i++)
+        text_size += text_index.struct_size(dwarf_bench_structs[i % DWARF_BENCH_STRUCT_COUNT]);
+    double text_time = now_seconds() - start;
+
+    if (!text_index.write_cache(cache_path, dwarf_path))
+    {
+        printf("Failed to write cache %s\n", cache_path.c_str());
+        return 1;
+    }
+
+    // Index from mmapped cache
+    DwarfIndex cache_index;
+    start = now_seconds();
+    if (!cache_index.load_cache(cache_path, dwarf_path))
+    {
+        printf("Failed to load cache %s\n", cache_path.c_str());
+        return 1;
+    }
+    int cache_size = 0;
+    for (int i = 0; i < lookup_count; i++)
+        cache_size += cache_index.struct_size(dwarf_bench_structs[i % DWARF_BENCH_STRUCT_COUNT]);
+    double cache_time = now_seconds() - start;
+
+    // Caches with a member range past the member table or an unterminated string pool are reparsed instead
+    ifstream cache_file(cache_path.c_str(), ios::binary);
+    string bytes((istreambuf_iterator<char>(cache_file)), istreambuf_iterator<char>());
+    int corrupt_loaded = 0;
+    for (int corruption = 0; corruption < 2 && bytes.size() > sizeof(dwarf_cache_header); corruption++)
+    {
+        string corrupt(bytes);
+        if (corruption == 0)
+            ((dwarf_struct_entry *) &corrupt[sizeof(dwarf_cache_header)])->first_member = cache_index.member_count();
+        else
+            corrupt[corrupt.size() - 1] = 'x';
+        ofstream(cache_path.c_str(), ios::binary | ios::trunc) << corrupt;
+        DwarfIndex corrupt_index;
+        corrupt_loaded += corrupt_index.load_cache(cache_path, dwarf_path);
+    }
+
+    unlink(cache_path.c_str());
+
+    printf("Indexed %u structs, %u members\n", cache_index.struct_count(), cache_index.member_count());
+    printf("Sum of struct sizes: legacy=%d text=%d cache=%d\n", legacy_size, text_size, cache_size);
+    printf("task_struct.files offset: %d (%s)\n", cache_index.member_offset("task_struct", "files"),
+        cache_index.member_type("task_struct", "files").c_str());
+    printf("Legacy scanner: %f seconds\n", legacy_time);
+    printf("Text index:     %f seconds\n", text_time);
+    printf("Mmapped cache:  %f seconds\n", cache_time);
+    bench_metric("dwarf", "legacy scan", "time", legacy_time * 1e3, "ms");
+    bench_metric("dwarf", "text index", "time", text_time * 1e3, "ms");
+    bench_metric("dwarf", "mmapped cache", "time", cache_time * 1e3, "ms");
+
+    return (legacy_size == text_size && text_size == cache_size && bytes.size() > sizeof(dwarf_cache_header) && corrupt_loaded == 0) ? 0 : 1;
+}
+
+// Producer pacing: spin until the batch containing event i is due (rate 0 = unpaced)
+static void pace_producer(double start, long i, double rate)
+{
+    if (rate <= 0 || (i & 63) != 0)
+        return;
+    double due = start + i / rate;
+    while (now_seconds() < due)
+        ring_cpu_relax();
+}
+
+struct queue_bench_args
+{
+    long events;
+    double rate;
+    long consumed;
+    long dropped;
+    double producer_time;
+    double total_time;
+};
+
+static Deque<int> bench_deque;
+
+static void *deque_consumer(void *arg)
+{
+    queue_bench_args *args = (queue_bench_args *) arg;
+    while (bench_deque.pop() != 0)
+        args->consumed++;
+    return NULL;
+}
+
+static void bench_deque_run(queue_bench_args *args)
+{
+    pthread_t consumer;
+    args->consumed = 0;
+    args->dropped = 0;
+    pthread_create(&consumer, NULL, deque_consumer, args);
+
+    double start = now_seconds();
+    for (long i = 0; i < args->events; i++)
+    {
+        pace_producer(start, i, args->rate);
+        bench_deque.push_back(PROCESS_BENCH_EVENT);
+    }
+    args->producer_time = now_seconds() - start;
+
+    bench_deque.push_back(0);
+    pthread_join(consumer, NULL);
+    args->total_time = now_seconds() - start;
+}
+
+static SpscRing<naive_event> *bench_ring;
+
+static void *ring_consumer(void *arg)
+{
+    queue_bench_args *args = (queue_bench_args *) arg;
+    naive_event batch[64];
+    size_t count;
+    while ((count = bench_ring->wait_pop_batch(batch, 64)) != 0)
+        args->consumed += count;
+    return NULL;
+}
+
+static void bench_ring_run(queue_bench_args *args)
+{
+    SpscRing<naive_event> ring(65536, RING_DROP_NEWEST);
+    bench_ring = &ring;
+
+    pthread_t consumer;
+    args->consumed = 0;
+    pthread_create(&consumer, NULL, ring_consumer, args);
+
+    naive_event record;
+    memset(&record, 0, sizeof(record));
+    record.type = PROCESS_BENCH_EVENT;
+
+    double start = now_seconds();
+    for (long i = 0; i < args->events; i++)
+    {
+        pace_producer(start, i, args->rate);
+        record.gfn = i;
+        record.timestamp = ring_timestamp_ns();
+        ring.push(record);
+    }
+    args->producer_time = now_seconds() - start;
+
+    ring.close();
+    pthread_join(consumer, NULL);
+    args->total_time = now_seconds() - start;
+    args->dropped = ring.dropped();
+    bench_ring = NULL;
+}
+
+static void print_queue_result(const char *name, const queue_bench_args *args)
+{
+    printf("%-6s rate=%-10.0f events=%ld consumed=%ld dropped=%ld push=%.1f ns/event throughput=%.2f Mevents/s\n",
+        name, args->rate, args->events, args->consumed, args->dropped,
+        args->producer_time / args->events * 1e9,
+        args->consumed / args->total_time / 1e6);
+
+    string name_rate = string(name) + " rate=" + to_string((long) args->rate);
+    bench_metric("queue", name_rate, "push", args->producer_time / args->events * 1e9, "ns/event");
+    bench_metric("queue", name_rate, "throughput", args->consumed / args->total_time / 1e6, "Mevents/s");
+    bench_metric("queue", name_rate, "dropped", args->dropped, "events");
+}
+
+static int bench_queue(long events)
+{
+    printf("Event queue benchmark (%ld events per run)\n", events);
+
+    // Offered load in events per second, 0 = as fast as the producer can go
+    double rates[] = { 0, 2e6, 5e6, 10e6 };
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        queue_bench_args deque_args;
+        deque_args.events = events;
+        deque_args.rate = rates[i];
+        bench_deque_run(&deque_args);
+        print_queue_result("deque", &deque_args);
+
+        queue_bench_args ring_args;
+        ring_args.events = events;
+        ring_args.rate = rates[i];
+        bench_ring_run(&ring_args);
+        print_queue_result("ring", &ring_args);
+    }
+
+    // The producer's own cost, the consumer awake but not contending for the lines: what every callback pays
+    SpscRing<naive_event> ring(65536, RING_DROP_NEWEST);
+    naive_event batch[64];
+    naive_event record;
+    memset(&record, 0, sizeof(record));
+    record.type = PROCESS_BENCH_EVENT;
+    double seconds = 0;
+    for (long done = 0; done < events; done += 64)
+    {
+        double start = now_seconds();
+        for (long i = 0; i < 64; i++)
+        {
+            record.gfn = done + i;
+            ring.push(record);
+        }
+        seconds += now_seconds() - start;
+        ring.pop_batch(batch, 64);
+    }
+    long pushed = (events + 63) / 64 * 64;
+    printf("ring push alone: %.1f ns/event\n", seconds / pushed * 1e9);
+    bench_metric("queue", "ring", "push_alone", seconds / pushed * 1e9, "ns/event");
+
+    return 0;
+}
+
+// Replays synthetic fork-like bursts through the coalescer for several quiet windows
+static int bench_coalesce(long bursts)
+{
+    const long burst_size = 40;            // Writes per burst
+    const uint64_t write_gap_ns = 20000;   // 20 us between writes in a burst
+    const uint64_t burst_gap_ns = 50000000; // 50 ms between bursts
+    const uint64_t analysis_ns = 30000000; // Simulated analysis duration
+
+    printf("Coalescing benchmark (%ld bursts of %ld writes)\n", bursts, burst_size);
+
+    uint64_t windows_ms[] = { 0, 1, 10, 100, 500 };
+    for (size_t w = 0; w < sizeof(windows_ms) / sizeof(windows_ms[0]); w++)
+    {
+        EventCoalescer coalescer(windows_ms[w] * 1000000ull, 2000000000ull);
+        coalesced_event analysis;
+        unsigned long max_covered = 0;
+        uint64_t busy_until = 0;
+        uint64_t latency_sum = 0;
+
+        naive_event record;
+        memset(&record, 0, sizeof(record));
+        record.type = PROCESS_BENCH_EVENT;
+
+        uint64_t now = 1;
+        for (long b = 0; b < bursts; b++)
+        {
+            for (long i = 0; i < burst_size; i++)
+            {
+                now += write_gap_ns;
+                record.gfn = 0x1000 + (i % 8);
+                record.timestamp = now;
+                coalescer.add(record);
+
+                // The analysis thread only looks for due work when it is idle
+                if (now >= busy_until && coalescer.due(now) && coalescer.take(PROCESS_BENCH_EVENT, now, analysis))
+                {
+                    busy_until = now + analysis_ns;
+                    latency_sum += now - analysis.first_seen;
+                    if (analysis.raw_events > max_covered)
+                        max_covered = analysis.raw_events;
+                }
+            }
+
+            // Idle gap: let pending work become due
+            uint64_t gap_end = now + burst_gap_ns;
+            while (coalescer.pending())
+            {
+                uint64_t at = coalescer.next_deadline();
+                if (at < busy_until)
+                    at = busy_until;
+                if (at > gap_end)
+                    break;
+                coalescer.take(PROCESS_BENCH_EVENT, at, analysis);
+                busy_until = at + analysis_ns;
+                latency_sum += at - analysis.first_seen;
+                if (analysis.raw_events > max_covered)
+                    max_covered = analysis.raw_events;
+            }
+            now = gap_end;
+        }
+
+        // Flush the trailing batch
+        if (coalescer.pending())
+            coalescer.take(PROCESS_BENCH_EVENT, coalescer.next_deadline(), analysis);
+
+        unsigned long analyses = coalescer.total_analyses();
+        printf("window=%-4lu ms raw=%lu analyses=%lu avg covered=%.1f max covered=%lu avg delay=%.2f ms\n",
+            (unsigned long) windows_ms[w], coalescer.total_raw_events(), analyses,
+            analyses ? (double) coalescer.total_raw_events() / analyses : 0.0,
+            max_covered, analyses ? latency_sum / 1e6 / analyses : 0.0);
+
+        string window = "window=" + to_string((unsigned long) windows_ms[w]) + "ms";
+        bench_metric("coalesce", window, "analyses", analyses, "count");
+        bench_metric("coalesce", window, "avg delay", analyses ? latency_sum / 1e6 / analyses : 0.0, "ms");
+    }
+
+    return 0;
+}
+
+static LatencyRecorder<2> bench_latency;
+
+static void *latency_writer(void *arg)
+{
+    long samples = *(long *) arg;
+    uint64_t value = 88172645463325252ull;
+    for (long i = 0; i < samples; i++)
+    {
+        // xorshift, spread over ~100 ns .. ~1 ms
+        value ^= value << 13;
+        value ^= value >> 7;
+        value ^= value << 17;
+        bench_latency.record(i & 1, 100 + (value & 0xfffff));
+    }
+    return NULL;
+}
+
+// Cost of recording a callback latency sample versus the old clock() + printf
+static int bench_latency_record(long samples)
+{
+    printf("Latency histogram benchmark (%ld samples per thread)\n", samples);
+
+    double start = now_seconds();
+    for (long i = 0; i < samples; i++)
+    {
+        uint64_t t0 = latency_now_ns();
+        bench_latency.record(0, latency_now_ns() - t0);
+    }
+    double timed_record = now_seconds() - start;
+
+    FILE *devnull = fopen("/dev/null", "w");
+    start = now_seconds();
+    for (long i = 0; i < samples; i++)
+    {
+        clock_t t = clock();
+        t = clock() - t;
+        fprintf(devnull, "mem_write_cb() took %f seconds to execute \n", ((double)t)/CLOCKS_PER_SEC);
+    }
+    double legacy = now_seconds() - start;
+    fclose(devnull);
+
+    const int threads = 4;
+    pthread_t writers[threads];
+    start = now_seconds();
+    for (int i = 0; i < threads; i++)
+        pthread_create(&writers[i], NULL, latency_writer, &samples);
+    for (int i = 0; i < threads; i++)
+        pthread_join(writers[i], NULL);
+    double parallel = now_seconds() - start;
+
+    start = now_seconds();
+    latency_snapshot snapshot;
+    bench_latency.snapshot(1, snapshot);
+    double merge = now_seconds() - start;
+
+    printf("clock_gettime + record:   %.1f ns/sample\n", timed_record / samples * 1e9);
+    printf("clock() + printf:         %.1f ns/sample\n", legacy / samples * 1e9);
+    printf("record, %d threads:        %.1f ns/sample per thread\n", threads, parallel / samples * 1e9);
+    printf("merge %d shards:           %.1f us\n", threads + 1, merge * 1e6);
+    snapshot.print("slot 1");
+    bench_metric("latency", "clock_gettime + record", "cost", timed_record / samples * 1e9, "ns/sample");
+    bench_metric("latency", "clock() + printf", "cost", legacy / samples * 1e9, "ns/sample");
+    bench_metric("latency", "record " + to_string(threads) + " threads", "cost", parallel / samples * 1e9, "ns/sample");
+
+    return 0;
+}
+
+// Callback counters: one shared atomic bumped by every thread versus per-thread shards
+static atomic<uint64_t> bench_shared_counter(0);
+static ShardedCounters<4> bench_sharded_counters;
+
+struct counter_args
+{
+    long increments;
+    bool sharded;
+};
+
+static void *counter_writer(void *arg)
+{
+    counter_args *args = (counter_args *) arg;
+    for (long i = 0; i < args->increments; i++)
+    {
+        if (args->sharded)
+            bench_sharded_counters.add(i & 3);
+        else
+            bench_shared_counter.fetch_add(1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static double run_counter_writers(int threads, long increments, bool sharded)
+{
+    vector<pthread_t> writers(threads);
+    counter_args args = { increments, sharded };
+    double start = now_seconds();
+    for (int i = 0; i < threads; i++)
+        pthread_create(&writers[i], NULL, counter_writer, &args);
+    for (int i = 0; i < threads; i++)
+        pthread_join(writers[i], NULL);
+    return now_seconds() - start;
+}
+
+// Counter cost as the callbacks see it, and the cost of rendering a Prometheus snapshot
+static int bench_metrics(int threads, long increments)
+{
+    printf("Metrics benchmark (%d threads, %ld increments each)\n", threads, increments);
+
+    double shared = run_counter_writers(threads, increments, false);
+    double sharded = run_counter_writers(threads, increments, true);
+    uint64_t total = 0;
+    for (unsigned i = 0; i < 4; i++)
+        total += bench_sharded_counters.get(i);
+
+    // One guest's worth of families: totals, per-type counters, summaries and both heat maps
+    latency_snapshot snapshot;
+    bench_latency.snapshot(0, snapshot);
+    const int renders = 1000;
+    size_t bytes = 0;
+    double start = now_seconds();
+    for (int i = 0; i < renders; i++)
+    {
+        MetricsText metrics;
+        string labels = metric_label("guest", "bench");
+        metrics.family("naive_events_total", "counter", "Write events received by mem_write_cb.");
+        metrics.sample("naive_events_total", labels, total);
+        metrics.family("naive_field_hits_total", "counter", "Writes to a watched field, per event type.");
+        for (unsigned type = 0; type < 5; type++)
+            metrics.sample("naive_field_hits_total", labels + "," + metric_label("type", to_string(type)), total >> type);
+        metrics.family("naive_callback_duration_seconds", "summary", "Time spent in mem_write_cb.");
+        for (unsigned type = 0; type < 6; type++)
+            metrics.summary("naive_callback_duration_seconds", labels + "," + metric_label("type", to_string(type)), snapshot);
+        metrics.family("naive_page_writes_total", "counter", "Trapped writes of the hottest watched pages.");
+        for (uint64_t gfn = 0; gfn < 20; gfn++)
+            metrics.sample("naive_page_writes_total", labels + "," + metric_hex_label("gfn", 0x100000 + gfn), total / (gfn + 1));
+        metrics.family("naive_object_hits_total", "counter", "Watched field writes of the hottest watched objects.");
+        for (uint64_t object = 0; object < 20; object++)
+            metrics.sample("naive_object_hits_total", labels + "," + metric_hex_label("object", 0x100000000ull + object * 0x1c80)
+                + "," + metric_label("type", "PROCESS_EVENT"), total / (object + 1));
+        bytes = metrics.str().size();
+    }
+    double render = now_seconds() - start;
+
+    printf("shared atomic fetch_add:  %.2f ns/increment per thread\n", shared / increments * 1e9);
+    printf("sharded counters:         %.2f ns/increment per thread\n", sharded / increments * 1e9);
+    printf("snapshot render:          %.1f us (%lu bytes)\n", render / renders * 1e6, (unsigned long) bytes);
+    string name = to_string(threads) + " threads";
+    bench_metric("metrics", "shared atomic " + name, "cost", shared / increments * 1e9, "ns/increment");
+    bench_metric("metrics", "sharded " + name, "cost", sharded / increments * 1e9, "ns/increment");
+    bench_metric("metrics", "snapshot", "render", render / renders * 1e6, "us");
+
+    return total == (uint64_t) threads * increments ? 0 : 1;
+}
+
+// Stand-in for vmi_event_t (similar size) so the registry can be measured without libvmi
+struct bench_vmi_event
+{
+    uint32_t type;
+    uint64_t gfn;
+    void *data;
+    char payload[96];
+};
+
+// Previous registration bookkeeping: malloc'd event, context and list node per watch
+struct legacy_event_data
+{
+    unsigned long type;
+    unsigned long physical_addr;
+    int monitor_size;
+};
+
+struct legacy_event_node
+{
+    bench_vmi_event *event;
+    legacy_event_node *next;
+};
+
+static int bench_registry(long pages, int rounds)
+{
+    printf("Event registry benchmark (%ld pages, %d re-registration rounds)\n", pages, rounds);
+
+    // Legacy: per-watch mallocs, linear search for a GFN, node-by-node teardown
+    double start = now_seconds();
+    unsigned long legacy_found = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        legacy_event_node *head = NULL;
+        for (long i = 0; i < pages; i++)
+        {
+            bench_vmi_event *event = (bench_vmi_event *) malloc(sizeof(bench_vmi_event));
+            event->gfn = 0x100000 + i * 3;
+            legacy_event_data *data = (legacy_event_data *) malloc(sizeof(legacy_event_data));
+            data->type = PROCESS_BENCH_EVENT;
+            data->physical_addr = event->gfn << 12;
+            data->monitor_size = 64;
+            event->data = data;
+
+            legacy_event_node *node = (legacy_event_node *) malloc(sizeof(legacy_event_node));
+            node->event = event;
+            node->next = head;
+            head = node;
+        }
+
+        // A handful of GFN lookups, as a callback-side search would need
+        for (long i = 0; i < 64; i++)
+        {
+            uint64_t gfn = 0x100000 + ((i * 7919) % pages) * 3;
+            for (legacy_event_node *node = head; node; node = node->next)
+            {
+                if (node->event->gfn == gfn)
+                {
+                    legacy_found++;
+                    break;
+                }
+            }
+        }
+
+        while (head)
+        {
+            legacy_event_node *next = head->next;
+            free(head->event->data);
+            free(head->event);
+            free(head);
+            head = next;
+        }
+    }
+    double legacy_time = now_seconds() - start;
+
+    // Pool: one slot per page, O(1) GFN index, bulk clear keeps slabs for the next round
+    WatchTable<bench_vmi_event> table;
+    start = now_seconds();
+    unsigned long pool_found = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        bool new_page;
+        for (long i = 0; i < pages; i++)
+        {
+            uint64_t gfn = 0x100000 + i * 3;
+            WatchTable<bench_vmi_event>::page_type *page = table.add(gfn, 0, 64, PROCESS_BENCH_EVENT, gfn << 12, &new_page);
+            page->event.gfn = gfn;
+            page->event.data = page;
+        }
+
+        for (long i = 0; i < 64; i++)
+        {
+            if (table.find(0x100000 + ((i * 7919) % pages) * 3))
+                pool_found++;
+        }
+
+        table.clear();
+    }
+    double pool_time = now_seconds() - start;
+
+    printf("Lookups found: legacy=%lu pool=%lu\n", legacy_found, pool_found);
+    printf("Legacy malloc + list: %.1f ns/registration\n", legacy_time / (pages * rounds) * 1e9);
+    printf("Slab pool + index:    %.1f ns/registration\n", pool_time / (pages * rounds) * 1e9);
+    bench_metric("registry", "legacy malloc + list", "cost", legacy_time / (pages * rounds) * 1e9, "ns/registration");
+    bench_metric("registry", "slab pool + index", "cost", pool_time / (pages * rounds) * 1e9, "ns/registration");
+
+    return legacy_found == pool_found ? 0 : 1;
+}
+
+// Re-check cost with a churning task list: re-watch everything versus WatchSet deltas
+static int bench_delta(long tasks, int rounds)
+{
+    const long churn = tasks / 100 + 1;   // Tasks replaced per re-check
+    const int task_size = 0x1c80;
+    printf("Re-registration benchmark (%ld tasks, %ld replaced per pass, %d passes)\n", tasks, churn, rounds);
+
+    vector<uint64_t> task_addrs(tasks);
+    for (long i = 0; i < tasks; i++)
+        task_addrs[i] = 0x10000000ull + i * 0x2000;
+
+    // Full: every pass watches every task again (previous behaviour, one more reference each time)
+    WatchTable<bench_vmi_event> full_table;
+    unsigned long full_watch_calls = 0;
+    double start = now_seconds();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (long i = 0; i < churn; i++)
+            task_addrs[(r * churn + i) % tasks] += 0x100000000ull;
+
+        bool new_page;
+        for (long i = 0; i < tasks; i++)
+        {
+            for (uint64_t page = task_addrs[i] >> 12; page <= (task_addrs[i] + task_size - 1) >> 12; page++)
+                full_table.add(page, 0, 64, PROCESS_BENCH_EVENT, task_addrs[i], &new_page);
+            full_watch_calls++;
+        }
+    }
+    double full_time = now_seconds() - start;
+
+    // Delta: only new tasks are watched and vanished ones unwatched
+    for (long i = 0; i < tasks; i++)
+        task_addrs[i] = 0x10000000ull + i * 0x2000;
+
+    WatchTable<bench_vmi_event> delta_table;
+    WatchSet set;
+    vector<watched_object> vanished;
+    unsigned long delta_watch_calls = 0;
+    start = now_seconds();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (long i = 0; i < churn; i++)
+            task_addrs[(r * churn + i) % tasks] += 0x100000000ull;
+
+        set.begin_pass(PROCESS_BENCH_EVENT, ring_timestamp_ns());
+        bool new_page;
+        int old_size;
+        for (long i = 0; i < tasks; i++)
+        {
+            if (!set.observe(PROCESS_BENCH_EVENT, task_addrs[i], task_size, &old_size))
+                continue;
+            for (uint64_t page = task_addrs[i] >> 12; page <= (task_addrs[i] + task_size - 1) >> 12; page++)
+                delta_table.add(page, 0, 64, PROCESS_BENCH_EVENT, task_addrs[i], &new_page);
+            delta_watch_calls++;
+        }
+
+        set.end_pass(PROCESS_BENCH_EVENT, ring_timestamp_ns(), vanished);
+        for (size_t i = 0; i < vanished.size(); i++)
+        {
+            uint64_t addr = vanished[i].physical_addr;
+            for (uint64_t page = addr >> 12; page <= (addr + vanished[i].size - 1) >> 12; page++)
+            {
+                bool found;
+                WatchTable<bench_vmi_event>::page_type *released = delta_table.remove(page, PROCESS_BENCH_EVENT, addr, &found);
+                if (released)
+                    delta_table.release(released);
+            }
+        }
+    }
+    double delta_time = now_seconds() - start;
+
+    const delta_stats &stats = set.stats();
+    printf("Full:  %lu watch calls, %lu pages, %lu ranges, %.3f ms/pass\n", full_watch_calls,
+        (unsigned long) full_table.page_count(), (unsigned long) full_table.range_count(), full_time * 1e3 / rounds);
+    printf("Delta: %lu watch calls, %lu pages, %lu ranges, %.3f ms/pass (added %lu, removed %lu, unchanged %lu)\n",
+        delta_watch_calls, (unsigned long) delta_table.page_count(), (unsigned long) delta_table.range_count(),
+        delta_time * 1e3 / rounds, stats.added, stats.removed, stats.unchanged);
+    printf("Pass timing: first (full) %.3f ms, delta average %.3f ms\n", stats.full_ns / 1e6,
+        stats.passes > stats.full_passes ? stats.delta_ns / 1e6 / (stats.passes - stats.full_passes) : 0.0);
+    bench_metric("delta", "full", "pass", full_time * 1e3 / rounds, "ms");
+    bench_metric("delta", "delta", "pass", delta_time * 1e3 / rounds, "ms");
+
+    return set.size(PROCESS_BENCH_EVENT) == (size_t) tasks ? 0 : 1;
+}
+
+// Function pointer and shared cred checks: per-pointer module scan (as the Volatility plugins do) versus KernelRanges
+static int bench_checks(long tables, int modules)
+{
+    const int members_per_table = 30;   // Function pointers in a file_operations table
+    const uint64_t text_start = 0xffffffff81000000ull;
+    const uint64_t text_end = 0xffffffff81600000ull;
+    printf("Check benchmark (%ld tables of %d pointers, %d modules)\n", tables, members_per_table, modules);
+
+    vector<address_range> module_ranges;
+    KernelRanges ranges;
+    ranges.add(text_start, text_end);
+    for (int i = 0; i < modules; i++)
+    {
+        address_range range;
+        range.start = 0xffffffffa0000000ull + i * 0x10000ull;
+        range.end = range.start + 0x8000;
+        module_ranges.push_back(range);
+        ranges.add(range.start, range.end);
+    }
+    ranges.finalize();
+
+    // Mostly kernel text, some module code, a few NULLs and one hook every 1000 tables
+    srand(1);
+    vector<uint64_t> pointers(tables * members_per_table);
+    for (size_t i = 0; i < pointers.size(); i++)
+    {
+        int kind = rand() % 10;
+        if (kind < 6)
+            pointers[i] = text_start + rand() % (text_end - text_start);
+        else if (kind < 8)
+            pointers[i] = module_ranges[rand() % modules].start + rand() % 0x8000;
+        else
+            pointers[i] = 0;
+    }
+    for (long t = 0; t < tables; t += 1000)
+        pointers[t * members_per_table + 3] = 0xffffffffc0de0000ull;
+
+    double start = now_seconds();
+    unsigned long scan_bad = 0;
+    for (size_t i = 0; i < pointers.size(); i++)
+    {
+        uint64_t pointer = pointers[i];
+        if (pointer == 0 || (pointer >= text_start && pointer < text_end))
+            continue;
+        bool found = false;
+        for (size_t m = 0; m < module_ranges.size() && !found; m++)
+            found = pointer >= module_ranges[m].start && pointer < module_ranges[m].end;
+        scan_bad += !found;
+    }
+    double scan_time = now_seconds() - start;
+
+    start = now_seconds();
+    unsigned long ranges_bad = 0;
+    uint32_t bad[members_per_table];
+    for (long t = 0; t < tables; t++)
+        ranges_bad += ranges.find_outside(pointers.data() + t * members_per_table, members_per_table, bad);
+    double ranges_time = now_seconds() - start;
+
+    printf("Module scan:   %.1f ns/pointer, %lu hooks\n", scan_time / pointers.size() * 1e9, scan_bad);
+    printf("KernelRanges:  %.1f ns/pointer, %lu hooks\n", ranges_time / pointers.size() * 1e9, ranges_bad);
+
+    // Shared creds: one in 500 tasks borrows another task's cred
+    long tasks = tables;
+    vector<task_cred> creds(tasks);
+    for (long i = 0; i < tasks; i++)
+    {
+        creds[i].pid = (int32_t) i + 1;
+        creds[i].cred = 0xffff880000000000ull + i * 0xc0;
+        if (i % 500 == 499)
+            creds[i].cred = creds[i - 1].cred;
+    }
+
+    start = now_seconds();
+    map<uint64_t, vector<int32_t> > by_cred;
+    for (long i = 0; i < tasks; i++)
+        by_cred[creds[i].cred].push_back(creds[i].pid);
+    unsigned long map_shared = 0;
+    for (auto it = by_cred.begin(); it != by_cred.end(); ++it)
+        map_shared += it->second.size() > 1;
+    double map_time = now_seconds() - start;
+
+    start = now_seconds();
+    vector<shared_cred> shared;
+    unsigned long hash_shared = find_shared_creds(creds, shared);
+    double hash_time = now_seconds() - start;
+
+    printf("Cred map:      %.1f ns/task, %lu shared\n", map_time / tasks * 1e9, map_shared);
+    printf("Cred hash:     %.1f ns/task, %lu shared\n", hash_time / tasks * 1e9, hash_shared);
+    bench_metric("checks", "module scan", "cost", scan_time / pointers.size() * 1e9, "ns/pointer");
+    bench_metric("checks", "kernel ranges", "cost", ranges_time / pointers.size() * 1e9, "ns/pointer");
+    bench_metric("checks", "cred map", "cost", map_time / tasks * 1e9, "ns/task");
+    bench_metric("checks", "cred hash", "cost", hash_time / tasks * 1e9, "ns/task");
+
+    return scan_bad == ranges_bad && map_shared == hash_shared ? 0 : 1;
+}
+
+// Translation cache: hit and miss cost, and invalidation by a leaf and by a top level page table entry
+static int bench_translate(long pages, long lookups)
+{
+    printf("Translation cache benchmark (%ld pages, %ld lookups)\n", pages, lookups);
+
+    // Kernel direct map style layout: one PML4 and PDPT entry, a PD entry per 2 MB, a PT entry per page
+    const uint64_t dtb = 0x1000000, va_base = 0xffff880000000000ull;
+    TranslationCache cache(pages);
+    translation_walk walk;
+    double start = now_seconds();
+    for (long i = 0; i < pages; i++)
+    {
+        walk.pa = 0x40000000ull + ((uint64_t) i << 12);
+        walk.entries[0] = dtb + 0x880;
+        walk.entries[1] = 0x2000000;
+        walk.entries[2] = 0x3000000 + (i >> 9) * 8;
+        walk.entries[3] = 0x4000000 + i * 8;
+        walk.entry_count = 4;
+        cache.insert(dtb, va_base + ((uint64_t) i << 12), walk);
+    }
+    double insert_time = now_seconds() - start;
+
+    vector<uint64_t> watch, unwatch;
+    cache.take_watch_changes(watch, unwatch);
+    unsigned long watched = watch.size();
+
+    uint64_t pa = 0, sum = 0;
+    start = now_seconds();
+    for (long i = 0; i < lookups; i++)
+    {
+        if (cache.lookup(dtb, va_base + (((uint64_t) (i * 7919) % pages) << 12) + (i & 0xff8), &pa))
+            sum += pa;
+    }
+    double lookup_time = now_seconds() - start;
+    translation_stats stats = cache.stats();
+
+    // Leaf entries of every 4th page, one translation each
+    long leaves = 0;
+    size_t leaf_dropped = 0;
+    start = now_seconds();
+    for (long i = 0; i < pages; i += 4, leaves++)
+        leaf_dropped = max(leaf_dropped, cache.invalidate(0x4000000 + 8 * i));
+    double leaf_time = leaves ? (now_seconds() - start) / leaves : 0.0;
+    start = now_seconds();
+    size_t top_dropped = cache.invalidate(dtb + 0x880);
+    double top_time = now_seconds() - start;
+    cache.take_watch_changes(watch, unwatch);
+
+    printf("Insert: %.1f ns/page, %lu page table entries to watch\n", insert_time / pages * 1e9, watched);
+    printf("Lookup: %.1f ns, %lu hits, %lu misses (evictions %lu)\n", lookup_time / lookups * 1e9,
+        stats.hits, stats.misses, stats.evictions);
+    printf("Invalidate: PTE %.3f us (at most %lu dropped), PML4E %.1f us (%lu dropped), %lu entries to unwatch\n",
+        leaf_time * 1e6, (unsigned long) leaf_dropped, top_time * 1e6, (unsigned long) top_dropped,
+        (unsigned long) unwatch.size());
+    bench_metric("translate", "insert", "cost", insert_time / pages * 1e9, "ns/page");
+    bench_metric("translate", "lookup", "cost", lookup_time / lookups * 1e9, "ns/lookup");
+    bench_metric("translate", "lookup", "hit rate", 100.0 * stats.hits / lookups, "%");
+    bench_metric("translate", "invalidate pte", "cost", leaf_time * 1e6, "us");
+    bench_metric("translate", "invalidate pml4e", "cost", top_time * 1e6, "us");
+
+    return sum != 0 && leaf_dropped <= 1 ? 0 : 1;
+}
+
+// Counts guest accesses and charges each a fixed cost, standing in for the libvmi call a live walk makes
+class CountingMemory : public GuestMemory
+{
+ public:
+
+    CountingMemory(GuestMemory &inner, uint64_t call_ns) : inner_(inner), call_ns_(call_ns) {}
+
+    uint64_t symbol(const char *name) { return inner_.symbol(name); }
+
+    uint64_t translate(uint64_t va)
+    {
+        charge();
+        return inner_.translate(va);
+    }
+
+    size_t read(uint64_t va, void *buf, size_t size)
+    {
+        charge();
+        return inner_.read(va, buf, size);
+    }
+
+    void prefetch(uint64_t va, size_t size) { inner_.prefetch(va, size); }
+
+    unsigned long calls = 0;
+
+ private:
+
+    void charge()
+    {
+        calls++;
+        uint64_t due = call_ns_ ? latency_now_ns() + call_ns_ : 0;
+        while (call_ns_ && latency_now_ns() < due)
+            ring_cpu_relax();
+    }
+
+    GuestMemory &inner_;
+    uint64_t call_ns_;
+};
+
+// Previous task walk: pid, comm and the next pointer each read from the guest separately
+template <typename F>
+static bool legacy_walk_tasks(GuestMemory &memory, const DwarfIndex &dwarf, F visit)
+{
+    int tasks_offset = dwarf.member_offset("task_struct", "tasks");
+    int pid_offset = dwarf.member_offset("task_struct", "pid");
+    int comm_offset = dwarf.member_offset("task_struct", "comm");
+    uint64_t list_head = memory.symbol("init_task") + tasks_offset;
+    uint64_t next_list_entry = list_head;
+    string name;
+    do
+    {
+        uint64_t va = next_list_entry - tasks_offset;
+        uint32_t pid = 0;
+        memory.read_32(va + pid_offset, &pid);
+        if (!memory.read_str(va + comm_offset, name))
+            return false;
+        visit(va, pid);
+        if (!memory.read_addr(next_list_entry, &next_list_entry))
+            return false;
+    } while (next_list_entry != list_head);
+    return true;
+}
+
+// Task walk plus the files and cred members the registration and checks use, per-field versus bulk reads
+static void bench_task_walks(GuestMemory &dump, const DwarfIndex &dwarf, int rounds, uint64_t call_ns)
+{
+    int files_offset = dwarf.member_offset("task_struct", "files");
+    int cred_offset = dwarf.member_offset("task_struct", "cred");
+    string name = call_ns ? to_string((unsigned long) call_ns) + " ns/access" : "dump";
+
+    CountingMemory legacy(dump, call_ns);
+    unsigned long tasks = 0;
+    double start = now_seconds();
+    for (int r = 0; r < rounds; r++)
+    {
+        legacy_walk_tasks(legacy, dwarf, [&](uint64_t va, uint32_t pid) {
+            uint64_t files = 0, cred = 0;
+            legacy.read_addr(va + files_offset, &files);
+            legacy.read_addr(va + cred_offset, &cred);
+            legacy.translate(va);
+            tasks += (pid | files | cred) != 0;
+        });
+    }
+    double legacy_time = now_seconds() - start;
+
+    CountingMemory bulk(dump, call_ns);
+    start = now_seconds();
+    for (int r = 0; r < rounds; r++)
+    {
+        walk_tasks(bulk, dwarf, [&](const guest_task &task) {
+            uint64_t files = 0, cred = 0;
+            task.field(files_offset, &files);
+            task.field(cred_offset, &cred);
+            bulk.translate(task.va);
+            tasks -= (task.pid | files | cred) != 0;
+        });
+    }
+    double bulk_time = now_seconds() - start;
+
+    printf("Task walk (%s): per-field %.3f ms/pass, %lu accesses; bulk %.3f ms/pass, %lu accesses%s\n",
+        name.c_str(), legacy_time * 1e3 / rounds, legacy.calls / rounds, bulk_time * 1e3 / rounds,
+        bulk.calls / rounds, tasks ? " (MISMATCH)" : "");
+    bench_metric("dump", "per-field task walk " + name, "time", legacy_time * 1e3 / rounds, "ms");
+    bench_metric("dump", "per-field task walk " + name, "accesses", legacy.calls / rounds, "calls");
+    bench_metric("dump", "bulk task walk " + name, "time", bulk_time * 1e3 / rounds, "ms");
+    bench_metric("dump", "bulk task walk " + name, "accesses", bulk.calls / rounds, "calls");
+}
+
+// Offline list walks, watch registration bookkeeping and native checks against a raw memory dump
+static int bench_dump(const char *dump_path, const char *system_map_path, const char *dwarf_path, int rounds)
+{
+    DwarfIndex dwarf;
+    DumpMemory memory;
+    if (!dwarf.load(dwarf_path) || !memory.open(dump_path, system_map_path))
+        return 1;
+    printf("Dump benchmark (%lu MB, %lu symbols, dtb %llx, %d rounds)\n", (unsigned long) (memory.size() >> 20),
+        (unsigned long) memory.symbol_count(), (unsigned long long) memory.dtb(), rounds);
+
+    // Process registration pass as register_processes_events() does it, minus libvmi
+    int task_size = dwarf.struct_size("task_struct");
+    WatchTable<bench_vmi_event> table;
+    WatchSet set;
+    vector<watched_object> vanished;
+    unsigned long tasks = 0;
+    bool ok = true;
+    double start = now_seconds();
+    for (int r = 0; r < rounds && ok; r++)
+    {
+        tasks = 0;
+        set.begin_pass(PROCESS_BENCH_EVENT, ring_timestamp_ns());
+        ok = walk_tasks(memory, dwarf, [&](const guest_task &task) {
+            tasks++;
+            uint64_t pa = memory.translate(task.va);
+            int old_size;
+            if (pa == 0 || !set.observe(PROCESS_BENCH_EVENT, pa, task_size, &old_size))
+                return;
+            bool new_page;
+            for (uint64_t page = pa >> 12; page <= (pa + task_size - 1) >> 12; page++)
+                table.add(page, 0, 64, PROCESS_BENCH_EVENT, pa, &new_page);
+        });
+        set.end_pass(PROCESS_BENCH_EVENT, ring_timestamp_ns(), vanished);
+    }
+    double walk_time = now_seconds() - start;
+    if (!ok)
+        return 1;
+    printf("Process pass:  %lu tasks, %lu pages watched, %.3f ms/pass\n", tasks,
+        (unsigned long) table.page_count(), walk_time * 1e3 / rounds);
+    bench_metric("dump", "process pass", "time", walk_time * 1e3 / rounds, "ms");
+
+    // Page walk in the dump versus a cached translation, per task
+    vector<uint64_t> task_vas;
+    walk_tasks(memory, dwarf, [&](const guest_task &task) { task_vas.push_back(task.va); });
+    TranslationCache cache;
+    translation_walk walk;
+    uint64_t checksum = 0;
+    start = now_seconds();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < task_vas.size(); i++)
+            checksum += memory.translate(task_vas[i]);
+    }
+    double walk_translate_time = now_seconds() - start;
+    for (size_t i = 0; i < task_vas.size(); i++)
+    {
+        walk.pa = memory.translate(task_vas[i], &walk);
+        cache.insert(memory.dtb(), task_vas[i], walk);
+    }
+    uint64_t pa;
+    start = now_seconds();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < task_vas.size(); i++)
+            checksum -= cache.lookup(memory.dtb(), task_vas[i], &pa) ? pa : memory.translate(task_vas[i]);
+    }
+    double cached_translate_time = now_seconds() - start;
+    double translations = (double) rounds * (task_vas.size() ? task_vas.size() : 1);
+    printf("Translate:     walk %.1f ns, cached %.1f ns, %lu page table entries watched%s\n",
+        walk_translate_time / translations * 1e9, cached_translate_time / translations * 1e9,
+        (unsigned long) cache.watched_entries(), checksum ? " (MISMATCH)" : "");
+    bench_metric("dump", "translate walk", "cost", walk_translate_time / translations * 1e9, "ns");
+    bench_metric("dump", "translate cached", "cost", cached_translate_time / translations * 1e9, "ns");
+
+    // Without and with a per-access cost in the range of a libvmi read
+    bench_task_walks(memory, dwarf, rounds, 0);
+    bench_task_walks(memory, dwarf, rounds, 2000);
+
+    unsigned long modules = 0;
+    start = now_seconds();
+    for (int r = 0; r < rounds; r++)
+    {
+        modules = 0;
+        walk_modules(memory, dwarf, [&](const guest_module &module) { modules += memory.translate(module.va) != 0; });
+    }
+    double module_time = now_seconds() - start;
+    printf("Module walk:   %lu modules, %.3f ms/pass\n", modules, module_time * 1e3 / rounds);
+    bench_metric("dump", "module walk", "time", module_time * 1e3 / rounds, "ms");
+
+    typedef bool (*check_fn)(GuestMemory &memory, const DwarfIndex &dwarf, analysis_result &result);
+    static const check_fn checks[] = { native_check_fop, native_check_creds, native_check_afinfo };
+    for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++)
+    {
+        analysis_result result;
+        double seconds = 0;
+        for (int r = 0; r < rounds; r++)
+        {
+            if (!checks[i](memory, dwarf, result))
+                break;
+            seconds += result.seconds;
+        }
+        printf("%-14s %lu findings, %.3f ms/run\n", (result.check + ":").c_str(),
+            (unsigned long) result.findings.size(), seconds * 1e3 / rounds);
+        bench_metric("dump", result.check, "time", seconds * 1e3 / rounds, "ms");
+    }
+
+    return 0;
+}
+
+// Feeds a recorded trace through filter -> ring -> coalescer -> workers, paced as recorded or as fast as possible
+static int bench_replay(const char *trace_path, bool realtime, long analysis_us, unsigned workers)
+{
+    TraceReader trace;
+    if (!trace.open(trace_path))
+    {
+        fprintf(stderr, "Failed to open trace: %s\n", trace_path);
+        return 1;
+    }
+    printf("Replay of %s (%lu records, %s, %ld us per analysis, %u workers)\n", trace_path,
+        (unsigned long) trace.count(), realtime ? "real time" : "max speed", analysis_us, workers);
+
+    SpscRing<naive_event> ring(65536, RING_DROP_NEWEST);
+    EventCoalescer coalescer(250 * 1000000ull, 2000 * 1000000ull);
+    WorkerPool<coalesced_event> pool;
+    atomic<unsigned long> analysed_events(0);
+    pool.start(workers,
+        [&](const coalesced_event &event, unsigned source) {
+            (void) source;
+            analysed_events += event.raw_events;
+            if (analysis_us > 0)
+                usleep(analysis_us);
+        },
+        [&](uint32_t type, unsigned source) { (void) type; (void) source; ring.notify(); });
+
+    // Dispatcher, as the detector's security checking thread runs it
+    struct dispatch_args { SpscRing<naive_event> *ring; EventCoalescer *coalescer; WorkerPool<coalesced_event> *pool; };
+    dispatch_args args = { &ring, &coalescer, &pool };
+    pthread_t dispatcher;
+    pthread_create(&dispatcher, NULL, [](void *arg) -> void * {
+        static const atomic<bool> never(false);
+        dispatch_args *a = (dispatch_args *) arg;
+        dispatch_events(*a->ring, *a->coalescer, *a->pool, never, true);
+        return NULL;
+    }, &args);
+
+    WatchTable<bench_vmi_event> table;
+    map<uint32_t, watch_fields> fields;
+    unsigned long events = 0, watches = 0, unwatches = 0, unwatched_hits = 0, mismatches = 0;
+    const trace_record *records = trace.records();
+    uint64_t first_ns = trace.count() ? records[0].timestamp : 0;
+    double start = now_seconds();
+    double filter_time = 0;
+    for (size_t i = 0; i < trace.count(); i++)
+    {
+        const trace_record &record = records[i];
+        if (realtime)
+        {
+            double due = start + (record.timestamp - first_ns) / 1e9;
+            while (now_seconds() < due)
+                usleep(due - now_seconds() > 0.001 ? 500 : 0);
+        }
+
+        if (record.kind == TRACE_FIELDS)
+        {
+            fields[record.type].add(record.offset, record.end - record.offset);
+            fields[record.type].finalize();
+        }
+        else if (record.kind == TRACE_WATCH)
+        {
+            bool new_page;
+            map<uint32_t, watch_fields>::const_iterator type_fields = fields.find(record.type);
+            table.add(record.gfn, record.offset, record.end, record.type, record.address, &new_page,
+                type_fields != fields.end() ? &type_fields->second : NULL);
+            watches++;
+        }
+        else if (record.kind == TRACE_UNWATCH)
+        {
+            bool found;
+            WatchTable<bench_vmi_event>::page_type *released = table.remove(record.gfn, record.type, record.address, &found);
+            if (released)
+                table.release(released);
+            unwatches++;
+        }
+        else if (record.kind == TRACE_EVENT)
+        {
+            events++;
+            WatchTable<bench_vmi_event>::page_type *page = table.find(record.gfn);
+            if (!page)
+            {
+                unwatched_hits++;
+                continue;
+            }
+
+            // The filter must make the same decision it made when the trace was recorded
+            double filter_start = realtime ? now_seconds() : 0;
+            uint32_t types = filter_event(&ring, page, record.vcpu, record.offset, ring_timestamp_ns(), PAGE_TABLE_BENCH_EVENT);
+            if (realtime)
+                filter_time += now_seconds() - filter_start;
+            mismatches += types != record.type;
+        }
+    }
+    double feed_time = now_seconds() - start;
+    if (!realtime)
+        filter_time = feed_time;
+
+    ring.close();
+    pthread_join(dispatcher, NULL);
+    double total_time = now_seconds() - start;
+    pool.stop();
+    worker_stats stats = pool.stats();
+
+    printf("Records:    %lu events, %lu watches, %lu unwatches\n", events, watches, unwatches);
+    printf("Filter:     %.1f ns/event, %.2f M events/s\n", events ? filter_time / events * 1e9 : 0.0,
+        filter_time > 0 ? events / filter_time / 1e6 : 0.0);
+    printf("Pipeline:   fed in %.3f s, drained in %.3f s, %lu dropped\n", feed_time, total_time, ring.dropped());
+    string mode = realtime ? "realtime" : "fast";
+    bench_metric("replay", mode, "filter", events ? filter_time / events * 1e9 : 0.0, "ns/event");
+    bench_metric("replay", mode, "drain", total_time, "s");
+    bench_metric("replay", mode, "dropped", ring.dropped(), "events");
+    printf("Analyses:   %lu covering %lu raw events, at most %u in parallel\n", stats.completed,
+        analysed_events.load(), stats.max_parallel);
+    if (unwatched_hits || mismatches)
+        printf("Divergence: %lu events on unwatched pages, %lu filter mismatches\n", unwatched_hits, mismatches);
+
+    return mismatches == 0 && unwatched_hits == 0 ? 0 : 1;
+}
+
+// Several producers on the legacy Deque, as several vCPU callbacks would push into it
+struct contention_args
+{
+    Deque<uint64_t> *deque;
+    long events;
+};
+
+static void *contention_producer(void *arg)
+{
+    contention_args *args = (contention_args *) arg;
+    for (long i = 0; i < args->events; i++)
+        args->deque->push_back(ring_timestamp_ns());
+    args->deque->push_back(0);
+    return NULL;
+}
+
+static int bench_contention(int producers, long events)
+{
+    printf("Deque contention benchmark (%d producers, %ld events each)\n", producers, events);
+
+    Deque<uint64_t> deque;
+    vector<contention_args> args(producers);
+    vector<pthread_t> threads(producers);
+    LatencyHistogram queue_latency;
+
+    unsigned long allocations = bench_allocations.load();
+    double start = now_seconds();
+    for (int i = 0; i < producers; i++)
+    {
+        args[i].deque = &deque;
+        args[i].events = events;
+        pthread_create(&threads[i], NULL, contention_producer, &args[i]);
+    }
+
+    // Push -> pop latency as seen by the single consumer; 0 marks a finished producer
+    long consumed = 0;
+    for (int finished = 0; finished < producers;)
+    {
+        uint64_t pushed = deque.pop();
+        if (pushed == 0)
+        {
+            finished++;
+            continue;
+        }
+        queue_latency.record(ring_timestamp_ns() - pushed);
+        consumed++;
+    }
+    double total_time = now_seconds() - start;
+    for (int i = 0; i < producers; i++)
+        pthread_join(threads[i], NULL);
+    allocations = bench_allocations.load() - allocations;
+
+    latency_snapshot snapshot;
+    snapshot.reset();
+    queue_latency.merge_into(snapshot);
+    printf("Consumed %ld events: %.2f M events/s, %.3f allocations/event\n", consumed,
+        consumed / total_time / 1e6, (double) allocations / consumed);
+    snapshot.print("push -> pop");
+
+    string name = to_string(producers) + " producers";
+    bench_metric("contention", name, "throughput", consumed / total_time / 1e6, "Mevents/s");
+    bench_metric("contention", name, "allocations", (double) allocations / consumed, "allocs/event");
+    bench_percentiles("contention", name, snapshot);
+
+    return consumed == producers * events ? 0 : 1;
+}
+
+// Watches objects of object_size placed every stride bytes from gfn 0x100000, as slab objects sit
+template <typename Event>
+static void populate_watch_table(WatchTable<Event> &table, long objects, int object_size, int stride,
+    const watch_fields *fields = NULL)
+{
+    bool new_page;
+    uint64_t base = 0x100000ull << WATCH_PAGE_SHIFT;
+    for (long i = 0; i < objects; i++)
+    {
+        uint64_t physical_addr = base + i * stride;
+        uint64_t end_addr = physical_addr + object_size;
+        for (uint64_t page_base = physical_addr & ~(WATCH_PAGE_SIZE - 1); page_base < end_addr; page_base += WATCH_PAGE_SIZE)
+        {
+            uint32_t start = physical_addr > page_base ? physical_addr - page_base : 0;
+            uint32_t end = end_addr - page_base < WATCH_PAGE_SIZE ? end_addr - page_base : WATCH_PAGE_SIZE;
+            typename WatchTable<Event>::page_type *page = table.add(page_base >> WATCH_PAGE_SHIFT, start, end,
+                PROCESS_BENCH_EVENT, physical_addr, &new_page, fields);
+            page->event.data = page;
+        }
+    }
+}
+
+// Runs events random writes over the watched pages through the filter, returns the relevant ones
+static unsigned long run_filter(const WatchTable<bench_vmi_event> &table, long events, double *seconds, unsigned long *allocations)
+{
+    // Precomputed write targets so the loop measures the filter, not the generator
+    uint64_t pages = table.page_count();
+    vector<uint64_t> targets(1 << 16);
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        targets[i] = ((0x100000 + seed % pages) << WATCH_PAGE_SHIFT) | ((seed >> 32) & (WATCH_PAGE_SIZE - 8));
+    }
+
+    unsigned long hits = 0;
+    *allocations = bench_allocations.load();
+    double start = now_seconds();
+    for (long i = 0; i < events; i++)
+    {
+        uint64_t target = targets[i & (targets.size() - 1)];
+        WatchTable<bench_vmi_event>::page_type *page = table.find(target >> WATCH_PAGE_SHIFT);
+        if (page && filter_event((SpscRing<naive_event> *) NULL, page, 0, target & (WATCH_PAGE_SIZE - 1), 0) != 0)
+            hits++;
+    }
+    *seconds = now_seconds() - start;
+    *allocations = bench_allocations.load() - *allocations;
+    return hits;
+}
+
+// mem_write_cb's filter on its own: page lookup, relevance bit and range match, no ring
+static int bench_filter(long objects, long events)
+{
+    // task_struct of the bundled module.dwarf: 2384 bytes, watched whole or only its security relevant members
+    const int task_size = 2384;
+    watch_fields task_fields;
+    task_fields.add(640, 16);     // tasks
+    task_fields.add(820, 8);      // pid, tgid
+    task_fields.add(840, 16);     // real_parent, parent
+    task_fields.add(1248, 32);    // real_cred, cred, comm
+    task_fields.add(1496, 8);     // files
+    task_fields.finalize();
+
+    printf("Event filter benchmark (%ld task_structs, %ld random writes)\n", objects, events);
+    const char *names[] = { "whole object", "fields" };
+    const watch_fields *masks[] = { NULL, &task_fields };
+    for (int m = 0; m < 2; m++)
+    {
+        WatchTable<bench_vmi_event> table;
+        populate_watch_table(table, objects, task_size, task_size, masks[m]);
+
+        double seconds;
+        unsigned long allocations;
+        unsigned long hits = run_filter(table, events, &seconds, &allocations);
+        printf("%-13s %.1f ns/event, %.2f%% relevant, %.3f allocations/event\n", (string(names[m]) + ":").c_str(),
+            seconds / events * 1e9, 100.0 * hits / events, (double) allocations / events);
+        bench_metric("filter", names[m], "cost", seconds / events * 1e9, "ns/event");
+        bench_metric("filter", names[m], "relevant", 100.0 * hits / events, "%");
+        bench_metric("filter", names[m], "allocations", (double) allocations / events, "allocs/event");
+    }
+
+    return 0;
+}
+
+// push_vmi_event/pop_vmi_event (naive-event-list.h) against the slab pool that replaced it
+static int bench_event_list(long events, int rounds)
+{
+    printf("Event list benchmark (%ld events, %d rounds)\n", events, rounds);
+
+    vector<vmi_event_t> vmi_events(events);
+    unsigned long allocations = bench_allocations.load();
+    double start = now_seconds();
+    unsigned long popped = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        struct vmi_event_node *head = NULL;
+        for (long i = 0; i < events; i++)
+            push_vmi_event(&head, &vmi_events[i]);
+        while (pop_vmi_event(&head) != NULL)
+            popped++;
+    }
+    double list_time = now_seconds() - start;
+    unsigned long list_allocations = bench_allocations.load() - allocations;
+
+    SlabPool<vmi_event_t> pool;
+    vector<pool_handle> handles(events);
+    allocations = bench_allocations.load();
+    start = now_seconds();
+    unsigned long freed = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        for (long i = 0; i < events; i++)
+            pool.alloc(&handles[i])->mem_event.gfn = i;
+        for (long i = 0; i < events; i++)
+            freed += pool.free(handles[i]);
+    }
+    double pool_time = now_seconds() - start;
+    unsigned long pool_allocations = bench_allocations.load() - allocations;
+
+    double total = (double) events * rounds;
+    printf("Linked list push/pop: %.1f ns/event, %.3f allocations/event\n", list_time / total * 1e9, list_allocations / total);
+    printf("Slab pool alloc/free: %.1f ns/event, %.3f allocations/event\n", pool_time / total * 1e9, pool_allocations / total);
+    bench_metric("event-list", "linked list push/pop", "cost", list_time / total * 1e9, "ns/event");
+    bench_metric("event-list", "linked list push/pop", "allocations", list_allocations / total, "allocs/event");
+    bench_metric("event-list", "slab pool alloc/free", "cost", pool_time / total * 1e9, "ns/event");
+    bench_metric("event-list", "slab pool alloc/free", "allocations", pool_allocations / total, "allocs/event");
+
+    return popped == freed ? 0 : 1;
+}
+
+/////////////////////
+// Event Storm
+/////////////////////
+// The whole detector pipeline on the fake libvmi: callback -> filter -> ring -> coalescer -> workers
+
+typedef WatchTable<vmi_event_t>::page_type storm_page;
+
+// Guest of the benchmarks' write callbacks, with hooks for handle_page_write (naive-callback.h) in place of
+// the detector's counters and trace
+struct bench_guest : RingAligned
+{
+    bench_guest() : event_ring(65536, RING_DROP_NEWEST) {}
+
+    SpscRing<naive_event> event_ring;
+    ResponseStrategy *response = NULL;
+    LatencyHistogram *callback_latency = NULL;
+    unsigned long hits = 0;                                     // Writes that hit a watched field
+    void (*relevant_write)(storm_page *page, uint32_t offset) = NULL;
+};
+
+static void write_filtered(bench_guest &guest, storm_page *page, vmi_event_t *event, uint64_t timestamp, uint32_t hit_types)
+{
+    (void) timestamp;
+    if (hit_types == 0)
+        return;
+    guest.hits++;
+    if (guest.relevant_write)
+        guest.relevant_write(page, event->mem_event.offset);
+}
+
+// The benchmarks record no trace
+static void write_traced(bench_guest &guest, storm_page *page, vmi_event_t *event, uint64_t timestamp, uint32_t hit_types)
+{
+    (void) guest;
+    (void) page;
+    (void) event;
+    (void) timestamp;
+    (void) hit_types;
+}
+
+static void write_timed(bench_guest &guest, uint32_t hit_types, uint64_t ns)
+{
+    (void) hit_types;
+    guest.callback_latency->record(ns);
+}
+
+// Guest whose fake vmi_events_listen() runs on this thread, as in naive-hawk.cpp
+static thread_local bench_guest *bench_listening_guest = NULL;
+
+// mem_write_cb of naive-hawk.cpp on the benchmark guests, untraced; Response is the guest's strategy, or
+// ResponseStrategy to call whichever it has through the vtable
+template <bool Monitoring, bool Timed, typename Response>
+static event_response_t bench_write_cb(vmi_instance_t vmi, vmi_event_t *event)
+{
+    return handle_page_write<PAGE_TABLE_BENCH_EVENT>(fixed_write_modes<Monitoring, Timed, false, Response>(),
+        *bench_listening_guest, vmi, event);
+}
+
+static int bench_storm(long events, long objects, unsigned workers)
+{
+    const int task_size = 0x1c80;
+    vmi_instance_t vmi = fake_vmi_create();
+    WatchTable<vmi_event_t> table;
+    populate_watch_table(table, objects, task_size, task_size);
+    for (uint64_t gfn = 0x100000; gfn < 0x100000 + table.page_count(); gfn++)
+    {
+        storm_page *page = table.find(gfn);
+        SETUP_MEM_EVENT(&page->event, gfn, VMI_MEMACCESS_W, (bench_write_cb<true, true, StepResponse>), 0);
+        page->event.data = page;
+        vmi_register_event(vmi, &page->event);
+    }
+    printf("Event storm benchmark (%ld events on %lu pages, %u workers)\n", events,
+        (unsigned long) vmi->events.size(), workers);
+
+    // The detector's defaults: monitoring, timed, step response
+    bench_guest guest;
+    StepResponse response;
+    LatencyHistogram callback_latency;
+    guest.response = &response;
+    guest.callback_latency = &callback_latency;
+    bench_listening_guest = &guest;
+    SpscRing<naive_event> &ring = guest.event_ring;
+    EventCoalescer coalescer(1000000ull, 10 * 1000000ull);
+    WorkerPool<coalesced_event> pool;
+    LatencyRecorder<1> analysis_delay;
+    atomic<unsigned long> analysed_events(0);
+    pool.start(workers,
+        [&](const coalesced_event &event, unsigned source) {
+            (void) source;
+            analysis_delay.record(0, ring_timestamp_ns() - event.first_seen);
+            analysed_events += event.raw_events;
+        },
+        [&](uint32_t type, unsigned source) { (void) type; (void) source; ring.notify(); });
+
+    struct dispatch_args { SpscRing<naive_event> *ring; EventCoalescer *coalescer; WorkerPool<coalesced_event> *pool; };
+    dispatch_args args = { &ring, &coalescer, &pool };
+    pthread_t dispatcher;
+    pthread_create(&dispatcher, NULL, [](void *arg) -> void * {
+        static const atomic<bool> never(false);
+        dispatch_args *a = (dispatch_args *) arg;
+        dispatch_events(*a->ring, *a->coalescer, *a->pool, never, true);
+        return NULL;
+    }, &args);
+
+    // Writes land anywhere on the watched pages, spread over 4 vCPUs
+    uint64_t pages = vmi->events.size();
+    uint64_t seed = 0x2545f4914f6cdd1dull;
+    unsigned long allocations = bench_allocations.load();
+    unsigned long callback_allocations = bench_thread_allocations;
+    double start = now_seconds();
+    for (long i = 0; i < events; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        fake_vmi_write(vmi, 0x100000 + seed % pages, (seed >> 32) & (WATCH_PAGE_SIZE - 8), i & 3);
+    }
+    double feed_time = now_seconds() - start;
+    callback_allocations = bench_thread_allocations - callback_allocations;
+
+    ring.close();
+    pthread_join(dispatcher, NULL);
+    double total_time = now_seconds() - start;
+    pool.stop();
+    allocations = bench_allocations.load() - allocations;
+    worker_stats stats = pool.stats();
+
+    latency_snapshot callback, delay;
+    callback.reset();
+    callback_latency.merge_into(callback);
+    analysis_delay.snapshot(0, delay);
+
+    printf("Delivered %lu events (%lu cleared, %lu stepped) in %.3f s: %.2f M events/s\n", vmi->delivered,
+        vmi->cleared, vmi->stepped, feed_time, vmi->delivered / feed_time / 1e6);
+    // The callback runs on this thread; the rest is the dispatcher's coalescing (one map node per object
+    // of a batch) and the hand-off to the workers
+    printf("Drained in %.3f s, %lu dropped, %lu analyses covering %lu raw events\n",
+        total_time, ring.dropped(), stats.completed, analysed_events.load());
+    printf("Allocations: %.3f/event, %.3f/event in the callback, %.1f/analysis after it\n", (double) allocations / events,
+        (double) callback_allocations / events, stats.completed ? (double) (allocations - callback_allocations) / stats.completed : 0.0);
+    callback.print("callback");
+    delay.print("event -> analysis");
+
+    bench_metric("storm", "pipeline", "throughput", vmi->delivered / feed_time / 1e6, "Mevents/s");
+    bench_metric("storm", "pipeline", "dropped", ring.dropped(), "events");
+    bench_metric("storm", "pipeline", "allocations", (double) allocations / events, "allocs/event");
+    bench_metric("storm", "callback", "allocations", (double) callback_allocations / events, "allocs/event");
+    bench_percentiles("storm", "callback", callback);
+    bench_percentiles("storm", "event -> analysis", delay);
+
+    bench_listening_guest = NULL;
+    fake_vmi_destroy(vmi);
+    return 0;
+}
+
+/////////////////////
+// Simulated Guests
+/////////////////////
+// Several guests in one process, as naive-hawk monitors them: an event loop thread and a dispatcher per
+// guest, one DWARF index shared through DwarfRegistry and one worker pool shared by all of them
+
+struct sim_guest : bench_guest
+{
+    sim_guest() : coalescer(1000000ull, 10 * 1000000ull) {}
+
+    unsigned index;
+    vmi_instance_t vmi;
+    WatchTable<vmi_event_t> table;
+    StepResponse step;
+    EventCoalescer coalescer;
+    WorkerPool<coalesced_event> *pool;
+    LatencyRecorder<1> analysis_delay;
+    long events;
+    double feed_time;
+    pthread_t event_thread;
+    pthread_t dispatcher;
+};
+
+static void *sim_event_loop(void *arg)
+{
+    sim_guest *guest = (sim_guest *) arg;
+    bench_listening_guest = guest;
+
+    uint64_t pages = guest->vmi->events.size();
+    uint64_t seed = 0x2545f4914f6cdd1dull + guest->index;
+    double start = now_seconds();
+    for (long i = 0; i < guest->events; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        fake_vmi_write(guest->vmi, 0x100000 + seed % pages, (seed >> 32) & (WATCH_PAGE_SIZE - 8), i & 3);
+    }
+    guest->feed_time = now_seconds() - start;
+    guest->event_ring.close();
+    return NULL;
+}
+
+static void *sim_dispatcher(void *arg)
+{
+    static const atomic<bool> never(false);
+    sim_guest *guest = (sim_guest *) arg;
+    dispatch_events(guest->event_ring, guest->coalescer, *guest->pool, never, true, guest->index);
+    return NULL;
+}
+
+// Guest 0 is a noisy neighbour writing 4x as much as the others
+static int bench_guests(unsigned guest_count, long events, unsigned workers, long analysis_us)
+{
+    if (guest_count == 0 || guest_count > WORKER_MAX_SOURCES)
+    {
+        fprintf(stderr, "Guests must be between 1 and %d\n", WORKER_MAX_SOURCES);
+        return 1;
+    }
+    printf("Simulated guests benchmark (%u guests, %ld events each, 4x on guest 0, %u workers, %ld us per analysis)\n",
+        guest_count, events, workers, analysis_us);
+
+    // Guests of one kernel build share its index; only the first load reads the file
+    if (access("module.dwarf", R_OK) == 0)
+    {
+        DwarfRegistry registry;
+        double start = now_seconds();
+        registry.load("module.dwarf");
+        double first_load = now_seconds() - start;
+        start = now_seconds();
+        for (unsigned i = 1; i < guest_count; i++)
+            registry.load("module.dwarf");
+        double later_loads = guest_count > 1 ? (now_seconds() - start) / (guest_count - 1) : 0.0;
+        printf("DWARF: %lu index for %u guests, first load %.3f ms, later loads %.3f us\n",
+            (unsigned long) registry.size(), guest_count, first_load * 1e3, later_loads * 1e6);
+        bench_metric("guests", "dwarf", "shared_load", later_loads * 1e6, "us");
+    }
+
+    WorkerPool<coalesced_event> pool;
+    vector<sim_guest *> guests;
+    for (unsigned i = 0; i < guest_count; i++)
+    {
+        sim_guest *guest = new sim_guest();
+        guest->index = i;
+        guest->vmi = fake_vmi_create();
+        guest->response = &guest->step;
+        guest->pool = &pool;
+        guest->events = i == 0 ? events * 4 : events;
+        populate_watch_table(guest->table, 500, 0x1c80, 0x1c80);
+        for (uint64_t gfn = 0x100000; gfn < 0x100000 + guest->table.page_count(); gfn++)
+        {
+            storm_page *page = guest->table.find(gfn);
+            SETUP_MEM_EVENT(&page->event, gfn, VMI_MEMACCESS_W, (bench_write_cb<true, false, StepResponse>), 0);
+            page->event.data = page;
+            vmi_register_event(guest->vmi, &page->event);
+        }
+        guests.push_back(guest);
+    }
+
+    pool.start(workers,
+        [&](const coalesced_event &event, unsigned source) {
+            guests[source]->analysis_delay.record(0, ring_timestamp_ns() - event.first_seen);
+            if (analysis_us > 0)
+                usleep(analysis_us);
+        },
+        [&](uint32_t type, unsigned source) { (void) type; guests[source]->event_ring.notify(); });
+
+    double start = now_seconds();
+    for (unsigned i = 0; i < guest_count; i++)
+    {
+        pthread_create(&guests[i]->dispatcher, NULL, sim_dispatcher, guests[i]);
+        pthread_create(&guests[i]->event_thread, NULL, sim_event_loop, guests[i]);
+    }
+    for (unsigned i = 0; i < guest_count; i++)
+    {
+        pthread_join(guests[i]->event_thread, NULL);
+        pthread_join(guests[i]->dispatcher, NULL);
+    }
+    double total_time = now_seconds() - start;
+    pool.stop();
+
+    printf("%-6s %10s %10s %9s %10s %12s %12s %12s\n", "Guest", "Events", "Mevents/s", "Dropped", "Analyses",
+        "Wait avg ms", "Wait max ms", "Delay p99 ms");
+    unsigned long delivered = 0;
+    double quiet_max_wait = 0, quiet_worst_p99 = 0;
+    for (unsigned i = 0; i < guest_count; i++)
+    {
+        sim_guest &guest = *guests[i];
+        worker_source_stats source = pool.source_stats(i);
+        latency_snapshot delay;
+        guest.analysis_delay.snapshot(0, delay);
+        double p99 = delay.percentile(0.99) / 1e6;
+        printf("%-6u %10lu %10.2f %9lu %10lu %12.3f %12.3f %12.3f\n", i, guest.vmi->delivered,
+            guest.vmi->delivered / guest.feed_time / 1e6, guest.event_ring.dropped(), source.completed,
+            source.completed ? source.wait_ns / 1e6 / source.completed : 0.0, source.max_wait_ns / 1e6, p99);
+        delivered += guest.vmi->delivered;
+        if (i != 0)
+        {
+            quiet_max_wait = max(quiet_max_wait, source.max_wait_ns / 1e6);
+            quiet_worst_p99 = max(quiet_worst_p99, p99);
+        }
+    }
+    printf("Total %lu events in %.3f s: %.2f M events/s\n", delivered, total_time, delivered / total_time / 1e6);
+
+    string name = to_string(guest_count) + " guests";
+    bench_metric("guests", name, "throughput", delivered / total_time / 1e6, "Mevents/s");
+    if (guest_count > 1)
+    {
+        bench_metric("guests", name, "quiet_max_wait", quiet_max_wait, "ms");
+        bench_metric("guests", name, "quiet_delay_p99", quiet_worst_p99, "ms");
+    }
+
+    for (unsigned i = 0; i < guest_count; i++)
+    {
+        fake_vmi_destroy(guests[i]->vmi);
+        delete guests[i];
+    }
+    return 0;
+}
+
+/////////////////////
+// Analysis Priority
+/////////////////////
+// A storm of process analyses from many guests with a module analysis now and then: its queue wait with
+// the FIFO pool against per-type priorities in a bounded queue that drops the oldest process analyses
+
+// An analysis of one raw event of type, submitted now
+static coalesced_event priority_job(uint32_t type)
+{
+    coalesced_event job;
+    job.type = type;
+    job.raw_events = 1;
+    job.first_seen = job.last_seen = ring_timestamp_ns();
+    return job;
+}
+
+static int run_priority(bool prioritised, unsigned sources, long modules, unsigned workers, long analysis_us,
+    size_t capacity, latency_snapshot &module_wait, worker_type_stats &process, size_t *max_queued)
+{
+    WorkerPool<coalesced_event> pool;
+    if (prioritised)
+    {
+        pool.set_priority(MODULE_BENCH_EVENT, 0);
+        pool.set_priority(PROCESS_BENCH_EVENT, 1);
+        pool.set_full_policy(PROCESS_BENCH_EVENT, WORKER_FULL_DROP_OLDEST);
+        pool.set_capacity(capacity);
+        pool.set_aging(100 * analysis_us * 1000ull);
+    }
+
+    LatencyRecorder<1> waits;
+    pool.start(workers,
+        [&](const coalesced_event &event, unsigned source) {
+            (void) source;
+            if (event.type == MODULE_BENCH_EVENT)
+                waits.record(0, ring_timestamp_ns() - event.first_seen);
+            if (analysis_us > 0)
+                usleep(analysis_us);
+        },
+        [](uint32_t type, unsigned source) { (void) type; (void) source; });
+
+    // Every idle guest resubmits its process analysis at once; a module analysis every few rounds
+    *max_queued = 0;
+    long submitted_modules = 0;
+    for (unsigned long round = 0; submitted_modules < modules; round++)
+    {
+        for (unsigned source = 0; source < sources; source++)
+            pool.submit(PROCESS_BENCH_EVENT, priority_job(PROCESS_BENCH_EVENT), source);
+        if (round % 8 == 7)
+            submitted_modules += pool.submit(MODULE_BENCH_EVENT, priority_job(MODULE_BENCH_EVENT), round % sources);
+        *max_queued = max(*max_queued, pool.queued());
+        usleep(analysis_us / 4 + 1);
+    }
+    pool.wait_idle();
+    pool.stop();
+
+    waits.snapshot(0, module_wait);
+    process = pool.type_stats(PROCESS_BENCH_EVENT);
+    return pool.type_stats(MODULE_BENCH_EVENT).dropped == 0 && (size_t) module_wait.count == (size_t) modules ? 0 : 1;
+}
+
+// One worker held on a first job while process analyses from other guests age well past priority 0 and a module
+// analysis arrives: the module analysis must still run first, and the aged ones before a fresh process analysis
+static bool priority_order_holds(uint64_t aging_ns)
+{
+    WorkerPool<coalesced_event> pool;
+    pool.set_priority(MODULE_BENCH_EVENT, 0);
+    pool.set_priority(PROCESS_BENCH_EVENT, 2);
+    pool.set_aging(aging_ns);
+
+    atomic<bool> release(false);
+    vector<pair<uint32_t, unsigned> > order;
+    pool.start(1,
+        [&](const coalesced_event &event, unsigned source) {
+            if (order.empty())
+                while (!release.load())
+                    usleep(100);
+            order.push_back(make_pair(event.type, source));
+        },
+        [](uint32_t type, unsigned source) { (void) type; (void) source; });
+
+    pool.submit(PROCESS_BENCH_EVENT, priority_job(PROCESS_BENCH_EVENT), 0);
+    while (pool.queued() != 0)
+        usleep(100);
+    for (unsigned source = 1; source <= 3; source++)
+        pool.submit(PROCESS_BENCH_EVENT, priority_job(PROCESS_BENCH_EVENT), source);
+    usleep(aging_ns * 5 / 1000);
+    pool.submit(MODULE_BENCH_EVENT, priority_job(MODULE_BENCH_EVENT), 4);
+    pool.submit(PROCESS_BENCH_EVENT, priority_job(PROCESS_BENCH_EVENT), 5);
+    release = true;
+    pool.wait_idle();
+    pool.stop();
+
+    return order.size() == 6 && order[1].first == MODULE_BENCH_EVENT && order[5].second == 5;
+}
+
+static int bench_priority(unsigned sources, long modules, unsigned workers, long analysis_us)
+{
+    const size_t capacity = 16;
+    printf("Analysis priority benchmark (%u guests storming process analyses, %ld module analyses, %u workers, %ld us per analysis)\n",
+        sources, modules, workers, analysis_us);
+
+    int failures = 0;
+    double p99[2] = { 0, 0 };
+    const char *names[] = { "fifo", "priority" };
+    for (int prioritised = 0; prioritised < 2; prioritised++)
+    {
+        latency_snapshot wait;
+        worker_type_stats process;
+        size_t max_queued;
+        failures += run_priority(prioritised, sources, modules, workers, analysis_us, capacity, wait, process, &max_queued);
+        p99[prioritised] = wait.percentile(0.99) / 1e6;
+        printf("%-9s module wait p50 %.3f ms, p99 %.3f ms, max %.3f ms; %lu process analyses run, %lu dropped, queue at most %lu\n",
+            (string(names[prioritised]) + ":").c_str(), wait.percentile(0.5) / 1e6, p99[prioritised], wait.max / 1e6,
+            process.completed, process.dropped, (unsigned long) max_queued);
+        bench_metric("priority", names[prioritised], "module_wait_p99", p99[prioritised], "ms");
+        bench_metric("priority", names[prioritised], "process_dropped", process.dropped, "jobs");
+        if (prioritised && max_queued > capacity)
+            failures++;
+    }
+
+    // A module analysis waits for at most the running ones once it outranks the storm
+    if (p99[1] >= p99[0])
+        failures++;
+
+    bool ordered = priority_order_holds(2000000ull);
+    printf("Aged process analyses stop at priority 0, behind a module analysis: %s\n", ordered ? "yes" : "NO");
+    failures += !ordered;
+    return failures ? 1 : 0;
+}
+
+/////////////////////
+// Write Responses
+/////////////////////
+// Exits, p2m changes and callback latency of each ResponseStrategy on the fake libvmi
+
+static int bench_response(long events, long objects)
+{
+    static const response_kind kinds[] = { RESPONSE_STEP, RESPONSE_EMULATE, RESPONSE_ALTP2M };
+    const int task_size = 0x1c80;
+    printf("Write response benchmark (%ld writes over %ld task_structs)\n", events, objects);
+    printf("%-8s %10s %10s %10s %10s %10s %10s %10s\n", "Response", "Exits", "Exits/wr", "P2M/wr", "Views/wr",
+        "p50 ns", "p99 ns", "Max ns");
+
+    int failures = 0;
+    unsigned long expected_hits = 0;
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++)
+    {
+        // The callback without the ring: every strategy answers the same filtered writes
+        vmi_instance_t vmi = fake_vmi_create();
+        ResponseStrategy *response_strategy = make_response_strategy(kinds[k]);
+        if (!response_strategy->setup(vmi))
+        {
+            printf("%-8s setup failed\n", response_strategy->name());
+            delete response_strategy;
+            fake_vmi_destroy(vmi);
+            failures++;
+            continue;
+        }
+
+        // Registered the way watch_object() does, so only the writes count below
+        WatchTable<vmi_event_t> table;
+        populate_watch_table(table, objects, task_size, task_size);
+        for (uint64_t gfn = 0x100000; gfn < 0x100000 + table.page_count(); gfn++)
+        {
+            storm_page *page = table.find(gfn);
+            memset(&page->event, 0, sizeof(page->event));
+            SETUP_MEM_EVENT(&page->event, gfn, VMI_MEMACCESS_W, (bench_write_cb<false, true, ResponseStrategy>), 0);
+            page->event.data = page;
+            response_strategy->prepare(&page->event);
+            vmi_register_event(vmi, &page->event);
+        }
+        unsigned long setup_p2m = vmi->p2m_updates;
+
+        bench_guest guest;
+        LatencyHistogram callback_latency;
+        guest.response = response_strategy;
+        guest.callback_latency = &callback_latency;
+        bench_listening_guest = &guest;
+        uint64_t pages = vmi->events.size();
+        uint64_t seed = 0x2545f4914f6cdd1dull;
+        for (long i = 0; i < events; i++)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            fake_vmi_write(vmi, 0x100000 + seed % pages, (seed >> 32) & (WATCH_PAGE_SIZE - 8), i & 3);
+        }
+
+        // Every strategy must see the same writes and leave each page event on the watched view
+        if (k == 0)
+            expected_hits = guest.hits;
+        bool consistent = guest.hits == expected_hits && vmi->delivered == (unsigned long) events;
+        table.for_each_page([&](storm_page *page) {
+            response_strategy->prepare(&page->event);
+            if (page->event.slat_id != (kinds[k] == RESPONSE_ALTP2M ? 1 : 0))
+                consistent = false;
+        });
+        if (!consistent)
+        {
+            printf("%-8s saw %lu relevant writes of %lu delivered, expected %lu\n", response_strategy->name(),
+                guest.hits, vmi->delivered, expected_hits);
+            failures++;
+        }
+
+        latency_snapshot callback;
+        callback.reset();
+        callback_latency.merge_into(callback);
+        unsigned long exits = fake_vmi_exits(vmi);
+        double writes = vmi->delivered;
+        printf("%-8s %10lu %10.2f %10.2f %10.2f %10lu %10lu %10lu\n", response_strategy->name(), exits, exits / writes,
+            (vmi->p2m_updates - setup_p2m) / writes, vmi->view_switches / writes, (unsigned long) callback.percentile(0.50),
+            (unsigned long) callback.percentile(0.99), (unsigned long) callback.max);
+
+        string name = response_strategy->name();
+        bench_metric("response", name, "exits", exits / writes, "exits/write");
+        bench_metric("response", name, "p2m_updates", (vmi->p2m_updates - setup_p2m) / writes, "updates/write");
+        bench_metric("response", name, "view_switches", vmi->view_switches / writes, "switches/write");
+        bench_percentiles("response", name, callback);
+
+        response_strategy->teardown(vmi);
+        delete response_strategy;
+        bench_listening_guest = NULL;
+        fake_vmi_destroy(vmi);
+    }
+    return failures ? 1 : 0;
+}
+
+/////////////////////
+// Adaptive Polling
+/////////////////////
+// Simulated guest time: a few slab pages take a storm of irrelevant writes while security relevant writes
+// land anywhere. Counts exits and relevant write detection latency, trapping only versus adaptive.
+
+struct adaptive_sim
+{
+    vmi_instance_t vmi;
+    WatchTable<vmi_event_t> *table;
+    AdaptiveController *adaptive;
+    vector<uint64_t> memory;                          // Guest words of the watched pages, from gfn 0x100000
+    unordered_map<uint64_t, uint64_t> pending;        // Physical address -> time of its first undetected relevant write
+    LatencyHistogram *detection;
+    uint64_t now;
+    unsigned long detected;
+};
+
+static adaptive_sim *adaptive_state;
+
+static void adaptive_detect(storm_page *page, uint32_t offset)
+{
+    adaptive_sim &sim = *adaptive_state;
+    unordered_map<uint64_t, uint64_t>::iterator it = sim.pending.find((page->gfn << WATCH_PAGE_SHIFT) + offset);
+    if (it == sim.pending.end())
+        return;
+    sim.detection->record(sim.now - it->second);
+    sim.detected++;
+    sim.pending.erase(it);
+}
+
+// adapt_page_watches' guest side on the fake libvmi and the simulated memory
+struct adaptive_host
+{
+    adaptive_sim &sim;
+
+    bool read(storm_page *page, uint64_t *contents)
+    {
+        memcpy(contents, &sim.memory[(page->gfn - 0x100000) * 512], WATCH_PAGE_SIZE);
+        return true;
+    }
+
+    bool untrap(storm_page *page)
+    {
+        fake_vmi_unregister(sim.vmi, &page->event);
+        return true;
+    }
+
+    bool trap(storm_page *page)
+    {
+        return vmi_register_event(sim.vmi, &page->event) == VMI_SUCCESS;
+    }
+
+    void poll(storm_page *page, uint64_t now)
+    {
+        sim.adaptive->poll(page->gfn, &sim.memory[(page->gfn - 0x100000) * 512], page->relevant, now,
+            [page](uint32_t offset) { adaptive_detect(page, offset); });
+    }
+};
+
+// The event loop's turn, as adapt_watches() in naive-hawk.cpp takes it
+static void adaptive_step(adaptive_sim &sim)
+{
+    adaptive_host host = { sim };
+    adapt_page_watches(*sim.adaptive, *sim.table, PAGE_TABLE_BENCH_EVENT, sim.now, host);
+}
+
+static int bench_adaptive(long seconds, int hot_pages, long hot_rate)
+{
+    const int task_size = 2384;
+    const long objects = 2000;
+    const long relevant_rate = 200;     // Security relevant writes per second, over all pages
+    watch_fields task_fields;
+    task_fields.add(640, 16);
+    task_fields.add(820, 8);
+    task_fields.add(840, 16);
+    task_fields.add(1248, 32);
+    task_fields.add(1496, 8);
+    task_fields.finalize();
+
+    printf("Adaptive polling benchmark (%ld s simulated, %d pages at %ld irrelevant writes/s, %ld relevant writes/s)\n",
+        seconds, hot_pages, hot_rate, relevant_rate);
+    printf("%-10s %12s %10s %10s %10s %12s %12s %12s\n", "Mode", "Exits", "Exits/s", "Switches", "Missed",
+        "Detect p50", "Detect p99", "Detect max");
+
+    int failures = 0;
+    for (int mode = 0; mode < 2; mode++)
+    {
+        WatchTable<vmi_event_t> table;
+        populate_watch_table(table, objects, task_size, task_size, &task_fields);
+        AdaptiveController adaptive;
+        adaptive.configure(mode == 0 ? 0 : ADAPTIVE_POLL_THRESHOLD, ADAPTIVE_POLL_INTERVAL_MS * 1000000ull);
+        LatencyHistogram detection;
+
+        adaptive_sim sim;
+        sim.vmi = fake_vmi_create();
+        sim.table = &table;
+        sim.adaptive = &adaptive;
+        sim.memory.assign(table.page_count() * 512, 0);
+        sim.detection = &detection;
+        sim.now = 0;
+        sim.detected = 0;
+        adaptive_state = &sim;
+
+        // The callback without the ring, with the emulate response so only the fault exits count
+        bench_guest guest;
+        EmulateResponse emulate;
+        guest.response = &emulate;
+        guest.relevant_write = adaptive_detect;
+        bench_listening_guest = &guest;
+        for (uint64_t gfn = 0x100000; gfn < 0x100000 + table.page_count(); gfn++)
+        {
+            storm_page *page = table.find(gfn);
+            SETUP_MEM_EVENT(&page->event, gfn, VMI_MEMACCESS_W, (bench_write_cb<false, false, EmulateResponse>), 0);
+            page->event.data = page;
+            vmi_register_event(sim.vmi, &page->event);
+        }
+
+        // Irrelevant and relevant word offsets of each page, so writes can pick either kind
+        uint64_t pages = table.page_count();
+        vector<vector<uint32_t> > irrelevant_words(pages), relevant_words(pages);
+        for (uint64_t i = 0; i < pages; i++)
+        {
+            storm_page *page = table.find(0x100000 + i);
+            for (uint32_t word = 0; word < WATCH_PAGE_SIZE >> WATCH_WORD_SHIFT; word++)
+                (watch_relevant(page, word << WATCH_WORD_SHIFT) ? relevant_words : irrelevant_words)[i].push_back(word);
+        }
+
+        // One step per simulated millisecond: the writes of that millisecond, then the event loop's turn
+        uint64_t seed = 0x2545f4914f6cdd1dull;
+        uint64_t value = 1;
+        unsigned long relevant_writes = 0;
+        long relevant_due = 0;
+        for (long ms = 0; ms < seconds * 1000; ms++)
+        {
+            sim.now = ms * 1000000ull;
+            for (int hot = 0; hot < hot_pages; hot++)
+            {
+                for (long i = 0; i < hot_rate / 1000; i++)
+                {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 7;
+                    seed ^= seed << 17;
+                    const vector<uint32_t> &words = irrelevant_words[hot];
+                    uint32_t word = words[seed % words.size()];
+                    sim.memory[hot * 512 + word] = value++;
+                    fake_vmi_write(sim.vmi, 0x100000 + hot, word << WATCH_WORD_SHIFT, i & 3);
+                }
+            }
+            for (relevant_due += relevant_rate; relevant_due >= 1000; relevant_due -= 1000)
+            {
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                uint64_t index = seed % pages;
+                const vector<uint32_t> &words = relevant_words[index];
+                if (words.empty())
+                    continue;
+                uint32_t word = words[(seed >> 32) % words.size()];
+                sim.memory[index * 512 + word] = value++;
+                sim.pending.insert(make_pair(((0x100000 + index) << WATCH_PAGE_SHIFT) + (word << WATCH_WORD_SHIFT), sim.now));
+                relevant_writes++;
+                fake_vmi_write(sim.vmi, 0x100000 + index, word << WATCH_WORD_SHIFT, 0);
+            }
+            adaptive_step(sim);
+        }
+
+        // One more polling interval so the last writes to polled pages are seen
+        for (long ms = 0; ms <= ADAPTIVE_POLL_INTERVAL_MS; ms++)
+        {
+            sim.now = (seconds * 1000 + ms) * 1000000ull;
+            adaptive_step(sim);
+        }
+
+        latency_snapshot snapshot;
+        snapshot.reset();
+        detection.merge_into(snapshot);
+        adaptive_stats stats = adaptive.stats();
+        const char *name = mode == 0 ? "trap" : "adaptive";
+        unsigned long exits = fake_vmi_exits(sim.vmi);
+        printf("%-10s %12lu %10.0f %10lu %10lu %9.3f ms %9.3f ms %9.3f ms\n", name, exits, (double) exits / seconds,
+            stats.to_polled + stats.to_trapped, (unsigned long) sim.pending.size(), snapshot.percentile(0.50) / 1e6,
+            snapshot.percentile(0.99) / 1e6, snapshot.max / 1e6);
+        bench_metric("adaptive", name, "exits", (double) exits / seconds, "exits/s");
+        bench_metric("adaptive", name, "missed", sim.pending.size(), "writes");
+        bench_percentiles("adaptive", name, snapshot);
+
+        // Every relevant write must be seen, polled ones within the polling interval
+        if (!sim.pending.empty() || snapshot.max > ADAPTIVE_POLL_INTERVAL_MS * 1000000ull || sim.detected != relevant_writes)
+            failures++;
+        adaptive_state = NULL;
+        bench_listening_guest = NULL;
+        fake_vmi_destroy(sim.vmi);
+    }
+    return failures ? 1 : 0;
+}
+
+// Sweeps of simulated task_structs: CRC32C of the watched fields with the crc32 instruction and the table
+static int bench_integrity(long objects, int sweeps)
+{
+    const int task_size = 2384;
+    watch_fields task_fields;
+    task_fields.add(640, 16);
+    task_fields.add(820, 8);
+    task_fields.add(840, 16);
+    task_fields.add(1248, 32);
+    task_fields.add(1496, 8);
+    task_fields.finalize();
+
+    printf("Integrity baseline benchmark (%ld objects of %d bytes, %u watched, %d sweeps)\n",
+        objects, task_size, task_fields.bytes(), sweeps);
+
+    // Check value of CRC32C("123456789")
+    int failures = 0;
+    const char *check = "123456789";
+    uint32_t expected = 0xe3069283;
+    if (crc32c_portable(0, (const uint8_t *) check, 9) != expected || integrity_crc32c(check, 9) != expected)
+    {
+        printf("CRC32C check value mismatch\n");
+        failures++;
+    }
+
+    vector<uint8_t> memory((size_t) objects * task_size);
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < memory.size(); i += 8)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        memcpy(&memory[i], &seed, 8);
+    }
+    const uint64_t base = 0x100000000ull;
+    auto read = [&memory, base](uint64_t pa, void *buffer, size_t size) {
+        memcpy(buffer, &memory[pa - base], size);
+        return true;
+    };
+
+    IntegrityBaseline baseline;
+    double start = now_seconds();
+    for (long i = 0; i < objects; i++)
+        baseline.record(read, PROCESS_BENCH_EVENT, base + i * task_size, task_size, &task_fields);
+    double record = now_seconds() - start;
+
+    start = now_seconds();
+    size_t clean = 0;
+    for (int i = 0; i < sweeps; i++)
+        clean += baseline.sweep(read, [](uint32_t, uint64_t, uint32_t) {});
+    double sweep = (now_seconds() - start) / sweeps;
+
+    // The hash alone over the same spans: instruction, table, and the whole object with the instruction
+    volatile uint32_t sink = 0;
+    double hashed[3];
+    for (int variant = 0; variant < 3; variant++)
+    {
+        start = now_seconds();
+        for (int round = 0; round < sweeps; round++)
+        {
+            for (long i = 0; i < objects; i++)
+            {
+                const uint8_t *object = &memory[(size_t) i * task_size];
+                if (variant == 2)
+                {
+                    sink = sink + integrity_crc32c(object, task_size);
+                    continue;
+                }
+                uint32_t crc = 0;
+                for (size_t span = 0; span < task_fields.spans.size(); span++)
+                {
+                    const uint8_t *data = object + task_fields.spans[span].first;
+                    size_t size = task_fields.spans[span].second - task_fields.spans[span].first;
+                    crc = variant == 0 && crc32c_hardware() ? integrity_crc32c(data, size, crc) : crc32c_portable(crc, data, size);
+                }
+                sink = sink + crc;
+            }
+        }
+        hashed[variant] = (now_seconds() - start) / sweeps;
+    }
+
+    // One watched field changed in 1% of the objects, an unwatched byte in another 1%
+    long changed_objects = objects / 100 > 0 ? objects / 100 : 1;
+    for (long i = 0; i < changed_objects; i++)
+    {
+        memory[(size_t) (i * 97 % objects) * task_size + 1248 + i % 32]++;
+        memory[(size_t) ((i * 97 + 1) % objects) * task_size + 100]++;
+    }
+    size_t found = baseline.sweep(read, [](uint32_t, uint64_t, uint32_t) {});
+    size_t found_again = baseline.sweep(read, [](uint32_t, uint64_t, uint32_t) {});
+
+    // The analysis accepts the changes, after which a sweep finds nothing
+    for (long i = 0; i < changed_objects; i++)
+        baseline.check(read, PROCESS_BENCH_EVENT, base + (i * 97 % objects) * task_size);
+    size_t found_after = baseline.sweep(read, [](uint32_t, uint64_t, uint32_t) {});
+
+    double bytes = (double) objects * task_fields.bytes();
+    printf("CRC32C implementation:   %s\n", crc32c_hardware() ? "SSE4.2" : "table");
+    printf("record:                  %.1f ns/object\n", record / objects * 1e9);
+    printf("sweep:                   %.3f ms (%.1f ns/object)\n", sweep * 1e3, sweep / objects * 1e9);
+    printf("fields crc32 insn:       %.1f ns/object (%.2f GB/s)\n", hashed[0] / objects * 1e9, bytes / hashed[0] / 1e9);
+    printf("fields table:            %.1f ns/object (%.2f GB/s)\n", hashed[1] / objects * 1e9, bytes / hashed[1] / 1e9);
+    printf("whole object crc32 insn: %.1f ns/object\n", hashed[2] / objects * 1e9);
+    printf("changed: %ld watched, %ld unwatched; sweep found %lu, again %lu, after accepting %lu\n",
+        changed_objects, changed_objects, (unsigned long) found, (unsigned long) found_again, (unsigned long) found_after);
+    bench_metric("integrity", "sweep", "cost", sweep / objects * 1e9, "ns/object");
+    bench_metric("integrity", "crc32 instruction", "cost", hashed[0] / objects * 1e9, "ns/object");
+    bench_metric("integrity", "table", "cost", hashed[1] / objects * 1e9, "ns/object");
+    bench_metric("integrity", "whole object", "cost", hashed[2] / objects * 1e9, "ns/object");
+
+    // Exactly the objects with a changed watched field, until their change is accepted
+    if (clean != 0 || found != (size_t) changed_objects || found_again != found || found_after != 0)
+        failures++;
+    return failures ? 1 : 0;
+}
+
+// Shadow diff of written task_structs: dirty lines only against a full reread, and exact member attribution
+static int bench_shadow(long objects, int rounds)
+{
+    const int task_size = 2384;
+    const uint64_t base = 0x100000000ull;
+
+    // 8-byte members, except a 16-byte list head and a 32-byte name; the watched ones as in bench_integrity
+    shadow_layout layout;
+    layout.struct_name = "task_struct";
+    vector<string> names;
+    names.reserve(task_size / 8);
+    for (uint32_t offset = 0; offset < (uint32_t) task_size; )
+    {
+        uint32_t size = offset == 640 || offset == 840 ? 16 : offset == 1248 ? 32 : 8;
+        names.push_back("m" + to_string(offset));
+        shadow_member member;
+        member.offset = offset;
+        member.end = offset + size;
+        member.name = names.back().c_str();
+        member.relevant = offset == 640 || offset == 820 || offset == 840 || offset == 1248 || offset == 1496;
+        layout.members.push_back(member);
+        layout.max_member_size = max(layout.max_member_size, size);
+        offset += size;
+    }
+
+    printf("Shadow diff benchmark (%ld objects of %d bytes, %lu members, %d rounds)\n",
+        objects, task_size, (unsigned long) layout.members.size(), rounds);
+
+    vector<uint8_t> memory((size_t) objects * task_size);
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < memory.size(); i += 8)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        memcpy(&memory[i], &seed, 8);
+    }
+    unsigned long bytes_read = 0;
+    auto read = [&memory, &bytes_read, base](uint64_t pa, void *buffer, size_t size) {
+        bytes_read += size;
+        memcpy(buffer, &memory[pa - base], size);
+        return true;
+    };
+
+    ShadowStore shadow;
+    for (long i = 0; i < objects; i++)
+        shadow.capture(read, PROCESS_BENCH_EVENT, base + i * task_size, task_size, &layout);
+
+    int failures = 0;
+    double diff_seconds = 0, full_seconds = 0;
+    unsigned long diffed = 0, diff_bytes = 0, full_bytes = 0, reported = 0, benign = 0;
+    vector<uint8_t> previous(task_size), current(task_size);
+    for (int round = 0; round < rounds; round++)
+    {
+        // A tenth of the objects get one to three writes of a member word; one write in eight stores the same value
+        EventCoalescer coalescer;
+        map<uint64_t, map<uint32_t, bool> > expected;
+        for (long n = 0; n < objects / 10; n++)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            uint64_t object = base + (seed % objects) * task_size;
+            for (int write = 0; write <= (int) ((seed >> 40) % 3); write++)
+            {
+                const shadow_member &member = layout.members[(seed >> (8 * write)) % layout.members.size()];
+                uint64_t *word = (uint64_t *) &memory[object - base + member.offset];
+                if ((seed >> (16 + write)) % 8 != 0)
+                {
+                    (*word)++;
+                    expected[object][member.offset] = member.relevant;
+                }
+                naive_event event;
+                event.type = PROCESS_BENCH_EVENT;
+                event.vcpu = 0;
+                event.gfn = (object + member.offset) >> WATCH_PAGE_SHIFT;
+                event.offset = (object + member.offset) & (WATCH_PAGE_SIZE - 1);
+                event.object = object;
+                event.timestamp = 1;
+                coalescer.add(event);
+            }
+        }
+
+        coalesced_event batch;
+        coalescer.take(PROCESS_BENCH_EVENT, 1, batch);
+
+        // The whole object reread and compared, as without dirty lines (counted, not applied)
+        bytes_read = 0;
+        double start = now_seconds();
+        size_t full_changed = 0;
+        for (unordered_map<uint64_t, coalesced_object>::const_iterator it = batch.objects.begin(); it != batch.objects.end(); ++it)
+        {
+            shadow.copy(PROCESS_BENCH_EVENT, it->first, 0, task_size, previous.data());
+            read(it->first, current.data(), task_size);
+            full_changed += memcmp(previous.data(), current.data(), task_size) != 0;
+        }
+        full_seconds += now_seconds() - start;
+        full_bytes += bytes_read;
+
+        // Every object's changes appended to one vector, reserved beforehand as the detector reuses its own
+        bytes_read = 0;
+        vector<shadow_change> changes;
+        changes.reserve(batch.objects.size() * 8);
+        vector<size_t> change_ends;
+        change_ends.reserve(batch.objects.size());
+        start = now_seconds();
+        for (unordered_map<uint64_t, coalesced_object>::const_iterator it = batch.objects.begin(); it != batch.objects.end(); ++it)
+        {
+            const shadow_layout *found_layout = NULL;
+            if (!shadow.diff(read, PROCESS_BENCH_EVENT, it->first, it->second.dirty_lines, COALESCE_LINE_WORDS, changes, &found_layout))
+                failures++;
+            change_ends.push_back(changes.size());
+        }
+        diff_seconds += now_seconds() - start;
+        diff_bytes += bytes_read;
+        diffed += batch.objects.size();
+        if (full_changed != expected.size())
+            failures++;
+
+        // Exactly the members whose value changed, nothing else
+        size_t index = 0;
+        for (unordered_map<uint64_t, coalesced_object>::const_iterator it = batch.objects.begin(); it != batch.objects.end(); ++it)
+        {
+            size_t first = index == 0 ? 0 : change_ends[index - 1], last = change_ends[index];
+            index++;
+            map<uint64_t, map<uint32_t, bool> >::const_iterator written = expected.find(it->first);
+            if (last - first != (written == expected.end() ? 0 : written->second.size()))
+                failures++;
+            for (size_t i = first; i < last; i++)
+            {
+                const shadow_member &member = layout.members[changes[i].member < 0 ? 0 : changes[i].member];
+                if (changes[i].member < 0 || written == expected.end() || !written->second.count(member.offset))
+                    failures++;
+                benign += !member.relevant;
+            }
+            reported += last - first;
+        }
+    }
+
+    shadow_stats stats = shadow.stats();
+    printf("full reread:   %.1f ns/object, %.0f bytes read/object\n", full_seconds / diffed * 1e9, (double) full_bytes / diffed);
+    printf("dirty lines:   %.1f ns/object, %.0f bytes read/object (%.2f lines)\n", diff_seconds / diffed * 1e9,
+        (double) diff_bytes / diffed, (double) stats.lines_read / diffed);
+    printf("changes:       %lu members over %lu objects (%lu benign)\n", reported, diffed, benign);
+    bench_metric("shadow", "full reread", "cost", full_seconds / diffed * 1e9, "ns/object");
+    bench_metric("shadow", "dirty lines", "cost", diff_seconds / diffed * 1e9, "ns/object");
+    bench_metric("shadow", "dirty lines", "read", (double) diff_bytes / diffed, "bytes/object");
+    return failures ? 1 : 0;
+}
+
+/////////////////////
+// Detector Modes
+/////////////////////
+// mem_write_cb for each choice of monitoring and callback timing: the instantiation the hawk picks at startup for
+// an untraced guest with the step response, and the same body testing the modes and calling the response through
+// the vtable on every write
+
+static uint32_t modes_selected;
+
+static event_response_t modes_branching_cb(vmi_instance_t vmi, vmi_event_t *event)
+{
+    runtime_write_modes modes = { modes_selected, false };
+    return handle_page_write<PAGE_TABLE_BENCH_EVENT>(modes, *bench_listening_guest, vmi, event);
+}
+
+static int bench_modes(long events, int rounds)
+{
+    const int task_size = 2384;
+    watch_fields task_fields;
+    task_fields.add(640, 16);
+    task_fields.add(820, 8);
+    task_fields.add(840, 16);
+    task_fields.add(1248, 32);
+    task_fields.add(1496, 8);
+    task_fields.finalize();
+
+    vmi_instance_t vmi = fake_vmi_create();
+    WatchTable<vmi_event_t> table;
+    populate_watch_table(table, 4096, task_size, task_size, &task_fields);
+    vector<storm_page *> pages;
+    for (uint64_t gfn = 0x100000; gfn < 0x100000 + table.page_count(); gfn++)
+    {
+        storm_page *page = table.find(gfn);
+        SETUP_MEM_EVENT(&page->event, gfn, VMI_MEMACCESS_W, modes_branching_cb, 0);
+        page->event.data = page;
+        vmi_register_event(vmi, &page->event);
+        pages.push_back(page);
+    }
+    printf("Detector modes benchmark (%ld writes on %lu pages, %d rounds)\n", events, (unsigned long) pages.size(), rounds);
+
+    // The same writes for every callback
+    vector<pair<uint64_t, uint64_t> > writes(events);
+    uint64_t seed = 0x2545f4914f6cdd1dull;
+    for (long i = 0; i < events; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        writes[i] = make_pair(0x100000 + seed % pages.size(), (seed >> 32) & (WATCH_PAGE_SIZE - 8));
+    }
+
+    bench_guest guest;
+    StepResponse response;
+    LatencyHistogram callback_latency;
+    guest.response = &response;
+    guest.callback_latency = &callback_latency;
+    bench_listening_guest = &guest;
+    SpscRing<naive_event> &ring = guest.event_ring;
+    vector<naive_event> drained(4096);
+
+    struct variant { const char *name; event_callback_t callback; };
+    struct mode_case { uint32_t modes; variant variants[2]; };
+    const mode_case cases[] = {
+        { 0, { { "specialised", bench_write_cb<false, false, StepResponse> }, { "branching", modes_branching_cb } } },
+        { MODE_MONITORING, { { "specialised", bench_write_cb<true, false, StepResponse> }, { "branching", modes_branching_cb } } },
+        { MODE_CALLBACK_TIME, { { "specialised", bench_write_cb<false, true, StepResponse> }, { "branching", modes_branching_cb } } },
+        { MODE_MONITORING | MODE_CALLBACK_TIME, { { "specialised", bench_write_cb<true, true, StepResponse> },
+            { "branching", modes_branching_cb } } },
+    };
+
+    int failures = 0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        modes_selected = cases[c].modes;
+        double best[2] = { 1e9, 1e9 };
+        unsigned long queued[2] = { 0, 0 };
+
+        // Rounds interleave the two, so frequency changes hit them alike; the fastest round counts
+        for (int round = 0; round < rounds; round++)
+        {
+            for (int v = 0; v < 2; v++)
+            {
+                for (size_t i = 0; i < pages.size(); i++)
+                    pages[i]->event.callback = cases[c].variants[v].callback;
+                queued[v] = 0;
+                double start = now_seconds();
+                for (long i = 0; i < events; i++)
+                {
+                    fake_vmi_write(vmi, writes[i].first, writes[i].second, i & 3);
+                    if ((i & 1023) == 1023)
+                        queued[v] += ring.pop_batch(drained.data(), drained.size());
+                }
+                best[v] = min(best[v], now_seconds() - start);
+                while (size_t popped = ring.pop_batch(drained.data(), drained.size()))
+                    queued[v] += popped;
+            }
+        }
+
+        // Same events queued whichever way the modes were chosen
+        if (queued[1] != queued[0] || ((cases[c].modes & MODE_MONITORING) != 0) != (queued[0] != 0))
+            failures++;
+        printf("%-26s specialised %.1f ns, branching %.1f ns (%+.1f%%), %lu queued\n",
+            (detector_mode_names(cases[c].modes) + ":").c_str(), best[0] / events * 1e9, best[1] / events * 1e9,
+            100.0 * (best[1] - best[0]) / best[0], queued[0]);
+        for (int v = 0; v < 2; v++)
+            bench_metric("modes", detector_mode_names(cases[c].modes) + " " + cases[c].variants[v].name, "cost",
+                best[v] / events * 1e9, "ns/event");
+    }
+
+    if (ring.dropped() != 0)
+        failures++;
+    bench_listening_guest = NULL;
+    fake_vmi_destroy(vmi);
+    return failures ? 1 : 0;
+}
+
+// List graph of a simulated tasks list: per-write checks against full walks, and the DKOM cases it must flag
+static int bench_listgraph(long nodes, long ops)
+{
+    const uint64_t head = 0xffffffff82a13000ull;
+    const uint64_t base = 0xffff888100000000ull;
+    const uint64_t stride = 0x940;
+
+    printf("List graph benchmark (%ld nodes, %ld list operations)\n", nodes, ops);
+
+    // The guest's list_heads; the nodes linked at the start (and the head) are the watched ones
+    unordered_map<uint64_t, list_node> guest;
+    unordered_set<uint64_t> watched;
+    vector<uint64_t> linked;
+    uint64_t next_va = base;
+    auto link_tail = [&](uint64_t va) {
+        list_node &node = guest[va];
+        node.object = va - base + 0x100000000ull;
+        node.next = head;
+        node.prev = guest[head].prev;
+        guest[node.prev].next = va;
+        guest[head].prev = va;
+        linked.push_back(va);
+    };
+    guest[head].next = guest[head].prev = head;
+    guest[head].object = 0x2a13000;
+    watched.insert(head);
+    for (long i = 0; i < nodes; i++, next_va += stride)
+    {
+        link_tail(next_va);
+        watched.insert(next_va);
+    }
+
+    auto read = [&guest](uint64_t va, list_node *node) {
+        unordered_map<uint64_t, list_node>::const_iterator it = guest.find(va);
+        if (it == guest.end())
+            return false;
+        *node = it->second;
+        return true;
+    };
+    auto walk = [&guest, head](vector<list_walk_node> &walked) {
+        walked.clear();
+        uint64_t va = head;
+        do
+        {
+            list_walk_node node;
+            node.va = va;
+            node.links = guest[va];
+            walked.push_back(node);
+            va = node.links.next;
+        } while (va != head && walked.size() <= guest.size());
+    };
+
+    ListGraph graph;
+    vector<list_walk_node> walked;
+    vector<list_anomaly> found;
+    walk(walked);
+    graph.reconcile(head, walked, found);
+
+    // Only the writes that hit a watched list_head reach the graph, as with the traps
+    vector<uint64_t> written;
+    auto apply = [&](vector<list_anomaly> &anomalies) {
+        for (size_t i = 0; i < written.size(); i++)
+        {
+            if (watched.count(written[i]))
+                graph.update(written[i], guest[written[i]].next, guest[written[i]].prev);
+        }
+        written.clear();
+        graph.end_batch(read, anomalies);
+    };
+
+    // Tail inserts and list_del deletions in equal parts
+    int failures = 0;
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    double start = now_seconds();
+    for (long op = 0; op < ops; op++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        if ((seed & 1) || linked.size() < 2)
+        {
+            uint64_t tail = guest[head].prev;
+            link_tail(next_va);
+            written.push_back(tail);
+            written.push_back(head);
+            written.push_back(next_va);
+            next_va += stride;
+        }
+        else
+        {
+            size_t index = (seed >> 1) % linked.size();
+            uint64_t va = linked[index];
+            list_node &node = guest[va];
+            guest[node.next].prev = node.prev;
+            guest[node.prev].next = node.next;
+            written.push_back(node.next);
+            written.push_back(node.prev);
+            written.push_back(va);
+            node.next = LIST_POISON_NEXT;
+            node.prev = LIST_POISON_PREV;
+            linked[index] = linked.back();
+            linked.pop_back();
+        }
+        apply(found);
+    }
+    double update_seconds = now_seconds() - start;
+    if (!found.empty())
+    {
+        printf("%lu anomalies on ordinary inserts and deletes, first: %s\n", (unsigned long) found.size(),
+            list_anomaly_name(found[0].kind));
+        failures++;
+    }
+
+    // Full walks for comparison; the drift is what the unwatched inserted nodes hid from the writes
+    const int walks = 5;
+    list_drift drift = list_drift();
+    start = now_seconds();
+    for (int i = 0; i < walks; i++)
+    {
+        walk(walked);
+        drift = graph.reconcile(head, walked, found);
+    }
+    double walk_seconds = (now_seconds() - start) / walks;
+
+    // Each manipulation on its own, the graph reconciled in between
+    struct attack { const char *name; list_anomaly_kind expected; };
+    const attack attacks[] = {
+        { "unlink without list_del", LIST_UNLINKED_INTACT },
+        { "next pointing back", LIST_SHARED_NEXT },
+        { "corrupted prev", LIST_ASYMMETRIC },
+    };
+    for (size_t a = 0; a < sizeof(attacks) / sizeof(attacks[0]); a++)
+    {
+        // A watched node whose predecessor is watched too
+        uint64_t va = 0;
+        for (size_t i = 0; i < linked.size() && va == 0; i++)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            uint64_t candidate = linked[(seed >> 1) % linked.size()];
+            if (watched.count(candidate) && watched.count(guest[candidate].prev) && guest[candidate].prev != head)
+                va = candidate;
+        }
+        if (va == 0)
+        {
+            failures++;
+            continue;
+        }
+        unordered_map<uint64_t, list_node> saved = guest;
+        list_node &node = guest[va];
+        if (attacks[a].expected == LIST_UNLINKED_INTACT)
+        {
+            guest[node.prev].next = node.next;
+            guest[node.next].prev = node.prev;
+            written.push_back(node.prev);
+            written.push_back(node.next);
+        }
+        else if (attacks[a].expected == LIST_SHARED_NEXT)
+        {
+            node.next = guest[node.prev].prev;
+            written.push_back(va);
+        }
+        else
+        {
+            uint64_t other = linked[(seed >> 1) % linked.size()];
+            node.prev = other == node.prev || other == va ? head : other;
+            written.push_back(va);
+        }
+
+        vector<list_anomaly> anomalies;
+        apply(anomalies);
+        bool flagged = false;
+        for (size_t i = 0; i < anomalies.size(); i++)
+            flagged = flagged || anomalies[i].kind == attacks[a].expected;
+        printf("%-24s %s (%lu anomalies)\n", attacks[a].name, flagged ? "flagged" : "MISSED", (unsigned long) anomalies.size());
+        failures += !flagged;
+
+        guest.swap(saved);
+        walk(walked);
+        graph.reconcile(head, walked, found);
+    }
+
+    list_graph_stats stats = graph.stats();
+    printf("per write:     %.2f us/operation (%lu link writes, %lu discovered, %lu reread, %lu unlinked)\n",
+        update_seconds / ops * 1e6, stats.updates, stats.discovered, stats.refreshed, stats.removed);
+    printf("full walk:     %.2f us (%lu nodes), drift %lu missing, %lu extra, %lu mismatched\n", walk_seconds * 1e6,
+        (unsigned long) drift.walked, (unsigned long) drift.missing, (unsigned long) drift.extra, (unsigned long) drift.mismatched);
+    bench_metric("listgraph", "per write", "cost", update_seconds / ops * 1e6, "us/operation");
+    bench_metric("listgraph", "full walk", "cost", walk_seconds * 1e6, "us/walk");
+    return failures ? 1 : 0;
+}
+
+// Every benchmark that needs no input files, plus the DWARF one when module.dwarf is present
+static int bench_all()
+{
+    int failures = 0;
+    if (access("module.dwarf", R_OK) == 0)
+        failures += bench_dwarf("module.dwarf", 1000) != 0;
+    failures += bench_queue(1000000) != 0;
+    failures += bench_contention(4, 250000) != 0;
+    failures += bench_filter(20000, 10000000) != 0;
+    failures += bench_event_list(100000, 20) != 0;
+    failures += bench_storm(2000000, 2000, 4) != 0;
+    failures += bench_guests(8, 200000, 4, 200) != 0;
+    failures += bench_priority(64, 200, 4, 200) != 0;
+    failures += bench_response(2000000, 2000) != 0;
+    failures += bench_adaptive(20, 8, 20000) != 0;
+    failures += bench_integrity(20000, 20) != 0;
+    failures += bench_shadow(20000, 10) != 0;
+    failures += bench_listgraph(20000, 20000) != 0;
+    failures += bench_modes(1000000, 3) != 0;
+    failures += bench_translate(4096, 10000000) != 0;
+    failures += bench_coalesce(1000) != 0;
+    failures += bench_latency_record(1000000) != 0;
+    failures += bench_metrics(4, 10000000) != 0;
+    failures += bench_registry(20000, 20) != 0;
+    failures += bench_delta(10000, 10) != 0;
+    failures += bench_checks(100000, 100) != 0;
+    return failures ? 1 : 0;
+}
+
+static int run_bench(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: naive-bench [--json=FILE] <benchmark> [args]\n");
+        fprintf(stderr, "       naive-bench all\n");
+        fprintf(stderr, "       naive-bench dwarf <module.dwarf> [lookups]\n");
+        fprintf(stderr, "       naive-bench queue [events]\n");
+        fprintf(stderr, "       naive-bench contention [producers] [events]\n");
+        fprintf(stderr, "       naive-bench filter [objects] [events]\n");
+        fprintf(stderr, "       naive-bench event-list [events] [rounds]\n");
+        fprintf(stderr, "       naive-bench storm [events] [objects] [workers]\n");
+        fprintf(stderr, "       naive-bench guests [guests] [events] [workers] [analysis us]\n");
+        fprintf(stderr, "       naive-bench priority [guests] [module analyses] [workers] [analysis us]\n");
+        fprintf(stderr, "       naive-bench response [events] [objects]\n");
+        fprintf(stderr, "       naive-bench adaptive [seconds] [hot pages] [irrelevant writes/s]\n");
+        fprintf(stderr, "       naive-bench integrity [objects] [sweeps]\n");
+        fprintf(stderr, "       naive-bench shadow [objects] [rounds]\n");
+        fprintf(stderr, "       naive-bench listgraph [nodes] [operations]\n");
+        fprintf(stderr, "       naive-bench modes [writes] [rounds]\n");
+        fprintf(stderr, "       naive-bench translate [pages] [lookups]\n");
+        fprintf(stderr, "       naive-bench coalesce [bursts]\n");
+        fprintf(stderr, "       naive-bench latency [samples]\n");
+        fprintf(stderr, "       naive-bench metrics [threads] [increments]\n");
+        fprintf(stderr, "       naive-bench registry [pages] [rounds]\n");
+        fprintf(stderr, "       naive-bench delta [tasks] [passes]\n");
+        fprintf(stderr, "       naive-bench checks [tables] [modules]\n");
+        fprintf(stderr, "       naive-bench dump <memory.raw> <System.map> <module.dwarf> [rounds]\n");
+        fprintf(stderr, "       naive-bench replay <trace> [fast|realtime] [analysis us] [workers]\n");
+        return 1;
+    }
+
+    if (strcmp(argv[1], "all") == 0)
+        return bench_all();
+
+    if (strcmp(argv[1], "dwarf") == 0 && argc > 2)
+        return bench_dwarf(argv[2], argc > 3 ? atoi(argv[3]) : 1000);
+
+    if (strcmp(argv[1], "queue") == 0)
+        return bench_queue(argc > 2 ? atol(argv[2]) : 5000000);
+
+    if (strcmp(argv[1], "contention") == 0)
+        return bench_contention(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atol(argv[3]) : 1000000);
+
+    if (strcmp(argv[1], "filter") == 0)
+        return bench_filter(argc > 2 ? atol(argv[2]) : 20000, argc > 3 ? atol(argv[3]) : 20000000);
+
+    if (strcmp(argv[1], "event-list") == 0)
+        return bench_event_list(argc > 2 ? atol(argv[2]) : 100000, argc > 3 ? atoi(argv[3]) : 50);
+
+    if (strcmp(argv[1], "storm") == 0)
+        return bench_storm(argc > 2 ? atol(argv[2]) : 5000000, argc > 3 ? atol(argv[3]) : 2000,
+            argc > 4 ? atoi(argv[4]) : 4);
+
+    if (strcmp(argv[1], "guests") == 0)
+        return bench_guests(argc > 2 ? atoi(argv[2]) : 8, argc > 3 ? atol(argv[3]) : 500000,
+            argc > 4 ? atoi(argv[4]) : 4, argc > 5 ? atol(argv[5]) : 200);
+
+    if (strcmp(argv[1], "priority") == 0)
+        return bench_priority(argc > 2 ? atoi(argv[2]) : 64, argc > 3 ? atol(argv[3]) : 500,
+            argc > 4 ? atoi(argv[4]) : 4, argc > 5 ? atol(argv[5]) : 200);
+
+    if (strcmp(argv[1], "response") == 0)
+        return bench_response(argc > 2 ? atol(argv[2]) : 5000000, argc > 3 ? atol(argv[3]) : 2000);
+
+    if (strcmp(argv[1], "adaptive") == 0)
+        return bench_adaptive(argc > 2 ? atol(argv[2]) : 60, argc > 3 ? atoi(argv[3]) : 8,
+            argc > 4 ? atol(argv[4]) : 20000);
+
+    if (strcmp(argv[1], "integrity") == 0)
+        return bench_integrity(argc > 2 ? atol(argv[2]) : 50000, argc > 3 ? atoi(argv[3]) : 20);
+
+    if (strcmp(argv[1], "shadow") == 0)
+        return bench_shadow(argc > 2 ? atol(argv[2]) : 20000, argc > 3 ? atoi(argv[3]) : 20);
+
+    if (strcmp(argv[1], "listgraph") == 0)
+        return bench_listgraph(argc > 2 ? atol(argv[2]) : 20000, argc > 3 ? atol(argv[3]) : 100000);
+
+    if (strcmp(argv[1], "modes") == 0)
+        return bench_modes(argc > 2 ? atol(argv[2]) : 2000000, argc > 3 ? atoi(argv[3]) : 5);
+
+    if (strcmp(argv[1], "translate") == 0)
+        return bench_translate(argc > 2 ? atol(argv[2]) : 4096, argc > 3 ? atol(argv[3]) : 10000000);
+
+    if (strcmp(argv[1], "coalesce") == 0)
+        return bench_coalesce(argc > 2 ? atol(argv[2]) : 1000);
+
+    if (strcmp(argv[1], "latency") == 0)
+        return bench_latency_record(argc > 2 ? atol(argv[2]) : 5000000);
+
+    if (strcmp(argv[1], "metrics") == 0)
+        return bench_metrics(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atol(argv[3]) : 20000000);
+
+    if (strcmp(argv[1], "registry") == 0)
+        return bench_registry(argc > 2 ? atol(argv[2]) : 20000, argc > 3 ? atoi(argv[3]) : 50);
+
+    if (strcmp(argv[1], "delta") == 0)
+        return bench_delta(argc > 2 ? atol(argv[2]) : 10000, argc > 3 ? atoi(argv[3]) : 20);
+
+    if (strcmp(argv[1], "checks") == 0)
+        return bench_checks(argc > 2 ? atol(argv[2]) : 100000, argc > 3 ? atoi(argv[3]) : 100);
+
+    if (strcmp(argv[1], "dump") == 0 && argc > 4)
+        return bench_dump(argv[2], argv[3], argv[4], argc > 5 ? atoi(argv[5]) : 10);
+
+    if (strcmp(argv[1], "replay") == 0 && argc > 2)
+        return bench_replay(argv[2], argc > 3 && strcmp(argv[3], "realtime") == 0,
+            argc > 4 ? atol(argv[4]) : 0, argc > 5 ? atoi(argv[5]) : 4);
+
+    fprintf(stderr, "Unknown benchmark: %s\n", argv[1]);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    // --json=FILE may appear anywhere; the remaining arguments select the benchmark
+    const char *json_path = NULL;
+    int kept = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--json=", 7) == 0)
+            json_path = argv[i] + 7;
+        else
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+
+    int result = run_bench(argc, argv);
+    if (json_path && !write_results(json_path))
+        return 1;
+    return result;
+}
@@ -0,0 +1,94 @@
+#ifndef NAIVE_CALLBACK
+#define NAIVE_CALLBACK
+
+#include <stdint.h>
+
+#include "naive-latency.h"
+#include "naive-modes.h"
+#include "naive-pipeline.h"
+#include "naive-response.h"
+#include "naive-ring.h"
+#include "naive-watch.h"
+
+/////////////////////
+// Write Callback
+/////////////////////
+
+// Monitoring, callback timing, tracing and the write response fixed at compile time, so handle_page_write
+// tests none of them and calls Response::respond directly
+template <bool Monitoring, bool Timed, bool Traced, typename Response>
+struct fixed_write_modes
+{
+  bool monitoring() const { return Monitoring; }
+  bool timed() const { return Timed; }
+  bool traced() const { return Traced; }
+
+  event_response_t respond(ResponseStrategy *response, vmi_instance_t vmi, vmi_event_t *event) const
+  {
+    return static_cast<Response *>(response)->respond(vmi, event);
+  }
+};
+
+// The same tested on every write instead, what the fixed instantiations save (see naive-bench modes)
+struct runtime_write_modes
+{
+  uint32_t modes;
+  bool tracing;
+
+  bool monitoring() const { return (modes & MODE_MONITORING) != 0; }
+  bool timed() const { return (modes & MODE_CALLBACK_TIME) != 0; }
+  bool traced() const { return tracing; }
+
+  event_response_t respond(ResponseStrategy *response, vmi_instance_t vmi, vmi_event_t *event) const
+  {
+    return response->respond(vmi, event);
+  }
+};
+
+/**
+ * Body of the detector's page write callback (mem_write_cb), a template
+ * over the guest it runs for so the benchmarks time the very code the
+ * detector runs on their fake guests. The write is filtered against its
+ * page's watched ranges and queued on guest.event_ring when modes has
+ * monitoring; hits of LocalTypes are only reported, never queued. The
+ * guest's hooks, free functions found by argument-dependent lookup, then
+ * see it:
+ *
+ *   write_filtered(guest, page, event, timestamp, hit_types)
+ *     every write: counting, handling the LocalTypes hits
+ *   write_traced(guest, page, event, timestamp, hit_types)
+ *     every write, when modes has tracing
+ *   write_timed(guest, hit_types, ns)
+ *     the callback's duration, when modes has timing
+ *
+ * guest.response lets the write through, through modes.respond so a
+ * fixed response type is called without a virtual call. Irrelevant writes
+ * are counted on the page for adaptive polling (see naive-adaptive.h).
+ **/
+template <uint32_t LocalTypes, typename Modes, typename Guest, typename Instance, typename Event>
+static inline event_response_t handle_page_write(const Modes &modes, Guest &guest, Instance vmi, Event *event)
+{
+  uint64_t callback_start = modes.timed() ? latency_now_ns() : 0;
+
+  // Find the watched objects on this page that cover the written offset and queue one event per object
+  page_watch<Event> *page = (page_watch<Event> *) event->data;
+  page->writes++;
+  uint64_t timestamp = ring_timestamp_ns();
+  uint32_t hit_types = filter_event(modes.monitoring() ? &guest.event_ring : NULL, page, event->vcpu_id,
+    event->mem_event.offset, timestamp, LocalTypes);
+  if (hit_types == 0)
+    page->irrelevant++;
+
+  write_filtered(guest, page, event, timestamp, hit_types);
+  if (modes.traced())
+    write_traced(guest, page, event, timestamp, hit_types);
+
+  // Lets the write through (see naive-response.h)
+  event_response_t response = modes.respond(guest.response, vmi, event);
+
+  if (modes.timed())
+    write_timed(guest, hit_types, latency_now_ns() - callback_start);
+  return response;
+}
+
+#endif
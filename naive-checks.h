@@ -0,0 +1,418 @@
+#ifndef NAIVE_CHECKS
+#define NAIVE_CHECKS
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "naive-dwarf.h"
+#include "naive-latency.h"
+#include "naive-memory.h"
+#include "naive-walk.h"
+
+// Upper bound on fds read per task by the fop check
+#define CHECK_MAX_FDS 65536
+
+/////////////////////
+// Analysis Results
+/////////////////////
+typedef std::vector<std::pair<std::string, std::string> > analysis_finding;
+
+struct analysis_result
+{
+  std::string check;
+  double seconds;     // Time spent running the check
+  std::vector<analysis_finding> findings;
+};
+
+static inline std::string check_hex(uint64_t value)
+{
+  char text[24];
+  snprintf(text, sizeof(text), "0x%llx", (unsigned long long) value);
+  return std::string(text);
+}
+
+/////////////////////
+// Kernel Code Ranges
+/////////////////////
+struct address_range
+{
+  uint64_t start;   // [start, end)
+  uint64_t end;
+};
+
+/**
+ * Sorted, merged set of address ranges that kernel function pointers may
+ * legitimately point into (kernel text plus module core/init sections).
+ * Pointer tables are checked in bulk: the widest range (kernel text) is
+ * compared first, everything else falls back to a binary search.
+ **/
+class KernelRanges
+{
+ public:
+
+  void clear()
+  {
+    ranges_.clear();
+    widest_.start = widest_.end = 0;
+  }
+
+  void add(uint64_t start, uint64_t end)
+  {
+    if (end > start)
+      ranges_.push_back(address_range{start, end});
+  }
+
+  // Sorts and merges; call after the last add()
+  void finalize()
+  {
+    std::sort(ranges_.begin(), ranges_.end(),
+      [](const address_range &a, const address_range &b) { return a.start < b.start; });
+
+    size_t out = 0;
+    for (size_t i = 0; i < ranges_.size(); i++)
+    {
+      if (out > 0 && ranges_[i].start <= ranges_[out - 1].end)
+        ranges_[out - 1].end = std::max(ranges_[out - 1].end, ranges_[i].end);
+      else
+        ranges_[out++] = ranges_[i];
+    }
+    ranges_.resize(out);
+
+    widest_.start = widest_.end = 0;
+    for (size_t i = 0; i < ranges_.size(); i++)
+    {
+      if (ranges_[i].end - ranges_[i].start > widest_.end - widest_.start)
+        widest_ = ranges_[i];
+    }
+  }
+
+  bool contains(uint64_t addr) const
+  {
+    if (addr - widest_.start < widest_.end - widest_.start)
+      return true;
+
+    // Branchless search for the last range starting at or below addr
+    const address_range *base = ranges_.data();
+    size_t count = ranges_.size();
+    if (count == 0 || addr < base->start)
+      return false;
+    while (count > 1)
+    {
+      size_t half = count / 2;
+      base = base[half].start <= addr ? base + half : base;
+      count -= half;
+    }
+    return addr < base->end;
+  }
+
+  // Writes the indices of non-NULL pointers outside every range to bad, returns how many
+  size_t find_outside(const uint64_t *pointers, size_t count, uint32_t *bad) const
+  {
+    size_t found = 0;
+    uint64_t text_start = widest_.start;
+    uint64_t text_size = widest_.end - widest_.start;
+    for (size_t i = 0; i < count; i++)
+    {
+      uint64_t pointer = pointers[i];
+      // Unsigned wrap turns the range test into a single compare
+      if (pointer == 0 || pointer - text_start < text_size)
+        continue;
+      if (!contains(pointer))
+        bad[found++] = (uint32_t) i;
+    }
+    return found;
+  }
+
+  size_t size() const { return ranges_.size(); }
+  const std::vector<address_range> &ranges() const { return ranges_; }
+
+ private:
+
+  std::vector<address_range> ranges_;
+  address_range widest_ = address_range();
+};
+
+/////////////////////
+// Shared Credentials
+/////////////////////
+struct task_cred
+{
+  int32_t pid;
+  uint64_t cred;
+};
+
+struct shared_cred
+{
+  uint64_t cred;
+  std::vector<int32_t> pids;
+};
+
+// Groups tasks that point at the same cred structure (only groups of two or more are returned)
+static inline size_t find_shared_creds(const std::vector<task_cred> &tasks, std::vector<shared_cred> &out)
+{
+  out.clear();
+
+  // cred -> first task index, or ~index of its group in out once shared
+  std::unordered_map<uint64_t, int64_t> seen;
+  seen.reserve(tasks.size() * 2);
+  for (size_t i = 0; i < tasks.size(); i++)
+  {
+    auto inserted = seen.insert(std::make_pair(tasks[i].cred, (int64_t) i));
+    if (inserted.second)
+      continue;
+
+    int64_t &slot = inserted.first->second;
+    if (slot >= 0)
+    {
+      shared_cred group;
+      group.cred = tasks[i].cred;
+      group.pids.push_back(tasks[slot].pid);
+      out.push_back(group);
+      slot = ~(int64_t) (out.size() - 1);
+    }
+    out[~slot].pids.push_back(tasks[i].pid);
+  }
+
+  return out.size();
+}
+
+/////////////////////
+// Native Checks
+/////////////////////
+// Native counterparts of the Volatility check_afinfo, check_fop and check_creds plugins
+
+typedef std::vector<std::pair<int, std::string> > function_member_list;
+
+// Offsets and names of the function pointer members of a struct
+static inline void function_members(const DwarfIndex &dwarf, const char *struct_name, function_member_list &out)
+{
+  out.clear();
+  const dwarf_struct_entry *entry = dwarf.find_struct(struct_name);
+  if (!entry)
+    return;
+
+  for (const dwarf_member_entry *member = dwarf.members_begin(entry); member != dwarf.members_end(entry); ++member)
+  {
+    const char *type = dwarf.string_at(member->type);
+    size_t length = strlen(type);
+    if (length >= 10 && strcmp(type + length - 10, "function *") == 0)
+      out.push_back(std::make_pair((int) member->offset, std::string(dwarf.string_at(member->name))));
+  }
+  std::sort(out.begin(), out.end());
+}
+
+// Checks every function pointer of the struct at va in one read, adding a finding per pointer outside kernel code
+static inline void check_function_table(GuestMemory &memory, uint64_t va, int table_size, const function_member_list &members,
+  const KernelRanges &ranges, const std::string &name, const char *hook_type, analysis_result &result)
+{
+  if (va == 0 || table_size <= 0 || members.empty())
+    return;
+
+  std::vector<uint8_t> table(table_size);
+  if (memory.read(va, table.data(), table_size) != (size_t) table_size)
+  {
+    printf("Failed to read function table at %llx\n", (unsigned long long) va);
+    return;
+  }
+
+  std::vector<uint64_t> pointers(members.size());
+  for (size_t i = 0; i < members.size(); i++)
+    memcpy(&pointers[i], table.data() + members[i].first, sizeof(uint64_t));
+
+  std::vector<uint32_t> bad(members.size());
+  size_t bad_count = ranges.find_outside(pointers.data(), pointers.size(), bad.data());
+  for (size_t i = 0; i < bad_count; i++)
+  {
+    analysis_finding finding;
+    finding.push_back(std::make_pair(std::string("name"), name));
+    finding.push_back(std::make_pair(std::string("member"), members[bad[i]].second));
+    if (hook_type)
+      finding.push_back(std::make_pair(std::string("hook_type"), std::string(hook_type)));
+    finding.push_back(std::make_pair(std::string("address"), check_hex(pointers[bad[i]])));
+    result.findings.push_back(finding);
+  }
+}
+
+// Kernel text plus the core and init sections of every loaded module
+static inline bool load_kernel_ranges(GuestMemory &memory, const DwarfIndex &dwarf, KernelRanges &ranges)
+{
+  ranges.clear();
+
+  uint64_t text_start = memory.symbol("_stext");
+  uint64_t text_end = memory.symbol("_etext");
+  if (text_start == 0 || text_end <= text_start)
+  {
+    printf("Failed to find kernel text range\n");
+    return false;
+  }
+  ranges.add(text_start, text_end);
+
+  int core_offset = dwarf.member_offset("module", "module_core");
+  int core_size_offset = dwarf.member_offset("module", "core_size");
+  int init_offset = dwarf.member_offset("module", "module_init");
+  int init_size_offset = dwarf.member_offset("module", "init_size");
+  if (core_offset < 0 || core_size_offset < 0)
+  {
+    printf("Failed to find module layout members\n");
+    return false;
+  }
+
+  bool ok = walk_modules(memory, dwarf, [&](const guest_module &module) {
+    uint64_t base = 0;
+    uint32_t size = 0;
+    if (module.field(core_offset, &base) && module.field(core_size_offset, &size))
+      ranges.add(base, base + size);
+
+    if (module.field(init_offset, &base) && module.field(init_size_offset, &size))
+      ranges.add(base, base + size);
+  });
+
+  ranges.finalize();
+  return ok;
+}
+
+static inline bool native_check_afinfo(GuestMemory &memory, const DwarfIndex &dwarf, analysis_result &result)
+{
+  uint64_t start = latency_now_ns();
+  result.check = "check_afinfo";
+  result.findings.clear();
+
+  KernelRanges ranges;
+  if (!load_kernel_ranges(memory, dwarf, ranges))
+    return false;
+
+  function_member_list fops_members;
+  function_member_list seq_members;
+  function_members(dwarf, "file_operations", fops_members);
+  function_members(dwarf, "seq_operations", seq_members);
+  int fops_size = dwarf.struct_size("file_operations");
+  int seq_size = dwarf.struct_size("seq_operations");
+
+  bool ok = walk_afinfo(memory, dwarf, [&](const guest_afinfo &afinfo) {
+    const char *struct_name = afinfo.symbol[0] == 't' ? "tcp_seq_afinfo" : "udp_seq_afinfo";
+    int seq_fops_offset = dwarf.member_offset(struct_name, "seq_fops");
+    int seq_ops_offset = dwarf.member_offset(struct_name, "seq_ops");
+    if (seq_fops_offset < 0 || seq_ops_offset < 0)
+      return;
+
+    uint64_t seq_fops = 0;
+    if (afinfo.field(seq_fops_offset, &seq_fops))
+      check_function_table(memory, seq_fops, fops_size, fops_members, ranges, afinfo.symbol, "seq_fops", result);
+    check_function_table(memory, afinfo.va + seq_ops_offset, seq_size, seq_members, ranges, afinfo.symbol, "seq_ops", result);
+  });
+
+  result.seconds = (latency_now_ns() - start) / 1e9;
+  return ok;
+}
+
+static inline bool native_check_fop(GuestMemory &memory, const DwarfIndex &dwarf, analysis_result &result)
+{
+  uint64_t start = latency_now_ns();
+  result.check = "check_fop";
+  result.findings.clear();
+
+  int files_offset = dwarf.member_offset("task_struct", "files");
+  int fdt_offset = dwarf.member_offset("files_struct", "fdt");
+  int fd_offset = dwarf.member_offset("fdtable", "fd");
+  int max_fds_offset = dwarf.member_offset("fdtable", "max_fds");
+  int f_op_offset = dwarf.member_offset("file", "f_op");
+  int fops_size = dwarf.struct_size("file_operations");
+  if (files_offset < 0 || fdt_offset < 0 || fd_offset < 0 || max_fds_offset < 0 || f_op_offset < 0)
+  {
+    printf("Failed to find open file members\n");
+    return false;
+  }
+
+  KernelRanges ranges;
+  if (!load_kernel_ranges(memory, dwarf, ranges))
+    return false;
+
+  function_member_list fops_members;
+  function_members(dwarf, "file_operations", fops_members);
+
+  // Each distinct file_operations table is checked once
+  std::unordered_set<uint64_t> checked_fops;
+  std::vector<uint64_t> fd_array;
+  bool ok = walk_tasks(memory, dwarf, [&](const guest_task &task) {
+    uint64_t files = 0, fdt = 0, fd = 0;
+    uint32_t max_fds = 0;
+    if (!task.field(files_offset, &files) || files == 0
+      || !memory.read_addr(files + fdt_offset, &fdt)
+      || !memory.read_32(fdt + max_fds_offset, &max_fds)
+      || !memory.read_addr(fdt + fd_offset, &fd))
+      return;
+
+    // Read the whole fd array at once
+    max_fds = max_fds > CHECK_MAX_FDS ? CHECK_MAX_FDS : max_fds;
+    fd_array.assign(max_fds, 0);
+    size_t bytes_read = max_fds ? memory.read(fd, fd_array.data(), max_fds * sizeof(uint64_t)) : 0;
+    for (size_t i = 0; i < bytes_read / sizeof(uint64_t); i++)
+    {
+      uint64_t f_op = 0;
+      if (fd_array[i] == 0 || !memory.read_addr(fd_array[i] + f_op_offset, &f_op))
+        continue;
+      if (f_op == 0 || !checked_fops.insert(f_op).second)
+        continue;
+
+      std::string name = "pid " + std::to_string(task.pid) + " fd " + std::to_string(i) + " f_op " + check_hex(f_op);
+      check_function_table(memory, f_op, fops_size, fops_members, ranges, name, NULL, result);
+    }
+  });
+
+  result.seconds = (latency_now_ns() - start) / 1e9;
+  return ok;
+}
+
+static inline bool native_check_creds(GuestMemory &memory, const DwarfIndex &dwarf, analysis_result &result)
+{
+  uint64_t start = latency_now_ns();
+  result.check = "check_creds";
+  result.findings.clear();
+
+  int cred_offset = dwarf.member_offset("task_struct", "cred");
+  if (cred_offset < 0)
+  {
+    printf("Failed to find cred member of task_struct\n");
+    return false;
+  }
+
+  std::vector<task_cred> creds;
+  bool ok = walk_tasks(memory, dwarf, [&](const guest_task &task) {
+    task_cred entry;
+    if (!task.field(cred_offset, &entry.cred))
+      return;
+    entry.pid = (int32_t) task.pid;
+    creds.push_back(entry);
+  });
+  if (!ok)
+    return false;
+
+  std::vector<shared_cred> shared;
+  find_shared_creds(creds, shared);
+  for (size_t i = 0; i < shared.size(); i++)
+  {
+    std::string pids;
+    for (size_t j = 0; j < shared[i].pids.size(); j++)
+      pids += (j ? "," : "") + std::to_string(shared[i].pids[j]);
+
+    analysis_finding finding;
+    finding.push_back(std::make_pair(std::string("cred"), check_hex(shared[i].cred)));
+    finding.push_back(std::make_pair(std::string("pids"), pids));
+    result.findings.push_back(finding);
+  }
+
+  result.seconds = (latency_now_ns() - start) / 1e9;
+  return true;
+}
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef NAIVE_COALESCE
+#define NAIVE_COALESCE
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <unordered_map>
+
+#include "naive-ring.h"
+
+// Event types are single bit flags (PROCESS_EVENT, MODULE_EVENT, ...)
+#define COALESCE_MAX_TYPES 32
+
+// Returned by next_deadline when nothing is pending
+#define COALESCE_NO_DEADLINE UINT64_MAX
+
+// Written lines are tracked per object in 64-byte lines, for the first 16 KB of it
+#define COALESCE_LINE_SHIFT 6
+#define COALESCE_LINE_WORDS 4
+
+/////////////////////
+// Coalesced Batch
+/////////////////////
+struct coalesced_object
+{
+  unsigned long raw_events;
+  uint64_t first_seen;
+  uint64_t last_seen;
+  uint64_t dirty_lines[COALESCE_LINE_WORDS];  // Bit i: a write hit bytes [64i, 64i+64) of the object
+};
+
+struct coalesced_event
+{
+  uint32_t type;
+  unsigned long raw_events;   // Raw ring events merged into this analysis
+  uint64_t first_seen;        // Timestamps of first and last merged event
+  uint64_t last_seen;
+
+  // Per watched object (physical address) breakdown
+  std::unordered_map<uint64_t, coalesced_object> objects;
+};
+
+/**
+ * Debounces raw write events into at most one analysis per event type.
+ * A type becomes due once no event has arrived for quiet_window_ns and
+ * at least quiet_window_ns has passed since its previous analysis.
+ * max_delay_ns bounds how long a continuous burst can postpone it.
+ * Events added while an analysis runs are merged into one follow-up.
+ * Only used from the analysis thread, so no locking.
+ **/
+class EventCoalescer
+{
+ public:
+
+  explicit EventCoalescer(uint64_t quiet_window_ns = 0, uint64_t max_delay_ns = 0)
+  {
+    configure(quiet_window_ns, max_delay_ns);
+  }
+
+  void configure(uint64_t quiet_window_ns, uint64_t max_delay_ns)
+  {
+    quiet_window_ns_ = quiet_window_ns;
+    max_delay_ns_ = max_delay_ns;
+  }
+
+  // Returns false if the type is not a single known bit
+  bool add(const naive_event &event)
+  {
+    int index = type_index(event.type);
+    if (index < 0)
+      return false;
+
+    slot &pending = slots_[index];
+    if (pending.batch.raw_events == 0)
+    {
+      pending.batch.type = event.type;
+      pending.batch.first_seen = event.timestamp;
+      dirty_mask_ |= event.type;
+    }
+    pending.batch.raw_events++;
+    if (event.timestamp > pending.batch.last_seen)
+      pending.batch.last_seen = event.timestamp;
+
+    coalesced_object &object = pending.batch.objects[event.object];
+    if (object.raw_events == 0)
+      object.first_seen = event.timestamp;
+    object.raw_events++;
+    object.last_seen = event.timestamp;
+
+    uint64_t written = (event.gfn << 12) + event.offset;
+    uint64_t line = (written - event.object) >> COALESCE_LINE_SHIFT;
+    if (written >= event.object && line < COALESCE_LINE_WORDS * 64)
+      object.dirty_lines[line / 64] |= 1ull << (line % 64);
+
+    total_raw_++;
+    return true;
+  }
+
+  // Bit mask of dirty types whose quiet window has elapsed, ignoring the blocked types
+  uint32_t due(uint64_t now, uint32_t blocked = 0) const
+  {
+    uint32_t result = 0;
+    for (uint32_t mask = dirty_mask_ & ~blocked; mask != 0; mask &= mask - 1)
+    {
+      int index = __builtin_ctz(mask);
+      if (due_at(slots_[index]) <= now)
+        result |= 1u << index;
+    }
+    return result;
+  }
+
+  // Earliest time any dirty type that is not blocked becomes due
+  uint64_t next_deadline(uint32_t blocked = 0) const
+  {
+    uint64_t deadline = COALESCE_NO_DEADLINE;
+    for (uint32_t mask = dirty_mask_ & ~blocked; mask != 0; mask &= mask - 1)
+    {
+      uint64_t at = due_at(slots_[__builtin_ctz(mask)]);
+      if (at < deadline)
+        deadline = at;
+    }
+    return deadline;
+  }
+
+  // Moves the pending batch for type into out and marks the analysis as started at now
+  bool take(uint32_t type, uint64_t now, coalesced_event &out)
+  {
+    int index = type_index(type);
+    if (index < 0 || !(dirty_mask_ & type))
+      return false;
+
+    slot &pending = slots_[index];
+    out.type = type;
+    out.raw_events = pending.batch.raw_events;
+    out.first_seen = pending.batch.first_seen;
+    out.last_seen = pending.batch.last_seen;
+    out.objects.swap(pending.batch.objects);
+
+    pending.batch.raw_events = 0;
+    pending.batch.first_seen = 0;
+    pending.batch.last_seen = 0;
+    pending.batch.objects.clear();
+    pending.previous_run = pending.last_run;
+    pending.last_run = now;
+    dirty_mask_ &= ~type;
+
+    total_analyses_++;
+    return true;
+  }
+
+  // Undoes a take() whose batch could not be handed on: merges it back into the events pending since and
+  // restores the previous analysis time, so it is due again as before
+  void restore(const coalesced_event &batch)
+  {
+    int index = type_index(batch.type);
+    if (index < 0 || batch.raw_events == 0)
+      return;
+
+    slot &pending = slots_[index];
+    if (pending.batch.raw_events == 0)
+    {
+      pending.batch.type = batch.type;
+      pending.batch.first_seen = batch.first_seen;
+      dirty_mask_ |= batch.type;
+    }
+    else if (batch.first_seen < pending.batch.first_seen)
+      pending.batch.first_seen = batch.first_seen;
+    if (batch.last_seen > pending.batch.last_seen)
+      pending.batch.last_seen = batch.last_seen;
+    pending.batch.raw_events += batch.raw_events;
+
+    for (std::unordered_map<uint64_t, coalesced_object>::const_iterator it = batch.objects.begin(); it != batch.objects.end(); ++it)
+    {
+      coalesced_object &object = pending.batch.objects[it->first];
+      if (object.raw_events == 0 || it->second.first_seen < object.first_seen)
+        object.first_seen = it->second.first_seen;
+      if (it->second.last_seen > object.last_seen)
+        object.last_seen = it->second.last_seen;
+      object.raw_events += it->second.raw_events;
+      for (unsigned i = 0; i < COALESCE_LINE_WORDS; i++)
+        object.dirty_lines[i] |= it->second.dirty_lines[i];
+    }
+
+    pending.last_run = pending.previous_run;
+    total_analyses_--;
+  }
+
+  bool pending() const { return dirty_mask_ != 0; }
+  uint32_t dirty_mask() const { return dirty_mask_; }
+  unsigned long total_raw_events() const { return total_raw_; }
+  unsigned long total_analyses() const { return total_analyses_; }
+  uint64_t quiet_window_ns() const { return quiet_window_ns_; }
+
+ private:
+
+  struct slot
+  {
+    coalesced_event batch = coalesced_event();
+    uint64_t last_run = 0;
+    uint64_t previous_run = 0;    // last_run before the latest take(), for restore()
+  };
+
+  static int type_index(uint32_t type)
+  {
+    if (type == 0 || (type & (type - 1)) != 0)
+      return -1;
+    return __builtin_ctz(type);
+  }
+
+  uint64_t due_at(const slot &pending) const
+  {
+    uint64_t at = pending.batch.last_seen + quiet_window_ns_;
+    if (max_delay_ns_ != 0 && pending.batch.first_seen + max_delay_ns_ < at)
+      at = pending.batch.first_seen + max_delay_ns_;
+
+    // Never more than one analysis per type per window
+    if (pending.last_run != 0 && pending.last_run + quiet_window_ns_ > at)
+      at = pending.last_run + quiet_window_ns_;
+    return at;
+  }
+
+  slot slots_[COALESCE_MAX_TYPES];
+  uint32_t dirty_mask_ = 0;
+  uint64_t quiet_window_ns_ = 0;
+  uint64_t max_delay_ns_ = 0;
+  unsigned long total_raw_ = 0;
+  unsigned long total_analyses_ = 0;
+};
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef NAIVE_DELTA
+#define NAIVE_DELTA
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <unordered_map>
+#include <vector>
+
+// Event types are single bit flags (PROCESS_EVENT, MODULE_EVENT, ...)
+#define DELTA_MAX_TYPES 32
+
+/////////////////////
+// Pass Statistics
+/////////////////////
+struct delta_stats
+{
+  unsigned long passes;        // Completed passes (full + delta)
+  unsigned long full_passes;   // Passes that started from an empty set
+  unsigned long walked;        // Objects visited by the list walks
+  unsigned long added;         // Objects that needed a new watch
+  unsigned long removed;       // Objects that vanished and were unwatched
+  unsigned long unchanged;     // Objects already watched, no libvmi call made
+  uint64_t full_ns;            // Time spent in full passes
+  uint64_t delta_ns;           // Time spent in delta passes
+};
+
+/////////////////////
+// Watched Object Set
+/////////////////////
+struct watched_object
+{
+  uint64_t physical_addr;
+  int size;
+  uint32_t epoch;   // Pass that last saw the object
+};
+
+/**
+ * Currently watched objects per event type, keyed by physical address.
+ * A re-check walks the guest list between begin_pass() and end_pass(),
+ * calling observe() for every object; observe() says whether the object
+ * needs a watch (new, or re-sized) and end_pass() returns the objects the
+ * walk no longer found.
+ * An aborted pass (failed walk) leaves the set untouched.
+ **/
+class WatchSet
+{
+ public:
+
+  WatchSet() = default;
+  WatchSet(const WatchSet&) = delete;            // disable copying
+  WatchSet& operator=(const WatchSet&) = delete; // disable assignment
+
+  void begin_pass(uint32_t type, uint64_t now_ns)
+  {
+    pass &current = passes_[type_index(type)];
+    current.full = current.objects.empty();
+    current.epoch++;
+    current.start_ns = now_ns;
+    current.walked = current.added = current.removed = 0;
+  }
+
+  // Records that the walk found the object. Returns true if it needs a watch; if it was
+  // watched with a different size, *old_size is set (else 0) and that watch must go first.
+  bool observe(uint32_t type, uint64_t physical_addr, int size, int *old_size)
+  {
+    pass &current = passes_[type_index(type)];
+    current.walked++;
+    *old_size = 0;
+
+    watched_object &object = current.objects[physical_addr];
+    if (object.epoch == current.epoch)
+      return false; // Seen twice in one walk (e.g. shared files_struct)
+
+    bool needs_watch = object.epoch == 0 || object.size != size;
+    if (needs_watch)
+    {
+      if (object.epoch != 0)
+        *old_size = object.size;
+      object.physical_addr = physical_addr;
+      object.size = size;
+      current.added++;
+    }
+    else
+      stats_.unchanged++;
+
+    object.epoch = current.epoch;
+    return needs_watch;
+  }
+
+  // Forgets an object whose watch could not be registered
+  void forget(uint32_t type, uint64_t physical_addr)
+  {
+    passes_[type_index(type)].objects.erase(physical_addr);
+  }
+
+  // Finishes the pass; out receives the vanished objects to unwatch
+  void end_pass(uint32_t type, uint64_t now_ns, std::vector<watched_object> &out)
+  {
+    pass &current = passes_[type_index(type)];
+    out.clear();
+
+    for (auto it = current.objects.begin(); it != current.objects.end();)
+    {
+      if (it->second.epoch != current.epoch)
+      {
+        out.push_back(it->second);
+        it = current.objects.erase(it);
+        current.removed++;
+      }
+      else
+        ++it;
+    }
+
+    uint64_t elapsed = now_ns - current.start_ns;
+    stats_.passes++;
+    stats_.walked += current.walked;
+    stats_.added += current.added;
+    stats_.removed += current.removed;
+    if (current.full)
+    {
+      stats_.full_passes++;
+      stats_.full_ns += elapsed;
+    }
+    else
+      stats_.delta_ns += elapsed;
+  }
+
+  // Keeps everything watched, e.g. when the walk failed half way
+  void abort_pass(uint32_t type)
+  {
+    pass &current = passes_[type_index(type)];
+    current.epoch++;
+    for (auto it = current.objects.begin(); it != current.objects.end(); ++it)
+      it->second.epoch = current.epoch;
+  }
+
+  // Summary line of the last pass for type
+  void print_pass(uint32_t type, const char *name, uint64_t now_ns) const
+  {
+    const pass &current = passes_[type_index(type)];
+    printf("%s %s pass: walked %lu, added %lu, removed %lu, watched %lu in %.3f ms\n",
+      name, current.full ? "full" : "delta", current.walked, current.added, current.removed,
+      (unsigned long) current.objects.size(), (now_ns - current.start_ns) / 1e6);
+  }
+
+  size_t size(uint32_t type) const { return passes_[type_index(type)].objects.size(); }
+  const delta_stats &stats() const { return stats_; }
+
+  void clear()
+  {
+    for (unsigned i = 0; i < DELTA_MAX_TYPES; i++)
+      passes_[i].objects.clear();
+  }
+
+ private:
+
+  struct pass
+  {
+    std::unordered_map<uint64_t, watched_object> objects;
+    uint32_t epoch = 0;
+    bool full = true;
+    uint64_t start_ns = 0;
+    unsigned long walked = 0;
+    unsigned long added = 0;
+    unsigned long removed = 0;
+  };
+
+  static unsigned type_index(uint32_t type)
+  {
+    return type ? __builtin_ctz(type) % DELTA_MAX_TYPES : 0;
+  }
+
+  pass passes_[DELTA_MAX_TYPES];
+  delta_stats stats_ = delta_stats();
+};
+
+#endif
@@ -0,0 +1,753 @@
+#ifndef NAIVE_DWARF
+#define NAIVE_DWARF
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/////////////////////
+// Binary Cache Layout
+/////////////////////
+#define DWARF_CACHE_MAGIC "NHDWARF"
+#define DWARF_CACHE_VERSION 2
+
+struct dwarf_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t struct_count;
+    uint32_t member_count;
+    uint32_t strings_size;
+
+    // Identity of the module.dwarf the cache was built from
+    uint64_t source_size;
+    int64_t source_mtime;
+    int64_t source_mtime_nsec;
+};
+
+struct dwarf_struct_entry
+{
+    uint32_t name;          // Offset into string pool
+    uint32_t size;          // DW_AT_byte_size
+    uint32_t first_member;  // Index into member table
+    uint32_t member_count;
+};
+
+struct dwarf_member_entry
+{
+    uint32_t name;          // Offset into string pool
+    uint32_t type;          // Offset into string pool (resolved type name)
+    uint32_t offset;        // Offset from start of enclosing struct
+    uint32_t size;          // Byte size of member type (0 if unknown)
+};
+
+/////////////////////
+// DWARF Type Index
+/////////////////////
+
+/**
+ * One-pass index over the dwarfdump text of module.dwarf. Members of
+ * anonymous structs/unions are flattened into their enclosing struct.
+ * Both a fresh parse and an mmapped cache expose the same sorted tables.
+ **/
+class DwarfIndex
+{
+ public:
+
+  DwarfIndex() = default;
+  DwarfIndex(const DwarfIndex&) = delete;            // disable copying
+  DwarfIndex& operator=(const DwarfIndex&) = delete; // disable assignment
+
+  ~DwarfIndex()
+  {
+    unmap();
+  }
+
+  // Load from "<dwarf_path>.cache" if it is current, otherwise parse and (re)write it
+  bool load(const std::string &dwarf_path)
+  {
+    std::string cache_path = dwarf_path + ".cache";
+    if (load_cache(cache_path, dwarf_path))
+      return true;
+
+    if (!load_text(dwarf_path))
+      return false;
+
+    if (!write_cache(cache_path, dwarf_path))
+      printf("Failed to write DWARF cache: %s\n", cache_path.c_str());
+
+    return true;
+  }
+
+  bool load_text(const std::string &dwarf_path)
+  {
+    unmap();
+
+    std::string text;
+    if (!read_file(dwarf_path, text))
+    {
+      printf("Failed to read DWARF file: %s\n", dwarf_path.c_str());
+      return false;
+    }
+
+    parse(text);
+    return true;
+  }
+
+  bool load_cache(const std::string &cache_path, const std::string &dwarf_path)
+  {
+    unmap();
+
+    struct stat source_st;
+    if (stat(dwarf_path.c_str(), &source_st) != 0)
+      return false;
+
+    int fd = open(cache_path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat cache_st;
+    if (fstat(fd, &cache_st) != 0 || (size_t) cache_st.st_size < sizeof(dwarf_cache_header))
+    {
+      close(fd);
+      return false;
+    }
+
+    void *map = mmap(NULL, cache_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      return false;
+
+    const dwarf_cache_header *header = (const dwarf_cache_header *) map;
+    uint64_t expected_size = sizeof(dwarf_cache_header)
+      + (uint64_t) header->struct_count * sizeof(dwarf_struct_entry)
+      + (uint64_t) header->member_count * sizeof(dwarf_member_entry)
+      + header->strings_size;
+
+    if (memcmp(header->magic, DWARF_CACHE_MAGIC, sizeof(header->magic)) != 0
+      || header->version != DWARF_CACHE_VERSION
+      || header->source_size != (uint64_t) source_st.st_size
+      || header->source_mtime != (int64_t) source_st.st_mtim.tv_sec
+      || header->source_mtime_nsec != (int64_t) source_st.st_mtim.tv_nsec
+      || expected_size != (uint64_t) cache_st.st_size)
+    {
+      munmap(map, cache_st.st_size);
+      return false;
+    }
+
+    map_ = map;
+    map_size_ = cache_st.st_size;
+
+    const char *cursor = (const char *) map + sizeof(dwarf_cache_header);
+    structs_ = (const dwarf_struct_entry *) cursor;
+    struct_count_ = header->struct_count;
+    cursor += struct_count_ * sizeof(dwarf_struct_entry);
+    members_ = (const dwarf_member_entry *) cursor;
+    member_count_ = header->member_count;
+    cursor += member_count_ * sizeof(dwarf_member_entry);
+    strings_ = cursor;
+
+    // A cache the lookups could read out of bounds or binary search wrongly is reparsed instead
+    if (!valid_tables(header->strings_size))
+    {
+      unmap();
+      return false;
+    }
+
+    return true;
+  }
+
+  bool write_cache(const std::string &cache_path, const std::string &dwarf_path) const
+  {
+    struct stat source_st;
+    if (stat(dwarf_path.c_str(), &source_st) != 0)
+      return false;
+
+    dwarf_cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DWARF_CACHE_MAGIC, sizeof(header.magic));
+    header.version = DWARF_CACHE_VERSION;
+    header.struct_count = struct_count_;
+    header.member_count = member_count_;
+    header.strings_size = strings_size();
+    header.source_size = source_st.st_size;
+    header.source_mtime = source_st.st_mtim.tv_sec;
+    header.source_mtime_nsec = source_st.st_mtim.tv_nsec;
+
+    // Write to a temporary file and rename so readers never map a partial cache
+    std::string tmp_path = cache_path + ".tmp";
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (!fp)
+      return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+      && fwrite(structs_, sizeof(dwarf_struct_entry), struct_count_, fp) == struct_count_
+      && fwrite(members_, sizeof(dwarf_member_entry), member_count_, fp) == member_count_
+      && fwrite(strings_, 1, header.strings_size, fp) == header.strings_size;
+
+    if (fclose(fp) != 0)
+      ok = false;
+
+    if (!ok || rename(tmp_path.c_str(), cache_path.c_str()) != 0)
+    {
+      unlink(tmp_path.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  // Returns -1 if struct is not found
+  int struct_size(const std::string &struct_name) const
+  {
+    const dwarf_struct_entry *entry = find_struct(struct_name.c_str());
+    return entry ? (int) entry->size : -1;
+  }
+
+  // Returns -1 if struct or member is not found
+  int member_offset(const std::string &struct_name, const std::string &member_name) const
+  {
+    const dwarf_member_entry *entry = find_member(struct_name.c_str(), member_name.c_str());
+    return entry ? (int) entry->offset : -1;
+  }
+
+  // Returns -1 if struct or member is not found
+  int member_size(const std::string &struct_name, const std::string &member_name) const
+  {
+    const dwarf_member_entry *entry = find_member(struct_name.c_str(), member_name.c_str());
+    return entry ? (int) entry->size : -1;
+  }
+
+  // Returns empty string if struct or member is not found
+  std::string member_type(const std::string &struct_name, const std::string &member_name) const
+  {
+    const dwarf_member_entry *entry = find_member(struct_name.c_str(), member_name.c_str());
+    return entry ? std::string(strings_ + entry->type) : std::string();
+  }
+
+  const dwarf_struct_entry *find_struct(const char *struct_name) const
+  {
+    const dwarf_struct_entry *end = structs_ + struct_count_;
+    const dwarf_struct_entry *it = std::lower_bound(structs_, end, struct_name,
+      [this](const dwarf_struct_entry &entry, const char *name) { return strcmp(strings_ + entry.name, name) < 0; });
+
+    if (it == end || strcmp(strings_ + it->name, struct_name) != 0)
+      return NULL;
+    return it;
+  }
+
+  const dwarf_member_entry *find_member(const char *struct_name, const char *member_name) const
+  {
+    const dwarf_struct_entry *parent = find_struct(struct_name);
+    if (!parent)
+      return NULL;
+
+    const dwarf_member_entry *begin = members_ + parent->first_member;
+    const dwarf_member_entry *end = begin + parent->member_count;
+    const dwarf_member_entry *it = std::lower_bound(begin, end, member_name,
+      [this](const dwarf_member_entry &entry, const char *name) { return strcmp(strings_ + entry.name, name) < 0; });
+
+    if (it == end || strcmp(strings_ + it->name, member_name) != 0)
+      return NULL;
+    return it;
+  }
+
+  // Members of a struct, sorted by name
+  const dwarf_member_entry *members_begin(const dwarf_struct_entry *entry) const { return members_ + entry->first_member; }
+  const dwarf_member_entry *members_end(const dwarf_struct_entry *entry) const { return members_ + entry->first_member + entry->member_count; }
+  const char *string_at(uint32_t offset) const { return strings_ + offset; }
+
+  bool loaded() const { return structs_ != NULL; }
+  bool mapped() const { return map_ != NULL; }
+  uint32_t struct_count() const { return struct_count_; }
+  uint32_t member_count() const { return member_count_; }
+
+ private:
+
+  struct die
+  {
+    int tag;
+    uint32_t name;          // Offset into string pool, 0 if anonymous
+    uint32_t byte_size;
+    uint64_t type_key;      // Referenced type key, 0 if none
+    uint32_t member_offset;
+    uint32_t upper_bound;
+    bool has_upper_bound;
+    bool declaration;
+    std::vector<size_t> children;
+  };
+
+  enum { TAG_OTHER, TAG_STRUCT, TAG_UNION, TAG_MEMBER, TAG_BASE, TAG_TYPEDEF, TAG_POINTER,
+    TAG_CONST, TAG_VOLATILE, TAG_ARRAY, TAG_SUBRANGE, TAG_ENUM, TAG_SUBROUTINE };
+
+  static bool read_file(const std::string &path, std::string &out)
+  {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp)
+      return false;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < 0)
+    {
+      fclose(fp);
+      return false;
+    }
+
+    out.resize(size);
+    bool ok = fread(&out[0], 1, size, fp) == (size_t) size;
+    fclose(fp);
+    return ok;
+  }
+
+  // Attribute value between "<attr><" and the matching ">", or NULL
+  static const char *find_attr(const char *line, const char *line_end, const char *attr, size_t attr_len)
+  {
+    const char *pos = line;
+    while (pos < line_end)
+    {
+      const char *hit = (const char *) memmem(pos, line_end - pos, attr, attr_len);
+      if (!hit)
+        return NULL;
+      if (hit + attr_len < line_end && hit[attr_len] == '<')
+        return hit + attr_len + 1;
+      pos = hit + attr_len;
+    }
+    return NULL;
+  }
+
+  static int parse_tag(const char *tag, size_t len)
+  {
+    #define DWARF_TAG_IS(literal) (len == sizeof(literal) - 1 && memcmp(tag, literal, len) == 0)
+    if (DWARF_TAG_IS("DW_TAG_structure_type")) return TAG_STRUCT;
+    if (DWARF_TAG_IS("DW_TAG_union_type")) return TAG_UNION;
+    if (DWARF_TAG_IS("DW_TAG_member")) return TAG_MEMBER;
+    if (DWARF_TAG_IS("DW_TAG_base_type")) return TAG_BASE;
+    if (DWARF_TAG_IS("DW_TAG_typedef")) return TAG_TYPEDEF;
+    if (DWARF_TAG_IS("DW_TAG_pointer_type")) return TAG_POINTER;
+    if (DWARF_TAG_IS("DW_TAG_const_type")) return TAG_CONST;
+    if (DWARF_TAG_IS("DW_TAG_volatile_type")) return TAG_VOLATILE;
+    if (DWARF_TAG_IS("DW_TAG_array_type")) return TAG_ARRAY;
+    if (DWARF_TAG_IS("DW_TAG_subrange_type")) return TAG_SUBRANGE;
+    if (DWARF_TAG_IS("DW_TAG_enumeration_type")) return TAG_ENUM;
+    if (DWARF_TAG_IS("DW_TAG_subroutine_type")) return TAG_SUBROUTINE;
+    #undef DWARF_TAG_IS
+    return TAG_OTHER;
+  }
+
+  uint32_t intern(const char *str, size_t len)
+  {
+    std::string key(str, len);
+    std::unordered_map<std::string, uint32_t>::iterator it = interned_.find(key);
+    if (it != interned_.end())
+      return it->second;
+
+    uint32_t offset = (uint32_t) own_strings_.size();
+    own_strings_.insert(own_strings_.end(), str, str + len);
+    own_strings_.push_back('\0');
+    interned_[key] = offset;
+    return offset;
+  }
+
+  void parse(const std::string &text)
+  {
+    own_structs_.clear();
+    own_members_.clear();
+    own_strings_.clear();
+    interned_.clear();
+    dies_.clear();
+    die_keys_.clear();
+
+    // Offset 0 is the anonymous (empty) name
+    intern("", 0);
+
+    uint64_t cu = 0;
+    size_t parent = (size_t) -1;
+    const char *cursor = text.data();
+    const char *text_end = cursor + text.size();
+
+    while (cursor < text_end)
+    {
+      const char *line_end = (const char *) memchr(cursor, '\n', text_end - cursor);
+      if (!line_end)
+        line_end = text_end;
+      const char *line = cursor;
+      cursor = line_end + 1;
+
+      // Format: <depth><0xoffset><DW_TAG_xxx> DW_AT_xxx<value> ...
+      if (line_end - line < 8 || line[0] != '<')
+        continue;
+
+      char *after_depth = NULL;
+      long depth = strtol(line + 1, &after_depth, 10);
+      if (after_depth[0] != '>' || after_depth[1] != '<')
+        continue;
+
+      char *after_offset = NULL;
+      uint64_t die_offset = strtoull(after_depth + 2, &after_offset, 16);
+      const char *tag_start = strchr(after_offset, '<');
+      if (!tag_start || tag_start >= line_end)
+        continue;
+      tag_start++;
+      const char *tag_end = (const char *) memchr(tag_start, '>', line_end - tag_start);
+      if (!tag_end)
+        continue;
+
+      if (depth == 0)
+      {
+        // Type references are relative to their compile unit
+        cu++;
+        parent = (size_t) -1;
+        continue;
+      }
+
+      die entry;
+      entry.tag = parse_tag(tag_start, tag_end - tag_start);
+      entry.name = 0;
+      entry.byte_size = 0;
+      entry.type_key = 0;
+      entry.member_offset = 0;
+      entry.upper_bound = 0;
+      entry.has_upper_bound = false;
+      entry.declaration = false;
+
+      if (entry.tag == TAG_OTHER)
+      {
+        if (depth == 1)
+          parent = (size_t) -1;
+        continue;
+      }
+
+      const char *value;
+      static const char name_attr[] = "DW_AT_name";
+      if ((value = find_attr(tag_end, line_end, name_attr, sizeof(name_attr) - 1)) && *value == '"')
+      {
+        const char *name_end = (const char *) memchr(value + 1, '"', line_end - value - 1);
+        if (name_end)
+          entry.name = intern(value + 1, name_end - value - 1);
+      }
+
+      static const char size_attr[] = "DW_AT_byte_size";
+      if ((value = find_attr(tag_end, line_end, size_attr, sizeof(size_attr) - 1)))
+        entry.byte_size = (uint32_t) strtoul(value, NULL, 0);
+
+      static const char type_attr[] = "DW_AT_type";
+      if ((value = find_attr(tag_end, line_end, type_attr, sizeof(type_attr) - 1)) && *value == '<')
+        entry.type_key = (cu << 32) | strtoull(value + 1, NULL, 16);
+
+      static const char location_attr[] = "DW_AT_data_member_location";
+      if ((value = find_attr(tag_end, line_end, location_attr, sizeof(location_attr) - 1)))
+        entry.member_offset = (uint32_t) strtoul(value, NULL, 10);
+
+      static const char bound_attr[] = "DW_AT_upper_bound";
+      if ((value = find_attr(tag_end, line_end, bound_attr, sizeof(bound_attr) - 1)))
+      {
+        entry.upper_bound = (uint32_t) strtoul(value, NULL, 0);
+        entry.has_upper_bound = true;
+      }
+
+      static const char declaration_attr[] = "DW_AT_declaration";
+      entry.declaration = find_attr(tag_end, line_end, declaration_attr, sizeof(declaration_attr) - 1) != NULL;
+
+      size_t index = dies_.size();
+      dies_.push_back(entry);
+
+      if (depth == 1)
+      {
+        die_keys_[(cu << 32) | die_offset] = index;
+        parent = index;
+      }
+      else if (depth == 2 && parent != (size_t) -1)
+      {
+        dies_[parent].children.push_back(index);
+      }
+    }
+
+    build_tables();
+
+    dies_.clear();
+    die_keys_.clear();
+    interned_.clear();
+  }
+
+  const die *lookup(uint64_t type_key) const
+  {
+    if (type_key == 0)
+      return NULL;
+    std::unordered_map<uint64_t, size_t>::const_iterator it = die_keys_.find(type_key);
+    return it == die_keys_.end() ? NULL : &dies_[it->second];
+  }
+
+  uint32_t resolve_size(const die *type, int depth = 0) const
+  {
+    if (!type || depth > 32)
+      return 0;
+
+    switch (type->tag)
+    {
+      case TAG_TYPEDEF:
+      case TAG_CONST:
+      case TAG_VOLATILE:
+        return resolve_size(lookup(type->type_key), depth + 1);
+      case TAG_ARRAY:
+      {
+        uint32_t count = 1;
+        for (size_t i = 0; i < type->children.size(); i++)
+        {
+          const die &range = dies_[type->children[i]];
+          if (range.tag == TAG_SUBRANGE)
+            count *= range.has_upper_bound ? range.upper_bound + 1 : 0;
+        }
+        return resolve_size(lookup(type->type_key), depth + 1) * count;
+      }
+      default:
+        return type->byte_size;
+    }
+  }
+
+  std::string resolve_name(const die *type, int depth = 0)
+  {
+    if (!type)
+      return "void";
+    if (depth > 32)
+      return "?";
+
+    switch (type->tag)
+    {
+      case TAG_POINTER:
+        return resolve_name(lookup(type->type_key), depth + 1) + " *";
+      case TAG_CONST:
+      case TAG_VOLATILE:
+        return resolve_name(lookup(type->type_key), depth + 1);
+      case TAG_ARRAY:
+        return resolve_name(lookup(type->type_key), depth + 1) + " []";
+      case TAG_SUBROUTINE:
+        return "function";
+      case TAG_STRUCT:
+        return type->name ? "struct " + std::string(&own_strings_[type->name]) : "struct <anonymous>";
+      case TAG_UNION:
+        return type->name ? "union " + std::string(&own_strings_[type->name]) : "union <anonymous>";
+      case TAG_ENUM:
+        return type->name ? "enum " + std::string(&own_strings_[type->name]) : "enum <anonymous>";
+      default:
+        return type->name ? std::string(&own_strings_[type->name]) : "?";
+    }
+  }
+
+  void flatten_members(const die &parent, uint32_t base_offset, int depth)
+  {
+    if (depth > 8)
+      return;
+
+    for (size_t i = 0; i < parent.children.size(); i++)
+    {
+      const die &member = dies_[parent.children[i]];
+      if (member.tag != TAG_MEMBER)
+        continue;
+
+      const die *type = lookup(member.type_key);
+      uint32_t offset = base_offset + member.member_offset;
+
+      if (member.name == 0)
+      {
+        // Anonymous struct/union: hoist its members into the parent
+        if (type && (type->tag == TAG_STRUCT || type->tag == TAG_UNION) && type->name == 0)
+          flatten_members(*type, offset, depth + 1);
+        continue;
+      }
+
+      std::string type_name = resolve_name(type);
+      dwarf_member_entry entry;
+      entry.name = member.name;
+      entry.type = intern(type_name.data(), type_name.size());
+      entry.offset = offset;
+      entry.size = resolve_size(type);
+      own_members_.push_back(entry);
+    }
+  }
+
+  void build_tables()
+  {
+    std::vector<size_t> struct_dies;
+    std::unordered_map<uint32_t, bool> seen;
+    for (size_t i = 0; i < dies_.size(); i++)
+    {
+      const die &entry = dies_[i];
+      if (entry.tag != TAG_STRUCT || entry.name == 0 || entry.declaration)
+        continue;
+
+      // First full definition wins (both compile units carry the same kernel types)
+      if (seen.count(entry.name))
+        continue;
+      seen[entry.name] = true;
+      struct_dies.push_back(i);
+    }
+
+    for (size_t i = 0; i < struct_dies.size(); i++)
+    {
+      const die &entry = dies_[struct_dies[i]];
+
+      dwarf_struct_entry struct_entry;
+      struct_entry.name = entry.name;
+      struct_entry.size = entry.byte_size;
+      struct_entry.first_member = (uint32_t) own_members_.size();
+      flatten_members(entry, 0, 0);
+      struct_entry.member_count = (uint32_t) own_members_.size() - struct_entry.first_member;
+
+      const char *pool = own_strings_.data();
+      std::stable_sort(own_members_.begin() + struct_entry.first_member, own_members_.end(),
+        [pool](const dwarf_member_entry &a, const dwarf_member_entry &b) { return strcmp(pool + a.name, pool + b.name) < 0; });
+
+      own_structs_.push_back(struct_entry);
+    }
+
+    const char *pool = own_strings_.data();
+    std::sort(own_structs_.begin(), own_structs_.end(),
+      [pool](const dwarf_struct_entry &a, const dwarf_struct_entry &b) { return strcmp(pool + a.name, pool + b.name) < 0; });
+
+    structs_ = own_structs_.data();
+    struct_count_ = (uint32_t) own_structs_.size();
+    members_ = own_members_.data();
+    member_count_ = (uint32_t) own_members_.size();
+    strings_ = own_strings_.data();
+  }
+
+  // Every struct's members inside the member table, every string offset inside a NUL-terminated string
+  // pool, and both tables sorted by name as find_struct and find_member expect
+  bool valid_tables(uint32_t strings_size) const
+  {
+    if (strings_size == 0 || strings_[strings_size - 1] != '\0')
+      return false;
+
+    for (uint32_t i = 0; i < struct_count_; i++)
+    {
+      const dwarf_struct_entry &entry = structs_[i];
+      if (entry.name >= strings_size || entry.first_member > member_count_
+        || entry.member_count > member_count_ - entry.first_member)
+        return false;
+      if (i > 0 && strcmp(strings_ + structs_[i - 1].name, strings_ + entry.name) > 0)
+        return false;
+
+      for (uint32_t j = entry.first_member; j < entry.first_member + entry.member_count; j++)
+      {
+        if (members_[j].name >= strings_size || members_[j].type >= strings_size)
+          return false;
+        if (j > entry.first_member && strcmp(strings_ + members_[j - 1].name, strings_ + members_[j].name) > 0)
+          return false;
+      }
+    }
+
+    // Members no struct points at are never looked up, but their strings are checked all the same
+    for (uint32_t j = 0; j < member_count_; j++)
+    {
+      if (members_[j].name >= strings_size || members_[j].type >= strings_size)
+        return false;
+    }
+    return true;
+  }
+
+  uint32_t strings_size() const
+  {
+    if (map_)
+    {
+      const dwarf_cache_header *header = (const dwarf_cache_header *) map_;
+      return header->strings_size;
+    }
+    return (uint32_t) own_strings_.size();
+  }
+
+  void unmap()
+  {
+    if (map_)
+      munmap(map_, map_size_);
+    map_ = NULL;
+    map_size_ = 0;
+    structs_ = NULL;
+    members_ = NULL;
+    strings_ = NULL;
+    struct_count_ = 0;
+    member_count_ = 0;
+  }
+
+  // Active tables (either owned vectors or the mmapped cache)
+  const dwarf_struct_entry *structs_ = NULL;
+  const dwarf_member_entry *members_ = NULL;
+  const char *strings_ = NULL;
+  uint32_t struct_count_ = 0;
+  uint32_t member_count_ = 0;
+
+  void *map_ = NULL;
+  size_t map_size_ = 0;
+
+  std::vector<dwarf_struct_entry> own_structs_;
+  std::vector<dwarf_member_entry> own_members_;
+  std::vector<char> own_strings_;
+
+  // Parse-time state only
+  std::vector<die> dies_;
+  std::unordered_map<uint64_t, size_t> die_keys_;
+  std::unordered_map<std::string, uint32_t> interned_;
+};
+
+/////////////////////
+// Shared Indexes
+/////////////////////
+
+/**
+ * DWARF indexes shared by guests running the same kernel build. Guests
+ * naming the same module.dwarf (by device and inode, so symlinks and hard
+ * links count) get one DwarfIndex, loaded once. Indexes live as long as
+ * the registry. Not locked: load every guest's index before starting them.
+ **/
+class DwarfRegistry
+{
+ public:
+
+  DwarfRegistry() = default;
+  DwarfRegistry(const DwarfRegistry&) = delete;            // disable copying
+  DwarfRegistry& operator=(const DwarfRegistry&) = delete; // disable assignment
+
+  // Index of dwarf_path, loaded on first use; NULL if it cannot be loaded
+  const DwarfIndex *load(const std::string &dwarf_path)
+  {
+    struct stat st;
+    if (stat(dwarf_path.c_str(), &st) != 0)
+    {
+      printf("Failed to read DWARF file: %s\n", dwarf_path.c_str());
+      return NULL;
+    }
+
+    std::pair<dev_t, ino_t> key(st.st_dev, st.st_ino);
+    std::map<std::pair<dev_t, ino_t>, std::unique_ptr<DwarfIndex> >::const_iterator it = indexes_.find(key);
+    if (it != indexes_.end())
+      return it->second.get();
+
+    std::unique_ptr<DwarfIndex> index(new DwarfIndex());
+    if (!index->load(dwarf_path))
+      return NULL;
+    return (indexes_[key] = std::move(index)).get();
+  }
+
+  // Distinct indexes loaded
+  size_t size() const { return indexes_.size(); }
+
+ private:
+
+  std::map<std::pair<dev_t, ino_t>, std::unique_ptr<DwarfIndex> > indexes_;
+};
+
+#endif
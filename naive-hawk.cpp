@@ -19,14 +19,37 @@
 #include <libvmi/libvmi.h> 
 #include <libvmi/events.h>
 
+#include <algorithm>
 #include <atomic>
-#include <fstream>
+#include <map>
+#include <mutex>
 #include <string>
+#include <unordered_set>
+#include <vector>
 
 using namespace std;
 
-#include "naive-deque.h"
-#include "naive-event-list.h"
+#include "naive-adaptive.h"
+#include "naive-callback.h"
+#include "naive-coalesce.h"
+#include "naive-delta.h"
+#include "naive-dwarf.h"
+#include "naive-integrity.h"
+#include "naive-latency.h"
+#include "naive-listgraph.h"
+#include "naive-metrics.h"
+#include "naive-modes.h"
+#include "naive-pipeline.h"
+#include "naive-python.h"
+#include "naive-response.h"
+#include "naive-shadow.h"
+#include "naive-ring.h"
+#include "naive-trace.h"
+#include "naive-translate.h"
+#include "naive-vmi.h"
+#include "naive-walk.h"
+#include "naive-watch.h"
+#include "naive-workers.h"
 #include "naive-hawk.h"
   
 /////////////////////
@@ -38,95 +61,370 @@ using namespace std;
 
 #define PAUSE_VM 0
 
+// Capacity of the callback -> analysis thread ring (events beyond it are dropped and counted)
+#define EVENT_RING_CAPACITY 65536
+
+// Default quiet window before a dirty event type is analysed, and the longest a burst may delay it
+#define ANALYSIS_QUIET_WINDOW_MS 250
+#define ANALYSIS_MAX_DELAY_MS 2000
+
+// Default number of analysis worker threads (one check per event type runs at a time)
+#define ANALYSIS_WORKERS 4
+
+// Default bound on analyses queued for the workers across all guests, and the wait that raises one a priority level
+#define ANALYSIS_QUEUE_CAPACITY 64
+#define ANALYSIS_AGING_MS 1000
+
+// Longest listen while analyses may be waiting to read the guest (the event loop holds its libvmi instance meanwhile)
+#define ANALYSIS_LISTEN_MS 10
+
+// Volatility profile of the guest and directory holding analysis_engine.py
+#define ANALYSIS_PROFILE "LinuxDebian31604x64"
+#define ANALYSIS_SCRIPTS_DIR "scripts"
+
 // Event Names Contants
-#define INTERRUPTED_EVENT 0
 #define PROCESS_EVENT 1
 #define MODULE_EVENT 2
 #define AFINFO_EVENT 4
 #define OPEN_FILES_EVENT 8
 
+// Page table entry used by a cached translation; handled in the callback, never analysed
+#define PAGE_TABLE_EVENT 16
+
+// Bytes watched per page table entry
+#define PAGE_TABLE_ENTRY_SIZE 8
+
+// Event types with per-type counters (bit index of PROCESS_EVENT .. PAGE_TABLE_EVENT)
+#define EVENT_TYPE_COUNT 5
+
+// Callback latency histogram slots: one per event type (bit index) plus irrelevant writes
+#define LATENCY_SLOT_IRRELEVANT 5
+#define LATENCY_SLOTS 6
+
+// Seconds between periodic callback latency reports
+#define LATENCY_REPORT_INTERVAL 60
+
+// Milliseconds between metrics snapshots (--metrics=FILE), and hottest pages and objects exported per guest
+#define METRICS_INTERVAL_MS 1000
+#define METRICS_HOT_ENTRIES 20
+
+// Pages watched after each files_struct (64 (fd array size) * 256 (file struct size))
+#define OPEN_FILES_PAGES 4
+
+// vcpu of the events an integrity sweep finds
+#define INTEGRITY_SWEEP_VCPU (UINT32_MAX - 1)
+
+// Objects whose changes an analysis prints in full
+#define SHADOW_PRINT_OBJECTS 16
+
+// Default interval of the full walks the task and module list graphs are reconciled with
+#define LIST_RECONCILE_MS 60000
+
+// Most guests one detector process monitors (each is a source of the shared analysis workers)
+#define MAX_GUESTS WORKER_MAX_SOURCES
+
+typedef WatchTable<vmi_event_t>::page_type watched_page;
+
+// Callback counters of a guest: totals, then one per event type (bit index) for field hits and filtered writes
+enum guest_counter
+{
+    COUNTER_MONITORED,
+    COUNTER_IRRELEVANT,
+    COUNTER_TYPE_HIT,
+    COUNTER_TYPE_FILTERED = COUNTER_TYPE_HIT + EVENT_TYPE_COUNT,
+    GUEST_COUNTERS = COUNTER_TYPE_FILTERED + EVENT_TYPE_COUNT
+};
+
+// Trapped writes of a watched page, and relevant writes of a watched object, as of the last heat map
+struct page_heat
+{
+    uint64_t gfn;
+    uint64_t writes;
+};
+
+struct object_heat
+{
+    uint64_t object;
+    uint32_t type;
+    uint64_t hits;
+};
+
+/////////////////////
+// Guest State
+/////////////////////
+
+// DWARF index and watched members of one kernel build, shared by every guest running it
+struct kernel_profile
+{
+    const DwarfIndex *dwarf;
+    watch_fields process_fields;
+    watch_fields module_fields;
+
+    // Every member of the same structs by offset, naming the bytes a shadow diff finds changed
+    shadow_layout process_layout;
+    shadow_layout module_layout;
+};
+
+/**
+ * Per-VM detector state. Each guest has its own event loop thread, which
+ * owns vmi, the watch table and the callback counters, and its own
+ * dispatcher (security checking) thread draining event_ring. Analyses run
+ * on the shared worker pool with index as their source. Allocated with
+ * new (RingAligned keeps event_ring cache line aligned).
+ **/
+struct guest_context : RingAligned
+{
+    guest_context(const string &vm_name, unsigned guest_index, const kernel_profile *profile)
+        : name(vm_name), index(guest_index), kernel(profile), event_ring(EVENT_RING_CAPACITY, RING_DROP_NEWEST) {}
+
+    guest_context(const guest_context&) = delete;            // disable copying
+    guest_context& operator=(const guest_context&) = delete; // disable assignment
+
+    ~guest_context()
+    {
+        delete response;
+    }
+
+    string name;
+    unsigned index;
+    const kernel_profile *kernel;
+    vmi_instance_t vmi = NULL;
+    int status = 0;     // Exit status of the guest (see main)
+
+    // Held around every libvmi call on vmi: by the event loop across listens and watch changes, by workers to read
+    VmiLock vmi_lock;
+
+    SpscRing<naive_event> event_ring;
+    WatchTable<vmi_event_t> watch_table;
+    WatchSet watch_set;
+    EventCoalescer event_coalescer;
+    LatencyRecorder<LATENCY_SLOTS> callback_latency;
+
+    // Lets trapped writes complete (--response=NAME), set up once libvmi is initialised
+    ResponseStrategy *response = NULL;
+
+    // mem_write_cb instantiated for the detector modes, this guest's response and whether it records a trace
+    event_callback_t write_callback = NULL;
+
+    // Pages whose irrelevant write rate got them polled instead of trapped
+    AdaptiveController adaptive;
+
+    // Hash of each watched object's relevant bytes; analyses of objects that still match are skipped
+    IntegrityBaseline integrity;
+    atomic<unsigned long> integrity_skipped{0};
+    uint64_t next_integrity_sweep = 0;
+
+    // Last-known bytes of watched task_structs and modules, diffed to name the members that changed
+    ShadowStore shadow;
+    atomic<unsigned long> benign_skipped{0};
+
+    // Shadows of the init_task tasks and modules lists, updated from list_head writes
+    ListGraph task_graph;
+    ListGraph module_graph;
+    uint64_t next_list_reconcile = 0;
+
+    // Kernel VA -> PA translations and symbols, kept coherent by watching the page table entries used
+    TranslationCache translation_cache;
+    uint64_t kernel_dtb = 0;
+
+    // Binary trace of callback events and watch changes (--record=FILE)
+    TraceWriter event_trace;
+    string record_path;
+
+    // Event types whose watches the event loop should re-register (set by analysis workers, see defer_to_event_loop)
+    atomic<uint32_t> pending_reregister{0};
+
+    // Event loop thread, joined by main; security checking thread, joined by cleanup() before libvmi is torn down
+    pthread_t event_thread;
+    bool event_thread_started = false;
+    pthread_t security_thread;
+    bool security_thread_started = false;
+
+    // Result counters (guest_counter), written by the event loop and readable from any thread
+    ShardedCounters<GUEST_COUNTERS> counters;
+    LatencyRecorder<EVENT_TYPE_COUNT> analysis_latency;
+
+    // Hottest pages and objects, rebuilt by the event loop between callbacks for the metrics thread
+    pthread_mutex_t heat_lock = PTHREAD_MUTEX_INITIALIZER;
+    vector<page_heat> hot_pages;
+    vector<object_heat> hot_objects;
+    size_t watched_pages = 0;
+    size_t watched_ranges = 0;
+    adaptive_stats adaptive_snapshot = adaptive_stats();
+};
+
 /////////////////////
 // Global Variables
 /////////////////////
-Deque<int> event_deque;
-struct vmi_event_node *vmi_event_head;
-string dwarf_fp;
+vector<guest_context *> guests;
+PythonEngine analysis_engine;
+
+// Volatility session settings for the analysis engine (opened on the first guest)
+string analysis_profile = ANALYSIS_PROFILE;
+string analysis_location;
+string analysis_scripts = ANALYSIS_SCRIPTS_DIR;
+WorkerPool<coalesced_event> analysis_workers;
+unsigned analysis_worker_count = ANALYSIS_WORKERS;
+
+// Analysis queue: bound (0 unbounded), aging, priority per event type bit index (0 most urgent; module and
+// afinfo tampering go first) and the types whose queued analyses a full queue drops, oldest first
+size_t analysis_queue_capacity = ANALYSIS_QUEUE_CAPACITY;
+long analysis_aging_ms = ANALYSIS_AGING_MS;
+unsigned analysis_priorities[EVENT_TYPE_COUNT] = { 1, 0, 0, 1, 0 };
+uint32_t analysis_drop_types = PROCESS_EVENT | OPEN_FILES_EVENT;
+
+// Prometheus text snapshot rewritten every METRICS_INTERVAL_MS (--metrics=FILE), empty if disabled
+string metrics_path;
+
+// Irrelevant writes per second that switch a page to polling (0 never does), and the polling interval
+uint32_t poll_threshold = ADAPTIVE_POLL_THRESHOLD * 1000ull / ADAPTIVE_WINDOW_MS;
+long poll_interval_ms = ADAPTIVE_POLL_INTERVAL_MS;
+
+// Interval the event loop rehashes every baselined object at, to catch writes no trap saw (0 never)
+long integrity_sweep_ms = 0;
+
+// Interval of the full walks that reconcile the list graphs (0 only builds them once)
+long list_reconcile_ms = LIST_RECONCILE_MS;
+
+// Write response every guest starts with
+response_kind response_mode = RESPONSE_STEP;
+
+// Event types every guest registers watches for
+uint32_t monitored_types = 0;
+
+// Module dwarf indexes and watched members per kernel build
+DwarfRegistry dwarf_registry;
+map<const DwarfIndex *, kernel_profile> kernel_profiles;
+
+// Guest whose vmi_events_listen() runs on this thread, for mem_write_cb
+static thread_local guest_context *listening_guest = NULL;
 
-// Result Measurements
+// Serialises the per-guest statistics printed as guests shut down
+pthread_mutex_t statistics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Security relevant members of watched task_structs and modules; other writes to them are ignored
+static const char *process_watch_members[] = { "tasks", "pid", "tgid", "real_parent", "parent",
+    "real_cred", "cred", "comm", "files" };
+static const char *module_watch_members[] = { "list", "name", "module_core", "module_init",
+    "core_size", "init_size", "core_layout", "init_layout" };
+
+// Result Measurements (the default detector modes, see --modes=)
 #define MONITORING_MODE
 //#define ANALYSIS_MODE
 //#define RE_REGISTER_EVENTS
+#define NATIVE_CHECKS
 
 #define MEASURE_EVENT_CALLBACK_TIME
-#define ALWAYS_SEND_EVENT /* Always send event due to register multiple event on same page failure */
 
-// Result variables
-long irrelevant_events_count = 0;
-long monitored_events_count = 0;
+// Only writes to the members listed above count for process and module events (else the whole struct)
+#define FIELD_WATCH_MASKS
+
+// Skip analyses whose objects' relevant bytes hash as they did when last analysed (see naive-integrity.h)
+#define INTEGRITY_BASELINE
+
+// Name the members each analysis' writes changed, skipping analyses that only changed unwatched members
+#define SHADOW_FIELD_DIFF
+
+// Check every tasks and modules list write against a shadow of the lists (hidden entries, broken links)
+#define LIST_GRAPH
+
+// Detector modes in effect: the defaults above unless --modes= replaces them (see naive-modes.h)
+uint32_t detector_modes = 0
+#ifdef MONITORING_MODE
+    | MODE_MONITORING
+#endif
+#ifdef ANALYSIS_MODE
+    | MODE_ANALYSIS
+#endif
+#ifdef RE_REGISTER_EVENTS
+    | MODE_RE_REGISTER
+#endif
+#ifdef MEASURE_EVENT_CALLBACK_TIME
+    | MODE_CALLBACK_TIME
+#endif
+#ifdef NATIVE_CHECKS
+    | MODE_NATIVE_CHECKS
+#endif
+#ifdef FIELD_WATCH_MASKS
+    | MODE_FIELD_MASKS
+#endif
+#ifdef INTEGRITY_BASELINE
+    | MODE_INTEGRITY
+#endif
+#ifdef SHADOW_FIELD_DIFF
+    | MODE_SHADOW_DIFF
+#endif
+#ifdef LIST_GRAPH
+    | MODE_LIST_GRAPH
+#endif
+    ;
+
+// Instantiation of analyse_events for the detector modes, chosen once in main() (mem_write_cb is per guest)
+static analysis_fn analyse = NULL;
 
 /////////////////////
 // Static Functions
 /////////////////////
 static atomic<bool> interrupted(false);
+
+// Set once every event loop has returned, which also ends the metrics thread
+static atomic<bool> event_loops_done(false);
 static void close_handler(int sig)
 {
     UNUSED_PARAMETER(sig); 
     interrupted = true;
-    event_deque.push_front(INTERRUPTED_EVENT);
+    for (size_t i = 0; i < guests.size(); i++)
+        guests[i]->event_ring.close();
 }
 
-static int retrieve_struct_size(string file_path, string struct_name){
-    int result = -1;
-    ifstream in_file(file_path);
-
-    string struct_substr("<DW_TAG_structure_type> DW_AT_name<\"" + struct_name + "\">");
-    string struct_size_substr("DW_AT_byte_size<");
-    string line;
-    while (getline(in_file, line))
+// Event type of a monitor list name (process, module, net, files), 0 if unknown
+static uint32_t event_type_from_name(const char *name, size_t length)
+{
+    static const char *names[] = { "process", "module", "net", "files" };
+    static const uint32_t types[] = { PROCESS_EVENT, MODULE_EVENT, AFINFO_EVENT, OPEN_FILES_EVENT };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
     {
-        if (line.find(struct_substr) != string::npos){
-            string temp_mem_loc(line.substr(line.find(struct_size_substr) + struct_size_substr.size()));
-            result = stoi(temp_mem_loc.substr(0, temp_mem_loc.find(">")), NULL, 16);
-            break;
-        }
+        if (strlen(names[i]) == length && strncmp(names[i], name, length) == 0)
+            return types[i];
     }
-
-    return result;
+    return 0;
 }
 
-static int retrieve_offset(string file_path, string struct_name, string member_name){
-    int result = -1;
-    ifstream in_file(file_path);
-
-    string struct_substr("<DW_TAG_structure_type> DW_AT_name<\"" + struct_name + "\">");
-    string member_substr("<DW_TAG_member> DW_AT_name<\"" + member_name + "\">");
-    string member_loc_substr("DW_AT_data_member_location<");
-    
-    bool struct_found = false;
-    string line;
-    while (getline(in_file, line))
+// TYPE:N[,TYPE:N...] into analysis_priorities; false on an unknown type or a missing priority
+static bool parse_analysis_priorities(const char *list)
+{
+    for (const char *item = list; *item; )
     {
-        if (struct_found)
-        {
-            if (line.substr(1,1).compare("2") != 0){
-                printf("Member: %s not found in struct: %s\n", member_name.c_str(), struct_name.c_str());
-                break;
-            }
-
-            if (line.find(member_substr) != string::npos){
-                string temp_mem_loc(line.substr(line.find(member_loc_substr) + member_loc_substr.size()));
-                result = stoi(temp_mem_loc.substr(0, temp_mem_loc.size() - 1));
-                break;
-            }
-        }
-
-        if (line.find(struct_substr) != string::npos){
-            struct_found = true;
-            continue;
-        }
+        const char *colon = strchr(item, ':');
+        if (!colon)
+            return false;
+        uint32_t type = event_type_from_name(item, colon - item);
+        char *end;
+        long priority = strtol(colon + 1, &end, 10);
+        if (type == 0 || end == colon + 1 || priority < 0 || (*end != ',' && *end != '\0'))
+            return false;
+        analysis_priorities[__builtin_ctz(type)] = (unsigned) priority;
+        item = *end == ',' ? end + 1 : end;
     }
+    return true;
+}
 
-    return result;
+// TYPE[,TYPE...] or none into analysis_drop_types; false on an unknown type
+static bool parse_analysis_drop_types(const char *list)
+{
+    uint32_t types = 0;
+    for (const char *item = list; strcmp(list, "none") != 0 && *item; )
+    {
+        const char *comma = strchr(item, ',');
+        size_t length = comma ? (size_t) (comma - item) : strlen(item);
+        uint32_t type = event_type_from_name(item, length);
+        if (type == 0)
+            return false;
+        types |= type;
+        item += comma ? length + 1 : length;
+    }
+    analysis_drop_types = types;
+    return true;
 }
 
 int main(int argc, char **argv)
@@ -136,33 +434,127 @@ int main(int argc, char **argv)
 
     if(argc < 3)
     {
-        fprintf(stderr, "Usage: naive-hawk <VM Name> <VM module.dwarf> <monitor events list e.g process OR module OR net OR files>\n");
+        fprintf(stderr, "Usage: naive-hawk <VM Name>[,<VM Name>[=<module.dwarf>]...] <VM module.dwarf> <monitor events list e.g process OR module OR net OR files> [--quiet-ms=N] [--max-delay-ms=N] [--profile=NAME] [--scripts=DIR] [--workers=N] [--queue-capacity=N] [--aging-ms=N] [--priority=TYPE:N,...] [--drop-oldest=TYPE,...|none] [--record=FILE] [--response=step|emulate|altp2m] [--poll-threshold=N] [--poll-interval-ms=N] [--integrity-sweep-ms=N] [--list-reconcile-ms=N] [--modes=LIST|none] [--metrics=FILE] [--compare-checks]\n");
         printf("Naive Event Hawk-Eye Program Ended!\n");
         return 1; 
     }
 
-    // Setup module dwarf file
-    dwarf_fp = string(argv[2]);
-
-    bool monitor_process = false;
-    bool monitor_modules = false;
-    bool monitor_net = false;
-    bool monitor_files = false;
+    long quiet_window_ms = ANALYSIS_QUIET_WINDOW_MS;
+    long max_delay_ms = ANALYSIS_MAX_DELAY_MS;
+    bool compare_only = false;
+    string record_path;
     if (argc > 3){
         for (int i = 3; i < argc; i++){
-            if (strcmp(argv[i], "process") == 0)
-                monitor_process = true;
+            if (strncmp(argv[i], "--quiet-ms=", 11) == 0)
+                quiet_window_ms = atol(argv[i] + 11);
+            else if (strncmp(argv[i], "--max-delay-ms=", 15) == 0)
+                max_delay_ms = atol(argv[i] + 15);
+            else if (strncmp(argv[i], "--profile=", 10) == 0)
+                analysis_profile = argv[i] + 10;
+            else if (strncmp(argv[i], "--scripts=", 10) == 0)
+                analysis_scripts = argv[i] + 10;
+            else if (strncmp(argv[i], "--workers=", 10) == 0)
+                analysis_worker_count = atoi(argv[i] + 10);
+            else if (strncmp(argv[i], "--queue-capacity=", 17) == 0)
+                analysis_queue_capacity = max(atol(argv[i] + 17), 0L);
+            else if (strncmp(argv[i], "--aging-ms=", 11) == 0)
+                analysis_aging_ms = max(atol(argv[i] + 11), 0L);
+            else if (strncmp(argv[i], "--priority=", 11) == 0 || strncmp(argv[i], "--drop-oldest=", 14) == 0)
+            {
+                bool priority = argv[i][2] == 'p';
+                if (priority ? !parse_analysis_priorities(argv[i] + 11) : !parse_analysis_drop_types(argv[i] + 14))
+                {
+                    fprintf(stderr, "Invalid %s (event types: process, module, net, files)\n", argv[i]);
+                    printf("Naive Event Hawk-Eye Program Ended!\n");
+                    return 1;
+                }
+            }
+            else if (strncmp(argv[i], "--record=", 9) == 0)
+                record_path = argv[i] + 9;
+            else if (strncmp(argv[i], "--poll-threshold=", 17) == 0)
+                poll_threshold = atol(argv[i] + 17);
+            else if (strncmp(argv[i], "--poll-interval-ms=", 19) == 0)
+                poll_interval_ms = max(atol(argv[i] + 19), 1L);
+            else if (strncmp(argv[i], "--integrity-sweep-ms=", 21) == 0)
+                integrity_sweep_ms = max(atol(argv[i] + 21), 0L);
+            else if (strncmp(argv[i], "--list-reconcile-ms=", 20) == 0)
+                list_reconcile_ms = max(atol(argv[i] + 20), 0L);
+            else if (strncmp(argv[i], "--metrics=", 10) == 0)
+                metrics_path = argv[i] + 10;
+            else if (strncmp(argv[i], "--response=", 11) == 0)
+            {
+                if (!response_kind_from_name(argv[i] + 11, &response_mode))
+                {
+                    fprintf(stderr, "Unknown write response: %s (step, emulate or altp2m)\n", argv[i] + 11);
+                    printf("Naive Event Hawk-Eye Program Ended!\n");
+                    return 1;
+                }
+            }
+            else if (strncmp(argv[i], "--modes=", 8) == 0)
+            {
+                if (!detector_modes_from_names(argv[i] + 8, &detector_modes))
+                {
+                    fprintf(stderr, "Unknown detector modes: %s (monitoring, analysis, reregister, callback-time or none)\n", argv[i] + 8);
+                    printf("Naive Event Hawk-Eye Program Ended!\n");
+                    return 1;
+                }
+            }
+            else if (strcmp(argv[i], "--compare-checks") == 0)
+                compare_only = true;
+            else if (strcmp(argv[i], "process") == 0)
+                monitored_types |= PROCESS_EVENT;
             else if (strcmp(argv[i], "module") == 0)
-                monitor_modules = true;
+                monitored_types |= MODULE_EVENT;
             else if (strcmp(argv[i], "net") == 0)
-                monitor_net = true;
+                monitored_types |= AFINFO_EVENT;
             else if (strcmp(argv[i], "files") == 0)
-                monitor_files = true;
+                monitored_types |= OPEN_FILES_EVENT;
         }
     }
 
-    // Initialise variables
-    vmi_instance_t vmi;
+    // One guest per comma separated VM name; guests of the same kernel build share its dwarf index
+    if (!add_guests(argv[1], argv[2]))
+    {
+        delete_guests();
+        printf("Naive Event Hawk-Eye Program Ended!\n");
+        return 1;
+    }
+    printf("Monitoring %lu guests (%lu kernel builds)\n", (unsigned long) guests.size(), (unsigned long) dwarf_registry.size());
+
+    // The Volatility session opens the first guest only, so checks without a native version cannot run on the others
+    string volatility_checks = volatility_only_checks(monitored_types);
+    if ((detector_modes & MODE_ANALYSIS) && guests.size() > 1 && !volatility_checks.empty())
+    {
+        printf("%s only run in Volatility, which can open %s only; monitor one guest or leave out their event types\n",
+            volatility_checks.c_str(), guests[0]->name.c_str());
+        delete_guests();
+        printf("Naive Event Hawk-Eye Program Ended!\n");
+        return 1;
+    }
+
+    // Every analysis uses the instantiation for these modes; each guest picks its callback once its response is set up
+    analyse = select_analyse_events(detector_modes);
+    printf("Detector modes: %s\n", detector_mode_names(detector_modes).c_str());
+
+    printf("Analysis quiet window: %ld ms (max delay %ld ms)\n", quiet_window_ms, max_delay_ms);
+    if (poll_threshold != 0)
+        printf("Pages with over %u irrelevant writes/s are polled every %ld ms\n", poll_threshold, poll_interval_ms);
+    if (detector_modes & MODE_INTEGRITY)
+    {
+        printf("Integrity hashing: CRC32C (%s)\n", crc32c_hardware() ? "SSE4.2" : "table");
+        if (integrity_sweep_ms != 0)
+            printf("Watched objects are rehashed every %ld ms\n", integrity_sweep_ms);
+    }
+    for (size_t i = 0; i < guests.size(); i++)
+    {
+        guest_context &guest = *guests[i];
+        guest.event_coalescer.configure(quiet_window_ms * 1000000ull, max_delay_ms * 1000000ull);
+        guest.adaptive.configure(poll_threshold * ADAPTIVE_WINDOW_MS / 1000, poll_interval_ms * 1000000ull);
+
+        // Each guest records to its own file once there are several
+        if (!record_path.empty())
+            guest.record_path = guests.size() > 1 ? record_path + "." + guest.name : record_path;
+    }
 
     // Setup signal action handling
     struct sigaction act;
@@ -174,548 +566,1273 @@ int main(int argc, char **argv)
     sigaction(SIGINT,  &act, NULL);
     sigaction(SIGALRM, &act, NULL);
 
-    char *vm_name = argv[1];
-    
-    // Initialize the libvmi library.
-    if (VMI_FAILURE ==
-        vmi_init_complete(&vmi, vm_name, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL, VMI_CONFIG_GLOBAL_FILE_ENTRY, NULL, NULL))
-    {
-        printf("Failed to init LibVMI library.\n");
-        return 2;
-    }
-    printf("LibVMI initialise succeeded: %p\n", vmi);
-
-    #ifdef MONITORING_MODE    
-        // Start security checking thread
-        pthread_t sec_thread;
-        if (pthread_create(&sec_thread, NULL, security_checking_thread, (void *)vmi) != 0)
-            printf("Failed to create thread");
-    #endif
+    // The embedded Volatility session opens a single location
+    analysis_location = string("vmi://") + guests[0]->name;
 
-    if(PAUSE_VM == 1) 
+    // Run the native and Volatility checks side by side once against the first guest, then exit
+    if (compare_only)
     {
-        // Pause vm for consistent memory access
-        if (VMI_SUCCESS != vmi_pause_vm(vmi))
+        guest_context &guest = *guests[0];
+        bool agreed = false;
+        if (init_guest_vmi(guest))
         {
-            printf("Failed to pause VM\n");
-            cleanup(vmi);
-            return 3;
+            agreed = compare_checks(guest);
+            vmi_destroy(guest.vmi);
         }
-    }
-    
-    // Register Processes Events
-    if (monitor_process && register_processes_events(vmi, dwarf_fp) == false)
-    {
-        printf("Registering of processes events failed!\n");
-
-        cleanup(vmi);
+        int status = guest.vmi ? (agreed ? 0 : 6) : 2;
+        delete_guests();
         printf("Naive Event Hawk-Eye Program Ended!\n");
-        return 4;
+        return status;
     }
 
-    // Register file Events
-    if (monitor_files && register_open_files_events(vmi, dwarf_fp) == false)
+    if (detector_modes & MODE_MONITORING)
     {
-        printf("Registering of file events failed!\n");
+        if (detector_modes & MODE_ANALYSIS)
+        {
+            // Import Volatility, open the guest and load the check plugins once
+            if (!analysis_engine.start(analysis_scripts, analysis_profile, analysis_location))
+                printf("Failed to start analysis engine, checks will be skipped\n");
+        }
 
-        cleanup(vmi);
-        printf("Naive Event Hawk-Eye Program Ended!\n");
-        return 4;
+        // Urgent types are taken first from a bounded queue; see naive-workers.h
+        analysis_workers.set_capacity(analysis_queue_capacity);
+        analysis_workers.set_aging(analysis_aging_ms * 1000000ull);
+        for (unsigned type = 0; type < EVENT_TYPE_COUNT; type++)
+        {
+            analysis_workers.set_priority(1u << type, analysis_priorities[type]);
+            analysis_workers.set_full_policy(1u << type,
+                (analysis_drop_types & (1u << type)) ? WORKER_FULL_DROP_OLDEST : WORKER_FULL_COALESCE);
+        }
+        print_analysis_queue_settings();
+
+        // Checks of every guest share the workers; a finished check (or room in a full queue) wakes its
+        // guest's dispatcher so that type's follow-up can be submitted
+        if (!analysis_workers.start(analysis_worker_count,
+            [](const coalesced_event &event, unsigned source) { analyse(*guests[source], event); },
+            [](uint32_t type, unsigned source) { UNUSED_PARAMETER(type); guests[source]->event_ring.notify(); }))
+            printf("Failed to start analysis workers\n");
+        else
+            printf("Analysis workers: %lu\n", (unsigned long) analysis_workers.threads());
     }
 
-    // Register Modules Events
-    if (monitor_modules && register_modules_events(vmi, dwarf_fp) == false)
+    // Snapshots read the guests' counters and heat maps; the callbacks never wait on it
+    pthread_t metrics_writer;
+    bool metrics_started = false;
+    if (!metrics_path.empty())
     {
-        printf("Registering of modules events failed!\n");
+        if (pthread_create(&metrics_writer, NULL, metrics_thread, NULL) != 0)
+            printf("Failed to create metrics thread\n");
+        else
+        {
+            metrics_started = true;
+            printf("Writing metrics to %s every %d ms\n", metrics_path.c_str(), METRICS_INTERVAL_MS);
+        }
+    }
 
-        cleanup(vmi);
-        printf("Naive Event Hawk-Eye Program Ended!\n");
-        return 5;
+    // One event loop thread per guest
+    for (size_t i = 0; i < guests.size(); i++)
+    {
+        if (pthread_create(&guests[i]->event_thread, NULL, guest_event_loop, guests[i]) != 0)
+        {
+            printf("Failed to create event loop thread for %s\n", guests[i]->name.c_str());
+            guests[i]->status = 2;
+        }
+        else
+            guests[i]->event_thread_started = true;
     }
 
-    // Register Afinfo Events
-    if (monitor_net && register_afinfo_events(vmi, dwarf_fp) == false)
+    for (size_t i = 0; i < guests.size(); i++)
     {
-        printf("Registering of af info events failed!\n");
+        if (guests[i]->event_thread_started)
+            pthread_join(guests[i]->event_thread, NULL);
+    }
 
-        cleanup(vmi);
-        printf("Naive Event Hawk-Eye Program Ended!\n");
-        return 5;
+    // Last snapshot holds the final counts
+    event_loops_done = true;
+    if (metrics_started)
+    {
+        pthread_join(metrics_writer, NULL);
+        write_metrics();
     }
 
-    printf("Waiting for events...\n");
-    while (!interrupted)
+    if (detector_modes & MODE_MONITORING)
     {
-         if (vmi_events_listen(vmi, 500) != VMI_SUCCESS) {
-            printf("Error waiting for events, quitting...\n");
-            interrupted = -1;
-        }
+        // Every guest has cancelled its own checks; this only joins the threads
+        analysis_workers.stop();
+        worker_stats workers = analysis_workers.stats();
+        printf("Analysis Workers: %lu completed, %lu abandoned at exit, at most %u in parallel\n",
+            workers.completed, workers.abandoned, workers.max_parallel);
+        print_analysis_queue_statistics();
+        if (detector_modes & MODE_ANALYSIS)
+            analysis_engine.stop();
     }
 
-    cleanup(vmi);
+    if (guests.size() > 1)
+        print_guest_summary();
+
+    // First failing guest decides the exit status
+    int status = 0;
+    for (size_t i = 0; i < guests.size() && status == 0; i++)
+        status = guests[i]->status;
+    delete_guests();
 
     printf("Naive Event Hawk-Eye Program Ended!\n");
     program_time = clock() - program_time;
     printf("Execution time: %f seconds\n", ((double)program_time)/CLOCKS_PER_SEC);
-    return 0;
+    return status;
 }
 
 /////////////////////
-// Definitions
+// Guests
 /////////////////////
-event_response_t mem_write_cb(vmi_instance_t vmi, vmi_event_t *event) 
-{ 
-    #ifdef MEASURE_EVENT_CALLBACK_TIME
-        clock_t t;
-        t = clock();
-    #endif
-
-    #ifdef ALWAYS_SEND_EVENT
-        monitored_events_count++;
-        vmi_clear_event(vmi, event, NULL);
-
-        #ifdef MONITORING_MODE
-            struct event_data *any_data = (struct event_data *) event->data;
-            event_deque.push_back(any_data->type);
-        #endif
-
-        vmi_step_event(vmi, event, event->vcpu_id, 1, NULL);
-
-        #ifdef MEASURE_EVENT_CALLBACK_TIME
-            t = clock() - t;
-            printf("mem_write_cb() took %f seconds to execute \n", ((double)t)/CLOCKS_PER_SEC);
-        #endif
-
-        return VMI_EVENT_RESPONSE_NONE;
-    #endif
+bool add_guests(const char *vm_list, const char *default_dwarf_fp)
+{
+    string list = vm_list;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t comma = list.find(',', start);
+        if (comma == string::npos)
+            comma = list.size();
+        string entry = list.substr(start, comma - start);
+        start = comma + 1;
+        if (entry.empty())
+            continue;
 
-    // Always clear event on callback
-    vmi_clear_event(vmi, event, NULL);
+        // "name" or "name=path/to/module.dwarf"
+        size_t equals = entry.find('=');
+        string vm_name = entry.substr(0, equals);
+        string dwarf_fp = equals == string::npos ? string(default_dwarf_fp) : entry.substr(equals + 1);
 
-    monitored_events_count++;
+        if (guests.size() >= MAX_GUESTS)
+        {
+            printf("Too many guests (at most %d)\n", MAX_GUESTS);
+            return false;
+        }
 
-    struct event_data *data = (struct event_data *) event->data;
-    
-    // Check that adddress hit is within monitoring range    
-    addr_t event_addr = (event->mem_event.gfn << 12) + event->mem_event.offset;
-    addr_t min_addr = data->physical_addr;
-    addr_t max_addr = data->physical_addr + data->monitor_size;
+        // Setup module dwarf index (parsed once per kernel build, cached next to the dwarf file)
+        const kernel_profile *kernel = load_kernel_profile(dwarf_fp);
+        if (!kernel)
+        {
+            printf("Failed to load module dwarf: %s\n", dwarf_fp.c_str());
+            return false;
+        }
+        guests.push_back(new guest_context(vm_name, guests.size(), kernel));
+    }
 
-    if (event_addr < min_addr || event_addr > max_addr)
+    if (guests.empty())
     {
-        irrelevant_events_count++;
-
-        vmi_step_event(vmi, event, event->vcpu_id, 1, NULL);
-        return VMI_EVENT_RESPONSE_NONE;
+        printf("No VM name given\n");
+        return false;
     }
+    return true;
+}
 
-    // print_event(event);
-
-    #ifdef MONITORING_MODE
-        event_deque.push_back(data->type);
-    #endif
-
-    vmi_step_event(vmi, event, event->vcpu_id, 1, NULL);
+const kernel_profile *load_kernel_profile(const string &dwarf_fp)
+{
+    const DwarfIndex *dwarf = dwarf_registry.load(dwarf_fp);
+    if (!dwarf)
+        return NULL;
 
-    #ifdef MEASURE_EVENT_CALLBACK_TIME
-        t = clock() - t;
-        printf("mem_write_cb() took %f seconds to execute \n", ((double)t)/CLOCKS_PER_SEC);
-    #endif
+    map<const DwarfIndex *, kernel_profile>::iterator it = kernel_profiles.find(dwarf);
+    if (it != kernel_profiles.end())
+        return &it->second;
 
-    return VMI_EVENT_RESPONSE_NONE;
-} 
+    kernel_profile &kernel = kernel_profiles[dwarf];
+    kernel.dwarf = dwarf;
+    if (detector_modes & MODE_FIELD_MASKS)
+    {
+        build_watch_fields(*dwarf, "task_struct", process_watch_members,
+            sizeof(process_watch_members) / sizeof(process_watch_members[0]), kernel.process_fields);
+        build_watch_fields(*dwarf, "module", module_watch_members,
+            sizeof(module_watch_members) / sizeof(module_watch_members[0]), kernel.module_fields);
+    }
+    if (detector_modes & MODE_SHADOW_DIFF)
+    {
+        build_shadow_layout(*dwarf, "task_struct", process_watch_members,
+            sizeof(process_watch_members) / sizeof(process_watch_members[0]), kernel.process_layout);
+        build_shadow_layout(*dwarf, "module", module_watch_members,
+            sizeof(module_watch_members) / sizeof(module_watch_members[0]), kernel.module_layout);
+    }
+    return &kernel;
+}
 
-void free_event_data(vmi_event_t *event, status_t rc)
+void delete_guests()
 {
-    struct event_data * data = (struct event_data *) event->data;
-    printf("Freeing data for physical address: \%" PRIx64" from page: \%" PRIx64" due to status %d \n", data->physical_addr, data->physical_addr << 12, rc);
-    free(data); 
+    for (size_t i = 0; i < guests.size(); i++)
+        delete guests[i];
+    guests.clear();
 }
 
-bool register_processes_events(vmi_instance_t vmi, string dwarf_fp)
+bool init_guest_vmi(guest_context &guest)
 {
-    printf("Registering Processes Events\n");
-
-    unsigned long tasks_offset = vmi_get_offset(vmi, "linux_tasks");
-    unsigned long name_offset = vmi_get_offset(vmi, "linux_name");
-    unsigned long pid_offset = vmi_get_offset(vmi, "linux_pid");
-
-    addr_t list_head = vmi_translate_ksym2v(vmi, "init_task") + tasks_offset;
+    // Initialize the libvmi library.
+    if (VMI_FAILURE ==
+        vmi_init_complete(&guest.vmi, (void *) guest.name.c_str(), VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL,
+            VMI_CONFIG_GLOBAL_FILE_ENTRY, NULL, NULL))
+    {
+        printf("Failed to init LibVMI library for %s.\n", guest.name.c_str());
+        guest.vmi = NULL;
+        return false;
+    }
+    printf("LibVMI initialise succeeded for %s: %p\n", guest.name.c_str(), guest.vmi);
 
-    addr_t next_list_entry = list_head;
+    guest.kernel_dtb = VmiMemory::kernel_dtb(guest.vmi);
+    if (guest.kernel_dtb == 0)
+        printf("Failed to find kernel page tables of %s, translations are not cached\n", guest.name.c_str());
+    return true;
+}
 
-    // Perform task list walk-through
-    addr_t current_process = 0;
-    char *procname = NULL;
-    vmi_pid_t pid = 0;
-    status_t status;
+void *guest_event_loop(void *arg)
+{
+    guest_context &guest = *(guest_context *) arg;
+    listening_guest = &guest;
 
-    printf("\nPID\tProcess Name\n");
-    do 
+    if (!init_guest_vmi(guest))
     {
-        current_process = next_list_entry - tasks_offset;
+        guest.status = 2;
+        return NULL;
+    }
 
-        vmi_read_32_va(vmi, current_process + pid_offset, 0, (uint32_t*)&pid);
+    // Analyses of this guest read it between iterations of the loop below, the hold is handed over there
+    std::unique_lock<VmiLock> vmi_hold(guest.vmi_lock);
 
-        procname = vmi_read_str_va(vmi, current_process + name_offset, 0);
-        if (!procname) 
-        {
-            printf("Failed to find procname\n");
-            return false;
-        }
+    // Guests without altp2m fall back to single-stepping
+    guest.response = make_response_strategy(response_mode);
+    if (!guest.response->setup(guest.vmi))
+    {
+        printf("Write response %s is not available for %s, using step\n", guest.response->name(), guest.name.c_str());
+        delete guest.response;
+        guest.response = make_response_strategy(RESPONSE_STEP);
+    }
+    printf("Write response of %s: %s\n", guest.name.c_str(), guest.response->name());
 
-        // Print details
-        printf("%d\t%s (struct addr: \%" PRIx64")\n", pid, procname, current_process);
-        if (procname) 
+    // Record watch changes from the first registration on, then every event
+    if (!guest.record_path.empty())
+    {
+        if (guest.event_trace.open(guest.record_path, ring_timestamp_ns()))
         {
-            free(procname);
-            procname = NULL;
+            printf("Recording event trace of %s to %s\n", guest.name.c_str(), guest.record_path.c_str());
+            trace_watch_fields(guest, PROCESS_EVENT, guest.kernel->process_fields);
+            trace_watch_fields(guest, MODULE_EVENT, guest.kernel->module_fields);
         }
+        else
+            printf("Failed to open event trace: %s\n", guest.record_path.c_str());
+    }
 
-        addr_t struct_addr = vmi_translate_kv2p(vmi, current_process);
-
-        #ifdef MYDEBUG
-            // Print details of process in physical memory
-            char *phy_procname = NULL;
-            vmi_pid_t phy_pid = 0;
-
-            vmi_read_32_pa(vmi, struct_addr + pid_offset, (uint32_t*)&phy_pid);
-            phy_procname = vmi_read_str_pa(vmi, struct_addr + name_offset);
-            printf("Physical:%d\t%s (struct addr: \%" PRIx64")\n", phy_pid, phy_procname, struct_addr);
-            if (phy_procname)
-            {
-                free(phy_procname);
-                phy_procname = NULL;
-            }
+    // Every watch registered from here on uses the callback specialised for the modes, response and trace
+    guest.write_callback = select_mem_write_cb(detector_modes, guest.response->kind(), guest.event_trace.recording());
 
-            page_info_t page_info;
-            status = vmi_pagetable_lookup_extended(vmi, vmi_pid_to_dtb(vmi, pid), current_process, &page_info);
-            if (status == VMI_FAILURE)
-            {
-                printf("Failed to retrieve page info at %" PRIx64"\n", current_process);
-                return false;
-            }
-            printf("Page Size: %d\n", page_info.size);
-        #endif
-        
-        printf("Registering event for physical addr: %" PRIx64"\n", struct_addr >> 12);
-        // Register write memory event (>> 12 to point to page base)
-        vmi_event_t *proc_event = (vmi_event_t *) malloc(sizeof(vmi_event_t));
-        SETUP_MEM_EVENT(proc_event, struct_addr >> 12, VMI_MEMACCESS_W, mem_write_cb, 0);
-        
-        // Setup event context data
-        struct event_data *event_data = (struct event_data *) malloc(sizeof(struct event_data));
-        event_data->type = PROCESS_EVENT;
-        event_data->physical_addr = struct_addr;
-        event_data->monitor_size = retrieve_struct_size(dwarf_fp,"task_struct");
-
-        proc_event->data = event_data;
-
-        if (vmi_register_event(vmi, proc_event) == VMI_FAILURE)
-            printf("Failed to register process event!\n");
+    if (detector_modes & MODE_MONITORING)
+    {
+        // Start security checking thread
+        if (pthread_create(&guest.security_thread, NULL, security_checking_thread, &guest) != 0)
+            printf("Failed to create thread");
         else
-            push_vmi_event(&vmi_event_head, proc_event);
+            guest.security_thread_started = true;
+    }
 
-        status = vmi_read_addr_va(vmi, next_list_entry, 0, &next_list_entry);
-        if (status == VMI_FAILURE)
+    if(PAUSE_VM == 1) 
+    {
+        // Pause vm for consistent memory access
+        if (VMI_SUCCESS != vmi_pause_vm(guest.vmi))
         {
-            printf("Failed to read next pointer in loop at %" PRIx64"\n", next_list_entry);
-            return false;
+            printf("Failed to pause VM %s\n", guest.name.c_str());
+            guest.status = 3;
+            vmi_hold.unlock();
+            cleanup(guest);
+            return NULL;
         }
+    }
+    
+    // Register Processes Events
+    if ((monitored_types & PROCESS_EVENT) && register_processes_events(guest) == false)
+    {
+        printf("Registering of processes events failed for %s!\n", guest.name.c_str());
+        guest.status = 4;
+        vmi_hold.unlock();
+        cleanup(guest);
+        return NULL;
+    }
 
-    } while(next_list_entry != list_head);
-
-    return true;
-}
+    // Register file Events
+    if ((monitored_types & OPEN_FILES_EVENT) && register_open_files_events(guest) == false)
+    {
+        printf("Registering of file events failed for %s!\n", guest.name.c_str());
+        guest.status = 4;
+        vmi_hold.unlock();
+        cleanup(guest);
+        return NULL;
+    }
 
-bool register_open_files_events(vmi_instance_t vmi, string dwarf_fp)
-{
-    printf("Registering open files events\n");
+    // Register Modules Events
+    if ((monitored_types & MODULE_EVENT) && register_modules_events(guest) == false)
+    {
+        printf("Registering of modules events failed for %s!\n", guest.name.c_str());
+        guest.status = 5;
+        vmi_hold.unlock();
+        cleanup(guest);
+        return NULL;
+    }
 
-    unsigned long tasks_offset = vmi_get_offset(vmi, "linux_tasks");
-    unsigned long pid_offset = vmi_get_offset(vmi, "linux_pid");
-    unsigned long files_offset = 0x5d8;
+    // Register Afinfo Events
+    if ((monitored_types & AFINFO_EVENT) && register_afinfo_events(guest) == false)
+    {
+        printf("Registering of af info events failed for %s!\n", guest.name.c_str());
+        guest.status = 5;
+        vmi_hold.unlock();
+        cleanup(guest);
+        return NULL;
+    }
 
-    addr_t list_head = vmi_translate_ksym2v(vmi, "init_task") + tasks_offset;
+    // Watch the page table entries behind the translations the registration cached
+    sync_translation_watches(guest);
 
-    addr_t next_list_entry = list_head;
+    if (detector_modes & MODE_LIST_GRAPH)
+    {
+        // First full walks build the list graphs
+        reconcile_list_graphs(guest);
+        guest.next_list_reconcile = latency_now_ns() + list_reconcile_ms * 1000000ull;
+    }
 
-    // Perform task list walk-through
-    addr_t current_process = 0;
-    addr_t open_files = 0;
-    vmi_pid_t pid = 0;
-    status_t status;
+    printf("Waiting for events of %s...\n", guest.name.c_str());
+    uint64_t next_latency_report = latency_now_ns() + LATENCY_REPORT_INTERVAL * 1000000000ull;
+    uint64_t next_heat_map = 0;
 
-    printf("\nPID\tFiles Addr\n");
-    do 
+    // Polled pages are checked between listens, so a listen never outlasts the polling interval
+    uint32_t listen_ms = guest.adaptive.enabled() && poll_interval_ms < 500 ? (uint32_t) poll_interval_ms : 500;
+    if ((detector_modes & MODE_MONITORING) && listen_ms > ANALYSIS_LISTEN_MS)
+        listen_ms = ANALYSIS_LISTEN_MS;
+    while (!interrupted)
     {
-        current_process = next_list_entry - tasks_offset;
-        vmi_read_32_va(vmi, current_process + pid_offset, 0, (uint32_t*)&pid);
+        // A guest that fails stops alone, the others keep running
+        if (vmi_events_listen(guest.vmi, listen_ms) != VMI_SUCCESS) {
+            printf("Error waiting for events of %s, quitting...\n", guest.name.c_str());
+            break;
+        }
 
-        // Retrieve open files
-        printf("%d\t\%" PRIx64" (struct addr: \%" PRIx64")\n", pid, current_process + files_offset, current_process);
+        // Watches are only changed from this thread, between callbacks (only requested with MODE_RE_REGISTER)
+        uint32_t reregister = guest.pending_reregister.exchange(0);
+        if (reregister & PROCESS_EVENT)
+            register_processes_events(guest);
+        if (reregister & OPEN_FILES_EVENT)
+            register_open_files_events(guest);
+        if (reregister & MODULE_EVENT)
+            register_modules_events(guest);
+
+        sync_translation_watches(guest);
+        adapt_watches(guest);
 
-        status = vmi_read_addr_va(vmi, current_process + files_offset, 0, &open_files);
-        if (status == VMI_FAILURE)
+        if ((detector_modes & MODE_LIST_GRAPH) && list_reconcile_ms != 0 && latency_now_ns() >= guest.next_list_reconcile)
         {
-            printf("Failed to read files member at %" PRIx64"\n", open_files);
-            status = vmi_read_addr_va(vmi, next_list_entry, 0, &next_list_entry);
-            if (status == VMI_FAILURE)
-            {
-                printf("Failed to read next pointer in loop at %" PRIx64"\n", next_list_entry);
-                return false;
-            }
-            continue;
+            reconcile_list_graphs(guest);
+            guest.next_list_reconcile = latency_now_ns() + list_reconcile_ms * 1000000ull;
         }
 
-        addr_t struct_addr = vmi_translate_kv2p(vmi, open_files);
-        printf("Registering 4 event for physical addr: %" PRIx64"\n", struct_addr >> 12);
-        for (int i = 0; i < 4; i++) // Register 4 pages of information (i.e. 64 (fd array size) * 256 (file struct size))
+        if ((detector_modes & MODE_INTEGRITY) && integrity_sweep_ms != 0 && latency_now_ns() >= guest.next_integrity_sweep)
         {
-            addr_t current_page_base = (struct_addr >> 12) + i;
-            
-            // Register write memory event (>> 12 to point to page base)
-            vmi_event_t *proc_event = (vmi_event_t *) malloc(sizeof(vmi_event_t));
-            SETUP_MEM_EVENT(proc_event, current_page_base, VMI_MEMACCESS_W, mem_write_cb, 0);
-            
-            // Setup event context data
-            struct event_data *event_data = (struct event_data *) malloc(sizeof(struct event_data));
-            event_data->type = OPEN_FILES_EVENT;
-            event_data->physical_addr = current_page_base;
-            event_data->monitor_size = retrieve_struct_size(dwarf_fp,"file");
+            sweep_integrity(guest);
+            guest.next_integrity_sweep = latency_now_ns() + integrity_sweep_ms * 1000000ull;
+        }
 
-            proc_event->data = event_data;
+        // The watch table is only walked here, so callbacks never share it with the metrics thread
+        if (!metrics_path.empty() && latency_now_ns() >= next_heat_map)
+        {
+            collect_heat_map(guest);
+            next_heat_map = latency_now_ns() + METRICS_INTERVAL_MS * 1000000ull;
+        }
 
-            if (vmi_register_event(vmi, proc_event) == VMI_SUCCESS)
-                push_vmi_event(&vmi_event_head, proc_event);
+        if ((detector_modes & MODE_CALLBACK_TIME) && latency_now_ns() >= next_latency_report)
+        {
+            print_callback_latency(guest);
+            next_latency_report += LATENCY_REPORT_INTERVAL * 1000000000ull;
         }
 
-        status = vmi_read_addr_va(vmi, next_list_entry, 0, &next_list_entry);
-        if (status == VMI_FAILURE)
+        // Waiting analyses take their turn before the next listen
+        if (guest.vmi_lock.contended())
         {
-            printf("Failed to read next pointer in loop at %" PRIx64"\n", next_list_entry);
-            return false;
+            vmi_hold.unlock();
+            vmi_hold.lock();
         }
+    }
 
-    } while(next_list_entry != list_head);
+    vmi_hold.unlock();
+    cleanup(guest);
+    return NULL;
+}
 
-    return true;
+/////////////////////
+// Definitions
+/////////////////////
+// Monitoring and Timed are MODE_MONITORING and MODE_CALLBACK_TIME, Traced whether the guest records a trace and
+// Response its ResponseStrategy, all folded away in each instantiation
+template <bool Monitoring, bool Timed, bool Traced, typename Response>
+event_response_t mem_write_cb(vmi_instance_t vmi, vmi_event_t *event) 
+{ 
+    // Callbacks run inside the guest's own vmi_events_listen(); page table entry hits are handled in write_filtered()
+    return handle_page_write<PAGE_TABLE_EVENT>(fixed_write_modes<Monitoring, Timed, Traced, Response>(), *listening_guest,
+        vmi, event);
+} 
+
+// mem_write_cb's bookkeeping of every write (see handle_page_write in naive-callback.h)
+void write_filtered(guest_context &guest, watched_page *page, vmi_event_t *event, uint64_t timestamp, uint32_t hit_types)
+{
+    UNUSED_PARAMETER(timestamp);
+    guest.counters.add(COUNTER_MONITORED);
+
+    if (hit_types == 0)
+    {
+        guest.counters.add(COUNTER_IRRELEVANT);
+
+        // Counted per type the whole-object filter would have reported
+        for (uint32_t types = watch_range_types(page, event->mem_event.offset); types != 0; types &= types - 1)
+            guest.counters.add(COUNTER_TYPE_FILTERED + __builtin_ctz(types));
+        return;
+    }
+
+    // print_event(event);
+
+    for (uint32_t types = hit_types; types != 0; types &= types - 1)
+        guest.counters.add(COUNTER_TYPE_HIT + __builtin_ctz(types));
+
+    // A page table entry behind cached translations changed
+    if (hit_types & PAGE_TABLE_EVENT)
+        invalidate_translations(guest, page, event->mem_event.offset);
 }
 
-bool register_modules_events(vmi_instance_t vmi, string dwarf_fp)
+void write_traced(guest_context &guest, watched_page *page, vmi_event_t *event, uint64_t timestamp, uint32_t hit_types)
 {
-    printf("Registering Modules Events\n");
+    guest.event_trace.event(timestamp, page->gfn, event->mem_event.offset, event->mem_event.gla,
+        event->mem_event.out_access, event->vcpu_id, hit_types);
+}
 
-    addr_t list_head;
-    if (vmi_read_addr_ksym(vmi, (char *) "modules", &list_head) == VMI_FAILURE)
+void write_timed(guest_context &guest, uint32_t hit_types, uint64_t ns)
+{
+    // Attributed to the lowest event type hit
+    guest.callback_latency.record(hit_types != 0 ? __builtin_ctz(hit_types) : LATENCY_SLOT_IRRELEVANT, ns);
+}
+
+template <bool Monitoring, bool Timed, bool Traced>
+static event_callback_t select_response_cb(response_kind response)
+{
+    switch (response)
     {
-        printf("Failed to read modules kernel symbol\n");
-        return false;
-    } 
+        case RESPONSE_EMULATE: return mem_write_cb<Monitoring, Timed, Traced, EmulateResponse>;
+        case RESPONSE_ALTP2M: return mem_write_cb<Monitoring, Timed, Traced, Altp2mResponse>;
+        default: return mem_write_cb<Monitoring, Timed, Traced, StepResponse>;
+    }
+}
+
+template <bool Monitoring, bool Timed>
+static event_callback_t select_traced_cb(response_kind response, bool traced)
+{
+    return traced ? select_response_cb<Monitoring, Timed, true>(response) : select_response_cb<Monitoring, Timed, false>(response);
+}
 
-    // Perform module list walk-through
-    addr_t next_list_entry = list_head;
-    char *modname = NULL;
-    status_t status;
+event_callback_t select_mem_write_cb(uint32_t modes, response_kind response, bool traced)
+{
+    if (modes & MODE_MONITORING)
+        return (modes & MODE_CALLBACK_TIME) ? select_traced_cb<true, true>(response, traced) :
+            select_traced_cb<true, false>(response, traced);
+    return (modes & MODE_CALLBACK_TIME) ? select_traced_cb<false, true>(response, traced) :
+        select_traced_cb<false, false>(response, traced);
+}
 
-    printf("\nModule Name\n");
-    do 
+bool watch_object(guest_context &guest, addr_t physical_addr, int size, uint32_t type)
+{
+    if (size <= 0)
     {
-        if (VMI_PM_IA32E == vmi_get_page_mode(vmi, 0))   // 64-bit paging
-            modname = vmi_read_str_va(vmi, next_list_entry + 16, 0);
-        else 
-            modname = vmi_read_str_va(vmi, next_list_entry + 8, 0);
+        printf("Invalid monitor size %d for physical addr: %" PRIx64"\n", size, physical_addr);
+        return false;
+    }
 
-        if (!modname) 
-        {
-            printf("Failed to find modname\n");
-            return false;
-        }
+    // One page_watch per GFN, the object adds a range on every page it spans
+    // (kernel slab objects are physically contiguous)
+    addr_t end_addr = physical_addr + size;
+    for (addr_t page_base = physical_addr & ~(WATCH_PAGE_SIZE - 1); page_base < end_addr; page_base += WATCH_PAGE_SIZE)
+    {
+        addr_t start = physical_addr > page_base ? physical_addr - page_base : 0;
+        addr_t end = end_addr < page_base + WATCH_PAGE_SIZE ? end_addr - page_base : WATCH_PAGE_SIZE;
 
-        // Print details
-        printf("%s (struct addr: \%" PRIx64")\n", modname, next_list_entry);
-        if (modname) 
+        bool new_page = false;
+        watched_page *page = guest.watch_table.add(page_base >> WATCH_PAGE_SHIFT, start, end, type, physical_addr, &new_page,
+            object_watch_fields(guest, type));
+        if (new_page)
         {
-            free(modname);
-            modname = NULL;
+            printf("Registering event for physical addr: %" PRIx64"\n", page->gfn);
+            // Register write memory event on the page base, the event lives in the page's pool slot
+            memset(&page->event, 0, sizeof(vmi_event_t));
+            SETUP_MEM_EVENT(&page->event, page->gfn, VMI_MEMACCESS_W, guest.write_callback, 0);
+            page->event.data = page;
+            guest.response->prepare(&page->event);
+
+            if (vmi_register_event(guest.vmi, &page->event) == VMI_FAILURE)
+            {
+                printf("Failed to register event for page: %" PRIx64"\n", page->gfn);
+                guest.watch_table.release(page);
+
+                // Drop the ranges already added on earlier pages
+                if (page_base > physical_addr)
+                    unwatch_object(guest, physical_addr, page_base - physical_addr, type);
+                return false;
+            }
         }
 
-        addr_t struct_addr = vmi_translate_kv2p(vmi, next_list_entry);
-        printf("Registering event for physical addr: %" PRIx64"\n", struct_addr);
-        // Register write memory event (>> 12 to point to page base)
-        vmi_event_t *mod_event = (vmi_event_t *) malloc(sizeof(vmi_event_t));
-        SETUP_MEM_EVENT(mod_event, struct_addr >> 12, VMI_MEMACCESS_W, mem_write_cb, 0);
-        
-        // Setup event context data
-        struct event_data *event_data = (struct event_data *) malloc(sizeof(struct event_data));
-        event_data->type = MODULE_EVENT;
-        event_data->physical_addr = struct_addr;
-        event_data->monitor_size = retrieve_struct_size(dwarf_fp,"module");
+        if (guest.event_trace.recording())
+            guest.event_trace.watch(ring_timestamp_ns(), page->gfn, start, end, type, physical_addr);
+    }
 
-        mod_event->data = event_data;
+    // Page table entries invalidate translations on any write, there is no analysis to skip
+    if ((detector_modes & MODE_INTEGRITY) && type != PAGE_TABLE_EVENT)
+        record_integrity(guest, physical_addr, size, type);
+    if ((detector_modes & MODE_SHADOW_DIFF) && object_shadow_layout(guest, type))
+        capture_shadow(guest, physical_addr, size, type);
 
-        if (vmi_register_event(vmi, mod_event) == VMI_FAILURE)
-            printf("Failed to register module event!\n");
-        else
-            push_vmi_event(&vmi_event_head, mod_event);
+    return true;
+}
+
+void unwatch_object(guest_context &guest, addr_t physical_addr, int size, uint32_t type)
+{
+    if ((detector_modes & MODE_INTEGRITY) && type != PAGE_TABLE_EVENT)
+        guest.integrity.forget(type, physical_addr);
+    if ((detector_modes & MODE_SHADOW_DIFF) && object_shadow_layout(guest, type))
+        guest.shadow.forget(type, physical_addr);
 
-        status = vmi_read_addr_va(vmi, next_list_entry, 0, &next_list_entry);
-        if (status == VMI_FAILURE)
+    addr_t end_addr = physical_addr + (size > 0 ? size : 1);
+    for (addr_t page_base = physical_addr & ~(WATCH_PAGE_SIZE - 1); page_base < end_addr; page_base += WATCH_PAGE_SIZE)
+    {
+        bool found = false;
+        watched_page *page = guest.watch_table.remove(page_base >> WATCH_PAGE_SHIFT, type, physical_addr, &found);
+        if (found && guest.event_trace.recording())
+            guest.event_trace.unwatch(ring_timestamp_ns(), page_base >> WATCH_PAGE_SHIFT, type, physical_addr);
+        if (!page)
+            continue;
+
+        // Last range on the page is gone, drop the libvmi event (unless polled) before its slot is reused
+        if (guest.adaptive.polled(page->gfn))
+            guest.adaptive.stop_polling(page->gfn, false);
+        else
         {
-            printf("Failed to read next pointer in loop at %" PRIx64"\n", next_list_entry);
-            return false;
+            guest.response->prepare(&page->event);
+            vmi_clear_event(guest.vmi, &page->event, NULL);
         }
-    } while(next_list_entry != list_head);
+        guest.watch_table.release(page);
+    }
+}
 
+bool watch_changed_object(guest_context &guest, addr_t physical_addr, int size, uint32_t type)
+{
+    // Already watched with the same size: nothing to do
+    int old_size = 0;
+    if (!guest.watch_set.observe(type, physical_addr, size, &old_size))
+        return true;
+
+    if (old_size != 0)
+        unwatch_object(guest, physical_addr, old_size, type);
+
+    if (!watch_object(guest, physical_addr, size, type))
+    {
+        guest.watch_set.forget(type, physical_addr);
+        return false;
+    }
     return true;
 }
 
-bool register_afinfo_events(vmi_instance_t vmi, string dwarf_fp){
+void finish_watch_pass(guest_context &guest, uint32_t type, const char *name)
+{
+    // Unwatch objects the walk no longer found
+    vector<watched_object> vanished;
+    guest.watch_set.end_pass(type, ring_timestamp_ns(), vanished);
+    for (size_t i = 0; i < vanished.size(); i++)
+        unwatch_object(guest, vanished[i].physical_addr, vanished[i].size, type);
 
-    printf("Registering Afinfo Events\n");
-    char *name = NULL;
+    guest.watch_set.print_pass(type, name, ring_timestamp_ns());
+}
+
+void build_watch_fields(const DwarfIndex &dwarf, const char *struct_name, const char **members, size_t count, watch_fields &out)
+{
+    out.spans.clear();
+    for (size_t i = 0; i < count; i++)
+        out.add(dwarf.member_offset(struct_name, members[i]), dwarf.member_size(struct_name, members[i]));
+    out.finalize();
+
+    int struct_size = dwarf.struct_size(struct_name);
+    printf("Watching %u of %d bytes of %s\n", out.bytes(), struct_size, struct_name);
+}
+
+const watch_fields *object_watch_fields(const guest_context &guest, uint32_t type)
+{
+    const watch_fields *fields = NULL;
+    if (type == PROCESS_EVENT)
+        fields = &guest.kernel->process_fields;
+    else if (type == MODULE_EVENT)
+        fields = &guest.kernel->module_fields;
+    return fields && !fields->spans.empty() ? fields : NULL;
+}
+
+void trace_watch_fields(guest_context &guest, uint32_t type, const watch_fields &fields)
+{
+    for (size_t i = 0; i < fields.spans.size(); i++)
+        guest.event_trace.fields(ring_timestamp_ns(), type, fields.spans[i].first, fields.spans[i].second);
+}
 
-    // Register TCP Seq Afinfo Events
-    addr_t tcp_seq_afinfo[2];
-    if (vmi_read_addr_ksym(vmi, (char *) "tcp6_seq_afinfo", &tcp_seq_afinfo[0]) == VMI_FAILURE)
+void invalidate_translations(guest_context &guest, const watched_page *page, uint64_t offset)
+{
+    const watch_range *hits[WATCH_MAX_HITS];
+    size_t hit_count = watch_match(page, (uint32_t) offset, hits, WATCH_MAX_HITS);
+
+    // Only the translations through the written entry go; VmiMemory reads never use libvmi's VA cache, so
+    // it needs no flush
+    for (size_t i = 0; i < hit_count; i++)
     {
-        printf("Failed to read tcp6_seq_afinfo kernel symbol\n");
-        return false;
+        if (hits[i]->type == PAGE_TABLE_EVENT)
+            guest.translation_cache.invalidate(hits[i]->object);
     }
+}
 
-    if (vmi_read_addr_ksym(vmi, (char *) "tcp4_seq_afinfo", &tcp_seq_afinfo[1]) == VMI_FAILURE)
+void sync_translation_watches(guest_context &guest)
+{
+    vector<uint64_t> watch, unwatch;
+    guest.translation_cache.take_watch_changes(watch, unwatch);
+    for (size_t i = 0; i < unwatch.size(); i++)
+        unwatch_object(guest, unwatch[i], PAGE_TABLE_ENTRY_SIZE, PAGE_TABLE_EVENT);
+    for (size_t i = 0; i < watch.size(); i++)
     {
-        printf("Failed to read tcp4_seq_afinfo kernel symbol\n");
-        return false;
-    } 
+        if (!watch_object(guest, watch[i], PAGE_TABLE_ENTRY_SIZE, PAGE_TABLE_EVENT))
+            printf("Failed to watch page table entry at %" PRIx64"\n", watch[i]);
+    }
+}
 
-    for (int i = 0; i < 2; i++){
-        name = vmi_read_str_va(vmi, tcp_seq_afinfo[i], 0);    
-        if (!name) 
+/////////////////////
+// Adaptive Polling
+/////////////////////
+void adapt_watches(guest_context &guest)
+{
+    // The guest side of adapt_page_watches (naive-adaptive.h), on the event loop under its hold of the VMI lock
+    struct watch_host
+    {
+        guest_context &guest;
+
+        bool read(watched_page *page, uint64_t *contents)
+        {
+            return read_watched_page(guest, page, contents);
+        }
+
+        bool untrap(watched_page *page)
         {
-            printf("Failed to find name\n");
+            guest.response->prepare(&page->event);
+            if (vmi_clear_event(guest.vmi, &page->event, NULL) != VMI_SUCCESS)
+                return false;
+            printf("Polling page %" PRIx64" of %s instead of trapping its writes\n", page->gfn, guest.name.c_str());
+            return true;
+        }
+
+        bool trap(watched_page *page)
+        {
+            guest.response->prepare(&page->event);
+            if (vmi_register_event(guest.vmi, &page->event) != VMI_FAILURE)
+                return true;
+            printf("Failed to re-arm event for page: %" PRIx64"\n", page->gfn);
             return false;
         }
 
-        // Print details
-        printf("%s (struct addr: \%" PRIx64")\n", name, tcp_seq_afinfo[i]);
-        if (name) 
+        void poll(watched_page *page, uint64_t now)
         {
-            free(name);
-            name = NULL;
+            poll_watched_page(guest, page, now);
         }
+    };
 
-        addr_t struct_addr = vmi_translate_kv2p(vmi, tcp_seq_afinfo[i]);
-        printf("Registering event for physical addr: %" PRIx64"\n", struct_addr >> 12);
-        // Register write memory event (>> 12 to point to page base)
-        vmi_event_t *net_event = (vmi_event_t *) malloc(sizeof(vmi_event_t));
-        SETUP_MEM_EVENT(net_event, struct_addr >> 12, VMI_MEMACCESS_W, mem_write_cb, 0);
-        
-        // Setup event context data
-        struct event_data *event_data = (struct event_data *) malloc(sizeof(struct event_data));
-        event_data->type = AFINFO_EVENT;
-        event_data->physical_addr = struct_addr;
-        event_data->monitor_size = retrieve_struct_size(dwarf_fp,"tcp_seq_afinfo");
+    // Page table entries stay trapped: a stale cached translation must not outlive the write
+    watch_host host = { guest };
+    adapt_page_watches(guest.adaptive, guest.watch_table, PAGE_TABLE_EVENT, latency_now_ns(), host);
+}
 
-        net_event->data = event_data;
+bool read_watched_page(guest_context &guest, const watched_page *page, uint64_t *contents)
+{
+    size_t bytes_read = 0;
+    return vmi_read_pa(guest.vmi, page->gfn << WATCH_PAGE_SHIFT, WATCH_PAGE_SIZE, contents, &bytes_read) == VMI_SUCCESS
+        && bytes_read == WATCH_PAGE_SIZE;
+}
 
-        if (vmi_register_event(vmi, net_event) == VMI_FAILURE)
-            printf("Failed to register afinfo event!\n");
-        else
-            push_vmi_event(&vmi_event_head, net_event);
+void poll_watched_page(guest_context &guest, watched_page *page, uint64_t now)
+{
+    uint64_t contents[WATCH_PAGE_SIZE / sizeof(uint64_t)];
+    if (!read_watched_page(guest, page, contents))
+        return;
+
+    // A changed relevant word goes through the same filter a trapped write would
+    SpscRing<naive_event> *ring = (detector_modes & MODE_MONITORING) ? &guest.event_ring : NULL;
+    uint64_t timestamp = ring_timestamp_ns();
+    guest.adaptive.poll(page->gfn, contents, page->relevant, now, [&guest, ring, page, timestamp](uint32_t offset) {
+        uint32_t hit_types = filter_event(ring, page, ADAPTIVE_POLL_VCPU, offset, timestamp);
+        for (uint32_t types = hit_types; types != 0; types &= types - 1)
+            guest.counters.add(COUNTER_TYPE_HIT + __builtin_ctz(types));
+    });
+}
+
+/////////////////////
+// Integrity Baseline
+/////////////////////
+bool read_guest_pa(guest_context &guest, uint64_t physical_addr, void *buffer, size_t size)
+{
+    size_t bytes_read = 0;
+    return vmi_read_pa(guest.vmi, physical_addr, size, buffer, &bytes_read) == VMI_SUCCESS && bytes_read == size;
+}
+
+void record_integrity(guest_context &guest, addr_t physical_addr, int size, uint32_t type)
+{
+    auto read = [&guest](uint64_t pa, void *buffer, size_t bytes) { return read_guest_pa(guest, pa, buffer, bytes); };
+    if (!guest.integrity.record(read, type, physical_addr, size, object_watch_fields(guest, type)))
+        printf("Failed to read object %" PRIx64" (type %u) for its integrity baseline\n", physical_addr, type);
+}
+
+bool objects_unchanged(guest_context &guest, const coalesced_event &event)
+{
+    // Every object is checked, so the changed ones all take their new hash as baseline (runs on a worker)
+    std::lock_guard<VmiLock> vmi_hold(guest.vmi_lock);
+    auto read = [&guest](uint64_t pa, void *buffer, size_t bytes) { return read_guest_pa(guest, pa, buffer, bytes); };
+    bool unchanged = !event.objects.empty();
+    for (unordered_map<uint64_t, coalesced_object>::const_iterator it = event.objects.begin(); it != event.objects.end(); ++it)
+    {
+        if (guest.integrity.check(read, event.type, it->first) != INTEGRITY_UNCHANGED)
+            unchanged = false;
     }
+    return unchanged;
+}
 
-    // Register UDP Seq Afinfo Events
-    addr_t udp_seq_afinfo[4];
-    if (vmi_read_addr_ksym(vmi, (char *) "udplite6_seq_afinfo", &udp_seq_afinfo[0]) == VMI_FAILURE)
+void sweep_integrity(guest_context &guest)
+{
+    // A changed object is queued as if every line of its watched fields was written (its first byte without
+    // a shadow to diff); the analysis then accepts the new baseline
+    SpscRing<naive_event> *ring = (detector_modes & MODE_MONITORING) ? &guest.event_ring : NULL;
+    uint64_t timestamp = ring_timestamp_ns();
+    auto read = [&guest](uint64_t pa, void *buffer, size_t bytes) { return read_guest_pa(guest, pa, buffer, bytes); };
+    size_t changed = guest.integrity.sweep(read, [&guest, ring, timestamp](uint32_t type, uint64_t object, uint32_t size) {
+        naive_event record;
+        record.type = type;
+        record.vcpu = INTEGRITY_SWEEP_VCPU;
+        record.object = object;
+        record.timestamp = timestamp;
+
+        vector<pair<uint32_t, uint32_t> > spans(1, make_pair(0u, 1u));
+        const watch_fields *fields = object_watch_fields(guest, type);
+        if (fields)
+            spans = fields->spans;
+        else if (object_shadow_layout(guest, type))
+            spans[0].second = size;
+        for (size_t i = 0; i < spans.size() && ring; i++)
+        {
+            uint32_t line_size = 1u << COALESCE_LINE_SHIFT;
+            for (uint32_t offset = spans[i].first & ~(line_size - 1); offset < spans[i].second; offset += line_size)
+            {
+                record.gfn = (object + offset) >> WATCH_PAGE_SHIFT;
+                record.offset = (object + offset) & (WATCH_PAGE_SIZE - 1);
+                ring->push(record);
+            }
+        }
+    });
+    if (changed != 0)
+        printf("Integrity sweep of %s found %lu changed objects\n", guest.name.c_str(), (unsigned long) changed);
+}
+
+/////////////////////
+// Shadow Field Diff
+/////////////////////
+const shadow_layout *object_shadow_layout(const guest_context &guest, uint32_t type)
+{
+    const shadow_layout *layout = NULL;
+    if (type == PROCESS_EVENT)
+        layout = &guest.kernel->process_layout;
+    else if (type == MODULE_EVENT)
+        layout = &guest.kernel->module_layout;
+    return layout && !layout->empty() ? layout : NULL;
+}
+
+void capture_shadow(guest_context &guest, addr_t physical_addr, int size, uint32_t type)
+{
+    auto read = [&guest](uint64_t pa, void *buffer, size_t bytes) { return read_guest_pa(guest, pa, buffer, bytes); };
+    if (!guest.shadow.capture(read, type, physical_addr, size, object_shadow_layout(guest, type)))
+        printf("Failed to read object %" PRIx64" (type %u) for its shadow copy\n", physical_addr, type);
+}
+
+// "pid 1234 (bash)" or "module nf_tables", from the shadow copy
+string describe_shadow_object(guest_context &guest, uint32_t type, uint64_t object)
+{
+    const DwarfIndex &dwarf = *guest.kernel->dwarf;
+    char text[96];
+    if (type == PROCESS_EVENT)
     {
-        printf("Failed to read udplite6_seq_afinfo kernel symbol\n");
-        return false;
+        int32_t pid = 0;
+        char comm[17] = "";
+        guest.shadow.copy(type, object, dwarf.member_offset("task_struct", "pid"), sizeof(pid), &pid);
+        guest.shadow.copy(type, object, dwarf.member_offset("task_struct", "comm"), 16, comm);
+        snprintf(text, sizeof(text), "pid %d (%s)", pid, comm);
+    }
+    else if (type == MODULE_EVENT)
+    {
+        char name[57] = "";
+        guest.shadow.copy(type, object, dwarf.member_offset("module", "name"), 56, name);
+        snprintf(text, sizeof(text), "module %s", name);
     }
+    else
+        snprintf(text, sizeof(text), "object %" PRIx64, object);
+    return text;
+}
 
-    if (vmi_read_addr_ksym(vmi, (char *) "udp6_seq_afinfo", &udp_seq_afinfo[1]) == VMI_FAILURE)
+bool only_benign_changes(guest_context &guest, const coalesced_event &event)
+{
+    // Every object is diffed so each shadow stays current; any object without a usable diff counts as relevant
+    // (runs on a worker)
+    std::lock_guard<VmiLock> vmi_hold(guest.vmi_lock);
+    auto read = [&guest](uint64_t pa, void *buffer, size_t bytes) { return read_guest_pa(guest, pa, buffer, bytes); };
+    bool benign = !event.objects.empty();
+    size_t printed = 0;
+    vector<shadow_change> changes;
+    for (unordered_map<uint64_t, coalesced_object>::const_iterator it = event.objects.begin(); it != event.objects.end(); ++it)
     {
-        printf("Failed to read udp6_seq_afinfo kernel symbol\n");
+        changes.clear();
+        const shadow_layout *layout = NULL;
+        if (!guest.shadow.diff(read, event.type, it->first, it->second.dirty_lines, COALESCE_LINE_WORDS, changes, &layout))
+        {
+            benign = false;
+            continue;
+        }
+        if (changes.empty())
+            continue;
+
+        string changeset;
+        for (size_t i = 0; i < changes.size(); i++)
+        {
+            const shadow_member *member = layout && changes[i].member >= 0 ? &layout->members[changes[i].member] : NULL;
+            char name[160];
+            if (member)
+                snprintf(name, sizeof(name), "%s.%s%s", layout->struct_name.c_str(), member->name, member->relevant ? "" : " (benign)");
+            else
+                snprintf(name, sizeof(name), "+0x%x..0x%x", changes[i].offset, changes[i].end);
+            changeset += changeset.empty() ? name : string(", ") + name;
+            if (!member || member->relevant)
+                benign = false;
+        }
+        if (printed++ < SHADOW_PRINT_OBJECTS)
+            printf("  %s on %s\n", changeset.c_str(), describe_shadow_object(guest, event.type, it->first).c_str());
+    }
+    if (printed > SHADOW_PRINT_OBJECTS)
+        printf("  ... %lu more changed objects\n", (unsigned long) (printed - SHADOW_PRINT_OBJECTS));
+    return benign;
+}
+
+/////////////////////
+// List Graphs
+/////////////////////
+ListGraph *object_list_graph(guest_context &guest, uint32_t type, int *list_offset)
+{
+    const DwarfIndex &dwarf = *guest.kernel->dwarf;
+    if (type == PROCESS_EVENT && (monitored_types & PROCESS_EVENT))
+    {
+        *list_offset = dwarf.member_offset("task_struct", "tasks");
+        return *list_offset >= 0 ? &guest.task_graph : NULL;
+    }
+    if (type == MODULE_EVENT && (monitored_types & MODULE_EVENT))
+    {
+        *list_offset = dwarf.member_offset("module", "list");
+        return *list_offset >= 0 ? &guest.module_graph : NULL;
+    }
+    return NULL;
+}
+
+void print_list_anomalies(guest_context &guest, uint32_t type, const vector<list_anomaly> &anomalies)
+{
+    for (size_t i = 0; i < anomalies.size(); i++)
+        printf("DKOM suspected on %s: %s list node %" PRIx64" (object %" PRIx64"): %s (other node %" PRIx64")\n",
+            guest.name.c_str(), type == PROCESS_EVENT ? "task" : "module", anomalies[i].node, anomalies[i].object,
+            list_anomaly_name(anomalies[i].kind), anomalies[i].other);
+}
+
+bool reconcile_list_graph(guest_context &guest, uint32_t type)
+{
+    int list_offset = 0;
+    ListGraph *graph = object_list_graph(guest, type, &list_offset);
+    if (!graph)
         return false;
-    } 
 
-    if (vmi_read_addr_ksym(vmi, (char *) "udplite4_seq_afinfo", &udp_seq_afinfo[2]) == VMI_FAILURE)
+    // Every node with its links as the walk read them; the first node seen twice stops the walk (a cycle), kept
+    // so reconcile reports it. Runs on the event loop, under its hold of the VMI lock, so no worker's batch is
+    // applied halfway through
+    const DwarfIndex &dwarf = *guest.kernel->dwarf;
+    VmiMemory memory(guest.vmi, &guest.translation_cache, guest.kernel_dtb);
+    vector<list_walk_node> walked;
+    unordered_set<uint64_t> seen;
+    auto visit = [&](const guest_object &object) -> bool {
+        list_walk_node node;
+        node.va = object.va + list_offset;
+        node.links.next = node.links.prev = 0;
+        object.field(list_offset, &node.links.next);
+        object.field(list_offset + 8, &node.links.prev);
+        node.links.object = memory.translate(object.va);
+        walked.push_back(node);
+        return seen.insert(node.va).second;
+    };
+
+    uint64_t head = 0;
+    bool ok;
+    uint64_t start = latency_now_ns();
+    if (type == PROCESS_EVENT)
     {
-        printf("Failed to read udplite4_seq_afinfo kernel symbol\n");
+        head = memory.symbol("init_task") + list_offset;
+        ok = walk_tasks(memory, dwarf, [&](const guest_task &task) { return visit(task); });
+    }
+    else
+    {
+        // The modules head is a bare list_head, not part of a module
+        list_walk_node node;
+        uint64_t links[2];
+        head = memory.symbol("modules");
+        ok = memory.read(head, links, sizeof(links)) == sizeof(links);
+        if (ok)
+        {
+            node.va = head;
+            node.links.next = links[0];
+            node.links.prev = links[1];
+            node.links.object = memory.translate(head);
+            walked.push_back(node);
+            seen.insert(head);
+            ok = walk_modules(memory, dwarf, [&](const guest_module &module) { return visit(module); });
+        }
+    }
+    if (!ok)
         return false;
+
+    vector<list_anomaly> anomalies;
+    list_drift drift = graph->reconcile(head, walked, anomalies);
+    printf("%s list of %s reconciled in %.3f ms: %lu nodes, %lu missing from the graph, %lu extra, %lu mismatched\n",
+        type == PROCESS_EVENT ? "Task" : "Module", guest.name.c_str(), (latency_now_ns() - start) / 1e6,
+        (unsigned long) drift.walked, (unsigned long) drift.missing, (unsigned long) drift.extra, (unsigned long) drift.mismatched);
+    print_list_anomalies(guest, type, anomalies);
+    return true;
+}
+
+void reconcile_list_graphs(guest_context &guest)
+{
+    if (monitored_types & PROCESS_EVENT)
+        reconcile_list_graph(guest, PROCESS_EVENT);
+    if (monitored_types & MODULE_EVENT)
+        reconcile_list_graph(guest, MODULE_EVENT);
+}
+
+void update_list_graph(guest_context &guest, const coalesced_event &event)
+{
+    int list_offset = 0;
+    ListGraph *graph = object_list_graph(guest, event.type, &list_offset);
+    if (!graph)
+        return;
+
+    // Runs on a worker: the hold also keeps the batch whole against the event loop's reconciles and walks
+    std::lock_guard<VmiLock> vmi_hold(guest.vmi_lock);
+
+    // Only objects whose written lines hold the list_head, one 16-byte read each
+    uint32_t first_line = list_offset >> COALESCE_LINE_SHIFT;
+    uint32_t last_line = (list_offset + 15) >> COALESCE_LINE_SHIFT;
+    for (unordered_map<uint64_t, coalesced_object>::const_iterator it = event.objects.begin(); it != event.objects.end(); ++it)
+    {
+        bool written = false;
+        for (uint32_t line = first_line; line <= last_line && line < COALESCE_LINE_WORDS * 64; line++)
+            written = written || (it->second.dirty_lines[line / 64] & (1ull << (line % 64)));
+        uint64_t node = written ? graph->node_of(it->first) : 0;
+        uint64_t links[2];
+        if (node != 0 && read_guest_pa(guest, it->first + list_offset, links, sizeof(links)))
+            graph->update(node, links[0], links[1]);
     }
 
-    if (vmi_read_addr_ksym(vmi, (char *) "udp4_seq_afinfo", &udp_seq_afinfo[3]) == VMI_FAILURE)
+    // Nodes the watches miss (new entries, the modules head) are read when a check needs them
+    VmiMemory memory(guest.vmi, &guest.translation_cache, guest.kernel_dtb);
+    auto read = [&memory, list_offset](uint64_t va, list_node *node) {
+        uint64_t links[2];
+        if (memory.read(va, links, sizeof(links)) != sizeof(links))
+            return false;
+        node->next = links[0];
+        node->prev = links[1];
+        node->object = memory.translate(va - list_offset);
+        return true;
+    };
+    vector<list_anomaly> anomalies;
+    graph->end_batch(read, anomalies);
+    print_list_anomalies(guest, event.type, anomalies);
+}
+
+void print_list_graph_statistics(guest_context &guest, const char *name, ListGraph &graph)
+{
+    list_graph_stats stats = graph.stats();
+    if (stats.reconciles == 0)
+        return;
+
+    unsigned long anomalies = 0;
+    for (unsigned i = 0; i < LIST_ANOMALY_KINDS; i++)
+        anomalies += stats.anomalies[i];
+    printf("%s List Graph: %lu nodes, %lu link writes, %lu discovered, %lu reread, %lu unlinked, %lu anomalies\n",
+        name, (unsigned long) stats.nodes, stats.updates, stats.discovered, stats.refreshed, stats.removed, anomalies);
+    for (unsigned i = 0; i < LIST_ANOMALY_KINDS; i++)
     {
-        printf("Failed to read udp4_seq_afinfo kernel symbol\n");
+        if (stats.anomalies[i] != 0)
+            printf("  %s: %lu\n", list_anomaly_name((list_anomaly_kind) i), stats.anomalies[i]);
+    }
+    printf("  %lu reconciliations, drift: %lu missing, %lu extra, %lu mismatched\n", stats.reconciles,
+        stats.drift_missing, stats.drift_extra, stats.drift_mismatched);
+    (void) guest;
+}
+
+// Watches only change on the guest's own event loop, where mem_write_cb reads the watch table and set without a
+// lock; called from anywhere else (an analysis), the pass is flagged for the event loop to run between callbacks
+bool defer_to_event_loop(guest_context &guest, uint32_t type)
+{
+    if (listening_guest == &guest)
         return false;
-    } 
+    guest.pending_reregister.fetch_or(type);
+    return true;
+}
 
-    for (int i = 0; i < 4; i++){
-        name = vmi_read_str_va(vmi, udp_seq_afinfo[i], 0);    
-        if (!name) 
-        {
-            printf("Failed to find name\n");
-            return false;
-        }
+bool register_processes_events(guest_context &guest)
+{
+    if (defer_to_event_loop(guest, PROCESS_EVENT))
+        return true;
+
+    printf("Registering Processes Events\n");
+
+    const DwarfIndex &dwarf = *guest.kernel->dwarf;
+    VmiMemory memory(guest.vmi, &guest.translation_cache, guest.kernel_dtb);
+    int task_struct_size = dwarf.struct_size("task_struct");
 
+    guest.watch_set.begin_pass(PROCESS_EVENT, ring_timestamp_ns());
+    printf("\nPID\tProcess Name\n");
+    bool walked = walk_tasks(memory, dwarf, [&](const guest_task &task) {
         // Print details
-        printf("%s (struct addr: \%" PRIx64")\n", name, udp_seq_afinfo[i]);
-        if (name) 
+        printf("%d\t%s (struct addr: \%" PRIx64")\n", task.pid, task.name.c_str(), task.va);
+
+        addr_t struct_addr = memory.translate(task.va);
+
+        #ifdef MYDEBUG
+            // Print details of process in physical memory
+            char *phy_procname = NULL;
+            vmi_pid_t phy_pid = 0;
+
+            vmi_read_32_pa(guest.vmi, struct_addr + dwarf.member_offset("task_struct", "pid"), (uint32_t*)&phy_pid);
+            phy_procname = vmi_read_str_pa(guest.vmi, struct_addr + dwarf.member_offset("task_struct", "comm"));
+            printf("Physical:%d\t%s (struct addr: \%" PRIx64")\n", phy_pid, phy_procname, struct_addr);
+            if (phy_procname)
+            {
+                free(phy_procname);
+                phy_procname = NULL;
+            }
+
+            page_info_t page_info;
+            if (vmi_pagetable_lookup_extended(guest.vmi, vmi_pid_to_dtb(guest.vmi, task.pid), task.va, &page_info) == VMI_FAILURE)
+                printf("Failed to retrieve page info at %" PRIx64"\n", task.va);
+            else
+                printf("Page Size: %d\n", page_info.size);
+        #endif
+
+        if (!watch_changed_object(guest, struct_addr, task_struct_size, PROCESS_EVENT))
+            printf("Failed to register process event!\n");
+    });
+
+    if (!walked)
+    {
+        guest.watch_set.abort_pass(PROCESS_EVENT);
+        return false;
+    }
+
+    finish_watch_pass(guest, PROCESS_EVENT, "Processes");
+    return true;
+}
+
+bool register_open_files_events(guest_context &guest)
+{
+    if (defer_to_event_loop(guest, OPEN_FILES_EVENT))
+        return true;
+
+    printf("Registering open files events\n");
+
+    const DwarfIndex &dwarf = *guest.kernel->dwarf;
+    VmiMemory memory(guest.vmi, &guest.translation_cache, guest.kernel_dtb);
+    int files_offset = dwarf.member_offset("task_struct", "files");
+    if (files_offset < 0)
+    {
+        printf("Failed to find files member of task_struct\n");
+        return false;
+    }
+
+    guest.watch_set.begin_pass(OPEN_FILES_EVENT, ring_timestamp_ns());
+    printf("\nPID\tFiles Addr\n");
+    bool walked = walk_tasks(memory, dwarf, [&](const guest_task &task) {
+        // Retrieve open files
+        printf("%d\t\%" PRIx64" (struct addr: \%" PRIx64")\n", task.pid, task.va + files_offset, task.va);
+
+        addr_t open_files = 0;
+        if (!task.field(files_offset, &open_files))
         {
-            free(name);
-            name = NULL;
+            printf("Failed to read files member at %" PRIx64"\n", task.va + files_offset);
+            return;
         }
 
-        addr_t struct_addr = vmi_translate_kv2p(vmi, udp_seq_afinfo[i]);
-        printf("Registering event for physical addr: %" PRIx64"\n", struct_addr >> 12);
-        // Register write memory event (>> 12 to point to page base)
-        vmi_event_t *net_event = (vmi_event_t *) malloc(sizeof(vmi_event_t));
-        SETUP_MEM_EVENT(net_event, struct_addr >> 12, VMI_MEMACCESS_W, mem_write_cb, 0);
-        
-        // Setup event context data
-        struct event_data *event_data = (struct event_data *) malloc(sizeof(struct event_data));
-        event_data->type = AFINFO_EVENT;
-        event_data->physical_addr = struct_addr;
-        event_data->monitor_size = retrieve_struct_size(dwarf_fp,"udp_seq_afinfo");
+        addr_t struct_addr = memory.translate(open_files);
+        printf("Registering 4 pages for physical addr: %" PRIx64"\n", struct_addr >> 12);
 
-        net_event->data = event_data;
+        // Watch 4 pages of information (i.e. 64 (fd array size) * 256 (file struct size))
+        addr_t files_page_base = struct_addr & ~(WATCH_PAGE_SIZE - 1);
+        if (!watch_changed_object(guest, files_page_base, OPEN_FILES_PAGES * WATCH_PAGE_SIZE, OPEN_FILES_EVENT))
+            printf("Failed to register open files event!\n");
+    });
 
-        if (vmi_register_event(vmi, net_event) == VMI_FAILURE)
-            printf("Failed to register afinfo event!\n");
-        else
-            push_vmi_event(&vmi_event_head, net_event);
+    if (!walked)
+    {
+        guest.watch_set.abort_pass(OPEN_FILES_EVENT);
+        return false;
     }
 
+    finish_watch_pass(guest, OPEN_FILES_EVENT, "Open files");
     return true;
 }
 
-void cleanup(vmi_instance_t vmi)
+bool register_modules_events(guest_context &guest)
 {
-    // Send Interrupt event to security checking thread
-    interrupted = true;
-    event_deque.push_front(INTERRUPTED_EVENT);
+    if (defer_to_event_loop(guest, MODULE_EVENT))
+        return true;
 
-    if(PAUSE_VM == 1) 
-        vmi_resume_vm(vmi);
+    printf("Registering Modules Events\n");
+
+    const DwarfIndex &dwarf = *guest.kernel->dwarf;
+    VmiMemory memory(guest.vmi, &guest.translation_cache, guest.kernel_dtb);
+    int module_struct_size = dwarf.struct_size("module");
 
-    struct vmi_event_node *current = vmi_event_head;
-    struct vmi_event_node *next = vmi_event_head;
+    guest.watch_set.begin_pass(MODULE_EVENT, ring_timestamp_ns());
+    printf("\nModule Name\n");
+    bool walked = walk_modules(memory, dwarf, [&](const guest_module &module) {
+        // Print details
+        printf("%s (struct addr: \%" PRIx64")\n", module.name.c_str(), module.va);
+
+        addr_t struct_addr = memory.translate(module.va);
+        if (!watch_changed_object(guest, struct_addr, module_struct_size, MODULE_EVENT))
+            printf("Failed to register module event!\n");
+    });
 
-    while (current) 
+    if (!walked)
     {
-        next = current->next;
+        guest.watch_set.abort_pass(MODULE_EVENT);
+        return false;
+    }
+
+    finish_watch_pass(guest, MODULE_EVENT, "Modules");
+    return true;
+}
+
+bool register_afinfo_events(guest_context &guest){
+
+    printf("Registering Afinfo Events\n");
+
+    const DwarfIndex &dwarf = *guest.kernel->dwarf;
+    VmiMemory memory(guest.vmi, &guest.translation_cache, guest.kernel_dtb);
+    return walk_afinfo(memory, dwarf, [&](const guest_afinfo &afinfo) {
+        // Print details
+        printf("%s (struct addr: \%" PRIx64")\n", afinfo.name.c_str(), afinfo.va);
 
-        vmi_clear_event(vmi, current->event, free_event_data);
+        addr_t struct_addr = memory.translate(afinfo.va);
+        if (!watch_object(guest, struct_addr, (int) afinfo.size, AFINFO_EVENT))
+            printf("Failed to register afinfo event!\n");
+    });
+}
 
-        free(current);
-        current = next;
+static const char *event_type_name(uint32_t type)
+{
+    switch (type)
+    {
+        case PROCESS_EVENT: return "PROCESS_EVENT";
+        case MODULE_EVENT: return "MODULE_EVENT";
+        case AFINFO_EVENT: return "AFINFO_EVENT";
+        case OPEN_FILES_EVENT: return "OPEN_FILES_EVENT";
+        case PAGE_TABLE_EVENT: return "PAGE_TABLE_EVENT";
+        default: return "UNKNOWN_EVENT";
     }
+}
+
+void print_analysis_queue_settings()
+{
+    printf("Analysis queue: %s jobs, aging %ld ms, priorities", analysis_queue_capacity ?
+        to_string(analysis_queue_capacity).c_str() : "unbounded", analysis_aging_ms);
+    for (unsigned type = 0; type < EVENT_TYPE_COUNT; type++)
+    {
+        if (!(monitored_types & (1u << type)))
+            continue;
+        printf(" %s=%u%s", event_type_name(1u << type), analysis_priorities[type],
+            (analysis_drop_types & (1u << type)) ? " (drop oldest)" : "");
+    }
+    printf("\n");
+}
+
+void print_analysis_queue_statistics()
+{
+    worker_stats workers = analysis_workers.stats();
+    if (workers.dropped + workers.deferred != 0)
+        printf("Analysis Queue Full: %lu analyses dropped, %lu deferred\n", workers.dropped, workers.deferred);
+    for (unsigned type = 0; type < EVENT_TYPE_COUNT; type++)
+    {
+        worker_type_stats stats = analysis_workers.type_stats(1u << type);
+        if (stats.submitted == 0)
+            continue;
+        printf("  %s (priority %u): %lu run, %lu dropped, %lu deferred, wait %.3f ms average, %.3f ms max\n",
+            event_type_name(1u << type), analysis_priorities[type], stats.completed, stats.dropped, stats.deferred,
+            stats.completed ? stats.wait_ns / 1e6 / stats.completed : 0.0, stats.max_wait_ns / 1e6);
+    }
+}
+
+void cleanup(guest_context &guest)
+{
+    // Wake and stop the guest's security checking thread, then drop its queued checks and wait for running ones
+    guest.event_ring.close();
+    if (guest.security_thread_started)
+    {
+        pthread_join(guest.security_thread, NULL);
+        guest.security_thread_started = false;
+    }
+    if (detector_modes & MODE_MONITORING)
+        analysis_workers.cancel(guest.index);
+
+    // No analysis of the guest is left running, the hold only orders the teardown after the last read
+    std::lock_guard<VmiLock> vmi_hold(guest.vmi_lock);
+
+    if(PAUSE_VM == 1) 
+        vmi_resume_vm(guest.vmi);
+
+    // Clear every registered page event, then release all pool slots at once
+    vmi_instance_t vmi = guest.vmi;
+    printf("Clearing events of %s for %lu pages (%lu watched ranges)\n", guest.name.c_str(),
+        (unsigned long) guest.watch_table.page_count(), (unsigned long) guest.watch_table.range_count());
+    ResponseStrategy *response = guest.response;
+    AdaptiveController &adaptive = guest.adaptive;
+    guest.watch_table.for_each_page([vmi, response, &adaptive](watched_page *page) {
+        if (adaptive.polled(page->gfn))
+            return;
+        response->prepare(&page->event);
+        vmi_clear_event(vmi, &page->event, NULL);
+    });
+    response->teardown(vmi);
 
     // Perform cleanup of libvmi instance
     vmi_destroy(vmi);
+    guest.vmi = NULL;
+    guest.watch_table.clear();
+
+    pthread_mutex_lock(&statistics_lock);
+    print_guest_statistics(guest);
+    pthread_mutex_unlock(&statistics_lock);
+}
+
+void print_guest_statistics(guest_context &guest)
+{
+    if (guests.size() > 1)
+        printf("=== Statistics of %s ===\n", guest.name.c_str());
 
     // Print Statistics
+    long monitored_events_count = guest.counters.get(COUNTER_MONITORED);
+    long irrelevant_events_count = guest.counters.get(COUNTER_IRRELEVANT);
     if (monitored_events_count != 0) 
     {
         printf("Total Irrelevant Events: %ld\n", irrelevant_events_count);
@@ -723,6 +1840,345 @@ void cleanup(vmi_instance_t vmi)
         printf("Total Monitored Events: %ld\n", monitored_events_count);
         printf("Total Irrelevant Events Percentage: %f%%\n", (double) irrelevant_events_count / (double)monitored_events_count * 100);
         printf("Total Hit Events: %f%%\n", (1 - (double) irrelevant_events_count / (double)monitored_events_count) * 100);
+
+        for (unsigned i = 0; i < EVENT_TYPE_COUNT; i++)
+        {
+            long hits = guest.counters.get(COUNTER_TYPE_HIT + i);
+            long filtered = guest.counters.get(COUNTER_TYPE_FILTERED + i);
+            if (hits + filtered != 0)
+                printf("%s: %ld field hits, %ld other writes to watched objects ignored (%.1f%%)\n",
+                    event_type_name(1u << i), hits, filtered, 100.0 * filtered / (hits + filtered));
+        }
+    }
+
+    integrity_stats integrity = guest.integrity.stats();
+    if (integrity.checked != 0)
+        printf("Integrity Baseline: %lu objects, %lu checks (%lu unchanged, %lu changed), %lu unreadable, %lu sweeps, %lu analyses skipped\n",
+            (unsigned long) guest.integrity.size(), integrity.checked, integrity.unchanged, integrity.changed,
+            integrity.unreadable, integrity.sweeps, guest.integrity_skipped.load());
+
+    print_list_graph_statistics(guest, "Task", guest.task_graph);
+    print_list_graph_statistics(guest, "Module", guest.module_graph);
+
+    shadow_stats shadow = guest.shadow.stats();
+    if (shadow.diffs != 0)
+        printf("Shadow Diff: %lu objects, %lu diffs read %lu lines, %lu changed members, %lu unreadable, %lu analyses skipped\n",
+            (unsigned long) guest.shadow.size(), shadow.diffs, shadow.lines_read, shadow.changes, shadow.unreadable,
+            guest.benign_skipped.load());
+
+    adaptive_stats adaptive = guest.adaptive.stats();
+    if (adaptive.to_polled != 0)
+        printf("Adaptive Polling: %lu pages switched to polling, %lu re-armed, %lu polls found %lu changed words\n",
+            adaptive.to_polled, adaptive.to_trapped, adaptive.polls, adaptive.changed_words);
+
+    if (guest.response && guest.response->stats().writes != 0)
+        printf("Write Response (%s): %lu writes, %lu single steps\n", guest.response->name(),
+            guest.response->stats().writes, guest.response->stats().steps);
+
+    if (guest.event_trace.recording())
+    {
+        printf("Event Trace Records: %lu\n", guest.event_trace.records());
+        guest.event_trace.close();
+    }
+
+    if (guest.event_ring.dropped() != 0)
+        printf("Total Dropped Events (ring full): %lu\n", guest.event_ring.dropped());
+
+    if (detector_modes & MODE_MONITORING)
+    {
+        worker_source_stats analyses = analysis_workers.source_stats(guest.index);
+        printf("Analyses Run: %lu covering %lu raw events\n", guest.event_coalescer.total_analyses(),
+            guest.event_coalescer.total_raw_events());
+        if (analyses.completed != 0)
+            printf("Analysis Queue Wait: %.3f ms average, %.3f ms max\n",
+                analyses.wait_ns / 1e6 / analyses.completed, analyses.max_wait_ns / 1e6);
+    }
+
+    translation_stats translations = guest.translation_cache.stats();
+    if (translations.hits + translations.misses != 0)
+    {
+        printf("Translation Cache: %lu hits, %lu misses, %lu evictions, %lu invalidations (%lu entry writes deferred)\n",
+            translations.hits, translations.misses, translations.evictions, translations.invalidations, translations.deferred);
+        printf("Symbol Cache: %lu hits, %lu misses\n", translations.symbol_hits, translations.symbol_misses);
+    }
+
+    const delta_stats &passes = guest.watch_set.stats();
+    if (passes.passes != 0)
+    {
+        unsigned long delta_passes = passes.passes - passes.full_passes;
+        printf("Watch Passes: %lu full, %lu delta\n", passes.full_passes, delta_passes);
+        printf("Watch Objects: walked %lu, added %lu, removed %lu, unchanged %lu\n",
+            passes.walked, passes.added, passes.removed, passes.unchanged);
+        printf("Average Full Pass: %.3f ms\n", passes.full_passes ? passes.full_ns / 1e6 / passes.full_passes : 0.0);
+        printf("Average Delta Pass: %.3f ms\n", delta_passes ? passes.delta_ns / 1e6 / delta_passes : 0.0);
+    }
+
+    if (detector_modes & MODE_CALLBACK_TIME)
+        print_callback_latency(guest);
+}
+
+// One line per guest once all of them have stopped
+void print_guest_summary()
+{
+    printf("%-24s %12s %12s %12s %10s %10s %6s\n", "Guest", "Monitored", "Hits", "Irrelevant", "Analyses", "Dropped", "Exit");
+    for (size_t i = 0; i < guests.size(); i++)
+    {
+        guest_context &guest = *guests[i];
+        long monitored = guest.counters.get(COUNTER_MONITORED);
+        long irrelevant = guest.counters.get(COUNTER_IRRELEVANT);
+        printf("%-24s %12ld %12ld %12ld %10lu %10lu %6d\n", guest.name.c_str(), monitored, monitored - irrelevant,
+            irrelevant, guest.event_coalescer.total_analyses(), guest.event_ring.dropped(), guest.status);
+    }
+}
+
+/////////////////////
+// Metrics
+/////////////////////
+void collect_heat_map(guest_context &guest)
+{
+    vector<page_heat> pages;
+    vector<object_heat> objects;
+    guest.watch_table.for_each_page([&pages, &objects](watched_page *page) {
+        if (page->writes != 0)
+        {
+            page_heat heat = { page->gfn, page->writes };
+            pages.push_back(heat);
+        }
+        for (size_t i = 0; i < page->ranges.size(); i++)
+        {
+            if (page->ranges[i].hits != 0)
+            {
+                object_heat heat = { page->ranges[i].object, page->ranges[i].type, page->ranges[i].hits };
+                objects.push_back(heat);
+            }
+        }
+    });
+
+    // An object spanning several pages has a range on each; it is reported once with their sum
+    sort(objects.begin(), objects.end(), [](const object_heat &a, const object_heat &b) {
+        return a.object != b.object ? a.object < b.object : a.type < b.type;
+    });
+    size_t merged = 0;
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        if (merged > 0 && objects[merged - 1].object == objects[i].object && objects[merged - 1].type == objects[i].type)
+            objects[merged - 1].hits += objects[i].hits;
+        else
+            objects[merged++] = objects[i];
+    }
+    objects.resize(merged);
+
+    size_t page_count = min(pages.size(), (size_t) METRICS_HOT_ENTRIES);
+    partial_sort(pages.begin(), pages.begin() + page_count, pages.end(),
+        [](const page_heat &a, const page_heat &b) { return a.writes > b.writes; });
+    pages.resize(page_count);
+    size_t object_count = min(objects.size(), (size_t) METRICS_HOT_ENTRIES);
+    partial_sort(objects.begin(), objects.begin() + object_count, objects.end(),
+        [](const object_heat &a, const object_heat &b) { return a.hits > b.hits; });
+    objects.resize(object_count);
+
+    pthread_mutex_lock(&guest.heat_lock);
+    guest.hot_pages.swap(pages);
+    guest.hot_objects.swap(objects);
+    guest.watched_pages = guest.watch_table.page_count();
+    guest.watched_ranges = guest.watch_table.range_count();
+    guest.adaptive_snapshot = guest.adaptive.stats();
+    pthread_mutex_unlock(&guest.heat_lock);
+}
+
+void write_metrics()
+{
+    MetricsText metrics;
+    vector<string> labels;
+    for (size_t i = 0; i < guests.size(); i++)
+        labels.push_back(metric_label("guest", guests[i]->name));
+
+    metrics.family("naive_events_total", "counter", "Write events received by mem_write_cb.");
+    for (size_t i = 0; i < guests.size(); i++)
+        metrics.sample("naive_events_total", labels[i], guests[i]->counters.get(COUNTER_MONITORED));
+
+    metrics.family("naive_irrelevant_events_total", "counter", "Write events that hit no watched field.");
+    for (size_t i = 0; i < guests.size(); i++)
+        metrics.sample("naive_irrelevant_events_total", labels[i], guests[i]->counters.get(COUNTER_IRRELEVANT));
+
+    metrics.family("naive_field_hits_total", "counter", "Writes to a watched field, per event type.");
+    for (size_t i = 0; i < guests.size(); i++)
+    {
+        for (unsigned type = 0; type < EVENT_TYPE_COUNT; type++)
+            metrics.sample("naive_field_hits_total", labels[i] + "," + metric_label("type", event_type_name(1u << type)),
+                guests[i]->counters.get(COUNTER_TYPE_HIT + type));
+    }
+
+    metrics.family("naive_field_filtered_total", "counter", "Writes inside a watched object that hit no watched field, per event type.");
+    for (size_t i = 0; i < guests.size(); i++)
+    {
+        for (unsigned type = 0; type < EVENT_TYPE_COUNT; type++)
+            metrics.sample("naive_field_filtered_total", labels[i] + "," + metric_label("type", event_type_name(1u << type)),
+                guests[i]->counters.get(COUNTER_TYPE_FILTERED + type));
+    }
+
+    metrics.family("naive_ring_depth", "gauge", "Events queued between the callback and the dispatcher.");
+    for (size_t i = 0; i < guests.size(); i++)
+        metrics.sample("naive_ring_depth", labels[i], (uint64_t) guests[i]->event_ring.size());
+
+    metrics.family("naive_ring_dropped_total", "counter", "Events dropped because the ring was full.");
+    for (size_t i = 0; i < guests.size(); i++)
+        metrics.sample("naive_ring_dropped_total", labels[i], (uint64_t) guests[i]->event_ring.dropped());
+
+    if (detector_modes & MODE_MONITORING)
+    {
+        metrics.family("naive_analysis_queue_depth", "gauge", "Analyses waiting for a worker.");
+        for (size_t i = 0; i < guests.size(); i++)
+            metrics.sample("naive_analysis_queue_depth", labels[i], (uint64_t) analysis_workers.source_stats(i).queued);
+
+        metrics.family("naive_analyses_total", "counter", "Analyses run to completion.");
+        for (size_t i = 0; i < guests.size(); i++)
+            metrics.sample("naive_analyses_total", labels[i], (uint64_t) analysis_workers.source_stats(i).completed);
+
+        metrics.family("naive_analysis_dropped_total", "counter", "Queued analyses dropped for a more urgent one, per event type.");
+        for (unsigned type = 0; type < EVENT_TYPE_COUNT; type++)
+            metrics.sample("naive_analysis_dropped_total", metric_label("type", event_type_name(1u << type)),
+                (uint64_t) analysis_workers.type_stats(1u << type).dropped);
+
+        metrics.family("naive_analysis_deferred_total", "counter", "Analyses left coalescing because the queue was full, per event type.");
+        for (unsigned type = 0; type < EVENT_TYPE_COUNT; type++)
+            metrics.sample("naive_analysis_deferred_total", metric_label("type", event_type_name(1u << type)),
+                (uint64_t) analysis_workers.type_stats(1u << type).deferred);
+
+        metrics.family("naive_analysis_wait_seconds_max", "gauge", "Longest an analysis waited for a worker, per event type.");
+        for (unsigned type = 0; type < EVENT_TYPE_COUNT; type++)
+            metrics.sample("naive_analysis_wait_seconds_max", metric_label("type", event_type_name(1u << type)),
+                analysis_workers.type_stats(1u << type).max_wait_ns / 1e9);
+
+        metrics.family("naive_analysis_duration_seconds", "summary", "Time an analysis ran on a worker, per event type.");
+        for (size_t i = 0; i < guests.size(); i++)
+        {
+            for (unsigned type = 0; type < EVENT_TYPE_COUNT; type++)
+            {
+                latency_snapshot snapshot;
+                guests[i]->analysis_latency.snapshot(type, snapshot);
+                if (snapshot.count != 0)
+                    metrics.summary("naive_analysis_duration_seconds",
+                        labels[i] + "," + metric_label("type", event_type_name(1u << type)), snapshot);
+            }
+        }
+    }
+
+    if (detector_modes & MODE_CALLBACK_TIME)
+    {
+        metrics.family("naive_callback_duration_seconds", "summary", "Time spent in mem_write_cb, per event type hit.");
+        for (size_t i = 0; i < guests.size(); i++)
+        {
+            for (unsigned slot = 0; slot < LATENCY_SLOTS; slot++)
+            {
+                latency_snapshot snapshot;
+                guests[i]->callback_latency.snapshot(slot, snapshot);
+                if (snapshot.count != 0)
+                    metrics.summary("naive_callback_duration_seconds", labels[i] + "," + metric_label("type",
+                        slot == LATENCY_SLOT_IRRELEVANT ? "IRRELEVANT" : event_type_name(1u << slot)), snapshot);
+            }
+        }
+    }
+
+    // Heat maps as of each guest's last rebuild
+    metrics.family("naive_watched_pages", "gauge", "Pages with a registered write event.");
+    for (size_t i = 0; i < guests.size(); i++)
+    {
+        pthread_mutex_lock(&guests[i]->heat_lock);
+        metrics.sample("naive_watched_pages", labels[i], (uint64_t) guests[i]->watched_pages);
+        pthread_mutex_unlock(&guests[i]->heat_lock);
+    }
+
+    metrics.family("naive_watched_ranges", "gauge", "Watched object ranges.");
+    for (size_t i = 0; i < guests.size(); i++)
+    {
+        pthread_mutex_lock(&guests[i]->heat_lock);
+        metrics.sample("naive_watched_ranges", labels[i], (uint64_t) guests[i]->watched_ranges);
+        pthread_mutex_unlock(&guests[i]->heat_lock);
+    }
+
+    metrics.family("naive_polled_pages", "gauge", "Watched pages polled instead of trapped.");
+    for (size_t i = 0; i < guests.size(); i++)
+    {
+        pthread_mutex_lock(&guests[i]->heat_lock);
+        metrics.sample("naive_polled_pages", labels[i], (uint64_t) guests[i]->adaptive_snapshot.polled);
+        pthread_mutex_unlock(&guests[i]->heat_lock);
+    }
+
+    metrics.family("naive_integrity_skipped_total", "counter", "Analyses skipped because their objects hashed unchanged.");
+    for (size_t i = 0; i < guests.size(); i++)
+        metrics.sample("naive_integrity_skipped_total", labels[i], (uint64_t) guests[i]->integrity_skipped.load());
+
+    metrics.family("naive_benign_skipped_total", "counter", "Analyses skipped because only unwatched members changed.");
+    for (size_t i = 0; i < guests.size(); i++)
+        metrics.sample("naive_benign_skipped_total", labels[i], (uint64_t) guests[i]->benign_skipped.load());
+
+    metrics.family("naive_poll_switches_total", "counter", "Watched pages switched between trapping and polling.");
+    for (size_t i = 0; i < guests.size(); i++)
+    {
+        pthread_mutex_lock(&guests[i]->heat_lock);
+        metrics.sample("naive_poll_switches_total", labels[i] + ",mode=\"polled\"", guests[i]->adaptive_snapshot.to_polled);
+        metrics.sample("naive_poll_switches_total", labels[i] + ",mode=\"trapped\"", guests[i]->adaptive_snapshot.to_trapped);
+        pthread_mutex_unlock(&guests[i]->heat_lock);
+    }
+
+    metrics.family("naive_page_writes_total", "counter", "Trapped writes of the hottest watched pages.");
+    for (size_t i = 0; i < guests.size(); i++)
+    {
+        pthread_mutex_lock(&guests[i]->heat_lock);
+        for (size_t j = 0; j < guests[i]->hot_pages.size(); j++)
+            metrics.sample("naive_page_writes_total", labels[i] + "," + metric_hex_label("gfn", guests[i]->hot_pages[j].gfn),
+                guests[i]->hot_pages[j].writes);
+        pthread_mutex_unlock(&guests[i]->heat_lock);
+    }
+
+    metrics.family("naive_object_hits_total", "counter", "Watched field writes of the hottest watched objects.");
+    for (size_t i = 0; i < guests.size(); i++)
+    {
+        pthread_mutex_lock(&guests[i]->heat_lock);
+        for (size_t j = 0; j < guests[i]->hot_objects.size(); j++)
+        {
+            const object_heat &heat = guests[i]->hot_objects[j];
+            metrics.sample("naive_object_hits_total", labels[i] + "," + metric_hex_label("object", heat.object) + ","
+                + metric_label("type", event_type_name(heat.type)), heat.hits);
+        }
+        pthread_mutex_unlock(&guests[i]->heat_lock);
+    }
+
+    if (!write_metrics_file(metrics_path, metrics.str()))
+        printf("Failed to write metrics to %s\n", metrics_path.c_str());
+}
+
+void *metrics_thread(void *arg)
+{
+    UNUSED_PARAMETER(arg);
+    uint64_t next_snapshot = latency_now_ns() + METRICS_INTERVAL_MS * 1000000ull;
+    while (!interrupted && !event_loops_done)
+    {
+        // Short sleeps so an interrupt ends the thread promptly
+        struct timespec pause = { 0, 100 * 1000000 };
+        nanosleep(&pause, NULL);
+        if (latency_now_ns() < next_snapshot)
+            continue;
+        write_metrics();
+        next_snapshot += METRICS_INTERVAL_MS * 1000000ull;
+    }
+    return NULL;
+}
+
+void print_callback_latency(guest_context &guest)
+{
+    static const char *slot_names[LATENCY_SLOTS] = {
+        "mem_write_cb() PROCESS_EVENT", "mem_write_cb() MODULE_EVENT", "mem_write_cb() AFINFO_EVENT",
+        "mem_write_cb() OPEN_FILES_EVENT", "mem_write_cb() PAGE_TABLE_EVENT", "mem_write_cb() irrelevant" };
+
+    // Guests report at their own pace, so name the guest once there are several
+    string prefix = guests.size() > 1 ? guest.name + " " : "";
+    latency_snapshot snapshot;
+    for (unsigned slot = 0; slot < LATENCY_SLOTS; slot++)
+    {
+        guest.callback_latency.snapshot(slot, snapshot);
+        snapshot.print((prefix + slot_names[slot]).c_str());
     }
 }
 
@@ -739,93 +2195,240 @@ void print_event(vmi_event_t *event)
     );
 }
 
-void *security_checking_thread(void *arg)
+void print_analysis_result(const analysis_result &result)
+{
+    for (size_t i = 0; i < result.findings.size(); i++)
+    {
+        printf("***Possible malware detected by %s***", result.check.c_str());
+        for (size_t j = 0; j < result.findings[i].size(); j++)
+            printf(" %s=%s", result.findings[i][j].first.c_str(), result.findings[i][j].second.c_str());
+        printf("\n");
+    }
+    printf("--- %s: %lu findings, %f seconds ---\n", result.check.c_str(), (unsigned long) result.findings.size(), result.seconds);
+}
+
+typedef bool (*native_check_fn)(GuestMemory &memory, const DwarfIndex &dwarf, analysis_result &result);
+
+// Native replacement of a Volatility check, NULL if there is none
+static native_check_fn native_check(const char *check)
+{
+    if (strcmp(check, "check_fop") == 0)
+        return native_check_fop;
+    if (strcmp(check, "check_creds") == 0)
+        return native_check_creds;
+    if (strcmp(check, "check_afinfo") == 0)
+        return native_check_afinfo;
+    return NULL;
+}
+
+// Checks analyse_events runs for types that have no native version, comma separated (empty if none)
+string volatility_only_checks(uint32_t types)
+{
+    static const pair<uint32_t, const char *> checks[] = { make_pair(PROCESS_EVENT, "check_fop"),
+        make_pair(PROCESS_EVENT, "check_creds"), make_pair(OPEN_FILES_EVENT | AFINFO_EVENT, "check_afinfo"),
+        make_pair(MODULE_EVENT, "check_hidden_modules") };
+    string names;
+    for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++)
+    {
+        if (!(types & checks[i].first) || ((detector_modes & MODE_NATIVE_CHECKS) && native_check(checks[i].second)))
+            continue;
+        if (names.find(checks[i].second) == string::npos)
+            names += (names.empty() ? "" : ", ") + string(checks[i].second);
+    }
+    return names;
+}
+
+// Volatility checks of guests other than the first are refused at startup (see volatility_only_checks)
+void run_check(guest_context &guest, const char *check)
+{
+    analysis_result result;
+    native_check_fn native = (detector_modes & MODE_NATIVE_CHECKS) ? native_check(check) : NULL;
+
+    bool ok;
+    if (native)
+    {
+        std::lock_guard<VmiLock> vmi_hold(guest.vmi_lock);
+        VmiMemory memory(guest.vmi, &guest.translation_cache, guest.kernel_dtb);
+        ok = native(memory, *guest.kernel->dwarf, result);
+    }
+    else
+        ok = analysis_engine.run(check, result);
+
+    if (!ok)
+    {
+        printf("Failed to run %s on %s\n", check, guest.name.c_str());
+        return;
+    }
+    if (guests.size() > 1)
+        printf("--- %s ---\n", guest.name.c_str());
+    print_analysis_result(result);
+}
+
+// Address (or cred) of every finding, used to match native and Volatility results
+static unordered_set<string> finding_keys(const analysis_result &result)
+{
+    unordered_set<string> keys;
+    for (size_t i = 0; i < result.findings.size(); i++)
+    {
+        for (size_t j = 0; j < result.findings[i].size(); j++)
+        {
+            if (result.findings[i][j].first == "address" || result.findings[i][j].first == "cred")
+                keys.insert(result.findings[i][j].second);
+        }
+    }
+    return keys;
+}
+
+bool compare_checks(guest_context &guest)
 {
-    vmi_instance_t vmi = (vmi_instance_t)arg;
-    printf("Security Checking Thread Initated: %p\n", vmi);
-
-    // Py_Initialize();
-    // PyRun_SimpleString("from time import time,ctime\n"
-    //                    "print 'Today is',ctime(time())\n");
-    int res = 0;
-    UNUSED_PARAMETER(res);
-
-    int event_type = INTERRUPTED_EVENT;
-    while(!interrupted)
-    {
-        event_type = event_deque.pop();
-
-        switch (event_type)
-        {
-            case PROCESS_EVENT:{
-                printf("Encountered PROCESS_EVENT\n");
-                #ifdef RE_REGISTER_EVENTS
-                    // Recheck processes
-                    register_processes_events(vmi, dwarf_fp);
-                #endif
-
-                #ifdef ANALYSIS_MODE
-                    // Volatility Plugin linux_check_fop
-                    res = system("python scripts/check_fop.py");
-                    // Volatility Plugin linux_check_creds
-                    res = system("python scripts/check_creds.py");
-                #endif
-                break;
-            } 
-            case OPEN_FILES_EVENT:{
-                printf("Encountered OPEN_FILES_EVENT\n");
-                #ifdef RE_REGISTER_EVENTS
-                    // Recheck open files
-                    register_open_files_events(vmi, dwarf_fp);
-                #endif
-
-                #ifdef ANALYSIS_MODE
-                    // Volatility Plugin linux_check_afinfo
-                    res = system("python scripts/check_afinfo.py");
-                #endif
-                break;
+    static const char *checks[] = { "check_fop", "check_creds", "check_afinfo" };
+
+    if (!analysis_engine.start(analysis_scripts, analysis_profile, analysis_location))
+    {
+        printf("Failed to start analysis engine\n");
+        return false;
+    }
+
+    VmiMemory memory(guest.vmi);
+    const DwarfIndex &dwarf = *guest.kernel->dwarf;
+    bool agreed = true;
+    for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++)
+    {
+        analysis_result native_result, python_result;
+        if (!native_check(checks[i])(memory, dwarf, native_result) || !analysis_engine.run(checks[i], python_result))
+        {
+            printf("Failed to run %s\n", checks[i]);
+            agreed = false;
+            continue;
+        }
+
+        unordered_set<string> native_keys = finding_keys(native_result);
+        unordered_set<string> python_keys = finding_keys(python_result);
+        unsigned long both = 0, native_only = 0, python_only = 0;
+        for (auto it = native_keys.begin(); it != native_keys.end(); ++it)
+        {
+            if (python_keys.count(*it))
+                both++;
+            else
+            {
+                native_only++;
+                printf("%s native only: %s\n", checks[i], it->c_str());
             }
-            case MODULE_EVENT:{
-                printf("Encountered MODULE_EVENT\n");
-                #ifdef RE_REGISTER_EVENTS
-                    // Recheck modules 
-                    register_modules_events(vmi, dwarf_fp);
-                #endif
-
-                #ifdef ANALYSIS_MODE
-                    // Volatility Plugin linux_check_modules
-                    res = system("python scripts/check_hidden_modules.py");
-                #endif
-                break;
-            } 
-            case AFINFO_EVENT:
+        }
+        for (auto it = python_keys.begin(); it != python_keys.end(); ++it)
+        {
+            if (!native_keys.count(*it))
             {
-                printf("Encountered AFINFO_EVENT\n");
-
-                #ifdef ANALYSIS_MODE
-                    // Volatility Plugin linux_check_afinfo
-                    res = system("python scripts/check_afinfo.py");
-                #endif
-                break;
-            } 
-            case INTERRUPTED_EVENT:
+                python_only++;
+                printf("%s volatility only: %s\n", checks[i], it->c_str());
+            }
+        }
+
+        agreed = agreed && native_only == 0 && python_only == 0;
+        printf("%s: native %.3f ms, volatility %.3f ms (%.1fx), findings both %lu, native only %lu, volatility only %lu\n",
+            checks[i], native_result.seconds * 1e3, python_result.seconds * 1e3,
+            native_result.seconds > 0 ? python_result.seconds / native_result.seconds : 0.0,
+            both, native_only, python_only);
+    }
+
+    analysis_engine.stop();
+    return agreed;
+}
+
+// Analysis and ReRegister are MODE_ANALYSIS and MODE_RE_REGISTER, folded away in each instantiation
+template <bool Analysis, bool ReRegister>
+void analyse_events(guest_context &guest, const coalesced_event &event)
+{
+    printf("Encountered %s on %s (%lu raw events, %lu objects, %.3f ms span)\n", event_type_name(event.type),
+        guest.name.c_str(), event.raw_events, (unsigned long) event.objects.size(), (event.last_seen - event.first_seen) / 1e6);
+    uint64_t analysis_start = latency_now_ns();
+
+    // Requested even when the checks are skipped below: the walk finds objects created or freed since,
+    // which no hash or shadow covers (done by the event loop)
+    if (ReRegister)
+        guest.pending_reregister.fetch_or(event.type & (PROCESS_EVENT | OPEN_FILES_EVENT | MODULE_EVENT));
+
+    // Before anything can skip the analysis: list writes keep the graph current either way
+    if (detector_modes & MODE_LIST_GRAPH)
+        update_list_graph(guest, event);
+
+    // Prints the changed members; writes that only changed unwatched members (or nothing) need no check
+    if ((detector_modes & MODE_SHADOW_DIFF) && only_benign_changes(guest, event))
+    {
+        printf("Skipping analysis of %s on %s, no watched member changed\n", event_type_name(event.type), guest.name.c_str());
+        guest.benign_skipped++;
+
+        // Keeps the hashes current with the changes the diff accepted
+        if (detector_modes & MODE_INTEGRITY)
+            objects_unchanged(guest, event);
+        return;
+    }
+
+    // The writes left every relevant byte as it was (e.g. rewritten with the same value, or reverted)
+    if ((detector_modes & MODE_INTEGRITY) && objects_unchanged(guest, event))
+    {
+        printf("Skipping analysis of %s on %s, watched objects unchanged\n", event_type_name(event.type), guest.name.c_str());
+        guest.integrity_skipped++;
+        return;
+    }
+
+    switch (event.type)
+    {
+        case PROCESS_EVENT:{
+            if (Analysis)
             {
-                printf("Encountered INTERRUPTED_EVENT\n");
-                printf("Security Checking Thread Ended!\n"); 
-                // Py_Finalize();
-                return NULL;
+                // linux_check_fop (native with MODE_NATIVE_CHECKS)
+                run_check(guest, "check_fop");
+                // linux_check_creds (native with MODE_NATIVE_CHECKS)
+                run_check(guest, "check_creds");
             }
-            default:
+            break;
+        } 
+        case OPEN_FILES_EVENT:{
+            if (Analysis)
             {
-                printf("Unknown event encountered\n");
-                printf("Security Checking Thread Ended!\n"); 
-                // Py_Finalize();
-                return NULL;
+                // linux_check_afinfo (native with MODE_NATIVE_CHECKS)
+                run_check(guest, "check_afinfo");
             }
+            break;
         }
+        case MODULE_EVENT:{
+            if (Analysis)
+            {
+                // Volatility Plugin linux_check_modules
+                run_check(guest, "check_hidden_modules");
+            }
+            break;
+        } 
+        case AFINFO_EVENT:
+        {
+            if (Analysis)
+            {
+                // linux_check_afinfo (native with MODE_NATIVE_CHECKS)
+                run_check(guest, "check_afinfo");
+            }
+            break;
+        } 
     }
-    
-    printf("Security Checking Thread Ended!\n");
-    // Py_Finalize();
+
+    guest.analysis_latency.record(__builtin_ctz(event.type), latency_now_ns() - analysis_start);
+}
+
+analysis_fn select_analyse_events(uint32_t modes)
+{
+    if (modes & MODE_ANALYSIS)
+        return (modes & MODE_RE_REGISTER) ? analyse_events<true, true> : analyse_events<true, false>;
+    return (modes & MODE_RE_REGISTER) ? analyse_events<false, true> : analyse_events<false, false>;
+}
+
+void *security_checking_thread(void *arg)
+{
+    guest_context &guest = *(guest_context *) arg;
+    printf("Security Checking Thread Initated for %s: %p\n", guest.name.c_str(), guest.vmi);
+
+    // Checks run on the shared workers as this guest's jobs
+    dispatch_events(guest.event_ring, guest.event_coalescer, analysis_workers, interrupted, false, guest.index);
+
+    printf("Security Checking Thread of %s Ended!\n", guest.name.c_str());
     return NULL;
-}
\ No newline at end of file
+}
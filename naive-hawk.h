@@ -2,37 +2,78 @@
 #define NAIVE_HAWK
 
 /////////////////////
-// Structs
+// Functions
 /////////////////////
 
-struct event_data 
-{
-    // Event type
-    unsigned long type;
-
-    // Physical address of event to monitor
-    unsigned long physical_addr;
+struct guest_context;
+struct kernel_profile;
 
-    // Size of monitoring page
-    int monitor_size;
-};
+bool add_guests(const char *vm_list, const char *default_dwarf_fp);
+const kernel_profile *load_kernel_profile(const std::string &dwarf_fp);
+void delete_guests();
+bool init_guest_vmi(guest_context &guest);
+void *guest_event_loop(void *arg);
+void cleanup(guest_context &guest);
+void print_guest_statistics(guest_context &guest);
+void print_guest_summary();
+void print_analysis_queue_settings();
+void print_analysis_queue_statistics();
 
-///////////////////// 
-// Functions
-/////////////////////
+template <bool Monitoring, bool Timed, bool Traced, typename Response>
+event_response_t mem_write_cb(vmi_instance_t vmi, vmi_event_t *event);
+event_callback_t select_mem_write_cb(uint32_t modes, response_kind response, bool traced);
+void write_filtered(guest_context &guest, page_watch<vmi_event_t> *page, vmi_event_t *event, uint64_t timestamp, uint32_t hit_types);
+void write_traced(guest_context &guest, page_watch<vmi_event_t> *page, vmi_event_t *event, uint64_t timestamp, uint32_t hit_types);
+void write_timed(guest_context &guest, uint32_t hit_types, uint64_t ns);
 
-void cleanup(vmi_instance_t vmi);
+bool watch_object(guest_context &guest, addr_t physical_addr, int size, uint32_t type);
+void unwatch_object(guest_context &guest, addr_t physical_addr, int size, uint32_t type);
+bool watch_changed_object(guest_context &guest, addr_t physical_addr, int size, uint32_t type);
+void finish_watch_pass(guest_context &guest, uint32_t type, const char *name);
+void build_watch_fields(const DwarfIndex &dwarf, const char *struct_name, const char **members, size_t count, watch_fields &out);
+const watch_fields *object_watch_fields(const guest_context &guest, uint32_t type);
+void trace_watch_fields(guest_context &guest, uint32_t type, const watch_fields &fields);
+void invalidate_translations(guest_context &guest, const page_watch<vmi_event_t> *page, uint64_t offset);
+void sync_translation_watches(guest_context &guest);
+void adapt_watches(guest_context &guest);
+bool read_watched_page(guest_context &guest, const page_watch<vmi_event_t> *page, uint64_t *contents);
+void poll_watched_page(guest_context &guest, page_watch<vmi_event_t> *page, uint64_t now);
+bool read_guest_pa(guest_context &guest, uint64_t physical_addr, void *buffer, size_t size);
+void record_integrity(guest_context &guest, addr_t physical_addr, int size, uint32_t type);
+bool objects_unchanged(guest_context &guest, const coalesced_event &event);
+void sweep_integrity(guest_context &guest);
+const shadow_layout *object_shadow_layout(const guest_context &guest, uint32_t type);
+void capture_shadow(guest_context &guest, addr_t physical_addr, int size, uint32_t type);
+std::string describe_shadow_object(guest_context &guest, uint32_t type, uint64_t object);
+bool only_benign_changes(guest_context &guest, const coalesced_event &event);
+ListGraph *object_list_graph(guest_context &guest, uint32_t type, int *list_offset);
+void print_list_anomalies(guest_context &guest, uint32_t type, const std::vector<list_anomaly> &anomalies);
+bool reconcile_list_graph(guest_context &guest, uint32_t type);
+void reconcile_list_graphs(guest_context &guest);
+void update_list_graph(guest_context &guest, const coalesced_event &event);
+void print_list_graph_statistics(guest_context &guest, const char *name, ListGraph &graph);
 
-event_response_t mem_write_cb(vmi_instance_t vmi, vmi_event_t *event);
+void collect_heat_map(guest_context &guest);
+void write_metrics();
+void *metrics_thread(void *arg);
 
-void free_event_data(vmi_event_t *event, status_t rc);
 void print_event(vmi_event_t *event);
+void print_callback_latency(guest_context &guest);
 
-bool register_processes_events(vmi_instance_t vmi, string dwarf_fp);
-bool register_open_files_events(vmi_instance_t vmi, string dwarf_fp);
-bool register_modules_events(vmi_instance_t vmi, string dwarf_fp);
-bool register_afinfo_events(vmi_instance_t vmi, string dwarf_fp);
+bool defer_to_event_loop(guest_context &guest, uint32_t type);
+bool register_processes_events(guest_context &guest);
+bool register_open_files_events(guest_context &guest);
+bool register_modules_events(guest_context &guest);
+bool register_afinfo_events(guest_context &guest);
 
+void print_analysis_result(const analysis_result &result);
+std::string volatility_only_checks(uint32_t types);
+void run_check(guest_context &guest, const char *check);
+bool compare_checks(guest_context &guest);
+typedef void (*analysis_fn)(guest_context &guest, const coalesced_event &event);
+template <bool Analysis, bool ReRegister>
+void analyse_events(guest_context &guest, const coalesced_event &event);
+analysis_fn select_analyse_events(uint32_t modes);
 void *security_checking_thread(void *arg);
 
-#endif
\ No newline at end of file
+#endif
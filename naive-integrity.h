@@ -0,0 +1,292 @@
+#ifndef NAIVE_INTEGRITY
+#define NAIVE_INTEGRITY
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "naive-watch.h"
+
+/////////////////////
+// CRC32C
+/////////////////////
+
+// Bitwise-table CRC32C (Castagnoli), for CPUs without SSE4.2
+struct crc32c_table
+{
+  crc32c_table()
+  {
+    for (uint32_t i = 0; i < 256; i++)
+    {
+      uint32_t value = i;
+      for (int bit = 0; bit < 8; bit++)
+        value = (value >> 1) ^ (0x82f63b78u & (0u - (value & 1)));
+      entries[i] = value;
+    }
+  }
+
+  uint32_t entries[256];
+};
+
+static inline uint32_t crc32c_portable(uint32_t crc, const uint8_t *data, size_t size)
+{
+  static const crc32c_table table;
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+    crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+#if defined(__x86_64__)
+// SSE4.2 crc32 instruction, 8 bytes per step; built for the target whatever the compiler flags
+__attribute__((target("sse4.2")))
+static inline uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t size)
+{
+  uint64_t value = ~crc;
+  for (; size >= 8; data += 8, size -= 8)
+  {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    value = _mm_crc32_u64(value, word);
+  }
+  uint32_t tail = (uint32_t) value;
+  for (; size > 0; data++, size--)
+    tail = _mm_crc32_u8(tail, *data);
+  return ~tail;
+}
+#endif
+
+// Whether integrity_crc32c() uses the crc32 instruction
+static inline bool crc32c_hardware()
+{
+#if defined(__x86_64__)
+  static const bool supported = __builtin_cpu_supports("sse4.2");
+  return supported;
+#else
+  return false;
+#endif
+}
+
+// CRC32C of size bytes, continuing from crc (0 to start)
+static inline uint32_t integrity_crc32c(const void *data, size_t size, uint32_t crc = 0)
+{
+#if defined(__x86_64__)
+  if (crc32c_hardware())
+    return crc32c_sse42(crc, (const uint8_t *) data, size);
+#endif
+  return crc32c_portable(crc, (const uint8_t *) data, size);
+}
+
+// Hash of the bytes of object (size bytes from its start) that fields covers, or all of them without fields
+static inline uint32_t integrity_hash(const uint8_t *object, uint32_t size, const watch_fields *fields)
+{
+  if (!fields)
+    return integrity_crc32c(object, size);
+
+  uint32_t crc = 0;
+  for (size_t i = 0; i < fields->spans.size() && fields->spans[i].first < size; i++)
+  {
+    uint32_t end = fields->spans[i].second < size ? fields->spans[i].second : size;
+    crc = integrity_crc32c(object + fields->spans[i].first, end - fields->spans[i].first, crc);
+  }
+  return crc;
+}
+
+/////////////////////
+// Integrity Baseline
+/////////////////////
+
+enum integrity_result
+{
+  INTEGRITY_UNCHANGED,    // Relevant bytes match the baseline
+  INTEGRITY_CHANGED,      // They differ
+  INTEGRITY_UNKNOWN       // No baseline for the object, or it could not be read
+};
+
+struct integrity_stats
+{
+  unsigned long recorded;     // Baselines taken
+  unsigned long checked;      // Objects compared against their baseline
+  unsigned long unchanged;
+  unsigned long changed;
+  unsigned long unreadable;   // Objects whose memory could not be read
+  unsigned long sweeps;
+};
+
+/**
+ * CRC32C of every watched object's security relevant bytes (its watch
+ * fields, or the whole object), taken when the object is watched. After a
+ * write the object is hashed again and compared, so a check can be
+ * skipped when nothing it reads has changed. Memory is read through a
+ * caller supplied reader, read(pa, buf, size) -> bool, one read per object
+ * spanning its first to last relevant byte. Locked, so the event loop
+ * records and the analysis workers compare concurrently; reads and hashing
+ * happen outside the lock.
+ **/
+class IntegrityBaseline
+{
+ public:
+
+  IntegrityBaseline() = default;
+  IntegrityBaseline(const IntegrityBaseline&) = delete;            // disable copying
+  IntegrityBaseline& operator=(const IntegrityBaseline&) = delete; // disable assignment
+
+  // Hashes object now and makes that its baseline; false if it could not be read
+  template <typename Reader>
+  bool record(Reader &read, uint32_t type, uint64_t object, uint32_t size, const watch_fields *fields)
+  {
+    uint32_t hash;
+    bool readable = hash_object(read, object, size, fields, &hash);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!readable)
+    {
+      stats_.unreadable++;
+      return false;
+    }
+    entry &baseline = entries_[key(type, object)];
+    baseline.size = size;
+    baseline.fields = fields;
+    baseline.hash = hash;
+    stats_.recorded++;
+    return true;
+  }
+
+  // Hashes object again and compares it with its baseline; with accept a changed hash becomes the baseline
+  template <typename Reader>
+  integrity_result check(Reader &read, uint32_t type, uint64_t object, bool accept = true)
+  {
+    entry baseline;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::unordered_map<uint64_t, entry>::const_iterator it = entries_.find(key(type, object));
+      if (it == entries_.end())
+        return INTEGRITY_UNKNOWN;
+      baseline = it->second;
+    }
+
+    uint32_t hash;
+    bool readable = hash_object(read, object, baseline.size, baseline.fields, &hash);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!readable)
+    {
+      stats_.unreadable++;
+      return INTEGRITY_UNKNOWN;
+    }
+    stats_.checked++;
+    if (hash == baseline.hash)
+    {
+      stats_.unchanged++;
+      return INTEGRITY_UNCHANGED;
+    }
+
+    // The object may have been forgotten (unwatched) meanwhile
+    std::unordered_map<uint64_t, entry>::iterator it = entries_.find(key(type, object));
+    if (accept && it != entries_.end())
+      it->second.hash = hash;
+    stats_.changed++;
+    return INTEGRITY_CHANGED;
+  }
+
+  void forget(uint32_t type, uint64_t object)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(key(type, object));
+  }
+
+  // Checks every baselined object, calling changed(type, object, size) for each that differs; returns how many did.
+  // The baselines are left as they were, for the analysis of the change to accept.
+  template <typename Reader, typename F>
+  size_t sweep(Reader &read, F changed)
+  {
+    std::vector<std::pair<uint64_t, uint32_t> > keys;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      keys.reserve(entries_.size());
+      for (std::unordered_map<uint64_t, entry>::const_iterator it = entries_.begin(); it != entries_.end(); ++it)
+        keys.push_back(std::make_pair(it->first, it->second.size));
+      stats_.sweeps++;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+      uint32_t type = 1u << (keys[i].first >> KEY_TYPE_SHIFT);
+      uint64_t object = keys[i].first & ((1ull << KEY_TYPE_SHIFT) - 1);
+      if (check(read, type, object, false) == INTEGRITY_CHANGED)
+      {
+        changed(type, object, keys[i].second);
+        count++;
+      }
+    }
+    return count;
+  }
+
+  size_t size()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  integrity_stats stats()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+ private:
+
+  // Physical addresses fit in 52 bits; the type's bit index goes above them
+  static const unsigned KEY_TYPE_SHIFT = 56;
+
+  struct entry
+  {
+    uint32_t size;
+    uint32_t hash;
+    const watch_fields *fields;
+  };
+
+  static uint64_t key(uint32_t type, uint64_t object)
+  {
+    return ((uint64_t) __builtin_ctz(type) << KEY_TYPE_SHIFT) | object;
+  }
+
+  // One read from the first to the last relevant byte, then the hash over the relevant spans
+  template <typename Reader>
+  static bool hash_object(Reader &read, uint64_t object, uint32_t size, const watch_fields *fields, uint32_t *hash)
+  {
+    uint32_t first = 0;
+    uint32_t last = size;
+    if (fields && !fields->spans.empty())
+    {
+      first = fields->spans.front().first < size ? fields->spans.front().first : size;
+      last = fields->spans.back().second < size ? fields->spans.back().second : size;
+    }
+    if (first >= last)
+    {
+      *hash = 0;
+      return true;
+    }
+
+    static thread_local std::vector<uint8_t> buffer;
+    buffer.resize(size);
+    if (!read(object + first, buffer.data() + first, last - first))
+      return false;
+    *hash = integrity_hash(buffer.data(), size, fields);
+    return true;
+  }
+
+  std::mutex mutex_;
+  std::unordered_map<uint64_t, entry> entries_;
+  integrity_stats stats_ = integrity_stats();
+};
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef NAIVE_LATENCY
+#define NAIVE_LATENCY
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Log-linear bucketing: values below 2^(LATENCY_SUB_BITS + 1) are exact, above that
+// each power of two is split into 2^LATENCY_SUB_BITS buckets (~3% relative error)
+#define LATENCY_SUB_BITS 5
+#define LATENCY_SUB_COUNT (1u << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_COUNT)
+
+static inline uint64_t latency_now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline unsigned latency_bucket(uint64_t value)
+{
+  if (value < 2 * LATENCY_SUB_COUNT)
+    return (unsigned) value;
+
+  unsigned msb = 63 - __builtin_clzll(value);
+  unsigned shift = msb - LATENCY_SUB_BITS;
+  return shift * LATENCY_SUB_COUNT + (unsigned) (value >> shift);
+}
+
+// Highest value that falls in bucket
+static inline uint64_t latency_bucket_value(unsigned bucket)
+{
+  if (bucket < 2 * LATENCY_SUB_COUNT)
+    return bucket;
+
+  unsigned shift = bucket / LATENCY_SUB_COUNT - 1;
+  uint64_t base = (uint64_t) (bucket - shift * LATENCY_SUB_COUNT) << shift;
+  return base + ((1ull << shift) - 1);
+}
+
+/////////////////////
+// Snapshot
+/////////////////////
+struct latency_snapshot
+{
+  uint64_t counts[LATENCY_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+
+  void reset()
+  {
+    memset(this, 0, sizeof(*this));
+  }
+
+  // Upper bound of the bucket holding quantile q (0..1)
+  uint64_t percentile(double q) const
+  {
+    if (count == 0)
+      return 0;
+
+    uint64_t rank = (uint64_t) (q * count + 0.5);
+    if (rank == 0)
+      rank = 1;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < LATENCY_BUCKETS; i++)
+    {
+      seen += counts[i];
+      if (seen >= rank)
+        return latency_bucket_value(i) < max ? latency_bucket_value(i) : max;
+    }
+    return max;
+  }
+
+  void print(const char *name) const
+  {
+    if (count == 0)
+      return;
+
+    printf("%s: count=%" PRIu64 " mean=%.0f p50=%" PRIu64 " p90=%" PRIu64 " p99=%" PRIu64 " p99.9=%" PRIu64 " max=%" PRIu64 " ns\n",
+      name, count, (double) sum / count, percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), max);
+  }
+};
+
+/////////////////////
+// Histogram
+/////////////////////
+
+/**
+ * Fixed-size latency histogram with a single writer. Counters are updated
+ * with relaxed load/store pairs (no locked instructions) so any thread can
+ * read a slightly stale but consistent-enough view while it is written.
+ **/
+class LatencyHistogram
+{
+ public:
+
+  LatencyHistogram()
+  {
+    for (unsigned i = 0; i < LATENCY_BUCKETS; i++)
+      counts_[i].store(0, std::memory_order_relaxed);
+  }
+
+  LatencyHistogram(const LatencyHistogram&) = delete;            // disable copying
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete; // disable assignment
+
+  void record(uint64_t value)
+  {
+    bump(counts_[latency_bucket(value)], 1);
+    bump(count_, 1);
+    bump(sum_, value);
+    if (value > max_.load(std::memory_order_relaxed))
+      max_.store(value, std::memory_order_relaxed);
+  }
+
+  void merge_into(latency_snapshot &out) const
+  {
+    for (unsigned i = 0; i < LATENCY_BUCKETS; i++)
+      out.counts[i] += counts_[i].load(std::memory_order_relaxed);
+    out.count += count_.load(std::memory_order_relaxed);
+    out.sum += sum_.load(std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    if (max > out.max)
+      out.max = max;
+  }
+
+ private:
+
+  static void bump(std::atomic<uint64_t> &counter, uint64_t amount)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> counts_[LATENCY_BUCKETS];
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+/////////////////////
+// Per-Thread Shards
+/////////////////////
+
+/**
+ * One Shard per recording thread, created on the thread's first use and
+ * kept until the owner is destroyed. Each instance takes an id that is
+ * never reused, and a thread caches its shards in a small direct-mapped
+ * table keyed on that id: a thread alternating between a few owners (a
+ * worker analysing several guests) hits the cache for each of them, and an
+ * owner reallocated at a freed owner's address can never match the stale
+ * entries, which are simply overwritten.
+ **/
+#define THREAD_SHARD_CACHE 8
+
+template <typename Shard>
+class ThreadShards
+{
+ public:
+
+  ThreadShards() : id_(next_id()) {}
+  ThreadShards(const ThreadShards&) = delete;            // disable copying
+  ThreadShards& operator=(const ThreadShards&) = delete; // disable assignment
+
+  ~ThreadShards()
+  {
+    for (size_t i = 0; i < shards_.size(); i++)
+      delete shards_[i];
+  }
+
+  Shard *local()
+  {
+    static thread_local cache_entry cache[THREAD_SHARD_CACHE];
+    cache_entry &entry = cache[id_ % THREAD_SHARD_CACHE];
+    if (entry.owner == id_)
+      return entry.shard;
+
+    pthread_t self = pthread_self();
+    Shard *result = NULL;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t i = 0; i < shards_.size() && !result; i++)
+      {
+        if (pthread_equal(threads_[i], self))
+          result = shards_[i];
+      }
+
+      if (!result)
+      {
+        result = new Shard();
+        shards_.push_back(result);
+        threads_.push_back(self);
+      }
+    }
+    entry.owner = id_;
+    entry.shard = result;
+    return result;
+  }
+
+  // Calls visit(shard) for every thread's shard, under the lock
+  template <typename Visitor>
+  void for_each(Visitor visit)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < shards_.size(); i++)
+      visit(*shards_[i]);
+  }
+
+ private:
+
+  struct cache_entry
+  {
+    uint64_t owner;   // 0 never matches: ids start at 1
+    Shard *shard;
+  };
+
+  static uint64_t next_id()
+  {
+    static std::atomic<uint64_t> ids{0};
+    return ids.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  const uint64_t id_;
+  std::mutex mutex_;
+  std::vector<Shard *> shards_;
+  std::vector<pthread_t> threads_;
+};
+
+/////////////////////
+// Per-Thread Recorder
+/////////////////////
+
+/**
+ * SLOTS histograms (e.g. one per event type) per recording thread. Each
+ * thread lazily gets its own shard, so recording never contends; shards
+ * outlive their threads and are summed on demand by snapshot().
+ **/
+template <unsigned SLOTS>
+class LatencyRecorder
+{
+ public:
+
+  LatencyRecorder() = default;
+  LatencyRecorder(const LatencyRecorder&) = delete;            // disable copying
+  LatencyRecorder& operator=(const LatencyRecorder&) = delete; // disable assignment
+
+  void record(unsigned slot, uint64_t value)
+  {
+    if (slot < SLOTS)
+      shards_.local()->slots[slot].record(value);
+  }
+
+  void snapshot(unsigned slot, latency_snapshot &out)
+  {
+    out.reset();
+    if (slot >= SLOTS)
+      return;
+
+    shards_.for_each([&out, slot](shard &each) { each.slots[slot].merge_into(out); });
+  }
+
+ private:
+
+  struct shard
+  {
+    LatencyHistogram slots[SLOTS];
+  };
+
+  ThreadShards<shard> shards_;
+};
+
+#endif
@@ -0,0 +1,431 @@
+#ifndef NAIVE_LISTGRAPH
+#define NAIVE_LISTGRAPH
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// list_del() and list_del_rcu() leave these in an unlinked entry (x86_64, no CONFIG_ILLEGAL_POINTER_VALUE offset)
+#define LIST_POISON_NEXT 0xdead000000000100ull
+#define LIST_POISON_PREV 0xdead000000000200ull
+
+// Nodes a batch may discover by reading the guest (entries inserted next to a watched one)
+#define LIST_MAX_DISCOVERED 64
+
+/////////////////////
+// List Nodes
+/////////////////////
+
+// A list_head: next and prev as read from the guest, and the physical address of its containing object
+struct list_node
+{
+  uint64_t next;
+  uint64_t prev;
+  uint64_t object;
+};
+
+// A node found by a full walk, keyed by the list_head's kernel virtual address
+struct list_walk_node
+{
+  uint64_t va;
+  list_node links;
+};
+
+enum list_anomaly_kind
+{
+  LIST_ASYMMETRIC,        // a->next is b but b->prev is not a (or the other way round)
+  LIST_SELF_LOOP,         // A node that is not the head points at itself
+  LIST_SHARED_NEXT,       // Two nodes have the same next: a cycle or a branch that skips the head
+  LIST_UNLINKED_INTACT,   // No node points at it any more, but its own links were not poisoned by list_del
+  LIST_WALK_CYCLE,        // A full walk visited a node twice before returning to the head
+  LIST_ANOMALY_KINDS
+};
+
+static inline const char *list_anomaly_name(list_anomaly_kind kind)
+{
+  switch (kind)
+  {
+    case LIST_ASYMMETRIC: return "asymmetric links";
+    case LIST_SELF_LOOP: return "self loop";
+    case LIST_SHARED_NEXT: return "shared next (cycle or branch)";
+    case LIST_UNLINKED_INTACT: return "unlinked without list_del";
+    case LIST_WALK_CYCLE: return "cycle on full walk";
+    default: return "unknown";
+  }
+}
+
+struct list_anomaly
+{
+  list_anomaly_kind kind;
+  uint64_t node;      // list_head virtual address
+  uint64_t object;    // Physical address of its object, 0 if unknown
+  uint64_t other;     // The node it disagrees with, if any
+};
+
+// Difference between the graph and a full walk of the list
+struct list_drift
+{
+  size_t walked;
+  size_t missing;     // Walked nodes the graph did not have
+  size_t extra;       // Linked graph nodes the walk did not find
+  size_t mismatched;  // Nodes in both whose next or prev differ
+};
+
+struct list_graph_stats
+{
+  unsigned long updates;        // Link writes applied
+  unsigned long discovered;     // Nodes read from the guest because a link pointed at them
+  unsigned long refreshed;      // Nodes reread to confirm a suspected anomaly
+  unsigned long removed;        // Nodes properly unlinked (poisoned), dropped from the graph
+  unsigned long anomalies[LIST_ANOMALY_KINDS];
+  unsigned long reconciles;
+  unsigned long drift_missing;
+  unsigned long drift_extra;
+  unsigned long drift_mismatched;
+  size_t nodes;
+};
+
+/////////////////////
+// List Graph
+/////////////////////
+
+/**
+ * Shadow of one circular kernel list (the init_task tasks list, the
+ * modules list), node virtual address -> next, prev. Writes to the
+ * watched list_heads update it in O(1) each; end_batch() then checks only
+ * the nodes the batch touched: symmetry with their neighbours, self loops,
+ * nodes pointed at by two others and nodes no longer pointed at by any.
+ * Nodes the watches do not cover (the modules head, entries inserted since
+ * the last registration) may be stale, so a suspected anomaly is confirmed
+ * by rereading the nodes involved through a caller supplied reader,
+ * read(va, list_node *) -> bool, before it is reported. reconcile()
+ * replaces the graph with a full walk and reports how far it had drifted.
+ * Locked, the event loop reconciles while an analysis worker updates.
+ **/
+class ListGraph
+{
+ public:
+
+  ListGraph() = default;
+  ListGraph(const ListGraph&) = delete;            // disable copying
+  ListGraph& operator=(const ListGraph&) = delete; // disable assignment
+
+  // Replaces the graph with the nodes of a full walk from head; returns the drift from the graph it replaces
+  list_drift reconcile(uint64_t head, const std::vector<list_walk_node> &walked, std::vector<list_anomaly> &found)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    list_drift drift = list_drift();
+    drift.walked = walked.size();
+
+    std::unordered_map<uint64_t, list_node> fresh;
+    fresh.reserve(walked.size());
+    for (size_t i = 0; i < walked.size(); i++)
+    {
+      if (!fresh.insert(std::make_pair(walked[i].va, walked[i].links)).second)
+      {
+        report(found, LIST_WALK_CYCLE, walked[i].va, walked[i].links.object, 0);
+        continue;
+      }
+      std::unordered_map<uint64_t, entry>::const_iterator it = nodes_.find(walked[i].va);
+      if (it == nodes_.end() || it->second.unlinked)
+        drift.missing++;
+      else if (it->second.links.next != walked[i].links.next || it->second.links.prev != walked[i].links.prev)
+        drift.mismatched++;
+    }
+    for (std::unordered_map<uint64_t, entry>::const_iterator it = nodes_.begin(); it != nodes_.end(); ++it)
+    {
+      if (!it->second.unlinked && fresh.find(it->first) == fresh.end())
+        drift.extra++;
+    }
+
+    // The first reconcile builds the graph, there is nothing to drift from
+    if (head_ != 0)
+    {
+      stats_.drift_missing += drift.missing;
+      stats_.drift_extra += drift.extra;
+      stats_.drift_mismatched += drift.mismatched;
+    }
+    stats_.reconciles++;
+
+    head_ = head;
+    nodes_.clear();
+    by_object_.clear();
+    referrers_.clear();
+    for (std::unordered_map<uint64_t, list_node>::const_iterator it = fresh.begin(); it != fresh.end(); ++it)
+      add(it->first, it->second);
+    touched_.clear();
+    unreferenced_.clear();
+    return drift;
+  }
+
+  // list_head address of the linked node inside object (physical address), 0 if there is none
+  uint64_t node_of(uint64_t object)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<uint64_t, uint64_t>::const_iterator it = by_object_.find(object);
+    return it == by_object_.end() ? 0 : it->second;
+  }
+
+  // The node's list_head now reads next, prev; checked at the next end_batch()
+  void update(uint64_t va, uint64_t next, uint64_t prev)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<uint64_t, entry>::iterator it = nodes_.find(va);
+    if (it == nodes_.end() || head_ == 0)
+      return;
+    set_links(va, it->second, next, prev);
+    stats_.updates++;
+  }
+
+  // Checks the nodes the updates since the last batch touched, appending confirmed anomalies to found
+  template <typename Reader>
+  void end_batch(Reader &read, std::vector<list_anomaly> &found)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t discovered = 0;
+
+    // Touched nodes first (rereads touch more, each is checked once), then nodes that lost their last referrer
+    std::unordered_set<uint64_t> checked;
+    for (size_t i = 0; i < touched_.size(); i++)
+    {
+      std::unordered_map<uint64_t, entry>::iterator it = nodes_.find(touched_[i]);
+      if (it == nodes_.end() || it->second.unlinked || !checked.insert(touched_[i]).second)
+        continue;
+      check_node(read, touched_[i], discovered, checked, found);
+    }
+    while (!unreferenced_.empty())
+    {
+      std::vector<uint64_t> pending(unreferenced_.begin(), unreferenced_.end());
+      unreferenced_.clear();
+      for (size_t i = 0; i < pending.size(); i++)
+        check_unreferenced(read, pending[i], found);
+    }
+
+    touched_.clear();
+  }
+
+  list_graph_stats stats()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    list_graph_stats copy = stats_;
+    copy.nodes = nodes_.size();
+    return copy;
+  }
+
+ private:
+
+  struct entry
+  {
+    list_node links;
+    bool unlinked;      // Reported as unlinked without list_del; kept for reference but no longer checked
+  };
+
+  void add(uint64_t va, const list_node &links)
+  {
+    entry &node = nodes_[va];
+    node.links.next = 0;
+    node.links.prev = 0;
+    node.links.object = links.object;
+    node.unlinked = false;
+    if (links.object != 0)
+      by_object_[links.object] = va;
+    set_links(va, node, links.next, links.prev);
+  }
+
+  void set_links(uint64_t va, entry &node, uint64_t next, uint64_t prev)
+  {
+    if (node.links.next != next)
+    {
+      if (node.links.next != 0 && release(node.links.next))
+        unreferenced_.insert(node.links.next);
+      if (next != 0)
+        referrers_[next]++;
+    }
+    node.links.next = next;
+    node.links.prev = prev;
+    touched_.push_back(va);
+  }
+
+  // Drops a reference to target; true if nothing points at it any more
+  bool release(uint64_t target)
+  {
+    std::unordered_map<uint64_t, uint32_t>::iterator it = referrers_.find(target);
+    if (it == referrers_.end())
+      return false;
+    if (--it->second != 0)
+      return false;
+    referrers_.erase(it);
+    return true;
+  }
+
+  uint32_t referrer_count(uint64_t target) const
+  {
+    std::unordered_map<uint64_t, uint32_t>::const_iterator it = referrers_.find(target);
+    return it == referrers_.end() ? 0 : it->second;
+  }
+
+  // Rereads a node from the guest; a node not yet in the graph is added
+  template <typename Reader>
+  bool refresh(Reader &read, uint64_t va)
+  {
+    list_node links;
+    if (!read(va, &links))
+      return false;
+    std::unordered_map<uint64_t, entry>::iterator it = nodes_.find(va);
+    if (it == nodes_.end())
+    {
+      add(va, links);
+      stats_.discovered++;
+      return true;
+    }
+    if (links.object == 0)
+      links.object = it->second.links.object;
+    set_links(va, it->second, links.next, links.prev);
+    stats_.refreshed++;
+    return true;
+  }
+
+  template <typename Reader>
+  void check_node(Reader &read, uint64_t va, size_t &discovered, std::unordered_set<uint64_t> &checked,
+    std::vector<list_anomaly> &found)
+  {
+    // Neighbours this node points at that the graph has never seen were inserted next to it
+    const uint64_t neighbours[2] = { nodes_[va].links.next, nodes_[va].links.prev };
+    for (int i = 0; i < 2; i++)
+    {
+      if (poisoned(neighbours[i]) || neighbours[i] == 0 || nodes_.find(neighbours[i]) != nodes_.end())
+        continue;
+      if (discovered < LIST_MAX_DISCOVERED && refresh(read, neighbours[i]))
+        discovered++;
+    }
+
+    if (suspicious(va))
+    {
+      // Confirm against the guest: this node and the neighbours it disagrees with
+      const list_node links = nodes_[va].links;
+      refresh(read, va);
+      if (nodes_.find(links.next) != nodes_.end())
+        refresh(read, links.next);
+      if (nodes_.find(links.prev) != nodes_.end())
+        refresh(read, links.prev);
+      if (referrer_count(nodes_[va].links.next) > 1)
+        refresh_referrers(read, nodes_[va].links.next);
+    }
+    if (!suspicious(va))
+      return;
+
+    // The node it disagrees with is not reported again from the other side
+    const list_node &links = nodes_[va].links;
+    if (links.next == va && va != head_)
+      report(found, LIST_SELF_LOOP, va, links.object, va);
+    else if (referrer_count(links.next) > 1)
+      report(found, LIST_SHARED_NEXT, va, links.object, links.next);
+    else
+    {
+      uint64_t other = asymmetric_neighbour(va);
+      checked.insert(other);
+      report(found, LIST_ASYMMETRIC, va, links.object, other);
+    }
+  }
+
+  // Whether a node's links disagree with its neighbours (for a node in the graph and still linked)
+  bool suspicious(uint64_t va) const
+  {
+    const entry &node = nodes_.find(va)->second;
+    if (node.unlinked || poisoned(node.links.next) || poisoned(node.links.prev))
+      return false;
+    if (node.links.next == va && va != head_)
+      return true;
+    if (referrer_count(node.links.next) > 1)
+      return true;
+    return asymmetric_neighbour(va) != 0;
+  }
+
+  // The neighbour whose link back does not match, 0 if both do (or are unknown)
+  uint64_t asymmetric_neighbour(uint64_t va) const
+  {
+    const entry &node = nodes_.find(va)->second;
+    std::unordered_map<uint64_t, entry>::const_iterator next = nodes_.find(node.links.next);
+    if (next != nodes_.end() && !next->second.unlinked && next->second.links.prev != va)
+      return node.links.next;
+    std::unordered_map<uint64_t, entry>::const_iterator prev = nodes_.find(node.links.prev);
+    if (prev != nodes_.end() && !prev->second.unlinked && prev->second.links.next != va)
+      return node.links.prev;
+    return 0;
+  }
+
+  // Rereads every node claiming target as next (rare: only when two do)
+  template <typename Reader>
+  void refresh_referrers(Reader &read, uint64_t target)
+  {
+    std::vector<uint64_t> claimants;
+    for (std::unordered_map<uint64_t, entry>::const_iterator it = nodes_.begin(); it != nodes_.end(); ++it)
+    {
+      if (it->second.links.next == target)
+        claimants.push_back(it->first);
+    }
+    for (size_t i = 0; i < claimants.size(); i++)
+      refresh(read, claimants[i]);
+  }
+
+  // Nothing points at va any more: properly unlinked (poisoned) and dropped, or hidden
+  template <typename Reader>
+  void check_unreferenced(Reader &read, uint64_t va, std::vector<list_anomaly> &found)
+  {
+    std::unordered_map<uint64_t, entry>::iterator it = nodes_.find(va);
+    if (it == nodes_.end() || it->second.unlinked || va == head_ || referrer_count(va) != 0)
+      return;
+
+    // Its predecessor may be a node the watches do not cover
+    uint64_t prev = it->second.links.prev;
+    refresh(read, va);
+    if (nodes_.find(prev) != nodes_.end())
+      refresh(read, prev);
+    it = nodes_.find(va);
+    if (it == nodes_.end() || referrer_count(va) != 0)
+      return;
+
+    if (poisoned(it->second.links.next) || poisoned(it->second.links.prev))
+    {
+      stats_.removed++;
+      if (release(it->second.links.next))
+        unreferenced_.erase(it->second.links.next);
+      by_object_.erase(it->second.links.object);
+      nodes_.erase(it);
+      return;
+    }
+    it->second.unlinked = true;
+    report(found, LIST_UNLINKED_INTACT, va, it->second.links.object, it->second.links.prev);
+  }
+
+  static bool poisoned(uint64_t link)
+  {
+    return link == LIST_POISON_NEXT || link == LIST_POISON_PREV;
+  }
+
+  void report(std::vector<list_anomaly> &found, list_anomaly_kind kind, uint64_t va, uint64_t object, uint64_t other)
+  {
+    list_anomaly anomaly;
+    anomaly.kind = kind;
+    anomaly.node = va;
+    anomaly.object = object;
+    anomaly.other = other;
+    found.push_back(anomaly);
+    stats_.anomalies[kind]++;
+  }
+
+  std::mutex mutex_;
+  uint64_t head_ = 0;
+  std::unordered_map<uint64_t, entry> nodes_;
+  std::unordered_map<uint64_t, uint64_t> by_object_;    // Object physical address -> list_head address
+  std::unordered_map<uint64_t, uint32_t> referrers_;    // Nodes whose next is the key
+  std::vector<uint64_t> touched_;
+  std::unordered_set<uint64_t> unreferenced_;
+  list_graph_stats stats_ = list_graph_stats();
+};
+
+#endif
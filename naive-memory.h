@@ -0,0 +1,308 @@
+#ifndef NAIVE_MEMORY
+#define NAIVE_MEMORY
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#include "naive-translate.h"
+
+// Longest string read_str() returns (task comm, module name, ...)
+#define GUEST_MAX_STR 256
+
+/////////////////////
+// Guest Memory
+/////////////////////
+
+/**
+ * Kernel virtual memory of the monitored guest, as seen by the list walks
+ * and checks. Backends supply symbol lookup, kernel VA -> PA translation
+ * and raw reads; the typed helpers are built on top of read().
+ * Addresses are plain 64-bit values so this header does not need libvmi.
+ **/
+class GuestMemory
+{
+ public:
+
+  virtual ~GuestMemory() {}
+
+  // Kernel virtual address of a symbol, 0 if unknown
+  virtual uint64_t symbol(const char *name) = 0;
+
+  // Physical address of a kernel virtual address, 0 if not mapped
+  virtual uint64_t translate(uint64_t va) = 0;
+
+  // Copies up to size bytes from va, returns the number of bytes read
+  virtual size_t read(uint64_t va, void *buf, size_t size) = 0;
+
+  // Hint that size bytes at va are read next (e.g. the following list element); may do nothing
+  virtual void prefetch(uint64_t va, size_t size)
+  {
+    (void) va;
+    (void) size;
+  }
+
+  bool read_addr(uint64_t va, uint64_t *value)
+  {
+    return read(va, value, sizeof(*value)) == sizeof(*value);
+  }
+
+  bool read_32(uint64_t va, uint32_t *value)
+  {
+    return read(va, value, sizeof(*value)) == sizeof(*value);
+  }
+
+  // NUL terminated string at va (at most GUEST_MAX_STR bytes); false if unreadable
+  bool read_str(uint64_t va, std::string &out)
+  {
+    char text[GUEST_MAX_STR];
+    size_t bytes_read = 0;
+    out.clear();
+    while (bytes_read < sizeof(text))
+    {
+      // Stop at page boundaries so a string at the end of a mapping still reads
+      size_t chunk = 4096 - ((va + bytes_read) & 4095);
+      if (chunk > sizeof(text) - bytes_read)
+        chunk = sizeof(text) - bytes_read;
+      if (read(va + bytes_read, text + bytes_read, chunk) != chunk)
+        break;
+
+      const char *end = (const char *) memchr(text + bytes_read, 0, chunk);
+      if (end)
+      {
+        out.assign(text, end - text);
+        return true;
+      }
+      bytes_read += chunk;
+    }
+
+    out.assign(text, bytes_read);
+    return bytes_read > 0;
+  }
+};
+
+/////////////////////
+// Raw Dump Backend
+/////////////////////
+#define DUMP_PAGE_SHIFT 12
+#define DUMP_PAGE_SIZE (1ull << DUMP_PAGE_SHIFT)
+
+// x86-64 page table entry bits
+#define DUMP_PTE_PRESENT 0x1ull
+#define DUMP_PTE_LARGE 0x80ull
+#define DUMP_PTE_ADDR_MASK 0x000ffffffffff000ull
+
+// Kernel image mapping base (__START_KERNEL_map)
+#define DUMP_KERNEL_MAP 0xffffffff80000000ull
+
+/**
+ * Guest memory backed by a raw physical memory dump (e.g. dumped with
+ * virsh dump --memory-only --format=raw, or LiME in raw mode). The file is
+ * mmapped read-only; translation walks the kernel's 4-level page tables
+ * (with 2 MB and 1 GB pages) directly in the mapping, and reads are copies
+ * straight out of it. Symbols come from the kernel's System.map.
+ **/
+class DumpMemory : public GuestMemory
+{
+ public:
+
+  DumpMemory() = default;
+  DumpMemory(const DumpMemory&) = delete;            // disable copying
+  DumpMemory& operator=(const DumpMemory&) = delete; // disable assignment
+
+  ~DumpMemory()
+  {
+    close();
+  }
+
+  // phys_base is the kernel's physical load offset (0 unless the kernel was relocated)
+  bool open(const std::string &dump_path, const std::string &system_map_path, uint64_t phys_base = 0)
+  {
+    close();
+    if (!load_symbols(system_map_path))
+    {
+      printf("Failed to load System.map: %s\n", system_map_path.c_str());
+      return false;
+    }
+
+    int fd = ::open(dump_path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      printf("Failed to open memory dump: %s\n", dump_path.c_str());
+      return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+      ::close(fd);
+      return false;
+    }
+
+    void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+      printf("Failed to map memory dump: %s\n", dump_path.c_str());
+      return false;
+    }
+    memory_ = (const uint8_t *) map;
+    size_ = info.st_size;
+    madvise(map, size_, MADV_RANDOM);
+
+    // Kernel page tables (init_level4_pgt, renamed init_top_pgt in 4.13)
+    uint64_t pgd = symbol("init_level4_pgt");
+    if (pgd == 0)
+      pgd = symbol("init_top_pgt");
+    if (pgd == 0 || pgd < DUMP_KERNEL_MAP)
+    {
+      printf("Failed to find kernel page tables in System.map\n");
+      close();
+      return false;
+    }
+    dtb_ = pgd - DUMP_KERNEL_MAP + phys_base;
+    return true;
+  }
+
+  void close()
+  {
+    if (memory_)
+      munmap((void *) memory_, size_);
+    memory_ = NULL;
+    size_ = 0;
+    dtb_ = 0;
+    symbols_.clear();
+  }
+
+  uint64_t symbol(const char *name)
+  {
+    std::unordered_map<std::string, uint64_t>::const_iterator it = symbols_.find(name);
+    return it == symbols_.end() ? 0 : it->second;
+  }
+
+  uint64_t translate(uint64_t va)
+  {
+    return translate(va, NULL);
+  }
+
+  // As above, recording the physical address of every entry read in walk (if set)
+  uint64_t translate(uint64_t va, translation_walk *walk)
+  {
+    if (walk)
+      walk->entry_count = 0;
+
+    uint64_t table = dtb_;
+    for (int level = 3; level >= 0; level--)
+    {
+      uint64_t entry;
+      uint64_t entry_pa = table + ((va >> (DUMP_PAGE_SHIFT + 9 * level)) & 0x1ff) * 8;
+      if (walk)
+        walk->entries[walk->entry_count++] = entry_pa;
+      if (!read_pa(entry_pa, &entry, sizeof(entry)))
+        return 0;
+      if (!(entry & DUMP_PTE_PRESENT))
+        return 0;
+
+      // 1 GB (level 2) or 2 MB (level 1) page
+      if (level > 0 && level < 3 && (entry & DUMP_PTE_LARGE))
+      {
+        uint64_t page_mask = (1ull << (DUMP_PAGE_SHIFT + 9 * level)) - 1;
+        return (entry & DUMP_PTE_ADDR_MASK & ~page_mask) | (va & page_mask);
+      }
+      table = entry & DUMP_PTE_ADDR_MASK;
+    }
+    return table | (va & (DUMP_PAGE_SIZE - 1));
+  }
+
+  size_t read(uint64_t va, void *buf, size_t size)
+  {
+    size_t done = 0;
+    while (done < size)
+    {
+      const uint8_t *src = map(va + done, 1);
+      if (!src)
+        break;
+
+      size_t chunk = DUMP_PAGE_SIZE - ((va + done) & (DUMP_PAGE_SIZE - 1));
+      if (chunk > size - done)
+        chunk = size - done;
+      memcpy((uint8_t *) buf + done, src, chunk);
+      done += chunk;
+    }
+    return done;
+  }
+
+  // Translates the first page now and starts pulling its lines into the cache
+  void prefetch(uint64_t va, size_t size)
+  {
+    size_t chunk = DUMP_PAGE_SIZE - (va & (DUMP_PAGE_SIZE - 1));
+    const uint8_t *src = map(va, chunk < size ? chunk : size);
+    if (!src)
+      return;
+    for (size_t line = 0; line < chunk && line < size; line += 64)
+      __builtin_prefetch(src + line);
+  }
+
+  // Zero-copy pointer to size bytes at va, NULL if they cross a page or are not in the dump
+  const uint8_t *map(uint64_t va, size_t size)
+  {
+    if (((va & (DUMP_PAGE_SIZE - 1)) + size) > DUMP_PAGE_SIZE)
+      return NULL;
+    uint64_t pa = translate(va);
+    return pa != 0 ? map_pa(pa, size) : NULL;
+  }
+
+  const uint8_t *map_pa(uint64_t pa, size_t size) const
+  {
+    return pa < size_ && size <= size_ - pa ? memory_ + pa : NULL;
+  }
+
+  bool read_pa(uint64_t pa, void *buf, size_t size) const
+  {
+    const uint8_t *src = map_pa(pa, size);
+    if (src)
+      memcpy(buf, src, size);
+    return src != NULL;
+  }
+
+  uint64_t dtb() const { return dtb_; }
+  size_t size() const { return size_; }
+  size_t symbol_count() const { return symbols_.size(); }
+
+ private:
+
+  // "ffffffff81000000 T _stext" per line
+  bool load_symbols(const std::string &path)
+  {
+    std::ifstream in(path.c_str());
+    if (!in)
+      return false;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+      char type;
+      char name[256];
+      unsigned long long address;
+      if (sscanf(line.c_str(), "%llx %c %255s", &address, &type, name) == 3)
+        symbols_[name] = address;
+    }
+    return !symbols_.empty();
+  }
+
+  const uint8_t *memory_ = NULL;
+  size_t size_ = 0;
+  uint64_t dtb_ = 0;
+  std::unordered_map<std::string, uint64_t> symbols_;
+};
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef NAIVE_METRICS
+#define NAIVE_METRICS
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "naive-latency.h"
+
+/////////////////////
+// Sharded Counters
+/////////////////////
+
+/**
+ * COUNTERS monotonic counters, sharded per recording thread like
+ * LatencyRecorder. A thread only ever writes its own shard, with relaxed
+ * load/store pairs, so counting costs no locked instruction and no shared
+ * cache line; get() sums the shards under a lock and may be called from any
+ * thread while the writers run.
+ **/
+template <unsigned COUNTERS>
+class ShardedCounters
+{
+ public:
+
+  ShardedCounters() = default;
+  ShardedCounters(const ShardedCounters&) = delete;            // disable copying
+  ShardedCounters& operator=(const ShardedCounters&) = delete; // disable assignment
+
+  void add(unsigned counter, uint64_t amount = 1)
+  {
+    if (counter >= COUNTERS)
+      return;
+    std::atomic<uint64_t> &value = shards_.local()->counts[counter];
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+  }
+
+  uint64_t get(unsigned counter)
+  {
+    uint64_t total = 0;
+    if (counter >= COUNTERS)
+      return total;
+
+    shards_.for_each([&total, counter](shard &each) { total += each.counts[counter].load(std::memory_order_relaxed); });
+    return total;
+  }
+
+ private:
+
+  struct shard
+  {
+    shard()
+    {
+      for (unsigned i = 0; i < COUNTERS; i++)
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> counts[COUNTERS];
+    char padding[64];   // Keeps the next allocation off the last counter's cache line
+  };
+
+  ThreadShards<shard> shards_;
+};
+
+/////////////////////
+// Prometheus Text
+/////////////////////
+
+// label="value" with the value escaped as the text exposition format requires
+static inline std::string metric_label(const char *name, const std::string &value)
+{
+  std::string out = name;
+  out += "=\"";
+  for (size_t i = 0; i < value.size(); i++)
+  {
+    if (value[i] == '\\' || value[i] == '"')
+      out += '\\';
+    if (value[i] == '\n')
+      out += "\\n";
+    else
+      out += value[i];
+  }
+  out += '"';
+  return out;
+}
+
+static inline std::string metric_hex_label(const char *name, uint64_t value)
+{
+  char text[32];
+  snprintf(text, sizeof(text), "0x%" PRIx64, value);
+  return metric_label(name, text);
+}
+
+/**
+ * Builds one snapshot in the Prometheus text exposition format. Samples of
+ * a family must follow its family() line, so callers loop over families
+ * first and over guests (or other label values) inside.
+ **/
+class MetricsText
+{
+ public:
+
+  void family(const char *name, const char *type, const char *help)
+  {
+    text_ += "# HELP ";
+    text_ += name;
+    text_ += ' ';
+    text_ += help;
+    text_ += "\n# TYPE ";
+    text_ += name;
+    text_ += ' ';
+    text_ += type;
+    text_ += '\n';
+  }
+
+  void sample(const char *name, const std::string &labels, uint64_t value)
+  {
+    char number[32];
+    snprintf(number, sizeof(number), "%" PRIu64, value);
+    append(name, labels, number);
+  }
+
+  void sample(const char *name, const std::string &labels, double value)
+  {
+    char number[32];
+    snprintf(number, sizeof(number), "%.9g", value);
+    append(name, labels, number);
+  }
+
+  // Summary of nanosecond samples, exported in seconds
+  void summary(const char *name, const std::string &labels, const latency_snapshot &snapshot)
+  {
+    static const char *quantiles[] = { "0.5", "0.9", "0.99" };
+    static const double values[] = { 0.5, 0.9, 0.99 };
+    std::string prefix = labels.empty() ? labels : labels + ",";
+    for (unsigned i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+      sample(name, prefix + "quantile=\"" + quantiles[i] + "\"", snapshot.percentile(values[i]) / 1e9);
+    sample((std::string(name) + "_sum").c_str(), labels, snapshot.sum / 1e9);
+    sample((std::string(name) + "_count").c_str(), labels, snapshot.count);
+  }
+
+  const std::string &str() const { return text_; }
+
+ private:
+
+  void append(const char *name, const std::string &labels, const char *value)
+  {
+    text_ += name;
+    if (!labels.empty())
+    {
+      text_ += '{';
+      text_ += labels;
+      text_ += '}';
+    }
+    text_ += ' ';
+    text_ += value;
+    text_ += '\n';
+  }
+
+  std::string text_;
+};
+
+// Replaces path with text in one step (written beside it, then renamed), so a scraper never reads half a file
+static inline bool write_metrics_file(const std::string &path, const std::string &text)
+{
+  std::string temp = path + ".tmp";
+  FILE *file = fopen(temp.c_str(), "w");
+  if (!file)
+    return false;
+  bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temp.c_str(), path.c_str()) != 0)
+  {
+    remove(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef NAIVE_MODES
+#define NAIVE_MODES
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+/////////////////////
+// Detector Modes
+/////////////////////
+
+/**
+ * What the detector does with the writes it traps, chosen once at
+ * startup. mem_write_cb and analyse_events are templates over the first
+ * four; the instantiation matching the chosen modes is picked before any
+ * event is registered, so the per-event paths test none of them. The
+ * others are tested where a kernel profile, a watch or an analysis is set
+ * up, never per write.
+ **/
+enum detector_mode
+{
+  MODE_MONITORING = 1,      // Queue hit writes for analysis (else they are only counted)
+  MODE_ANALYSIS = 2,        // Run the checks of each analysed event type
+  MODE_RE_REGISTER = 4,     // Rewalk the analysed type's objects and update the watches
+  MODE_CALLBACK_TIME = 8,   // Record mem_write_cb latency per event type
+  MODE_NATIVE_CHECKS = 16,  // Run the checks that have a native version natively instead of in Volatility
+  MODE_FIELD_MASKS = 32,    // Only writes to watched members count for process and module events
+  MODE_INTEGRITY = 64,      // Skip analyses whose objects' relevant bytes hash as they did (naive-integrity.h)
+  MODE_SHADOW_DIFF = 128,   // Name the changed members, skip analyses that only changed unwatched ones (naive-shadow.h)
+  MODE_LIST_GRAPH = 256     // Check tasks and modules list writes against graphs of the lists (naive-listgraph.h)
+};
+
+#define DETECTOR_MODE_COUNT 9
+
+static inline const char *detector_mode_name(detector_mode mode)
+{
+  switch (mode)
+  {
+    case MODE_MONITORING: return "monitoring";
+    case MODE_ANALYSIS: return "analysis";
+    case MODE_RE_REGISTER: return "reregister";
+    case MODE_CALLBACK_TIME: return "callback-time";
+    case MODE_NATIVE_CHECKS: return "native-checks";
+    case MODE_FIELD_MASKS: return "field-masks";
+    case MODE_INTEGRITY: return "integrity";
+    case MODE_SHADOW_DIFF: return "shadow-diff";
+    case MODE_LIST_GRAPH: return "list-graph";
+    default: return "unknown";
+  }
+}
+
+// Comma separated mode names, or "none"; false on an unknown name
+static inline bool detector_modes_from_names(const char *names, uint32_t *modes)
+{
+  uint32_t result = 0;
+  if (strcmp(names, "none") != 0)
+  {
+    for (const char *name = names; ; )
+    {
+      const char *end = strchr(name, ',');
+      size_t length = end ? (size_t) (end - name) : strlen(name);
+      uint32_t mode = 0;
+      for (unsigned i = 0; i < DETECTOR_MODE_COUNT && mode == 0; i++)
+      {
+        const char *candidate = detector_mode_name((detector_mode) (1u << i));
+        if (strlen(candidate) == length && strncmp(candidate, name, length) == 0)
+          mode = 1u << i;
+      }
+      if (mode == 0)
+        return false;
+      result |= mode;
+      if (!end)
+        break;
+      name = end + 1;
+    }
+  }
+  *modes = result;
+  return true;
+}
+
+// The names of the modes set, as accepted by detector_modes_from_names
+static inline std::string detector_mode_names(uint32_t modes)
+{
+  std::string names;
+  for (unsigned i = 0; i < DETECTOR_MODE_COUNT; i++)
+  {
+    if (!(modes & (1u << i)))
+      continue;
+    if (!names.empty())
+      names += ",";
+    names += detector_mode_name((detector_mode) (1u << i));
+  }
+  return names.empty() ? "none" : names;
+}
+
+#endif
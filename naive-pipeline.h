@@ -0,0 +1,121 @@
+#ifndef NAIVE_PIPELINE
+#define NAIVE_PIPELINE
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <utility>
+
+#include "naive-coalesce.h"
+#include "naive-ring.h"
+#include "naive-watch.h"
+#include "naive-workers.h"
+
+// Events moved from the ring per wakeup of the dispatcher
+#define PIPELINE_BATCH_SIZE 64
+
+/////////////////////
+// Event Filter
+/////////////////////
+// Queues one ring event per watched range the write hit (if ring is set); returns the hit types.
+// Hits of local_types are only reported, for the caller to handle in the callback itself.
+template <typename Event>
+static inline uint32_t filter_event(SpscRing<naive_event> *ring, const page_watch<Event> *page,
+  uint32_t vcpu, uint64_t offset, uint64_t timestamp, uint32_t local_types = 0)
+{
+  // Writes to words no watched field covers are dropped on a single bit test
+  if (!watch_relevant(page, (uint32_t) offset))
+    return 0;
+
+  const watch_range *hits[WATCH_MAX_HITS];
+  size_t hit_count = watch_match(page, (uint32_t) offset, hits, WATCH_MAX_HITS);
+
+  uint32_t types = 0;
+  naive_event record;
+  record.vcpu = vcpu;
+  record.gfn = page->gfn;
+  record.offset = offset;
+  record.timestamp = timestamp;
+  for (size_t i = 0; i < hit_count; i++)
+  {
+    record.type = hits[i]->type;
+    record.object = hits[i]->object;
+    hits[i]->hits++;
+    if (ring && !(record.type & local_types))
+      ring->push(record);
+    types |= hits[i]->type;
+  }
+  return types;
+}
+
+/////////////////////
+// Dispatcher
+/////////////////////
+
+/**
+ * Analysis side of the pipeline: drains the ring into the coalescer and
+ * hands each due type to the workers, one job per type at a time. Returns
+ * when stop is set or the ring is closed and drained. With flush, batches
+ * still pending at that point are analysed (ignoring their quiet window)
+ * before returning, as a replay wants; the detector drops them on exit.
+ * Jobs are submitted as source, so several guests can share the workers.
+ * Types a full worker queue would refuse are left coalescing like busy
+ * ones; a batch refused anyway goes back into the coalescer.
+ **/
+static inline void dispatch_events(SpscRing<naive_event> &ring, EventCoalescer &coalescer,
+  WorkerPool<coalesced_event> &workers, const std::atomic<bool> &stop, bool flush, unsigned source = 0)
+{
+  naive_event batch[PIPELINE_BATCH_SIZE];
+  coalesced_event analysis;
+  while (!stop)
+  {
+    // Types with a check in flight (or no room in a full queue) keep coalescing until it finishes
+    uint32_t busy = workers.blocked_mask(source);
+
+    // Blocks until events arrive, the next coalesced analysis is due, a check finishes or the ring is closed
+    uint64_t timeout = RING_WAIT_FOREVER;
+    uint64_t deadline = coalescer.next_deadline(busy);
+    if (deadline != COALESCE_NO_DEADLINE)
+    {
+      uint64_t now = ring_timestamp_ns();
+      timeout = deadline > now ? deadline - now : 0;
+    }
+
+    size_t count = ring.wait_pop_batch(batch, PIPELINE_BATCH_SIZE, timeout);
+    if (count == 0 && ring.closed() && ring.size() == 0)
+      break;
+
+    for (size_t i = 0; i < count; i++)
+    {
+      if (!coalescer.add(batch[i]))
+        printf("Unknown event encountered: %u\n", batch[i].type);
+    }
+
+    // Hand each due, idle type to the workers; events arriving meanwhile form its follow-up batch
+    uint64_t now = ring_timestamp_ns();
+    busy = workers.blocked_mask(source);
+    for (uint32_t due = coalescer.due(now, busy); due != 0 && !stop; due &= due - 1)
+    {
+      uint32_t type = due & -due;
+      if (coalescer.take(type, now, analysis) && !workers.submit(type, std::move(analysis), source))
+        coalescer.restore(analysis);
+    }
+  }
+
+  if (!flush || stop)
+    return;
+
+  // Analyse what is left once the running checks are done
+  workers.wait_idle(source);
+  uint64_t now = ring_timestamp_ns();
+  for (uint32_t pending = coalescer.dirty_mask(); pending != 0; pending &= pending - 1)
+  {
+    uint32_t type = pending & -pending;
+    if (coalescer.take(type, now, analysis) && !workers.submit(type, std::move(analysis), source))
+      coalescer.restore(analysis);
+  }
+  workers.wait_idle(source);
+}
+
+#endif
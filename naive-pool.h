@@ -0,0 +1,279 @@
+#ifndef NAIVE_POOL
+#define NAIVE_POOL
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <algorithm>
+#include <vector>
+
+// Handles pack a slot index with the slot's generation; a stale handle fails lookup
+typedef uint64_t pool_handle;
+#define POOL_NO_HANDLE 0
+#define POOL_NO_INDEX UINT32_MAX
+
+// Marks an empty GfnIndex bucket (never a valid frame number)
+#define GFN_INDEX_EMPTY UINT64_MAX
+
+static inline pool_handle pool_make_handle(uint32_t index, uint32_t generation)
+{
+  return ((uint64_t) generation << 32) | index;
+}
+
+static inline uint32_t pool_handle_index(pool_handle handle) { return (uint32_t) handle; }
+static inline uint32_t pool_handle_generation(pool_handle handle) { return (uint32_t) (handle >> 32); }
+
+/////////////////////
+// Slab Pool
+/////////////////////
+
+/**
+ * Fixed-slot object pool carved out of SLAB_SIZE-entry slabs. Slots never
+ * move, so pointers stay valid while an entry is live. Freed slots keep
+ * their constructed T (and any capacity it owns) for reuse, and bump their
+ * generation so outstanding handles to them stop resolving.
+ **/
+template <typename T, size_t SLAB_SIZE = 256>
+class SlabPool
+{
+ public:
+
+  SlabPool() = default;
+  SlabPool(const SlabPool&) = delete;            // disable copying
+  SlabPool& operator=(const SlabPool&) = delete; // disable assignment
+
+  ~SlabPool()
+  {
+    for (size_t i = 0; i < slabs_.size(); i++)
+      delete[] slabs_[i];
+  }
+
+  T *alloc(pool_handle *handle)
+  {
+    if (free_head_ == POOL_NO_INDEX)
+      grow();
+
+    uint32_t index = free_head_;
+    slot &entry = at(index);
+    free_head_ = entry.next_free;
+    entry.next_free = POOL_NO_INDEX;
+    entry.live = true;
+    live_++;
+
+    *handle = pool_make_handle(index, entry.generation);
+    return &entry.value;
+  }
+
+  // Returns false if the handle is stale
+  bool free(pool_handle handle)
+  {
+    uint32_t index = pool_handle_index(handle);
+    if (index >= capacity() || !at(index).live || at(index).generation != pool_handle_generation(handle))
+      return false;
+
+    release(index);
+    return true;
+  }
+
+  T *get(pool_handle handle) const
+  {
+    uint32_t index = pool_handle_index(handle);
+    if (index >= capacity())
+      return NULL;
+
+    slot &entry = at(index);
+    if (!entry.live || entry.generation != pool_handle_generation(handle))
+      return NULL;
+    return &entry.value;
+  }
+
+  // Live entry in slot index, without a generation check
+  T *at_index(uint32_t index) const
+  {
+    if (index >= capacity() || !at(index).live)
+      return NULL;
+    return &at(index).value;
+  }
+
+  template <typename F>
+  void for_each(F fn) const
+  {
+    for (uint32_t index = 0; index < capacity(); index++)
+    {
+      if (at(index).live)
+        fn(&at(index).value);
+    }
+  }
+
+  // Frees every live entry in one pass, keeping the slabs
+  void clear()
+  {
+    for (uint32_t index = 0; index < capacity(); index++)
+    {
+      if (at(index).live)
+        release(index);
+    }
+  }
+
+  size_t size() const { return live_; }
+  uint32_t capacity() const { return (uint32_t) (slabs_.size() * SLAB_SIZE); }
+  size_t slab_count() const { return slabs_.size(); }
+
+ private:
+
+  struct slot
+  {
+    T value;
+    uint32_t generation = 1;
+    uint32_t next_free = POOL_NO_INDEX;
+    bool live = false;
+  };
+
+  slot &at(uint32_t index) const
+  {
+    return slabs_[index / SLAB_SIZE][index % SLAB_SIZE];
+  }
+
+  void release(uint32_t index)
+  {
+    slot &entry = at(index);
+    entry.live = false;
+    if (++entry.generation == 0)
+      entry.generation = 1;
+    entry.next_free = free_head_;
+    free_head_ = index;
+    live_--;
+  }
+
+  void grow()
+  {
+    uint32_t base = capacity();
+    slabs_.push_back(new slot[SLAB_SIZE]);
+
+    // Thread the new slots onto the free list in index order
+    for (size_t i = SLAB_SIZE; i-- > 0;)
+    {
+      slabs_.back()[i].next_free = free_head_;
+      free_head_ = base + (uint32_t) i;
+    }
+  }
+
+  std::vector<slot *> slabs_;
+  uint32_t free_head_ = POOL_NO_INDEX;
+  size_t live_ = 0;
+};
+
+/////////////////////
+// GFN Index
+/////////////////////
+
+/**
+ * Open-addressing GFN -> pool slot index map with linear probing and
+ * backward-shift deletion, so lookups touch one flat array and removals
+ * leave no tombstones.
+ **/
+class GfnIndex
+{
+ public:
+
+  GfnIndex()
+  {
+    rehash(64);
+  }
+
+  uint32_t find(uint64_t gfn) const
+  {
+    for (size_t pos = bucket(gfn);; pos = (pos + 1) & mask_)
+    {
+      if (keys_[pos] == gfn)
+        return values_[pos];
+      if (keys_[pos] == GFN_INDEX_EMPTY)
+        return POOL_NO_INDEX;
+    }
+  }
+
+  void insert(uint64_t gfn, uint32_t index)
+  {
+    if ((size_ + 1) * 10 > keys_.size() * 7)
+      rehash(keys_.size() * 2);
+
+    size_t pos = bucket(gfn);
+    while (keys_[pos] != GFN_INDEX_EMPTY && keys_[pos] != gfn)
+      pos = (pos + 1) & mask_;
+
+    if (keys_[pos] == GFN_INDEX_EMPTY)
+      size_++;
+    keys_[pos] = gfn;
+    values_[pos] = index;
+  }
+
+  bool erase(uint64_t gfn)
+  {
+    size_t pos = bucket(gfn);
+    while (keys_[pos] != gfn)
+    {
+      if (keys_[pos] == GFN_INDEX_EMPTY)
+        return false;
+      pos = (pos + 1) & mask_;
+    }
+
+    // Shift later members of the probe run back into the hole
+    size_t hole = pos;
+    for (size_t next = (hole + 1) & mask_; keys_[next] != GFN_INDEX_EMPTY; next = (next + 1) & mask_)
+    {
+      size_t home = bucket(keys_[next]);
+      if (((next - home) & mask_) >= ((next - hole) & mask_))
+      {
+        keys_[hole] = keys_[next];
+        values_[hole] = values_[next];
+        hole = next;
+      }
+    }
+    keys_[hole] = GFN_INDEX_EMPTY;
+    size_--;
+    return true;
+  }
+
+  void clear()
+  {
+    std::fill(keys_.begin(), keys_.end(), GFN_INDEX_EMPTY);
+    size_ = 0;
+  }
+
+  size_t size() const { return size_; }
+
+ private:
+
+  size_t bucket(uint64_t gfn) const
+  {
+    return (size_t) ((gfn * 0x9E3779B97F4A7C15ull) >> shift_);
+  }
+
+  void rehash(size_t capacity)
+  {
+    std::vector<uint64_t> old_keys;
+    std::vector<uint32_t> old_values;
+    old_keys.swap(keys_);
+    old_values.swap(values_);
+
+    keys_.assign(capacity, GFN_INDEX_EMPTY);
+    values_.assign(capacity, POOL_NO_INDEX);
+    mask_ = capacity - 1;
+    shift_ = 64 - __builtin_ctzll(capacity);
+    size_ = 0;
+
+    for (size_t i = 0; i < old_keys.size(); i++)
+    {
+      if (old_keys[i] != GFN_INDEX_EMPTY)
+        insert(old_keys[i], old_values[i]);
+    }
+  }
+
+  std::vector<uint64_t> keys_;
+  std::vector<uint32_t> values_;
+  size_t mask_ = 0;
+  unsigned shift_ = 0;
+  size_t size_ = 0;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef NAIVE_PYTHON
+#define NAIVE_PYTHON
+
+#include <Python.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "naive-checks.h"
+
+// Python module (in the scripts directory) holding the warm Volatility session
+#define ANALYSIS_ENGINE_MODULE "analysis_engine"
+
+/**
+ * Embedded Python interpreter that imports Volatility, opens vmi:// and
+ * instantiates the check plugins once in start(). Checks are then plain
+ * function calls into the warm session returning structured findings.
+ * The GIL is released between calls, so run() may be used from any thread.
+ **/
+class PythonEngine
+{
+ public:
+
+  PythonEngine() = default;
+  PythonEngine(const PythonEngine&) = delete;            // disable copying
+  PythonEngine& operator=(const PythonEngine&) = delete; // disable assignment
+
+  ~PythonEngine()
+  {
+    stop();
+  }
+
+  bool start(const std::string &script_dir, const std::string &profile, const std::string &location)
+  {
+    if (started_)
+      return true;
+
+    Py_Initialize();
+    PyEval_InitThreads();
+
+    // Volatility's config.parse_options() in setup() parses sys.argv, which an embedded interpreter lacks;
+    // it gets the command line vol.py would have been run with (sys.path is set up below)
+    std::vector<std::string> args;
+    args.push_back(ANALYSIS_ENGINE_MODULE);
+    args.push_back("--profile=" + profile);
+    args.push_back("--location=" + location);
+    std::vector<char *> argv;
+    for (size_t i = 0; i < args.size(); i++)
+      argv.push_back(&args[i][0]);
+    PySys_SetArgvEx((int) argv.size(), argv.data(), 0);
+
+    std::string path_setup = "import sys\nsys.path.insert(0, '" + script_dir + "')\n";
+    bool ok = PyRun_SimpleString(path_setup.c_str()) == 0;
+
+    if (ok)
+    {
+      module_ = PyImport_ImportModule(ANALYSIS_ENGINE_MODULE);
+      ok = module_ != NULL;
+    }
+
+    if (ok)
+    {
+      PyObject *result = PyObject_CallMethod(module_, (char *) "setup", (char *) "ss", profile.c_str(), location.c_str());
+      ok = result != NULL;
+      Py_XDECREF(result);
+    }
+
+    if (!ok)
+    {
+      PyErr_Print();
+      Py_XDECREF(module_);
+      module_ = NULL;
+      Py_Finalize();
+      return false;
+    }
+
+    // Let other threads take the GIL
+    main_state_ = PyEval_SaveThread();
+    started_ = true;
+    return true;
+  }
+
+  void stop()
+  {
+    if (!started_)
+      return;
+
+    PyEval_RestoreThread(main_state_);
+    Py_XDECREF(module_);
+    module_ = NULL;
+    Py_Finalize();
+    started_ = false;
+  }
+
+  // Runs one check ("check_fop", "check_creds", "check_afinfo", "check_hidden_modules")
+  bool run(const char *check, analysis_result &out)
+  {
+    out.check = check;
+    out.seconds = 0;
+    out.findings.clear();
+    if (!started_)
+      return false;
+
+    PyGILState_STATE gil = PyGILState_Ensure();
+    PyObject *result = PyObject_CallMethod(module_, (char *) "run", (char *) "s", check);
+    bool ok = result != NULL && convert(result, out);
+    if (!ok)
+      PyErr_Print();
+    Py_XDECREF(result);
+    PyGILState_Release(gil);
+    return ok;
+  }
+
+  bool started() const { return started_; }
+
+ private:
+
+  // {"seconds": float, "findings": [{field: str}]} -> analysis_result
+  static bool convert(PyObject *result, analysis_result &out)
+  {
+    if (!PyDict_Check(result))
+      return false;
+
+    PyObject *seconds = PyDict_GetItemString(result, "seconds");
+    if (seconds)
+      out.seconds = PyFloat_AsDouble(seconds);
+
+    PyObject *findings = PyDict_GetItemString(result, "findings");
+    if (!findings || !PyList_Check(findings))
+      return false;
+
+    for (Py_ssize_t i = 0; i < PyList_Size(findings); i++)
+    {
+      PyObject *fields = PyList_GetItem(findings, i);
+      if (!PyDict_Check(fields))
+        continue;
+
+      analysis_finding finding;
+      PyObject *key;
+      PyObject *value;
+      Py_ssize_t pos = 0;
+      while (PyDict_Next(fields, &pos, &key, &value))
+      {
+        PyObject *text = PyObject_Str(value);
+        if (PyString_Check(key) && text)
+          finding.push_back(std::make_pair(std::string(PyString_AsString(key)), std::string(PyString_AsString(text))));
+        Py_XDECREF(text);
+      }
+      out.findings.push_back(finding);
+    }
+    return true;
+  }
+
+  bool started_ = false;
+  PyObject *module_ = NULL;
+  PyThreadState *main_state_ = NULL;
+};
+
+#endif
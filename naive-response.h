@@ -0,0 +1,221 @@
+#ifndef NAIVE_RESPONSE
+#define NAIVE_RESPONSE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libvmi/libvmi.h>
+#include <libvmi/events.h>
+
+/////////////////////
+// Response Strategies
+/////////////////////
+
+// How the trapped write is let through, selected with --response=NAME
+enum response_kind
+{
+  RESPONSE_STEP,      // Clear the page event, single-step the write, re-register (the original behaviour)
+  RESPONSE_EMULATE,   // Let Xen emulate the write; the watch stays armed
+  RESPONSE_ALTP2M     // Switch the vCPU to an unrestricted altp2m view for one step
+};
+
+struct response_stats
+{
+  unsigned long writes;       // Trapped writes answered
+  unsigned long steps;        // Single steps requested
+};
+
+/**
+ * Lets a trapped write complete once the callback has looked at it. The
+ * callback hands every memory event to respond() and returns its result;
+ * page events go through prepare() before they are registered or cleared. One
+ * instance per guest, used only from the guest's event loop thread.
+ **/
+class ResponseStrategy
+{
+ public:
+
+  virtual ~ResponseStrategy() {}
+
+  virtual const char *name() const = 0;
+  virtual response_kind kind() const = 0;
+
+  // Called once before any page event is registered; false if the guest cannot use this strategy
+  virtual bool setup(vmi_instance_t vmi)
+  {
+    (void) vmi;
+    return true;
+  }
+
+  // Adjusts a page event before vmi_register_event or vmi_clear_event
+  virtual void prepare(vmi_event_t *event)
+  {
+    (void) event;
+  }
+
+  virtual event_response_t respond(vmi_instance_t vmi, vmi_event_t *event) = 0;
+
+  // Undoes setup() once the page events are cleared
+  virtual void teardown(vmi_instance_t vmi)
+  {
+    (void) vmi;
+  }
+
+  const response_stats &stats() const { return stats_; }
+
+ protected:
+
+  response_stats stats_ = response_stats();
+};
+
+/**
+ * Clears the page event, single-steps the vCPU over the write and has
+ * libvmi re-register the event afterwards. Works everywhere, but costs a
+ * step exit and two permission changes per write, and the page is
+ * unwatched for every vCPU while the step runs.
+ **/
+class StepResponse final : public ResponseStrategy
+{
+ public:
+
+  const char *name() const { return "step"; }
+  response_kind kind() const { return RESPONSE_STEP; }
+
+  event_response_t respond(vmi_instance_t vmi, vmi_event_t *event)
+  {
+    stats_.writes++;
+    stats_.steps++;
+    vmi_clear_event(vmi, event, NULL);
+    vmi_step_event(vmi, event, event->vcpu_id, 1, NULL);
+    return VMI_EVENT_RESPONSE_NONE;
+  }
+};
+
+/**
+ * Asks Xen to emulate the faulting instruction, so the write completes in
+ * the same exit and the page stays watched. Instructions Xen's emulator
+ * cannot handle (some vector stores) fail in the guest, so check the
+ * guest's workload before picking it.
+ **/
+class EmulateResponse final : public ResponseStrategy
+{
+ public:
+
+  const char *name() const { return "emulate"; }
+  response_kind kind() const { return RESPONSE_EMULATE; }
+
+  event_response_t respond(vmi_instance_t vmi, vmi_event_t *event)
+  {
+    (void) vmi;
+    (void) event;
+    stats_.writes++;
+    return VMI_EVENT_RESPONSE_EMULATE;
+  }
+};
+
+/**
+ * Page events are registered on a restricted altp2m view that every vCPU
+ * runs in. A trapped write switches only that vCPU to the unrestricted
+ * view 0 for one single step, and the step event switches it back. No
+ * permissions change, so other vCPUs stay watched; needs altp2m (Xen
+ * with altp2m=1 in the domain config).
+ **/
+class Altp2mResponse final : public ResponseStrategy
+{
+ public:
+
+  const char *name() const { return "altp2m"; }
+  response_kind kind() const { return RESPONSE_ALTP2M; }
+
+  bool setup(vmi_instance_t vmi)
+  {
+    if (vmi_slat_set_domain_state(vmi, true) != VMI_SUCCESS)
+      return false;
+    if (vmi_slat_create(vmi, &view_) != VMI_SUCCESS)
+    {
+      vmi_slat_set_domain_state(vmi, false);
+      return false;
+    }
+
+    // Disabled until a write toggles it on for its vCPU
+    unsigned vcpus = vmi_get_num_vcpus(vmi);
+    memset(&step_event_, 0, sizeof(step_event_));
+    SETUP_SINGLESTEP_EVENT(&step_event_, vcpus >= 32 ? UINT32_MAX : (1u << vcpus) - 1, step_cb, 0);
+    step_event_.data = this;
+    if (vmi_register_event(vmi, &step_event_) != VMI_SUCCESS || vmi_slat_switch(vmi, view_) != VMI_SUCCESS)
+    {
+      vmi_slat_destroy(vmi, view_);
+      vmi_slat_set_domain_state(vmi, false);
+      return false;
+    }
+    active_ = true;
+    return true;
+  }
+
+  // respond() points the event at view 0 for the response; registering and clearing use the watched view
+  void prepare(vmi_event_t *event)
+  {
+    event->slat_id = view_;
+  }
+
+  event_response_t respond(vmi_instance_t vmi, vmi_event_t *event)
+  {
+    (void) vmi;
+    stats_.writes++;
+    stats_.steps++;
+    event->slat_id = 0;
+    return VMI_EVENT_RESPONSE_SLAT_ID | VMI_EVENT_RESPONSE_TOGGLE_SINGLESTEP;
+  }
+
+  void teardown(vmi_instance_t vmi)
+  {
+    if (!active_)
+      return;
+    vmi_slat_switch(vmi, 0);
+    vmi_clear_event(vmi, &step_event_, NULL);
+    vmi_slat_destroy(vmi, view_);
+    vmi_slat_set_domain_state(vmi, false);
+    active_ = false;
+  }
+
+ private:
+
+  // The write has executed: back to the watched view, stepping off
+  static event_response_t step_cb(vmi_instance_t vmi, vmi_event_t *event)
+  {
+    (void) vmi;
+    event->slat_id = ((Altp2mResponse *) event->data)->view_;
+    return VMI_EVENT_RESPONSE_SLAT_ID | VMI_EVENT_RESPONSE_TOGGLE_SINGLESTEP;
+  }
+
+  uint16_t view_ = 0;
+  bool active_ = false;
+  vmi_event_t step_event_;
+};
+
+// "step", "emulate" or "altp2m"; false if the name is unknown
+static inline bool response_kind_from_name(const char *name, response_kind *kind)
+{
+  if (strcmp(name, "step") == 0)
+    *kind = RESPONSE_STEP;
+  else if (strcmp(name, "emulate") == 0)
+    *kind = RESPONSE_EMULATE;
+  else if (strcmp(name, "altp2m") == 0)
+    *kind = RESPONSE_ALTP2M;
+  else
+    return false;
+  return true;
+}
+
+static inline ResponseStrategy *make_response_strategy(response_kind kind)
+{
+  switch (kind)
+  {
+    case RESPONSE_EMULATE: return new EmulateResponse();
+    case RESPONSE_ALTP2M: return new Altp2mResponse();
+    default: return new StepResponse();
+  }
+}
+
+#endif
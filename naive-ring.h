@@ -0,0 +1,317 @@
+#ifndef NAIVE_RING
+#define NAIVE_RING
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/membarrier.h>
+
+#include <atomic>
+#include <new>
+
+#define RING_CACHE_LINE 64
+
+// Number of empty polls before the consumer sleeps on the futex
+#define RING_SPIN_LIMIT 2048
+
+// Timeout value for wait_pop_batch that never expires
+#define RING_WAIT_FOREVER UINT64_MAX
+
+/////////////////////
+// Event Record
+/////////////////////
+struct naive_event
+{
+  uint32_t type;       // PROCESS_EVENT, MODULE_EVENT, ...
+  uint32_t vcpu;
+  uint64_t gfn;
+  uint64_t offset;     // Offset of the write within the page
+  uint64_t object;     // Physical address of the watched object that was hit
+  uint64_t timestamp;  // CLOCK_MONOTONIC nanoseconds
+};
+
+static inline uint64_t ring_timestamp_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void ring_cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+// Registers the process for ring_process_barrier once; false if the kernel lacks expedited membarrier
+static inline bool ring_register_process_barrier()
+{
+#ifdef SYS_membarrier
+  static const bool registered = (syscall(SYS_membarrier, MEMBARRIER_CMD_QUERY, 0) & MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+    && syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+  return registered;
+#else
+  return false;
+#endif
+}
+
+// Runs a full memory barrier on every running thread of the process, so the other side of a store/load
+// handshake gets away with a compiler barrier; needs ring_register_process_barrier
+static inline void ring_process_barrier()
+{
+#ifdef SYS_membarrier
+  syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+#endif
+}
+
+/////////////////////
+// Aligned Allocation
+/////////////////////
+
+// Base for heap allocated types that hold a ring: new only honours its cache line alignment from C++17
+struct RingAligned
+{
+  static void *operator new(size_t size)
+  {
+    void *memory = NULL;
+    if (posix_memalign(&memory, RING_CACHE_LINE, size) != 0)
+      throw std::bad_alloc();
+    return memory;
+  }
+
+  static void operator delete(void *memory)
+  {
+    free(memory);
+  }
+};
+
+/////////////////////
+// Overflow Policies
+/////////////////////
+enum ring_overflow_policy
+{
+  RING_DROP_NEWEST,  // Drop the incoming item and count it (never blocks producer)
+  RING_SPIN          // Spin until the consumer frees a slot
+};
+
+/**
+ * Bounded lock-free single-producer/single-consumer ring.
+ * Producer and consumer indices live on separate cache lines, each side
+ * keeps a cached copy of the other's index to avoid cache-line ping-pong.
+ * An idle consumer spins briefly and then sleeps on a futex. The sleep
+ * handshake's barrier is paid by the consumer as it goes to sleep (a
+ * process wide membarrier), so a push only checks the sleep flag; kernels
+ * without membarrier fall back to a fence on every push.
+ **/
+template <typename T>
+class SpscRing
+{
+ public:
+
+  // Capacity is rounded up to a power of two
+  explicit SpscRing(size_t capacity = 65536, ring_overflow_policy policy = RING_DROP_NEWEST)
+    : policy_(policy), process_barrier_(ring_register_process_barrier())
+  {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+    mask_ = size - 1;
+    slots_ = new T[size];
+  }
+
+  ~SpscRing()
+  {
+    delete[] slots_;
+  }
+
+  SpscRing(const SpscRing&) = delete;            // disable copying
+  SpscRing& operator=(const SpscRing&) = delete; // disable assignment
+
+  // Producer side. Returns false if the item was dropped.
+  bool push(const T& item)
+  {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - producer_head_cache_ > mask_)
+    {
+      producer_head_cache_ = head_.load(std::memory_order_acquire);
+      while (tail - producer_head_cache_ > mask_)
+      {
+        if (policy_ == RING_DROP_NEWEST || closed_.load(std::memory_order_relaxed))
+        {
+          dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+          return false;
+        }
+        ring_cpu_relax();
+        producer_head_cache_ = head_.load(std::memory_order_acquire);
+      }
+    }
+
+    slots_[tail & mask_] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    wake_consumer();
+    return true;
+  }
+
+  // Consumer side. Copies up to max items without blocking, returns count.
+  size_t pop_batch(T *out, size_t max)
+  {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (consumer_tail_cache_ == head)
+    {
+      consumer_tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (consumer_tail_cache_ == head)
+        return 0;
+    }
+
+    size_t count = consumer_tail_cache_ - head;
+    if (count > max)
+      count = max;
+
+    for (size_t i = 0; i < count; i++)
+      out[i] = slots_[(head + i) & mask_];
+
+    head_.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  // Consumer side. Blocks until at least one item is available or the ring is closed.
+  size_t wait_pop_batch(T *out, size_t max)
+  {
+    return wait_pop_batch(out, max, RING_WAIT_FOREVER);
+  }
+
+  // As above, but gives up and returns 0 after timeout_ns (RING_WAIT_FOREVER blocks)
+  size_t wait_pop_batch(T *out, size_t max, uint64_t timeout_ns)
+  {
+    uint64_t deadline = timeout_ns == RING_WAIT_FOREVER ? RING_WAIT_FOREVER : ring_timestamp_ns() + timeout_ns;
+    unsigned spins = 0;
+    while (true)
+    {
+      size_t count = pop_batch(out, max);
+      if (count > 0)
+        return count;
+
+      if (closed_.load(std::memory_order_acquire) || take_notification())
+        return 0;
+
+      if (spins < RING_SPIN_LIMIT)
+      {
+        spins++;
+        ring_cpu_relax();
+        continue;
+      }
+
+      // Announce sleep, then re-check so a concurrent push cannot be missed: the barrier makes the
+      // producer's last tail store visible here, or this announcement visible to its next check
+      sleeping_.store(1, std::memory_order_relaxed);
+      if (process_barrier_)
+        ring_process_barrier();
+      else
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (tail_.load(std::memory_order_acquire) != head_.load(std::memory_order_relaxed)
+        || closed_.load(std::memory_order_acquire) || notified_.load(std::memory_order_acquire))
+      {
+        sleeping_.store(0, std::memory_order_relaxed);
+        continue;
+      }
+
+      if (deadline == RING_WAIT_FOREVER)
+        syscall(SYS_futex, (int *) &sleeping_, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+      else
+      {
+        uint64_t now = ring_timestamp_ns();
+        if (now >= deadline)
+        {
+          sleeping_.store(0, std::memory_order_relaxed);
+          return 0;
+        }
+
+        struct timespec timeout;
+        timeout.tv_sec = (deadline - now) / 1000000000ull;
+        timeout.tv_nsec = (deadline - now) % 1000000000ull;
+        syscall(SYS_futex, (int *) &sleeping_, FUTEX_WAIT_PRIVATE, 1, &timeout, NULL, 0);
+      }
+      sleeping_.store(0, std::memory_order_relaxed);
+      spins = 0;
+    }
+  }
+
+  // Wakes the consumer and makes wait_pop_batch return once drained.
+  // Only touches atomics and the futex syscall, so it is signal-safe.
+  void close()
+  {
+    closed_.store(true, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    sleeping_.store(0, std::memory_order_relaxed);
+    syscall(SYS_futex, (int *) &sleeping_, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+  }
+
+  // Makes a waiting (or the next) wait_pop_batch return 0 early, e.g. when the
+  // consumer has other work to look at. Safe from any thread.
+  void notify()
+  {
+    notified_.store(true, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    sleeping_.store(0, std::memory_order_relaxed);
+    syscall(SYS_futex, (int *) &sleeping_, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+
+  bool closed() const { return closed_.load(std::memory_order_acquire); }
+  size_t capacity() const { return mask_ + 1; }
+  unsigned long dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  // Approximate number of queued items (exact when called from either endpoint)
+  size_t size() const
+  {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+
+ private:
+
+  bool take_notification()
+  {
+    return notified_.load(std::memory_order_relaxed) && notified_.exchange(false, std::memory_order_acquire);
+  }
+
+  // Pairs with the consumer's barrier after it announces sleep (see wait_pop_batch)
+  void wake_consumer()
+  {
+    if (process_barrier_)
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    else
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed) != 0)
+    {
+      sleeping_.store(0, std::memory_order_relaxed);
+      syscall(SYS_futex, (int *) &sleeping_, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+  }
+
+  // Read-mostly configuration
+  T *slots_;
+  size_t mask_;
+  ring_overflow_policy policy_;
+  bool process_barrier_;      // The consumer pays for the sleep handshake's barrier
+
+  // Producer cache line
+  alignas(RING_CACHE_LINE) std::atomic<size_t> tail_{0};
+  size_t producer_head_cache_ = 0;
+  std::atomic<unsigned long> dropped_{0};
+
+  // Consumer cache line
+  alignas(RING_CACHE_LINE) std::atomic<size_t> head_{0};
+  size_t consumer_tail_cache_ = 0;
+
+  // Shared wakeup state
+  alignas(RING_CACHE_LINE) std::atomic<int> sleeping_{0};
+  std::atomic<bool> closed_{false};
+  std::atomic<bool> notified_{false};
+};
+
+#endif
@@ -0,0 +1,343 @@
+#ifndef NAIVE_SHADOW
+#define NAIVE_SHADOW
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+#include "naive-coalesce.h"
+#include "naive-dwarf.h"
+
+// Granularity of the shadow diff, the lines the coalescer marks dirty per object
+#define SHADOW_LINE_SHIFT COALESCE_LINE_SHIFT
+#define SHADOW_LINE_SIZE (1u << SHADOW_LINE_SHIFT)
+
+// Most dirty lines diff reads at once, into a buffer on its stack
+#define SHADOW_READ_LINES 8
+
+/////////////////////
+// Member Map
+/////////////////////
+
+struct shadow_member
+{
+  uint32_t offset;
+  uint32_t end;
+  const char *name;     // In the DwarfIndex string pool
+  bool relevant;        // One of the watched members; changes to the others are benign
+};
+
+/**
+ * Members of one struct sorted by offset, for mapping changed bytes back to
+ * member names. Members of anonymous structs and unions are flattened by
+ * DwarfIndex, so members may overlap.
+ **/
+struct shadow_layout
+{
+  std::string struct_name;
+  std::vector<shadow_member> members;
+  uint32_t max_member_size = 0;
+
+  bool empty() const { return members.empty(); }
+
+  // Calls fn(index) for every member overlapping [start, end)
+  template <typename F>
+  void for_each_member(uint32_t start, uint32_t end, F fn) const
+  {
+    std::vector<shadow_member>::const_iterator it = std::lower_bound(members.begin(), members.end(), end,
+      [](const shadow_member &member, uint32_t offset) { return member.offset < offset; });
+    while (it != members.begin())
+    {
+      --it;
+      if (it->offset + max_member_size <= start)
+        break;
+      if (it->end > start)
+        fn((size_t) (it - members.begin()));
+    }
+  }
+};
+
+// Every member of struct_name by offset, relevant if its name is in relevant
+static inline void build_shadow_layout(const DwarfIndex &dwarf, const char *struct_name, const char **relevant,
+  size_t relevant_count, shadow_layout &out)
+{
+  out.struct_name = struct_name;
+  out.members.clear();
+  out.max_member_size = 0;
+
+  const dwarf_struct_entry *entry = dwarf.find_struct(struct_name);
+  if (!entry)
+    return;
+  for (const dwarf_member_entry *it = dwarf.members_begin(entry); it != dwarf.members_end(entry); ++it)
+  {
+    shadow_member member;
+    member.offset = it->offset;
+    member.end = it->offset + (it->size ? it->size : 1);
+    member.name = dwarf.string_at(it->name);
+    member.relevant = false;
+    for (size_t i = 0; i < relevant_count && !member.relevant; i++)
+      member.relevant = strcmp(member.name, relevant[i]) == 0;
+    out.members.push_back(member);
+    out.max_member_size = std::max(out.max_member_size, member.end - member.offset);
+  }
+  std::stable_sort(out.members.begin(), out.members.end(),
+    [](const shadow_member &a, const shadow_member &b) { return a.offset < b.offset; });
+}
+
+/////////////////////
+// Line Diff
+/////////////////////
+
+// Bit i set where the 64-byte lines a and b differ at byte i
+static inline uint64_t shadow_line_diff(const uint8_t *a, const uint8_t *b)
+{
+#if defined(__x86_64__)
+  uint64_t same = 0;
+  for (unsigned i = 0; i < SHADOW_LINE_SIZE; i += 16)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+    same |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) << i;
+  }
+  return ~same;
+#else
+  uint64_t diff = 0;
+  for (unsigned i = 0; i < SHADOW_LINE_SIZE; i++)
+    diff |= (uint64_t) (a[i] != b[i]) << i;
+  return diff;
+#endif
+}
+
+/////////////////////
+// Shadow Store
+/////////////////////
+
+// One changed member (or unnamed bytes, member -1) of an object
+struct shadow_change
+{
+  uint32_t offset;      // Changed bytes, from the object start
+  uint32_t end;
+  int member;           // Index into the object's shadow_layout members
+};
+
+struct shadow_stats
+{
+  unsigned long captured;     // Objects copied when watched
+  unsigned long diffs;        // Objects diffed after writes
+  unsigned long lines_read;   // Dirty lines read back from the guest
+  unsigned long changes;      // Changed members (or unnamed ranges) reported
+  unsigned long unreadable;
+};
+
+/**
+ * Last-known bytes of every watched object with a member layout. After a
+ * write, diff() reads back only the lines the writes touched (the
+ * coalescer's dirty line bitmap), comparing each run with the copy 16
+ * bytes at a time as it arrives and mapping the changed bytes to members,
+ * updating the copy. Reads through a caller supplied reader,
+ * read(pa, buf, size) -> bool; capture reads outside the lock, diff under
+ * it. The event loop captures while analysis workers diff.
+ **/
+class ShadowStore
+{
+ public:
+
+  ShadowStore() = default;
+  ShadowStore(const ShadowStore&) = delete;            // disable copying
+  ShadowStore& operator=(const ShadowStore&) = delete; // disable assignment
+
+  // Copies the object as it is now; false if it could not be read
+  template <typename Reader>
+  bool capture(Reader &read, uint32_t type, uint64_t object, uint32_t size, const shadow_layout *layout)
+  {
+    std::vector<uint8_t> bytes(size);
+    bool readable = read(object, bytes.data(), size);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!readable)
+    {
+      stats_.unreadable++;
+      return false;
+    }
+    entry &shadow = entries_[key(type, object)];
+    shadow.layout = layout;
+    shadow.bytes.swap(bytes);
+    stats_.captured++;
+    return true;
+  }
+
+  // Rereads the lines set in dirty (bit i is bytes [64i, 64i+64)) and appends what changed to changes.
+  // Returns false without a shadow for the object or if the guest could not be read.
+  template <typename Reader>
+  bool diff(Reader &read, uint32_t type, uint64_t object, const uint64_t *dirty, size_t dirty_words,
+    std::vector<shadow_change> &changes, const shadow_layout **layout)
+  {
+    // Held across the reads: callers already serialise their guest reads (the VMI lock), and each
+    // run is compared as it is read instead of being staged for a second lookup
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<uint64_t, entry>::iterator it = entries_.find(key(type, object));
+    if (it == entries_.end())
+      return false;
+    *layout = it->second.layout;
+
+    // Runs of dirty lines are read in one go, up to SHADOW_READ_LINES at a time; clean lines are never touched
+    std::vector<uint8_t> &shadow = it->second.bytes;
+    uint32_t size = (uint32_t) shadow.size();
+    uint32_t lines = (size + SHADOW_LINE_SIZE - 1) >> SHADOW_LINE_SHIFT;
+    uint8_t current[SHADOW_READ_LINES * SHADOW_LINE_SIZE];
+    size_t first_change = changes.size();
+    uint32_t run_start = 0, run_end = 0;
+    unsigned long lines_read = 0;
+    for (uint32_t line = 0; line < lines && line < dirty_words * 64; )
+    {
+      if (!(dirty[line / 64] & (1ull << (line % 64))))
+      {
+        line++;
+        continue;
+      }
+      uint32_t first = line;
+      while (line < lines && line < dirty_words * 64 && line - first < SHADOW_READ_LINES &&
+        (dirty[line / 64] & (1ull << (line % 64))))
+        line++;
+      uint32_t start = first << SHADOW_LINE_SHIFT;
+      uint32_t end = std::min(line << SHADOW_LINE_SHIFT, size);
+      if (!read(object + start, current, end - start))
+      {
+        changes.resize(first_change);
+        stats_.unreadable++;
+        return false;
+      }
+      lines_read += line - first;
+
+      // Changed byte runs, merged across line boundaries, then named
+      for (uint32_t base = start; base < end; base += SHADOW_LINE_SIZE)
+      {
+        uint32_t valid = std::min(SHADOW_LINE_SIZE, end - base);
+        const uint8_t *read_line = current + (base - start);
+        uint64_t changed = line_diff(read_line, shadow.data() + base, valid);
+        if (changed == 0)
+          continue;
+        memcpy(shadow.data() + base, read_line, valid);
+
+        while (changed != 0)
+        {
+          uint32_t from = __builtin_ctzll(changed);
+          uint64_t rest = ~changed & (~0ull << from);
+          uint32_t to = rest == 0 ? SHADOW_LINE_SIZE : __builtin_ctzll(rest);
+          changed &= to == SHADOW_LINE_SIZE ? 0 : ~0ull << to;
+          if (run_end == base + from && run_end != 0)
+            run_end = base + to;
+          else
+          {
+            if (run_end != 0)
+              name_changes(it->second.layout, run_start, run_end, changes);
+            run_start = base + from;
+            run_end = base + to;
+          }
+        }
+      }
+    }
+    if (run_end != 0)
+      name_changes(it->second.layout, run_start, run_end, changes);
+
+    stats_.diffs++;
+    stats_.lines_read += lines_read;
+    stats_.changes += changes.size() - first_change;
+    return true;
+  }
+
+  // Copies size bytes at offset of the shadow (no guest read); false without one
+  bool copy(uint32_t type, uint64_t object, uint32_t offset, uint32_t size, void *out)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<uint64_t, entry>::const_iterator it = entries_.find(key(type, object));
+    if (it == entries_.end() || (uint64_t) offset + size > it->second.bytes.size())
+      return false;
+    memcpy(out, it->second.bytes.data() + offset, size);
+    return true;
+  }
+
+  void forget(uint32_t type, uint64_t object)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(key(type, object));
+  }
+
+  size_t size()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  shadow_stats stats()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+ private:
+
+  struct entry
+  {
+    const shadow_layout *layout;
+    std::vector<uint8_t> bytes;
+  };
+
+  // Same keying as IntegrityBaseline: type bit index above the 52-bit physical address
+  static uint64_t key(uint32_t type, uint64_t object)
+  {
+    return ((uint64_t) __builtin_ctz(type) << 56) | object;
+  }
+
+  // Diff of the first valid bytes of a line (the object's last line may be partial)
+  static uint64_t line_diff(const uint8_t *current, const uint8_t *shadow, uint32_t valid)
+  {
+    if (valid == SHADOW_LINE_SIZE)
+      return shadow_line_diff(current, shadow);
+    uint64_t changed = 0;
+    for (uint32_t i = 0; i < valid; i++)
+      changed |= (uint64_t) (current[i] != shadow[i]) << i;
+    return changed;
+  }
+
+  // One change per member the run overlaps, clipped to it; bytes no member covers become one unnamed change
+  static void name_changes(const shadow_layout *layout, uint32_t start, uint32_t end, std::vector<shadow_change> &changes)
+  {
+    size_t first = changes.size();
+    if (layout)
+    {
+      layout->for_each_member(start, end, [layout, start, end, &changes](size_t index) {
+        const shadow_member &member = layout->members[index];
+        shadow_change change;
+        change.offset = std::max(start, member.offset);
+        change.end = std::min(end, member.end);
+        change.member = (int) index;
+        changes.push_back(change);
+      });
+      std::reverse(changes.begin() + first, changes.end());
+    }
+    if (changes.size() == first)
+    {
+      shadow_change change;
+      change.offset = start;
+      change.end = end;
+      change.member = -1;
+      changes.push_back(change);
+    }
+  }
+
+  std::mutex mutex_;
+  std::unordered_map<uint64_t, entry> entries_;
+  shadow_stats stats_ = shadow_stats();
+};
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef NAIVE_TRACE
+#define NAIVE_TRACE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#define TRACE_MAGIC "NHTRACE"
+#define TRACE_VERSION 2   // 2 added TRACE_FIELDS; version 1 traces still read
+
+// Records buffered before each write to the trace file
+#define TRACE_BUFFER_RECORDS 4096
+
+/////////////////////
+// Trace Format
+/////////////////////
+// Header followed by fixed size records, appended in callback order
+
+struct trace_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t start_ns;      // CLOCK_MONOTONIC time the recording started
+};
+
+enum trace_kind
+{
+  TRACE_EVENT = 1,        // Memory event received by the callback
+  TRACE_WATCH = 2,        // Range added to the watch table
+  TRACE_UNWATCH = 3,      // Range removed from the watch table
+  TRACE_FIELDS = 4        // Relevant member span of a type's objects (before its first watch)
+};
+
+struct trace_record
+{
+  uint64_t timestamp;     // CLOCK_MONOTONIC nanoseconds
+  uint64_t gfn;
+  uint64_t address;       // TRACE_EVENT: gla, TRACE_(UN)WATCH: watched object
+  uint32_t type;          // TRACE_EVENT: types of the ranges hit (0 = irrelevant), else the range type
+  uint16_t offset;        // TRACE_EVENT: offset in the page, TRACE_WATCH: range start, TRACE_FIELDS: span start
+  uint16_t end;           // TRACE_WATCH: range end, TRACE_FIELDS: span end (from the object start)
+  uint16_t vcpu;
+  uint8_t access;         // VMI_MEMACCESS_* bits reported by the event
+  uint8_t kind;           // trace_kind
+  uint32_t reserved;
+};
+
+/////////////////////
+// Trace Writer
+/////////////////////
+
+/**
+ * Append-only trace file. Records are buffered and written in blocks, so
+ * the callback only copies 40 bytes per event. Watch table changes are
+ * recorded alongside the events so a replay can rebuild the filter state
+ * at every point. Not thread-safe: events and watch changes both happen on
+ * the event loop thread.
+ **/
+class TraceWriter
+{
+ public:
+
+  TraceWriter() = default;
+  TraceWriter(const TraceWriter&) = delete;            // disable copying
+  TraceWriter& operator=(const TraceWriter&) = delete; // disable assignment
+
+  ~TraceWriter()
+  {
+    close();
+  }
+
+  bool open(const std::string &path, uint64_t start_ns)
+  {
+    close();
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_)
+      return false;
+
+    trace_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(trace_record);
+    header.start_ns = start_ns;
+    if (fwrite(&header, sizeof(header), 1, file_) != 1)
+    {
+      close();
+      return false;
+    }
+
+    buffer_.reserve(TRACE_BUFFER_RECORDS);
+    records_ = 0;
+    return true;
+  }
+
+  void event(uint64_t timestamp, uint64_t gfn, uint32_t offset, uint64_t gla, uint8_t access, uint32_t vcpu, uint32_t types)
+  {
+    trace_record record = make(TRACE_EVENT, timestamp, gfn, types);
+    record.address = gla;
+    record.offset = (uint16_t) offset;
+    record.access = access;
+    record.vcpu = (uint16_t) vcpu;
+    append(record);
+  }
+
+  void watch(uint64_t timestamp, uint64_t gfn, uint32_t start, uint32_t end, uint32_t type, uint64_t object)
+  {
+    trace_record record = make(TRACE_WATCH, timestamp, gfn, type);
+    record.address = object;
+    record.offset = (uint16_t) start;
+    record.end = (uint16_t) end;
+    append(record);
+  }
+
+  void unwatch(uint64_t timestamp, uint64_t gfn, uint32_t type, uint64_t object)
+  {
+    trace_record record = make(TRACE_UNWATCH, timestamp, gfn, type);
+    record.address = object;
+    append(record);
+  }
+
+  void fields(uint64_t timestamp, uint32_t type, uint32_t start, uint32_t end)
+  {
+    trace_record record = make(TRACE_FIELDS, timestamp, 0, type);
+    record.offset = (uint16_t) start;
+    record.end = (uint16_t) end;
+    append(record);
+  }
+
+  void flush()
+  {
+    if (file_ && !buffer_.empty())
+      fwrite(buffer_.data(), sizeof(trace_record), buffer_.size(), file_);
+    buffer_.clear();
+  }
+
+  void close()
+  {
+    if (!file_)
+      return;
+    flush();
+    fclose(file_);
+    file_ = NULL;
+  }
+
+  bool recording() const { return file_ != NULL; }
+  unsigned long records() const { return records_; }
+
+ private:
+
+  static trace_record make(uint8_t kind, uint64_t timestamp, uint64_t gfn, uint32_t type)
+  {
+    trace_record record;
+    memset(&record, 0, sizeof(record));
+    record.kind = kind;
+    record.timestamp = timestamp;
+    record.gfn = gfn;
+    record.type = type;
+    return record;
+  }
+
+  void append(const trace_record &record)
+  {
+    if (!file_)
+      return;
+    buffer_.push_back(record);
+    records_++;
+    if (buffer_.size() >= TRACE_BUFFER_RECORDS)
+      flush();
+  }
+
+  FILE *file_ = NULL;
+  std::vector<trace_record> buffer_;
+  unsigned long records_ = 0;
+};
+
+/////////////////////
+// Trace Reader
+/////////////////////
+
+// Read-only mmap of a trace file
+class TraceReader
+{
+ public:
+
+  TraceReader() = default;
+  TraceReader(const TraceReader&) = delete;            // disable copying
+  TraceReader& operator=(const TraceReader&) = delete; // disable assignment
+
+  ~TraceReader()
+  {
+    close();
+  }
+
+  bool open(const std::string &path)
+  {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(trace_header))
+    {
+      ::close(fd);
+      return false;
+    }
+
+    void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+      return false;
+    map_ = map;
+    size_ = info.st_size;
+
+    const trace_header *header = (const trace_header *) map_;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 || header->version < 1 || header->version > TRACE_VERSION
+      || header->record_size != sizeof(trace_record))
+    {
+      close();
+      return false;
+    }
+
+    madvise(map_, size_, MADV_SEQUENTIAL);
+    start_ns_ = header->start_ns;
+    records_ = (const trace_record *) ((const char *) map_ + sizeof(trace_header));
+    count_ = (size_ - sizeof(trace_header)) / sizeof(trace_record);
+    return true;
+  }
+
+  void close()
+  {
+    if (map_)
+      munmap(map_, size_);
+    map_ = NULL;
+    size_ = 0;
+    records_ = NULL;
+    count_ = 0;
+  }
+
+  const trace_record *records() const { return records_; }
+  size_t count() const { return count_; }
+  uint64_t start_ns() const { return start_ns_; }
+
+ private:
+
+  void *map_ = NULL;
+  size_t size_ = 0;
+  const trace_record *records_ = NULL;
+  size_t count_ = 0;
+  uint64_t start_ns_ = 0;
+};
+
+#endif
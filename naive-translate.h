@@ -0,0 +1,355 @@
+#ifndef NAIVE_TRANSLATE
+#define NAIVE_TRANSLATE
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "naive-ring.h"
+
+// Default number of cached translations (rounded up to a power of two) and entries per set
+#define TRANSLATION_CACHE_ENTRIES 4096
+#define TRANSLATION_CACHE_WAYS 4
+
+// Most page table entries a walk goes through (PML4E, PDPTE, PDE, PTE)
+#define TRANSLATION_MAX_LEVELS 4
+
+// Page table entry writes queued while a reader holds the lock; more drop every translation
+#define TRANSLATION_DEFERRED_WRITES 256
+
+#define TRANSLATION_PAGE_SHIFT 12
+#define TRANSLATION_PAGE_MASK ((1ull << TRANSLATION_PAGE_SHIFT) - 1)
+
+/////////////////////
+// Page Walk
+/////////////////////
+struct translation_walk
+{
+  uint64_t pa;                                    // Physical address the walk produced
+  uint64_t entries[TRANSLATION_MAX_LEVELS];       // Physical addresses of the entries it read
+  unsigned entry_count;
+};
+
+struct translation_stats
+{
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long inserts;
+  unsigned long evictions;        // Translations displaced by another one in their set
+  unsigned long invalidations;    // Translations dropped because an entry they used was written
+  unsigned long deferred;         // Entry writes left for the next lock holder to apply
+  unsigned long symbol_hits;
+  unsigned long symbol_misses;
+};
+
+/////////////////////
+// Translation Cache
+/////////////////////
+
+/**
+ * Bounded VA -> PA cache keyed by (dtb, virtual page), set associative so
+ * a lookup is one hash and at most TRANSLATION_CACHE_WAYS compares; a full
+ * set replaces its entries round robin. Every cached translation remembers
+ * the page table entries its walk read. The caller watches those entries
+ * for writes (take_watch_changes() reports which ones to add and drop)
+ * and calls invalidate() when one is written, which drops every
+ * translation that went through it, found through a reverse index from
+ * entry to slots. Kernel symbol addresses never change and are cached
+ * without bound. Locked, so checks on worker threads may share it with
+ * the event loop; invalidate() never waits for the lock, it leaves the
+ * write to the next lock holder, who applies it before using the cache.
+ **/
+class TranslationCache
+{
+ public:
+
+  explicit TranslationCache(size_t capacity = TRANSLATION_CACHE_ENTRIES)
+    : deferred_(TRANSLATION_DEFERRED_WRITES, RING_DROP_NEWEST)
+  {
+    size_t size = TRANSLATION_CACHE_WAYS;
+    while (size < capacity)
+      size <<= 1;
+    slots_.resize(size);
+    victims_.assign(size / TRANSLATION_CACHE_WAYS, 0);
+    set_mask_ = size / TRANSLATION_CACHE_WAYS - 1;
+  }
+
+  TranslationCache(const TranslationCache&) = delete;            // disable copying
+  TranslationCache& operator=(const TranslationCache&) = delete; // disable assignment
+
+  bool lookup(uint64_t dtb, uint64_t va, uint64_t *pa)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    apply_deferred();
+    slot *entry = find(dtb, va);
+    if (!entry)
+    {
+      stats_.misses++;
+      return false;
+    }
+    stats_.hits++;
+    *pa = entry->ppage | (va & TRANSLATION_PAGE_MASK);
+    return true;
+  }
+
+  void insert(uint64_t dtb, uint64_t va, const translation_walk &walk)
+  {
+    if (walk.pa == 0)
+      return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    apply_deferred();
+    slot &entry = victim(dtb, va);
+    if (entry.valid)
+    {
+      if (entry.dtb != dtb || entry.vpage != va >> TRANSLATION_PAGE_SHIFT)
+        stats_.evictions++;
+      drop(entry);
+    }
+
+    entry.valid = true;
+    entry.dtb = dtb;
+    entry.vpage = va >> TRANSLATION_PAGE_SHIFT;
+    entry.ppage = walk.pa & ~TRANSLATION_PAGE_MASK;
+    entry.walk = walk;
+    for (unsigned i = 0; i < walk.entry_count; i++)
+    {
+      std::vector<uint32_t> &users = entry_refs_[walk.entries[i]];
+      if (users.empty())
+        queue_change(walk.entries[i], true);
+      entry.ref_index[i] = (uint32_t) users.size();
+      users.push_back((uint32_t) (&entry - &slots_[0]));
+    }
+    stats_.inserts++;
+  }
+
+  // The page table entry at entry_pa was written; returns the number of translations dropped, 0 if a reader
+  // held the lock and the write was queued for it. Only called from one thread (the guest's event loop).
+  size_t invalidate(uint64_t entry_pa)
+  {
+    if (!mutex_.try_lock())
+    {
+      if (!deferred_.push(entry_pa))
+        deferred_overflow_.store(true, std::memory_order_relaxed);
+      deferred_pending_.store(true, std::memory_order_release);
+      return 0;
+    }
+    apply_deferred();
+    size_t dropped = drop_users(entry_pa);
+    mutex_.unlock();
+    return dropped;
+  }
+
+  // Drops every translation (e.g. after the domain was restored)
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    apply_deferred();
+    drop_all();
+  }
+
+  // Entries that became used (watch) or unused (unwatch) since the last call
+  void take_watch_changes(std::vector<uint64_t> &watch, std::vector<uint64_t> &unwatch)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    apply_deferred();
+    watch.clear();
+    unwatch.clear();
+    for (std::unordered_map<uint64_t, bool>::const_iterator it = changes_.begin(); it != changes_.end(); ++it)
+      (it->second ? watch : unwatch).push_back(it->first);
+    changes_.clear();
+  }
+
+  bool symbol(const std::string &name, uint64_t *va)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<std::string, uint64_t>::const_iterator it = symbols_.find(name);
+    if (it == symbols_.end())
+    {
+      stats_.symbol_misses++;
+      return false;
+    }
+    stats_.symbol_hits++;
+    *va = it->second;
+    return true;
+  }
+
+  void add_symbol(const std::string &name, uint64_t va)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    symbols_[name] = va;
+  }
+
+  size_t capacity() const { return slots_.size(); }
+
+  // Page table entries currently referenced by cached translations
+  size_t watched_entries()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    apply_deferred();
+    return entry_refs_.size();
+  }
+
+  translation_stats stats()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    apply_deferred();
+    return stats_;
+  }
+
+ private:
+
+  struct slot
+  {
+    bool valid = false;
+    uint64_t dtb = 0;
+    uint64_t vpage = 0;
+    uint64_t ppage = 0;
+    translation_walk walk;
+    uint32_t ref_index[TRANSLATION_MAX_LEVELS];   // Position in entry_refs_ of each entry of walk
+  };
+
+  // First slot of the set (dtb, va) maps to
+  size_t set(uint64_t dtb, uint64_t va) const
+  {
+    uint64_t key = (va >> TRANSLATION_PAGE_SHIFT) ^ (dtb * 0x9e3779b97f4a7c15ull);
+    return ((size_t) ((key * 0xff51afd7ed558ccdull) >> 32) & set_mask_) * TRANSLATION_CACHE_WAYS;
+  }
+
+  slot *find(uint64_t dtb, uint64_t va)
+  {
+    uint64_t vpage = va >> TRANSLATION_PAGE_SHIFT;
+    slot *ways = &slots_[set(dtb, va)];
+    for (unsigned i = 0; i < TRANSLATION_CACHE_WAYS; i++)
+    {
+      if (ways[i].valid && ways[i].vpage == vpage && ways[i].dtb == dtb)
+        return &ways[i];
+    }
+    return NULL;
+  }
+
+  // Slot for a new translation: the same key, a free way, or the set's next round robin victim
+  slot &victim(uint64_t dtb, uint64_t va)
+  {
+    slot *existing = find(dtb, va);
+    if (existing)
+      return *existing;
+
+    size_t first = set(dtb, va);
+    for (unsigned i = 0; i < TRANSLATION_CACHE_WAYS; i++)
+    {
+      if (!slots_[first + i].valid)
+        return slots_[first + i];
+    }
+    unsigned &next = victims_[first / TRANSLATION_CACHE_WAYS];
+    next = (next + 1) % TRANSLATION_CACHE_WAYS;
+    return slots_[first + next];
+  }
+
+  // Removes entry from the users of each page table entry of its walk, the last user moving into its place
+  void drop(slot &entry)
+  {
+    entry.valid = false;
+    uint32_t index = (uint32_t) (&entry - &slots_[0]);
+    for (unsigned i = 0; i < entry.walk.entry_count; i++)
+    {
+      uint64_t entry_pa = entry.walk.entries[i];
+      std::unordered_map<uint64_t, std::vector<uint32_t> >::iterator ref = entry_refs_.find(entry_pa);
+      if (ref == entry_refs_.end())
+        continue;
+
+      std::vector<uint32_t> &users = ref->second;
+      uint32_t moved = users.back();
+      users[entry.ref_index[i]] = moved;
+      users.pop_back();
+      if (moved != index)
+      {
+        slot &other = slots_[moved];
+        for (unsigned level = 0; level < other.walk.entry_count; level++)
+        {
+          if (other.walk.entries[level] == entry_pa)
+            other.ref_index[level] = entry.ref_index[i];
+        }
+      }
+      if (users.empty())
+      {
+        entry_refs_.erase(ref);
+        queue_change(entry_pa, false);
+      }
+    }
+  }
+
+  // Drops the translations whose walk went through entry_pa; called with mutex_ held
+  size_t drop_users(uint64_t entry_pa)
+  {
+    // Each drop takes its slot off the list, the last one takes the list with it
+    size_t dropped = 0;
+    std::unordered_map<uint64_t, std::vector<uint32_t> >::iterator ref;
+    while ((ref = entry_refs_.find(entry_pa)) != entry_refs_.end())
+    {
+      drop(slots_[ref->second.back()]);
+      dropped++;
+    }
+    stats_.invalidations += dropped;
+    return dropped;
+  }
+
+  void drop_all()
+  {
+    for (size_t i = 0; i < slots_.size(); i++)
+    {
+      if (slots_[i].valid)
+      {
+        drop(slots_[i]);
+        stats_.invalidations++;
+      }
+    }
+  }
+
+  // Entry writes invalidate() queued while the lock was held; called with mutex_ held, before any use
+  void apply_deferred()
+  {
+    if (!deferred_pending_.load(std::memory_order_relaxed) || !deferred_pending_.exchange(false, std::memory_order_acquire))
+      return;
+
+    bool overflow = deferred_overflow_.exchange(false, std::memory_order_relaxed);
+    size_t count;
+    while ((count = deferred_.pop_batch(deferred_batch_, TRANSLATION_DEFERRED_WRITES)) != 0)
+    {
+      stats_.deferred += count;
+      for (size_t i = 0; i < count && !overflow; i++)
+        drop_users(deferred_batch_[i]);
+    }
+    if (overflow)
+      drop_all();
+  }
+
+  // A watch added and dropped again before the caller looked cancels out
+  void queue_change(uint64_t entry_pa, bool watch)
+  {
+    std::unordered_map<uint64_t, bool>::iterator it = changes_.find(entry_pa);
+    if (it != changes_.end() && it->second != watch)
+      changes_.erase(it);
+    else
+      changes_[entry_pa] = watch;
+  }
+
+  std::mutex mutex_;
+  std::vector<slot> slots_;
+  std::vector<unsigned> victims_;                       // Last replaced way per set
+  size_t set_mask_;
+  std::unordered_map<uint64_t, std::vector<uint32_t> > entry_refs_;   // Entry PA -> slots whose walk used it
+  SpscRing<uint64_t> deferred_;                         // Entry writes from invalidate() awaiting the lock
+  std::atomic<bool> deferred_pending_{false};           // Set after every write queued on deferred_
+  std::atomic<bool> deferred_overflow_{false};          // deferred_ was full: every translation is suspect
+  uint64_t deferred_batch_[TRANSLATION_DEFERRED_WRITES];
+  std::unordered_map<uint64_t, bool> changes_;          // Entry PA -> watch (true) / unwatch (false)
+  std::unordered_map<std::string, uint64_t> symbols_;
+  translation_stats stats_ = translation_stats();
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef NAIVE_VMI
+#define NAIVE_VMI
+
+#include <pthread.h>
+
+#include <libvmi/libvmi.h>
+
+#include "naive-memory.h"
+#include "naive-translate.h"
+
+/////////////////////
+// LibVMI Backend
+/////////////////////
+
+/**
+ * Guest memory of a live domain through libvmi. Holds no state besides
+ * the instance (and an optional shared translation cache), so it is cheap
+ * to construct wherever a vmi handle is. With a cache, symbols and kernel
+ * translations are looked up there first; misses walk the page tables
+ * with vmi_pagetable_lookup_extended so the entries used can be watched.
+ * Reads then go by physical address, so libvmi's VA cache is never used.
+ **/
+class VmiMemory : public GuestMemory
+{
+ public:
+
+  explicit VmiMemory(vmi_instance_t vmi, TranslationCache *cache = NULL, uint64_t dtb = 0)
+    : vmi_(vmi), cache_(dtb != 0 ? cache : NULL), dtb_(dtb) {}
+
+  // Kernel page table base (init_level4_pgt, renamed init_top_pgt in 4.13), 0 if unknown
+  static uint64_t kernel_dtb(vmi_instance_t vmi)
+  {
+    addr_t pgd = vmi_translate_ksym2v(vmi, "init_level4_pgt");
+    if (pgd == 0)
+      pgd = vmi_translate_ksym2v(vmi, "init_top_pgt");
+    return pgd != 0 ? vmi_translate_kv2p(vmi, pgd) : 0;
+  }
+
+  uint64_t symbol(const char *name)
+  {
+    uint64_t va;
+    if (cache_ && cache_->symbol(name, &va))
+      return va;
+
+    va = vmi_translate_ksym2v(vmi_, name);
+    if (cache_ && va != 0)
+      cache_->add_symbol(name, va);
+    return va;
+  }
+
+  uint64_t translate(uint64_t va)
+  {
+    if (!cache_)
+      return vmi_translate_kv2p(vmi_, va);
+
+    uint64_t pa;
+    if (cache_->lookup(dtb_, va, &pa))
+      return pa;
+
+    page_info_t info;
+    memset(&info, 0, sizeof(info));
+    if (vmi_pagetable_lookup_extended(vmi_, dtb_, va, &info) != VMI_SUCCESS)
+      return 0;
+
+    // Entries from the top level down; a large page stops the walk early
+    translation_walk walk;
+    walk.pa = info.paddr;
+    walk.entry_count = 0;
+    addr_t locations[] = { info.x86_ia32e.pml4e_location, info.x86_ia32e.pdpte_location,
+      info.x86_ia32e.pgd_location, info.x86_ia32e.pte_location };
+    for (size_t i = 0; i < sizeof(locations) / sizeof(locations[0]) && locations[i] != 0; i++)
+      walk.entries[walk.entry_count++] = locations[i];
+
+    cache_->insert(dtb_, va, walk);
+    return info.paddr;
+  }
+
+  size_t read(uint64_t va, void *buf, size_t size)
+  {
+    size_t bytes_read = 0;
+    if (!cache_)
+    {
+      vmi_read_va(vmi_, va, 0, size, buf, &bytes_read);
+      return bytes_read;
+    }
+
+    // Page by page through the cache, whose translations page table writes drop one by one; libvmi's own
+    // VA cache could only be flushed whole
+    while (bytes_read < size)
+    {
+      uint64_t pa = translate(va + bytes_read);
+      size_t chunk = TRANSLATION_PAGE_MASK + 1 - ((va + bytes_read) & TRANSLATION_PAGE_MASK);
+      if (chunk > size - bytes_read)
+        chunk = size - bytes_read;
+      size_t chunk_read = 0;
+      if (pa == 0 || vmi_read_pa(vmi_, pa, chunk, (uint8_t *) buf + bytes_read, &chunk_read) != VMI_SUCCESS)
+        break;
+      bytes_read += chunk_read;
+      if (chunk_read != chunk)
+        break;
+    }
+    return bytes_read;
+  }
+
+  vmi_instance_t instance() const { return vmi_; }
+
+ private:
+
+  vmi_instance_t vmi_;
+  TranslationCache *cache_;
+  uint64_t dtb_;
+};
+
+/////////////////////
+// Instance Lock
+/////////////////////
+
+/**
+ * Serialises the libvmi calls on one guest's instance, which is not thread
+ * safe: the event loop listens and changes watches while analysis workers
+ * read guest memory. Waiters are served in arrival order, so the event loop
+ * handing the lock over between listens lets every waiting read in before
+ * it takes the lock back. Not recursive; callbacks run inside
+ * vmi_events_listen() under the event loop's hold and must not take it.
+ **/
+class VmiLock
+{
+ public:
+
+  VmiLock()
+  {
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&turn_, NULL);
+  }
+
+  VmiLock(const VmiLock&) = delete;            // disable copying
+  VmiLock& operator=(const VmiLock&) = delete; // disable assignment
+
+  ~VmiLock()
+  {
+    pthread_cond_destroy(&turn_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  void lock()
+  {
+    pthread_mutex_lock(&mutex_);
+    unsigned long ticket = next_++;
+    while (serving_ != ticket)
+      pthread_cond_wait(&turn_, &mutex_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  void unlock()
+  {
+    pthread_mutex_lock(&mutex_);
+    serving_++;
+    pthread_cond_broadcast(&turn_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  // Another thread waits for the holder to let go
+  bool contended()
+  {
+    pthread_mutex_lock(&mutex_);
+    bool waiting = next_ - serving_ > 1;
+    pthread_mutex_unlock(&mutex_);
+    return waiting;
+  }
+
+ private:
+
+  pthread_mutex_t mutex_;
+  pthread_cond_t turn_;
+  unsigned long next_ = 0;
+  unsigned long serving_ = 0;
+};
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef NAIVE_WALK
+#define NAIVE_WALK
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "naive-dwarf.h"
+#include "naive-memory.h"
+
+/////////////////////
+// Guest Objects
+/////////////////////
+
+/**
+ * A kernel structure read in one piece. data holds its bytes (as many as
+ * could be read) while the visitor runs, so further members are decoded
+ * from the copy instead of being read from the guest again.
+ **/
+struct guest_object
+{
+  uint64_t va;
+  const uint8_t *data;
+  size_t size;
+
+  // Member at offset; false if it lies outside the bytes read
+  template <typename T>
+  bool field(int offset, T *value) const
+  {
+    if (offset < 0 || (size_t) offset + sizeof(T) > size)
+      return false;
+    memcpy(value, data + offset, sizeof(T));
+    return true;
+  }
+
+  // NUL terminated char array member (comm, module name)
+  bool field_str(int offset, std::string &out) const
+  {
+    out.clear();
+    if (offset < 0 || (size_t) offset >= size)
+      return false;
+    size_t max = size - offset < GUEST_MAX_STR ? size - offset : GUEST_MAX_STR;
+    const char *text = (const char *) data + offset;
+    const char *end = (const char *) memchr(text, 0, max);
+    out.assign(text, end ? end - text : max);
+    return true;
+  }
+};
+
+struct guest_task : guest_object
+{
+  uint32_t pid;
+  std::string name;   // comm
+};
+
+struct guest_module : guest_object
+{
+  std::string name;
+};
+
+struct guest_afinfo : guest_object
+{
+  const char *symbol; // e.g. tcp4_seq_afinfo
+  std::string name;   // afinfo->name, e.g. "tcp"
+};
+
+/////////////////////
+// List Walks
+/////////////////////
+// Independent of how guest memory is accessed, so they run against a live domain or a dump.
+// Each element is read with a single read() into a buffer and its members are decoded from
+// the copy; the next element is prefetched before the current one is visited.
+
+// Most elements a list walk visits (pid_max can be at most 4M); a list that does not return to its head stops there
+#define WALK_MAX_ELEMENTS (1 << 22)
+
+// Calls visit(object); a visit returning bool ends the walk, successfully, by returning false
+template <typename F, typename T>
+static inline typename std::enable_if<std::is_void<decltype(std::declval<F &>()(std::declval<const T &>()))>::value, bool>::type
+walk_visit(F &visit, const T &object)
+{
+  visit(object);
+  return true;
+}
+
+template <typename F, typename T>
+static inline typename std::enable_if<!std::is_void<decltype(std::declval<F &>()(std::declval<const T &>()))>::value, bool>::type
+walk_visit(F &visit, const T &object)
+{
+  return visit(object);
+}
+
+// Bytes to read per element: the whole struct, or at least up to the end of the members used
+static inline size_t walk_read_size(int struct_size, int needed_end)
+{
+  return struct_size > needed_end ? struct_size : needed_end;
+}
+
+// Reads the element at va into buffer; false if the members up to needed_end could not be read
+static inline bool walk_read(GuestMemory &memory, uint64_t va, std::vector<uint8_t> &buffer,
+  size_t needed_end, guest_object &object)
+{
+  object.va = va;
+  object.data = buffer.data();
+  object.size = memory.read(va, buffer.data(), buffer.size());
+  return object.size >= needed_end;
+}
+
+// Visits every task on the init_task list (until visit returns false, see walk_visit); false if the list could
+// not be walked
+template <typename F>
+static bool walk_tasks(GuestMemory &memory, const DwarfIndex &dwarf, F visit)
+{
+  int tasks_offset = dwarf.member_offset("task_struct", "tasks");
+  int pid_offset = dwarf.member_offset("task_struct", "pid");
+  int comm_offset = dwarf.member_offset("task_struct", "comm");
+  uint64_t init_task = memory.symbol("init_task");
+  if (tasks_offset < 0 || pid_offset < 0 || comm_offset < 0 || init_task == 0)
+  {
+    printf("Failed to find task list layout\n");
+    return false;
+  }
+
+  int needed_end = std::max(tasks_offset + 8, std::max(pid_offset + 4, comm_offset + 1));
+  std::vector<uint8_t> buffer(walk_read_size(dwarf.struct_size("task_struct"), needed_end));
+
+  uint64_t list_head = init_task + tasks_offset;
+  uint64_t next_list_entry = list_head;
+  guest_task task;
+  size_t visited = 0;
+  do
+  {
+    if (visited++ == WALK_MAX_ELEMENTS)
+    {
+      printf("Task list does not return to its head after %d elements\n", WALK_MAX_ELEMENTS);
+      return false;
+    }
+    if (!walk_read(memory, next_list_entry - tasks_offset, buffer, needed_end, task))
+    {
+      printf("Failed to read task_struct at %llx\n", (unsigned long long) (next_list_entry - tasks_offset));
+      return false;
+    }
+    task.pid = 0;
+    task.field(pid_offset, &task.pid);
+    task.field_str(comm_offset, task.name);
+
+    task.field(tasks_offset, &next_list_entry);
+    if (next_list_entry != list_head)
+      memory.prefetch(next_list_entry - tasks_offset, buffer.size());
+
+    if (!walk_visit(visit, task))
+      break;
+  } while (next_list_entry != list_head);
+
+  return true;
+}
+
+// Visits every module on the modules list (until visit returns false, see walk_visit)
+template <typename F>
+static bool walk_modules(GuestMemory &memory, const DwarfIndex &dwarf, F visit)
+{
+  int list_offset = dwarf.member_offset("module", "list");
+  int name_offset = dwarf.member_offset("module", "name");
+  uint64_t list_head = memory.symbol("modules");
+  if (list_offset < 0 || name_offset < 0 || list_head == 0)
+  {
+    printf("Failed to read modules kernel symbol\n");
+    return false;
+  }
+
+  uint64_t next_list_entry;
+  if (!memory.read_addr(list_head, &next_list_entry))
+  {
+    printf("Failed to read modules list head\n");
+    return false;
+  }
+
+  int needed_end = std::max(list_offset + 8, name_offset + 1);
+  std::vector<uint8_t> buffer(walk_read_size(dwarf.struct_size("module"), needed_end));
+
+  guest_module module;
+  size_t visited = 0;
+  while (next_list_entry != list_head)
+  {
+    if (visited++ == WALK_MAX_ELEMENTS)
+    {
+      printf("Module list does not return to its head after %d elements\n", WALK_MAX_ELEMENTS);
+      return false;
+    }
+    if (!walk_read(memory, next_list_entry - list_offset, buffer, needed_end, module))
+    {
+      printf("Failed to read module at %llx\n", (unsigned long long) (next_list_entry - list_offset));
+      return false;
+    }
+    module.field_str(name_offset, module.name);
+
+    module.field(list_offset, &next_list_entry);
+    if (next_list_entry != list_head)
+      memory.prefetch(next_list_entry - list_offset, buffer.size());
+
+    if (!walk_visit(visit, module))
+      break;
+  }
+
+  return true;
+}
+
+// Visits the TCP and UDP seq_afinfo structures
+template <typename F>
+static bool walk_afinfo(GuestMemory &memory, const DwarfIndex &dwarf, F visit)
+{
+  static const char *afinfo_symbols[] = { "tcp6_seq_afinfo", "tcp4_seq_afinfo",
+    "udplite6_seq_afinfo", "udp6_seq_afinfo", "udplite4_seq_afinfo", "udp4_seq_afinfo" };
+
+  std::vector<uint8_t> buffer;
+  guest_afinfo afinfo;
+  for (size_t i = 0; i < sizeof(afinfo_symbols) / sizeof(afinfo_symbols[0]); i++)
+  {
+    const char *struct_name = afinfo_symbols[i][0] == 't' ? "tcp_seq_afinfo" : "udp_seq_afinfo";
+    int name_offset = dwarf.member_offset(struct_name, "name");
+
+    uint64_t va = memory.symbol(afinfo_symbols[i]);
+    if (va == 0 || name_offset < 0)
+    {
+      printf("Failed to read %s kernel symbol\n", afinfo_symbols[i]);
+      return false;
+    }
+
+    afinfo.symbol = afinfo_symbols[i];
+    buffer.resize(walk_read_size(dwarf.struct_size(struct_name), name_offset + 8));
+    uint64_t name = 0;
+    if (!walk_read(memory, va, buffer, name_offset + 8, afinfo)
+      || !afinfo.field(name_offset, &name) || !memory.read_str(name, afinfo.name))
+    {
+      printf("Failed to find name\n");
+      return false;
+    }
+
+    visit(afinfo);
+  }
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef NAIVE_WATCH
+#define NAIVE_WATCH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "naive-pool.h"
+
+#define WATCH_PAGE_SHIFT 12
+#define WATCH_PAGE_SIZE (1ul << WATCH_PAGE_SHIFT)
+
+// Most ranges a single write can hit (overlapping watches on one page)
+#define WATCH_MAX_HITS 16
+
+// Relevance bitmap granularity: one bit per 8-byte word of the page
+#define WATCH_WORD_SHIFT 3
+#define WATCH_BITMAP_WORDS (WATCH_PAGE_SIZE >> WATCH_WORD_SHIFT >> 6)
+
+/////////////////////
+// Watch Fields
+/////////////////////
+
+/**
+ * Members of a watched struct whose writes matter (e.g. cred, tasks, comm
+ * of task_struct), as merged byte spans from the start of the object.
+ * Built once per event type from DWARF; ranges point at it, so it must
+ * outlive the watch table.
+ **/
+struct watch_fields
+{
+  std::vector<std::pair<uint32_t, uint32_t> > spans;  // [start, end) from the object start
+
+  void add(int offset, int size)
+  {
+    if (offset >= 0 && size > 0)
+      spans.push_back(std::make_pair((uint32_t) offset, (uint32_t) (offset + size)));
+  }
+
+  // Sorts and merges the spans; call once all members are added
+  void finalize()
+  {
+    std::sort(spans.begin(), spans.end());
+    size_t out = 0;
+    for (size_t i = 0; i < spans.size(); i++)
+    {
+      if (out > 0 && spans[i].first <= spans[out - 1].second)
+        spans[out - 1].second = std::max(spans[out - 1].second, spans[i].second);
+      else
+        spans[out++] = spans[i];
+    }
+    spans.resize(out);
+  }
+
+  // Whether the 8-byte word holding object_offset overlaps a span
+  bool covers(uint64_t object_offset) const
+  {
+    uint64_t word = object_offset & ~((1ull << WATCH_WORD_SHIFT) - 1);
+    std::vector<std::pair<uint32_t, uint32_t> >::const_iterator it = std::upper_bound(spans.begin(), spans.end(),
+      std::make_pair((uint32_t) (word + (1u << WATCH_WORD_SHIFT) - 1), UINT32_MAX));
+    return it != spans.begin() && (--it)->second > word;
+  }
+
+  uint32_t bytes() const
+  {
+    uint32_t total = 0;
+    for (size_t i = 0; i < spans.size(); i++)
+      total += spans[i].second - spans[i].first;
+    return total;
+  }
+};
+
+/////////////////////
+// Watch Entries
+/////////////////////
+struct watch_range
+{
+  uint16_t start;     // Watched byte range [start, end) within the page
+  uint16_t end;
+  uint32_t type;      // PROCESS_EVENT, MODULE_EVENT, ...
+  uint64_t object;    // Physical address of the watched object
+  uint32_t refs;      // Number of times this exact range was watched
+  const watch_fields *fields; // Relevant members of the object, NULL if every byte is
+  mutable uint64_t hits;      // Writes that hit the fields (bumped by the filter on the owning thread)
+};
+
+/**
+ * One registered GFN. The ranges are kept sorted by start offset in a
+ * flat vector so the callback scans a few contiguous entries. The page's
+ * event (vmi_event_t in the detector) is stored inline so one pool slot
+ * holds both the event and its context. relevant has a bit per 8-byte word
+ * that a range's fields cover, so most irrelevant writes are rejected by a
+ * single bit test before the ranges are looked at. writes counts the
+ * trapped writes to the page, for the heat map the metrics export;
+ * irrelevant counts those that hit no field until the adaptive controller
+ * reads and resets it.
+ **/
+template <typename Event>
+struct page_watch
+{
+  uint64_t gfn;
+  uint32_t refs;      // Sum of range refs, page is released at zero
+  pool_handle handle; // Handle of the pool slot holding this page
+  Event event;
+  std::vector<watch_range> ranges;
+  uint64_t relevant[WATCH_BITMAP_WORDS];
+  uint64_t writes;
+  uint32_t irrelevant;
+};
+
+template <typename Event>
+static inline bool watch_relevant(const page_watch<Event> *page, uint32_t offset)
+{
+  uint32_t word = (offset & (WATCH_PAGE_SIZE - 1)) >> WATCH_WORD_SHIFT;
+  return (page->relevant[word >> 6] >> (word & 63)) & 1;
+}
+
+// Whether a write at offset in the page hits one of the range's fields
+template <typename Event>
+static inline bool watch_range_covers(const page_watch<Event> *page, const watch_range *range, uint32_t offset)
+{
+  return !range->fields || range->fields->covers((page->gfn << WATCH_PAGE_SHIFT) + offset - range->object);
+}
+
+// Collects up to max ranges whose fields contain offset, returns the number found
+template <typename Event>
+static inline size_t watch_match(const page_watch<Event> *page, uint32_t offset, const watch_range **out, size_t max)
+{
+  size_t count = 0;
+  const watch_range *it = page->ranges.data();
+  const watch_range *end = it + page->ranges.size();
+  for (; it != end && it->start <= offset; ++it)
+  {
+    if (offset < it->end && count < max && watch_range_covers(page, it, offset))
+      out[count++] = it;
+  }
+  return count;
+}
+
+// Types of the ranges containing offset, whether or not a field was hit
+template <typename Event>
+static inline uint32_t watch_range_types(const page_watch<Event> *page, uint32_t offset)
+{
+  uint32_t types = 0;
+  for (size_t i = 0; i < page->ranges.size() && page->ranges[i].start <= offset; i++)
+  {
+    if (offset < page->ranges[i].end)
+      types |= page->ranges[i].type;
+  }
+  return types;
+}
+
+/////////////////////
+// Watch Table
+/////////////////////
+
+/**
+ * GFN -> page_watch index. Several objects sharing a page share one
+ * page_watch (and so one libvmi event); each watched range is reference
+ * counted and the page is reported as released when its last range goes.
+ * Pages live in a slab pool, so event->data pointers stay stable and a
+ * re-registered page reuses a slot (and its range capacity) without
+ * touching the heap. The GFN index is a flat open-addressing table.
+ **/
+template <typename Event>
+class WatchTable
+{
+ public:
+
+  WatchTable() = default;
+  WatchTable(const WatchTable&) = delete;            // disable copying
+  WatchTable& operator=(const WatchTable&) = delete; // disable assignment
+
+  typedef page_watch<Event> page_type;
+
+  // Adds a reference to [start, end) on gfn, relevant where fields say (everywhere if NULL).
+  // Sets *new_page when the caller must register page->event.
+  page_type *add(uint64_t gfn, uint32_t start, uint32_t end, uint32_t type, uint64_t object, bool *new_page,
+    const watch_fields *fields = NULL)
+  {
+    page_type *page = find(gfn);
+    *new_page = page == NULL;
+    if (!page)
+    {
+      pool_handle handle;
+      page = pages_.alloc(&handle);
+      page->gfn = gfn;
+      page->refs = 0;
+      page->handle = handle;
+      page->event = Event();
+      page->ranges.clear();
+      memset(page->relevant, 0, sizeof(page->relevant));
+      page->writes = 0;
+      page->irrelevant = 0;
+      index_.insert(gfn, pool_handle_index(handle));
+    }
+
+    std::vector<watch_range> &ranges = page->ranges;
+    size_t pos = 0;
+    while (pos < ranges.size() && ranges[pos].start < start)
+      pos++;
+
+    // Same object watched again: bump the existing range
+    for (size_t i = pos; i < ranges.size() && ranges[i].start == start; i++)
+    {
+      if (ranges[i].end == end && ranges[i].type == type && ranges[i].object == object)
+      {
+        ranges[i].refs++;
+        page->refs++;
+        return page;
+      }
+    }
+
+    watch_range range;
+    range.start = (uint16_t) start;
+    range.end = (uint16_t) end;
+    range.type = type;
+    range.object = object;
+    range.refs = 1;
+    range.fields = fields;
+    range.hits = 0;
+    ranges.insert(ranges.begin() + pos, range);
+    mark_relevant(page, range);
+    page->refs++;
+    range_count_++;
+    return page;
+  }
+
+  // Drops one reference to the object's range on gfn. Returns the page if it has no references left;
+  // the caller unregisters its event and then calls release().
+  page_type *remove(uint64_t gfn, uint32_t type, uint64_t object, bool *found)
+  {
+    *found = false;
+    page_type *page = find(gfn);
+    if (!page)
+      return NULL;
+
+    std::vector<watch_range> &ranges = page->ranges;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+      if (ranges[i].type != type || ranges[i].object != object)
+        continue;
+
+      *found = true;
+      page->refs--;
+      if (--ranges[i].refs == 0)
+      {
+        ranges.erase(ranges.begin() + i);
+        range_count_--;
+
+        // Other ranges may share words with the one removed, so rebuild from what is left
+        memset(page->relevant, 0, sizeof(page->relevant));
+        for (size_t j = 0; j < ranges.size(); j++)
+          mark_relevant(page, ranges[j]);
+      }
+      break;
+    }
+
+    return page->refs == 0 ? page : NULL;
+  }
+
+  // Forgets a page with no references left
+  void release(page_type *page)
+  {
+    range_count_ -= page->ranges.size();
+    page->ranges.clear();
+    index_.erase(page->gfn);
+    pages_.free(page->handle);
+  }
+
+  page_type *find(uint64_t gfn) const
+  {
+    uint32_t index = index_.find(gfn);
+    return index == POOL_NO_INDEX ? NULL : pages_.at_index(index);
+  }
+
+  // NULL if the page was released since the handle was taken
+  page_type *get(pool_handle handle) const
+  {
+    return pages_.get(handle);
+  }
+
+  template <typename F>
+  void for_each_page(F fn) const
+  {
+    pages_.for_each(fn);
+  }
+
+  // Drops every page at once; slabs are kept for reuse
+  void clear()
+  {
+    pages_.for_each([](page_type *page) { page->ranges.clear(); });
+    pages_.clear();
+    index_.clear();
+    range_count_ = 0;
+  }
+
+  size_t page_count() const { return pages_.size(); }
+  size_t range_count() const { return range_count_; }
+
+ private:
+
+  // Sets the bits of the words in range that its fields cover
+  static void mark_relevant(page_type *page, const watch_range &range)
+  {
+    if (!range.fields)
+    {
+      set_words(page, range.start, range.end);
+      return;
+    }
+
+    // Spans are relative to the object, which may start on an earlier page
+    uint64_t page_base = page->gfn << WATCH_PAGE_SHIFT;
+    for (size_t i = 0; i < range.fields->spans.size(); i++)
+    {
+      uint64_t span_start = range.object + range.fields->spans[i].first;
+      uint64_t span_end = range.object + range.fields->spans[i].second;
+      uint64_t start = std::max(span_start, page_base + range.start);
+      uint64_t end = std::min(span_end, page_base + range.end);
+      if (start < end)
+        set_words(page, (uint32_t) (start - page_base), (uint32_t) (end - page_base));
+    }
+  }
+
+  static void set_words(page_type *page, uint32_t start, uint32_t end)
+  {
+    for (uint32_t word = start >> WATCH_WORD_SHIFT; word <= (end - 1) >> WATCH_WORD_SHIFT; word++)
+      page->relevant[word >> 6] |= 1ull << (word & 63);
+  }
+
+  SlabPool<page_type> pages_;
+  GfnIndex index_;
+  size_t range_count_ = 0;
+};
+
+#endif
@@ -0,0 +1,551 @@
+#ifndef NAIVE_WORKERS
+#define NAIVE_WORKERS
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Most job sources (e.g. monitored guests) one pool serves
+#define WORKER_MAX_SOURCES 256
+
+// Job types are single bit flags, one priority and full-queue policy each
+#define WORKER_MAX_TYPES 32
+
+// What a full queue does with queued jobs of a type when a job at least as urgent arrives
+enum worker_full_policy
+{
+  WORKER_FULL_COALESCE,       // Never dropped; the newcomer waits (its caller keeps coalescing) until there is room
+  WORKER_FULL_DROP_OLDEST     // The oldest of the least urgent such jobs is dropped to make room
+};
+
+/////////////////////
+// Worker Statistics
+/////////////////////
+struct worker_stats
+{
+  unsigned long submitted;    // Jobs accepted by submit()
+  unsigned long rejected;     // submit() calls refused because the type was in flight
+  unsigned long completed;    // Jobs run to completion
+  unsigned long abandoned;    // Queued jobs dropped by stop()
+  unsigned long dropped;      // Queued jobs dropped to make room in a full queue
+  unsigned long deferred;     // submit() calls refused because the queue was full
+  unsigned max_parallel;      // Most jobs seen running at once
+};
+
+// Per type: jobs run, dropped and refused, and how long they waited for a worker
+struct worker_type_stats
+{
+  unsigned long submitted;
+  unsigned long completed;
+  unsigned long dropped;
+  unsigned long deferred;
+  uint64_t wait_ns;
+  uint64_t max_wait_ns;
+};
+
+// Per source: jobs run and how long they waited for a worker
+struct worker_source_stats
+{
+  unsigned long submitted;
+  unsigned long completed;
+  uint64_t wait_ns;           // Summed time from submit() until a worker picked the job
+  uint64_t max_wait_ns;
+  unsigned long queued;       // Jobs waiting for a worker right now
+};
+
+/**
+ * Fixed pool of worker threads running at most one job per type (a single
+ * bit, e.g. PROCESS_EVENT) at a time. A type is in flight from submit()
+ * until its job returns; submit() refuses a second job for it, so the
+ * queue never holds more than one job per type. The caller keeps
+ * coalescing events of a busy type and submits them once it is idle;
+ * on_done is called from the worker after each job so it can do that.
+ * Jobs carry a source (the guest they belong to, 0 by default); types are
+ * tracked per source.
+ *
+ * Each type has a priority (0 most urgent, the default for all). Idle
+ * workers take the most urgent queued job; with set_aging() a job gains
+ * one level for every aging_ns it waits, up to level 0, so urgent types go
+ * first without starving the rest. Jobs of equal urgency are taken by
+ * priority, so an aged job never overtakes one of a more urgent type, then
+ * round robin across sources, so a busy guest cannot starve the others. With set_capacity()
+ * the queue holds at most that many jobs across all sources. A job for a
+ * full queue replaces the oldest of the least urgent queued jobs whose
+ * type has WORKER_FULL_DROP_OLDEST, if one is no more urgent than it;
+ * otherwise submit() refuses it, and blocked_mask() reports its type until
+ * a job leaves the queue. on_done(0, source) then tells each source that
+ * was refused or blocked that there is room.
+ * stop() drops queued jobs, waits for running ones and joins the threads.
+ **/
+template <typename Job>
+class WorkerPool
+{
+ public:
+
+  typedef std::function<void(const Job &job, unsigned source)> job_fn;
+  typedef std::function<void(uint32_t type, unsigned source)> done_fn;
+
+  WorkerPool() = default;
+  WorkerPool(const WorkerPool&) = delete;            // disable copying
+  WorkerPool& operator=(const WorkerPool&) = delete; // disable assignment
+
+  ~WorkerPool()
+  {
+    stop();
+  }
+
+  // Starts threads workers (at least one); returns false if none could be created
+  bool start(unsigned threads, job_fn run, done_fn on_done)
+  {
+    if (!threads_.empty())
+      return true;
+
+    run_ = run;
+    on_done_ = on_done;
+    stopping_ = false;
+    for (unsigned i = 0; i < (threads ? threads : 1); i++)
+    {
+      pthread_t thread;
+      if (pthread_create(&thread, NULL, worker_main, this) != 0)
+        break;
+      threads_.push_back(thread);
+    }
+    return !threads_.empty();
+  }
+
+  // Most jobs queued across all sources (0, the default, is unbounded)
+  void set_capacity(size_t jobs)
+  {
+    pthread_mutex_lock(&lock_);
+    capacity_ = jobs;
+    pthread_mutex_unlock(&lock_);
+  }
+
+  // Wait that raises a queued job by one priority level (0, the default, never does)
+  void set_aging(uint64_t aging_ns)
+  {
+    pthread_mutex_lock(&lock_);
+    aging_ns_ = aging_ns;
+    pthread_mutex_unlock(&lock_);
+  }
+
+  void set_priority(uint32_t type, unsigned priority)
+  {
+    int index = type_index(type);
+    pthread_mutex_lock(&lock_);
+    if (index >= 0)
+      priorities_[index] = priority;
+    pthread_mutex_unlock(&lock_);
+  }
+
+  void set_full_policy(uint32_t type, worker_full_policy policy)
+  {
+    int index = type_index(type);
+    pthread_mutex_lock(&lock_);
+    if (index >= 0)
+      policies_[index] = policy;
+    pthread_mutex_unlock(&lock_);
+  }
+
+  // Queues job unless a job of the same type and source is queued or running, or the queue is full
+  // and holds no job it may replace. An accepted job is moved into the queue, a refused one left as it was.
+  bool submit(uint32_t type, Job &&job, unsigned source = 0)
+  {
+    pthread_mutex_lock(&lock_);
+    if (stopping_ || source >= WORKER_MAX_SOURCES || type_index(type) < 0 || (busy_[source].load(std::memory_order_relaxed) & type))
+    {
+      stats_.rejected++;
+      pthread_mutex_unlock(&lock_);
+      return false;
+    }
+
+    if (source >= source_stats_.size())
+    {
+      source_stats_.resize(source + 1, worker_source_stats());
+      full_waiters_.resize(source + 1, false);
+    }
+
+    queued_job dropped;
+    bool dropping = false;
+    if (capacity_ != 0 && queue_.size() >= capacity_)
+    {
+      size_t victim = drop_candidate(priority_of(type));
+      if (victim == NO_JOB)
+      {
+        stats_.deferred++;
+        type_stats_[__builtin_ctz(type)].deferred++;
+        full_waiters_[source] = true;
+        pthread_mutex_unlock(&lock_);
+        return false;
+      }
+
+      // The victim's events are lost; its source may submit that type again
+      dropped = std::move(queue_[victim]);
+      dropping = true;
+      queue_.erase(queue_.begin() + victim);
+      busy_[dropped.source].fetch_and(~dropped.type, std::memory_order_release);
+      stats_.dropped++;
+      type_stats_[__builtin_ctz(dropped.type)].dropped++;
+      pthread_cond_broadcast(&idle_);
+    }
+
+    busy_[source].fetch_or(type, std::memory_order_release);
+    queued_job queued = { type, source, worker_now_ns(), std::move(job) };
+    queue_.push_back(std::move(queued));
+    stats_.submitted++;
+    source_stats_[source].submitted++;
+    type_stats_[__builtin_ctz(type)].submitted++;
+    pthread_cond_signal(&work_ready_);
+    pthread_mutex_unlock(&lock_);
+
+    if (dropping && on_done_)
+      on_done_(dropped.type, dropped.source);
+    return true;
+  }
+
+  // Types of source with a job queued or running
+  uint32_t busy_mask(unsigned source = 0) const
+  {
+    return source < WORKER_MAX_SOURCES ? busy_[source].load(std::memory_order_acquire) : 0;
+  }
+
+  // busy_mask, plus the types a full queue would refuse from source right now. A source that gets any of
+  // those is told (on_done(0, source)) once a job leaves the queue.
+  uint32_t blocked_mask(unsigned source = 0)
+  {
+    uint32_t blocked = busy_mask(source);
+    pthread_mutex_lock(&lock_);
+    if (capacity_ != 0 && queue_.size() >= capacity_ && source < WORKER_MAX_SOURCES)
+    {
+      // A type gets in if some droppable queued job is no more urgent than it
+      unsigned least_urgent = 0;
+      bool droppable = false;
+      for (size_t i = 0; i < queue_.size(); i++)
+      {
+        if (policies_[__builtin_ctz(queue_[i].type)] != WORKER_FULL_DROP_OLDEST)
+          continue;
+        least_urgent = droppable ? std::max(least_urgent, priority_of(queue_[i].type)) : priority_of(queue_[i].type);
+        droppable = true;
+      }
+      uint32_t refused = 0;
+      for (unsigned index = 0; index < WORKER_MAX_TYPES; index++)
+      {
+        if (!droppable || priorities_[index] > least_urgent)
+          refused |= 1u << index;
+      }
+      if (refused & ~blocked)
+      {
+        if (source >= full_waiters_.size())
+        {
+          source_stats_.resize(source + 1, worker_source_stats());
+          full_waiters_.resize(source + 1, false);
+        }
+        full_waiters_[source] = true;
+      }
+      blocked |= refused;
+    }
+    pthread_mutex_unlock(&lock_);
+    return blocked;
+  }
+
+  // Blocks until no job is queued or running
+  void wait_idle()
+  {
+    pthread_mutex_lock(&lock_);
+    while (!all_idle())
+      pthread_cond_wait(&idle_, &lock_);
+    pthread_mutex_unlock(&lock_);
+  }
+
+  // Blocks until source has no job queued or running
+  void wait_idle(unsigned source)
+  {
+    if (source >= WORKER_MAX_SOURCES)
+      return;
+
+    pthread_mutex_lock(&lock_);
+    while (busy_[source].load(std::memory_order_relaxed) != 0)
+      pthread_cond_wait(&idle_, &lock_);
+    pthread_mutex_unlock(&lock_);
+  }
+
+  // Drops the queued jobs of source and waits for its running ones (e.g. before its guest goes away)
+  void cancel(unsigned source)
+  {
+    if (source >= WORKER_MAX_SOURCES)
+      return;
+
+    pthread_mutex_lock(&lock_);
+    abandon(source);
+    while (busy_[source].load(std::memory_order_relaxed) != 0)
+      pthread_cond_wait(&idle_, &lock_);
+    pthread_mutex_unlock(&lock_);
+  }
+
+  void stop()
+  {
+    pthread_mutex_lock(&lock_);
+    stopping_ = true;
+    for (unsigned source = 0; source < source_stats_.size(); source++)
+      abandon(source);
+    pthread_cond_broadcast(&work_ready_);
+    pthread_cond_broadcast(&idle_);
+    pthread_mutex_unlock(&lock_);
+
+    for (size_t i = 0; i < threads_.size(); i++)
+      pthread_join(threads_[i], NULL);
+    threads_.clear();
+  }
+
+  size_t threads() const { return threads_.size(); }
+
+  worker_stats stats()
+  {
+    pthread_mutex_lock(&lock_);
+    worker_stats copy = stats_;
+    pthread_mutex_unlock(&lock_);
+    return copy;
+  }
+
+  worker_source_stats source_stats(unsigned source)
+  {
+    pthread_mutex_lock(&lock_);
+    worker_source_stats copy = source < source_stats_.size() ? source_stats_[source] : worker_source_stats();
+    copy.queued = 0;
+    for (size_t i = 0; i < queue_.size(); i++)
+      copy.queued += queue_[i].source == source;
+    pthread_mutex_unlock(&lock_);
+    return copy;
+  }
+
+  worker_type_stats type_stats(uint32_t type)
+  {
+    int index = type_index(type);
+    pthread_mutex_lock(&lock_);
+    worker_type_stats copy = index >= 0 ? type_stats_[index] : worker_type_stats();
+    pthread_mutex_unlock(&lock_);
+    return copy;
+  }
+
+  size_t queued()
+  {
+    pthread_mutex_lock(&lock_);
+    size_t count = queue_.size();
+    pthread_mutex_unlock(&lock_);
+    return count;
+  }
+
+ private:
+
+  static const size_t NO_JOB = (size_t) -1;
+
+  struct queued_job
+  {
+    uint32_t type;
+    unsigned source;
+    uint64_t queued_at;
+    Job job;
+  };
+
+  static int type_index(uint32_t type)
+  {
+    if (type == 0 || (type & (type - 1)) != 0)
+      return -1;
+    return __builtin_ctz(type);
+  }
+
+  unsigned priority_of(uint32_t type) const
+  {
+    return priorities_[__builtin_ctz(type)];
+  }
+
+  static uint64_t worker_now_ns()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+  }
+
+  bool all_idle() const
+  {
+    for (unsigned source = 0; source < source_stats_.size(); source++)
+    {
+      if (busy_[source].load(std::memory_order_relaxed) != 0)
+        return false;
+    }
+    return true;
+  }
+
+  // Called with lock_ held
+  void abandon(unsigned source)
+  {
+    for (size_t i = 0; i < queue_.size(); )
+    {
+      if (queue_[i].source != source)
+      {
+        i++;
+        continue;
+      }
+      busy_[source].fetch_and(~queue_[i].type, std::memory_order_release);
+      queue_.erase(queue_.begin() + i);
+      stats_.abandoned++;
+    }
+    pthread_cond_broadcast(&idle_);
+  }
+
+  // Priority less the levels gained by waiting, scaled by aging_ns_ and never below 0 (lower runs first)
+  int64_t urgency(const queued_job &queued, uint64_t now) const
+  {
+    if (aging_ns_ == 0)
+      return priority_of(queued.type);
+    int64_t waited = (int64_t) (now - queued.queued_at);
+    return std::max<int64_t>((int64_t) priority_of(queued.type) * (int64_t) aging_ns_ - waited, 0);
+  }
+
+  // Most urgent queued job; ties go to the more urgent type, then round robin across sources after the one
+  // served last, then to the oldest. Called with lock_ held and the queue not empty.
+  size_t next_job()
+  {
+    uint64_t now = worker_now_ns();
+    size_t best = 0;
+    int64_t best_urgency = urgency(queue_[0], now);
+    unsigned sources = (unsigned) source_stats_.size();
+    for (size_t i = 1; i < queue_.size(); i++)
+    {
+      int64_t candidate = urgency(queue_[i], now);
+      unsigned priority = priority_of(queue_[i].type), best_priority = priority_of(queue_[best].type);
+      unsigned turn = (queue_[i].source + sources - next_source_) % sources;
+      unsigned best_turn = (queue_[best].source + sources - next_source_) % sources;
+      if (candidate < best_urgency || (candidate == best_urgency && (priority < best_priority
+        || (priority == best_priority && (turn < best_turn
+        || (turn == best_turn && queue_[i].queued_at < queue_[best].queued_at))))))
+      {
+        best = i;
+        best_urgency = candidate;
+      }
+    }
+    next_source_ = (queue_[best].source + 1) % sources;
+    return best;
+  }
+
+  // Oldest of the least urgent droppable jobs no more urgent than priority, NO_JOB if none; called with lock_ held
+  size_t drop_candidate(unsigned priority) const
+  {
+    size_t victim = NO_JOB;
+    for (size_t i = 0; i < queue_.size(); i++)
+    {
+      unsigned candidate = priority_of(queue_[i].type);
+      if (policies_[__builtin_ctz(queue_[i].type)] != WORKER_FULL_DROP_OLDEST || candidate < priority)
+        continue;
+      if (victim == NO_JOB || candidate > priority_of(queue_[victim].type)
+        || (candidate == priority_of(queue_[victim].type) && queue_[i].queued_at < queue_[victim].queued_at))
+        victim = i;
+    }
+    return victim;
+  }
+
+  // Sources refused or blocked by a full queue, cleared as they are told there is room; called with lock_ held
+  std::vector<unsigned> take_full_waiters()
+  {
+    std::vector<unsigned> waiters;
+    for (unsigned source = 0; source < full_waiters_.size(); source++)
+    {
+      if (full_waiters_[source])
+      {
+        waiters.push_back(source);
+        full_waiters_[source] = false;
+      }
+    }
+    return waiters;
+  }
+
+  static void *worker_main(void *arg)
+  {
+    static_cast<WorkerPool *>(arg)->work();
+    return NULL;
+  }
+
+  void work()
+  {
+    pthread_mutex_lock(&lock_);
+    while (true)
+    {
+      while (queue_.empty() && !stopping_)
+        pthread_cond_wait(&work_ready_, &lock_);
+      if (queue_.empty())
+        break;
+
+      size_t index = next_job();
+      queued_job next = std::move(queue_[index]);
+      queue_.erase(queue_.begin() + index);
+      unsigned source = next.source;
+      running_++;
+      if (running_ > stats_.max_parallel)
+        stats_.max_parallel = running_;
+      uint64_t wait = worker_now_ns() - next.queued_at;
+      source_stats_[source].wait_ns += wait;
+      if (wait > source_stats_[source].max_wait_ns)
+        source_stats_[source].max_wait_ns = wait;
+      worker_type_stats &type = type_stats_[__builtin_ctz(next.type)];
+      type.wait_ns += wait;
+      if (wait > type.max_wait_ns)
+        type.max_wait_ns = wait;
+
+      // A job left the queue: sources a full queue turned away may submit again
+      std::vector<unsigned> waiters;
+      if (capacity_ != 0)
+        waiters = take_full_waiters();
+      pthread_mutex_unlock(&lock_);
+
+      for (size_t i = 0; i < waiters.size() && on_done_; i++)
+        on_done_(0, waiters[i]);
+
+      run_(next.job, source);
+
+      pthread_mutex_lock(&lock_);
+      running_--;
+      stats_.completed++;
+      source_stats_[source].completed++;
+      type_stats_[__builtin_ctz(next.type)].completed++;
+      busy_[source].fetch_and(~next.type, std::memory_order_release);
+      if (busy_[source].load(std::memory_order_relaxed) == 0)
+        pthread_cond_broadcast(&idle_);
+      pthread_mutex_unlock(&lock_);
+
+      if (on_done_)
+        on_done_(next.type, source);
+      pthread_mutex_lock(&lock_);
+    }
+    pthread_mutex_unlock(&lock_);
+  }
+
+  job_fn run_;
+  done_fn on_done_;
+  std::vector<pthread_t> threads_;
+
+  pthread_mutex_t lock_ = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t work_ready_ = PTHREAD_COND_INITIALIZER;
+  pthread_cond_t idle_ = PTHREAD_COND_INITIALIZER;
+  std::vector<queued_job> queue_;                   // Every source's jobs, in submission order
+  std::atomic<uint32_t> busy_[WORKER_MAX_SOURCES] = {};
+  unsigned next_source_ = 0;
+  bool stopping_ = false;
+  unsigned running_ = 0;
+  size_t capacity_ = 0;
+  uint64_t aging_ns_ = 0;
+  unsigned priorities_[WORKER_MAX_TYPES] = {};
+  worker_full_policy policies_[WORKER_MAX_TYPES] = {};
+  std::vector<bool> full_waiters_;                  // Per source, grown with source_stats_
+  worker_stats stats_ = worker_stats();
+  worker_type_stats type_stats_[WORKER_MAX_TYPES] = {};
+  std::vector<worker_source_stats> source_stats_;   // Per source, grown by submit()
+};
+
+#endif
@@ -0,0 +1,96 @@
+#!/usr/bin/python
+
+# Long-lived Volatility session for the embedded analysis engine.
+# setup() is called once at startup; run() is then called per analysis and
+# returns structured findings instead of printing them.
+
+# Import System Required Paths
+import sys
+sys.path.append('/usr/local/src/volatility-master')
+
+# Other imports
+import time
+
+plugins = {}
+address_space = None
+
+# Field names of the tuples each plugin yields
+check_fields = {
+	"check_fop": ["name", "member", "address"],
+	"check_afinfo": ["name", "member", "hook_type", "address"],
+	"check_hidden_modules": ["name", "address"],
+	"check_creds": ["cred", "pids"],
+}
+
+def setup(profile, location):
+	global address_space
+
+	# Import Volalatility
+	import volatility.conf as conf
+	import volatility.registry as registry
+	registry.PluginImporter()
+	config = conf.ConfObject()
+	import volatility.commands as commands
+	import volatility.addrspace as addrspace
+	import volatility.utils as utils
+	registry.register_global_options(config, commands.Command)
+	registry.register_global_options(config, addrspace.BaseAddressSpace)
+	config.parse_options()
+	config.PROFILE = profile
+	config.LOCATION = location
+
+	# Open vmi:// and parse the profile once; plugins reuse the same address space
+	address_space = utils.load_as(config)
+	original_load_as = utils.load_as
+	def cached_load_as(config, astype = 'virtual', **kwargs):
+		if astype == 'virtual':
+			return address_space
+		return original_load_as(config, astype, **kwargs)
+	utils.load_as = cached_load_as
+
+	import volatility.plugins.linux.check_fops as fopPlugin
+	import volatility.plugins.linux.check_creds as credsPlugin
+	import volatility.plugins.linux.check_afinfo as afInfoPlugin
+	import volatility.plugins.linux.hidden_modules as hiddenModulesPlugin
+	plugins["check_fop"] = fopPlugin.linux_check_fop(config)
+	plugins["check_creds"] = credsPlugin.linux_check_creds(config)
+	plugins["check_afinfo"] = afInfoPlugin.linux_check_afinfo(config)
+	plugins["check_hidden_modules"] = hiddenModulesPlugin.linux_hidden_modules(config)
+	return True
+
+def plain(value):
+	# Volatility objects become addresses or strings
+	if isinstance(value, (int, long)):
+		return hex(value).rstrip("L")
+	if isinstance(value, (list, tuple)):
+		return ",".join([plain(v) for v in value])
+	if hasattr(value, "v"):
+		try:
+			return hex(int(value.v())).rstrip("L")
+		except (TypeError, ValueError):
+			pass
+	return str(value)
+
+def findings_for(check, results):
+	if check == "check_creds":
+		# One dict of cred address -> pids, only shared creds are findings
+		findings = []
+		for creds in results:
+			for cred, pids in creds.items():
+				if len(pids) > 1:
+					findings.append({"cred": plain(cred), "pids": plain(pids)})
+		return findings
+
+	fields = check_fields[check]
+	findings = []
+	for result in results:
+		if isinstance(result, tuple) and len(result) == len(fields):
+			findings.append(dict([(fields[i], plain(result[i])) for i in range(len(fields))]))
+		else:
+			findings.append({"result": plain(result)})
+	return findings
+
+def run(check):
+	start_time = time.time()
+	findings = findings_for(check, plugins[check].calculate())
+	return {"check": check, "seconds": time.time() - start_time, "findings": findings}